@@ -27,6 +27,7 @@
 #include <clicknet/icmp.h>
 #include <click/packet_anno.hh>
 #include <click/handlercall.hh>
+#include <click/master.hh>
 CLICK_DECLS
 
 #define SEC_OLDER(s1, s2)	((int)(s1 - s2) < 0)
@@ -71,15 +72,23 @@ flip_ports(uint32_t ports)
 
 // actual AggregateIPFlows operations
 
+AggregateIPFlows::Shard::Shard()
+    : _active_sec(0), _gc_sec(0), _wheel_sec(0), _started(false)
+{
+    memset(_wheel, 0, sizeof(_wheel));
+}
+
 AggregateIPFlows::AggregateIPFlows()
+    : _shards(0), _nshards(0)
 #if CLICK_USERLEVEL
-    : _traceinfo_file(0), _packet_source(0), _filepos_h(0)
+    , _traceinfo_file(0), _packet_source(0), _filepos_h(0)
 #endif
 {
 }
 
 AggregateIPFlows::~AggregateIPFlows()
 {
+    delete[] _shards;
 }
 
 void *
@@ -100,11 +109,13 @@ AggregateIPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
     _tcp_done_timeout = 30;
     _udp_timeout = 60;
     _fragment_timeout = 30;
-    _gc_interval = 20 * 60;
+    _gc_interval = 1;
     _fragments = 2;
     bool handle_icmp_errors = false;
     bool fragments_parsed;
     bool fragments = true;
+    int nthreads = master()->nthreads();
+    int nshards = nthreads > 1 ? 4 * nthreads : 1;
 
     if (Args(conf, this, errh)
 	.read("TCP_TIMEOUT", _tcp_timeout)
@@ -118,6 +129,7 @@ AggregateIPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("SOURCE", ElementArg(), _packet_source)
 #endif
 	.read("FRAGMENTS", fragments).read_status(fragments_parsed)
+	.read("SHARDS", nshards)
 	.complete() < 0)
 	return -1;
 
@@ -126,6 +138,11 @@ AggregateIPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
     _handle_icmp_errors = handle_icmp_errors;
     if (fragments_parsed)
 	_fragments = fragments;
+    if (nshards <= 0 || nshards > 1024 || (nshards & (nshards - 1)))
+	return errh->error("SHARDS must be a power of two up to 1024");
+    _nshards = nshards;
+    for (_shard_shift = 32; nshards > 1; nshards >>= 1)
+	_shard_shift--;
     return 0;
 }
 
@@ -133,8 +150,10 @@ int
 AggregateIPFlows::initialize(ErrorHandler *errh)
 {
     _next = 1;
-    _active_sec = _gc_sec = 0;
+    _clock_sec = 0;
+    _sweep_sec = 0;
     _timestamp_warning = false;
+    _shards = new Shard[_nshards];
 
 #if CLICK_USERLEVEL
     if (_traceinfo_filename == "-")
@@ -164,8 +183,17 @@ AggregateIPFlows::initialize(ErrorHandler *errh)
 void
 AggregateIPFlows::cleanup(CleanupStage)
 {
-    clean_map(_tcp_map);
-    clean_map(_udp_map);
+    for (int i = 0; i < _nshards && _shards; i++) {
+	clean_map(_shards[i]._tcp_map);
+	clean_map(_shards[i]._udp_map);
+    }
+    for (unsigned i = 0; i < _thread_state.weight(); i++) {
+	ThreadState &ts = _thread_state.get_value(i);
+	while (Packet *p = ts._emit_head) {
+	    ts._emit_head = p->next();
+	    p->kill();
+	}
+    }
 #if CLICK_USERLEVEL
     if (_traceinfo_file && _traceinfo_file != stdout) {
 	fprintf(_traceinfo_file, "</trace>\n");
@@ -175,12 +203,22 @@ AggregateIPFlows::cleanup(CleanupStage)
 #endif
 }
 
+inline AggregateIPFlows::Shard &
+AggregateIPFlows::shard(const HostPair &hosts) const
+{
+    // Mix the hash code: the low bits also index each shard's HashTable
+    if (_nshards == 1)
+	return _shards[0];
+    return _shards[((uint32_t) hosts.hashcode() * 0x9E3779B1U) >> _shard_shift];
+}
+
 inline void
-AggregateIPFlows::delete_flowinfo(const HostPair &hp, FlowInfo *finfo, bool really_delete)
+AggregateIPFlows::delete_flowinfo(FlowInfo *finfo, bool really_delete)
 {
 #if CLICK_USERLEVEL
     if (_traceinfo_file) {
 	StatFlowInfo *sinfo = static_cast<StatFlowInfo *>(finfo);
+	const HostPair &hp = sinfo->_hosts;
 	IPAddress src(sinfo->reverse() ? hp.b : hp.a);
 	int sport = (ntohl(sinfo->_ports) >> (sinfo->reverse() ? 0 : 16)) & 0xFFFF;
 	IPAddress dst(sinfo->reverse() ? hp.a : hp.b);
@@ -218,11 +256,72 @@ AggregateIPFlows::clean_map(Map &table)
 	}
 	while (FlowInfo *f = hpinfo->_flows) {
 	    hpinfo->_flows = f->_next;
-	    delete_flowinfo(iter.key(), f);
+	    delete_flowinfo(f);
 	}
     }
 }
 
+void
+AggregateIPFlows::clear_map(Shard &s, Map &table)
+{
+    // emit all fragments, then delete all flows
+    for (Map::iterator iter = table.begin(); iter.live(); iter++) {
+	HostPairInfo *hpinfo = &iter.value();
+	while (hpinfo->_fragment_head)
+	    emit_fragment_head(s, hpinfo);
+	while (FlowInfo *f = hpinfo->_flows) {
+	    hpinfo->_flows = f->_next;
+	    notify_later(f->_aggregate, AggregateListener::DELETE_AGG, 0);
+	    disarm(f);
+	    delete_flowinfo(f);
+	}
+    }
+    table.clear();
+}
+
+inline void
+AggregateIPFlows::notify_later(uint32_t agg, AggregateListener::AggregateEvent e, const Packet *p)
+{
+    AggregateListener::Event ev = {agg, e, p};
+    _thread_state->_events.push_back(ev);
+}
+
+/** @brief Release @a held, if any, then deliver the notifications and emit
+ * the fragments queued by this thread. */
+void
+AggregateIPFlows::finish(Shard *held)
+{
+    if (held)
+	release(held);
+    // one thread at a time advances the shards that receive no packets
+    unsigned clock = _clock_sec.value(), sweep = _sweep_sec.value();
+    if (unlikely(!SEC_OLDER(clock, sweep)) && _nshards > 1
+	&& _sweep_sec.compare_swap(sweep, clock + _gc_interval) == sweep)
+	sweep_shards(clock);
+    ThreadState &ts = *_thread_state;
+    if (ts._events.size()) {
+	notify_batch(ts._events.data(), ts._events.size());
+	ts._events.clear();
+    }
+    if (Packet *head = ts._emit_head) {
+	Packet *tail = ts._emit_tail;
+	ts._emit_head = ts._emit_tail = 0;
+#if HAVE_BATCH
+	if (in_batch_mode) {
+	    int count = 0;
+	    for (Packet *p = head; p; p = p->next())
+		count++;
+	    output(0).push_batch(PacketBatch::make_from_simple_list(head, tail, count));
+	} else
+#endif
+	    while (Packet *p = head) {
+		head = p->next();
+		p->set_next(0);
+		output(0).push(p);
+	    }
+    }
+}
+
 #if CLICK_USERLEVEL
 void
 AggregateIPFlows::stat_new_flow_hook(const Packet *p, FlowInfo *finfo)
@@ -236,7 +335,7 @@ AggregateIPFlows::stat_new_flow_hook(const Packet *p, FlowInfo *finfo)
 #endif
 
 inline void
-AggregateIPFlows::packet_emit_hook(const Packet *p, const click_ip *iph, FlowInfo *finfo)
+AggregateIPFlows::packet_emit_hook(Shard &s, const Packet *p, const click_ip *iph, FlowInfo *finfo)
 {
     // account for timestamp
     finfo->_last_timestamp = p->timestamp_anno();
@@ -248,12 +347,16 @@ AggregateIPFlows::packet_emit_hook(const Packet *p, const click_ip *iph, FlowInf
 	   there. */
 	&& p->transport_length() >= 14
 	&& PAINT_ANNO(p) < 2) {	// ignore ICMP errors
+	unsigned old_over = finfo->_flow_over;
 	if (p->tcp_header()->th_flags & TH_RST)
 	    finfo->_flow_over = 3;
 	else if (p->tcp_header()->th_flags & TH_FIN)
 	    finfo->_flow_over |= (1 << PAINT_ANNO(p));
 	else if (p->tcp_header()->th_flags & TH_SYN)
 	    finfo->_flow_over = 0;
+	// completed flows have a shorter timeout
+	if (finfo->_flow_over == 3 && old_over != 3)
+	    arm(s, finfo, finfo->_last_timestamp.sec() + _tcp_done_timeout + 1);
     }
 
 #if CLICK_USERLEVEL
@@ -265,52 +368,139 @@ AggregateIPFlows::packet_emit_hook(const Packet *p, const click_ip *iph, FlowInf
 #endif
 }
 
+/** @brief Schedule @a finfo to be checked for expiry at second @a sec. */
 void
-AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
+AggregateIPFlows::arm(Shard &s, FlowInfo *finfo, unsigned sec)
 {
-    timeout = _active_sec - timeout;
-    done_timeout = _active_sec - done_timeout;
-    int frag_timeout = _active_sec - _fragment_timeout;
+    disarm(finfo);
+    // flows expiring beyond the wheel are checked again after a full turn
+    if ((int) (sec - s._wheel_sec) <= 0)
+	sec = s._wheel_sec + 1;
+    else if (sec - s._wheel_sec > WHEEL_SIZE)
+	sec = s._wheel_sec + WHEEL_SIZE;
+    FlowInfo **slot = &s._wheel[sec & (WHEEL_SIZE - 1)];
+    finfo->_wnext = *slot;
+    if (*slot)
+	(*slot)->_wpprev = &finfo->_wnext;
+    finfo->_wpprev = slot;
+    *slot = finfo;
+}
 
-    // free completed flows and emit fragments
-    for (Map::iterator iter = table.begin(); iter.live(); iter++) {
-	HostPairInfo *hpinfo = &iter.value();
-	Packet *head;
-	// fragments
-	while ((head = hpinfo->_fragment_head)
-	       && (head->timestamp_anno().sec() < frag_timeout
-		   || !IP_ISFRAG(good_ip_header(head))))
-	    emit_fragment_head(hpinfo);
+inline void
+AggregateIPFlows::disarm(FlowInfo *finfo)
+{
+    if (finfo->_wpprev) {
+	*finfo->_wpprev = finfo->_wnext;
+	if (finfo->_wnext)
+	    finfo->_wnext->_wpprev = finfo->_wpprev;
+	finfo->_wpprev = 0;
+    }
+}
+
+void
+AggregateIPFlows::expire_flow(Shard &s, FlowInfo *finfo)
+{
+    Map &m = (finfo->_udp ? s._udp_map : s._tcp_map);
+    Map::iterator iter = m.find(finfo->_hosts);
+    assert(iter.live());
+    HostPairInfo *hpinfo = &iter.value();
+
+    emit_old_fragments(s, hpinfo);
 
+    // circular comparison
+    unsigned expiry = finfo->_last_timestamp.sec() + relevant_timeout(finfo);
+    if (!SEC_OLDER(expiry, s._active_sec)) {
+	arm(s, finfo, expiry + 1);
+	return;
+    } else if (hpinfo->_fragment_head) {
 	// can't delete any flows if there are fragments
-	if (hpinfo->_fragment_head)
+	arm(s, finfo, s._active_sec + 1);
+	return;
+    }
+
+    notify_later(finfo->_aggregate, AggregateListener::DELETE_AGG, 0);
+    FlowInfo **pprev = &hpinfo->_flows;
+    while (*pprev != finfo)
+	pprev = &(*pprev)->_next;
+    *pprev = finfo->_next;
+    disarm(finfo);
+    delete_flowinfo(finfo);
+    if (!hpinfo->_flows)
+	m.erase(iter);
+}
+
+void
+AggregateIPFlows::advance_wheel(Shard &s)
+{
+    if ((int) (s._active_sec - s._wheel_sec) > WHEEL_SIZE)
+	s._wheel_sec = s._active_sec - WHEEL_SIZE;
+    // Process each slot from a local list head, so that expire_flow() can
+    // rearm any flow of the slot
+    FlowInfo *pending;
+    while (SEC_OLDER(s._wheel_sec, s._active_sec)) {
+	s._wheel_sec++;
+	FlowInfo **slot = &s._wheel[s._wheel_sec & (WHEEL_SIZE - 1)];
+	if (!(pending = *slot))
 	    continue;
+	*slot = 0;
+	pending->_wpprev = &pending;
+	while (FlowInfo *f = pending) {
+	    disarm(f);
+	    expire_flow(s, f);
+	}
+    }
 
-	// completed flows
-	FlowInfo **pprev = &hpinfo->_flows;
-	FlowInfo *f = *pprev;
-	while (f) {
-	    // circular comparison
-	    if (SEC_OLDER(f->_last_timestamp.sec(), (f->_flow_over == 3 ? done_timeout : timeout))) {
-		notify(f->_aggregate, AggregateListener::DELETE_AGG, 0);
-		*pprev = f->_next;
-		delete_flowinfo(iter.key(), f);
-	    } else
-		pprev = &f->_next;
-	    f = *pprev;
+    // host pairs with fragments but no flows
+    for (int udp = 0; udp < 2; udp++) {
+	Map &m = (udp ? s._udp_map : s._tcp_map);
+	Vector<HostPair> &orphans = s._orphans[udp];
+	for (int i = 0; i < orphans.size(); ) {
+	    Map::iterator iter = m.find(orphans[i]);
+	    if (iter.live()) {
+		HostPairInfo *hpinfo = &iter.value();
+		emit_old_fragments(s, hpinfo);
+		if (!hpinfo->_flows && hpinfo->_fragment_head) {
+		    i++;
+		    continue;
+		} else if (!hpinfo->_flows)
+		    m.erase(iter);
+	    }
+	    orphans[i] = orphans.back();
+	    orphans.pop_back();
 	}
-	// XXX never free host pairs
     }
+    s._gc_sec = s._active_sec + _gc_interval;
+}
+
+inline void
+AggregateIPFlows::release(Shard *s)
+{
+    unsigned clock = _clock_sec.value();
+    if (SEC_OLDER(clock, s->_active_sec))
+	_clock_sec.compare_swap(clock, s->_active_sec);
+    if (s->_active_sec >= s->_gc_sec)
+	advance_wheel(*s);
+    s->_lock.release();
 }
 
+/** @brief Advance the timer wheels of the idle shards to second @a sec.
+ *
+ * A shard only sees packet time go by when it receives packets, so flows in
+ * a shard that stops receiving them would otherwise never expire. */
 void
-AggregateIPFlows::reap()
+AggregateIPFlows::sweep_shards(unsigned sec)
 {
-    if (_gc_sec) {
-	reap_map(_tcp_map, _tcp_timeout, _tcp_done_timeout);
-	reap_map(_udp_map, _udp_timeout, _udp_timeout);
+    for (int i = 0; i < _nshards; i++) {
+	Shard &s = _shards[i];
+	// a busy shard advances its own wheel when it is released
+	if (!s._lock.attempt())
+	    continue;
+	if (s._started && SEC_OLDER(s._active_sec, sec)) {
+	    s._active_sec = sec;
+	    advance_wheel(s);
+	}
+	s._lock.release();
     }
-    _gc_sec = _active_sec + _gc_interval;
 }
 
 const click_ip *
@@ -333,9 +523,9 @@ AggregateIPFlows::icmp_encapsulated_header(const Packet *p)
 }
 
 int
-AggregateIPFlows::relevant_timeout(const FlowInfo *f, const Map &m) const
+AggregateIPFlows::relevant_timeout(const FlowInfo *f) const
 {
-    if (&m == &_udp_map)
+    if (f->_udp)
 	return _udp_timeout;
     else if (f->_flow_over == 3)
 	return _tcp_done_timeout;
@@ -346,7 +536,7 @@ AggregateIPFlows::relevant_timeout(const FlowInfo *f, const Map &m) const
 // XXX timing when fragments are merged back in?
 
 AggregateIPFlows::FlowInfo *
-AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, bool flipped, const Packet *p)
+AggregateIPFlows::find_flow_info(Shard &s, bool udp, HostPairInfo *hpinfo, const HostPair &hosts, uint32_t ports, bool flipped, const Packet *p)
 {
     FlowInfo **pprev = &hpinfo->_flows;
     for (FlowInfo *finfo = *pprev; finfo; pprev = &finfo->_next, finfo = finfo->_next)
@@ -357,26 +547,23 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 	    // 4.Feb.2004 - Also start a new flow if the old flow closed off,
 	    // and we have a SYN.
 	    if ((age > (int) _smallest_timeout
-		 && age > relevant_timeout(finfo, m))
+		 && age > relevant_timeout(finfo))
 		|| (finfo->_flow_over == 3
 		    && p->ip_header()->ip_p == IP_PROTO_TCP
 		    && (p->tcp_header()->th_flags & TH_SYN))) {
 		// old aggregate has died
-		notify(finfo->aggregate(), AggregateListener::DELETE_AGG, 0);
-		const click_ip *iph = good_ip_header(p);
-		HostPair hp(iph->ip_src.s_addr, iph->ip_dst.s_addr);
-		delete_flowinfo(hp, finfo, false);
+		notify_later(finfo->aggregate(), AggregateListener::DELETE_AGG, 0);
+		delete_flowinfo(finfo, false);
 
 		// make a new aggregate
-		finfo->_aggregate = _next;
-		_next++;
+		finfo->_aggregate = _next.fetch_and_add(1);
 		finfo->_reverse = flipped;
 		finfo->_flow_over = 0;
 #if CLICK_USERLEVEL
 		if (stats())
 		    stat_new_flow_hook(p, finfo);
 #endif
-		notify(finfo->aggregate(), AggregateListener::NEW_AGG, p);
+		notify_later(finfo->aggregate(), AggregateListener::NEW_AGG, p);
 	    }
 
 	    // otherwise, move to the front of the list and return
@@ -388,23 +575,24 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 
     // make and install new FlowInfo pair
     FlowInfo *finfo;
+    uint32_t agg = _next.fetch_and_add(1);
 #if CLICK_USERLEVEL
     if (stats()) {
-	finfo = new StatFlowInfo(ports, hpinfo->_flows, _next);
+	finfo = new StatFlowInfo(hosts, ports, udp, hpinfo->_flows, agg);
 	stat_new_flow_hook(p, finfo);
     } else
 #endif
-	finfo = new FlowInfo(ports, hpinfo->_flows, _next);
+	finfo = new FlowInfo(hosts, ports, udp, hpinfo->_flows, agg);
 
     finfo->_reverse = flipped;
     hpinfo->_flows = finfo;
-    _next++;
-    notify(finfo->aggregate(), AggregateListener::NEW_AGG, p);
+    arm(s, finfo, p->timestamp_anno().sec() + relevant_timeout(finfo) + 1);
+    notify_later(finfo->aggregate(), AggregateListener::NEW_AGG, p);
     return finfo;
 }
 
 void
-AggregateIPFlows::emit_fragment_head(HostPairInfo *hpinfo)
+AggregateIPFlows::emit_fragment_head(Shard &s, HostPairInfo *hpinfo)
 {
     Packet *head = hpinfo->_fragment_head;
     hpinfo->_fragment_head = head->next();
@@ -443,17 +631,31 @@ AggregateIPFlows::emit_fragment_head(HostPairInfo *hpinfo)
 	}
 
     assert(finfo);
-    packet_emit_hook(head, iph, finfo);
-#if HAVE_BATCH
-    if (in_batch_mode)
-        output(0).push_batch(PacketBatch::make_from_packet(head));
+    packet_emit_hook(s, head, iph, finfo);
+
+    // emitted once the shard is released
+    ThreadState &ts = *_thread_state;
+    head->set_next(0);
+    if (ts._emit_head)
+	ts._emit_tail->set_next(head);
     else
-#endif
-        output(0).push(head);
+	ts._emit_head = head;
+    ts._emit_tail = head;
+}
+
+void
+AggregateIPFlows::emit_old_fragments(Shard &s, HostPairInfo *hpinfo)
+{
+    int frag_timeout = s._active_sec - _fragment_timeout;
+    Packet *head;
+    while ((head = hpinfo->_fragment_head)
+	   && (head->timestamp_anno().sec() < frag_timeout
+	       || !IP_ISFRAG(good_ip_header(head))))
+	emit_fragment_head(s, hpinfo);
 }
 
 int
-AggregateIPFlows::handle_fragment(Packet *p, HostPairInfo *hpinfo)
+AggregateIPFlows::handle_fragment(Shard &s, Packet *p, HostPairInfo *hpinfo, const HostPair &hosts, bool udp)
 {
     if (hpinfo->_fragment_head)
         hpinfo->_fragment_tail->set_next(p);
@@ -461,20 +663,23 @@ AggregateIPFlows::handle_fragment(Packet *p, HostPairInfo *hpinfo)
         hpinfo->_fragment_head = p;
     hpinfo->_fragment_tail = p;
     p->set_next(0);
-    _active_sec = p->timestamp_anno().sec();
+    s._active_sec = p->timestamp_anno().sec();
+
+    // fragments without flows are not in the timer wheel
+    if (!hpinfo->_flows && hpinfo->_fragment_head == p)
+        s._orphans[udp].push_back(hosts);
 
     // get rid of old fragments
-    int frag_timeout = _active_sec - _fragment_timeout;
-    Packet *head;
-    while ((head = hpinfo->_fragment_head)
-            && (head->timestamp_anno().sec() < frag_timeout
-                    || !IP_ISFRAG(good_ip_header(head))))
-        emit_fragment_head(hpinfo);
+    emit_old_fragments(s, hpinfo);
     return ACT_NONE;
 }
 
+/** @brief Process @a p, leaving its shard locked in @a held.
+ *
+ * The lock previously in @a held is released when @a p belongs to another
+ * shard, so that a run of packets of the same shard takes the lock once. */
 int
-AggregateIPFlows::handle_packet(Packet *p)
+AggregateIPFlows::handle_packet(Packet *p, Shard *&held)
 {
     const click_ip *iph = p->ip_header();
     int paint = 0;
@@ -502,9 +707,24 @@ AggregateIPFlows::handle_packet(Packet *p)
         return ACT_DROP;
     }
 
-    // find relevant HostPairInfo
-    Map &m = (iph->ip_p == IP_PROTO_TCP ? _tcp_map : _udp_map);
+    // lock the relevant shard
     HostPair hosts(iph->ip_src.s_addr, iph->ip_dst.s_addr);
+    Shard &s = shard(hosts);
+    if (held != &s) {
+        if (held)
+            release(held);
+        s._lock.acquire();
+        held = &s;
+    }
+    if (unlikely(!s._started)) {
+        s._wheel_sec = p->timestamp_anno().sec();
+        s._gc_sec = s._wheel_sec + _gc_interval;
+        s._started = true;
+    }
+
+    // find relevant HostPairInfo
+    bool udp = (iph->ip_p == IP_PROTO_UDP);
+    Map &m = (udp ? s._udp_map : s._tcp_map);
     if (hosts.a != iph->ip_src.s_addr)
         paint ^= 1;
     HostPairInfo *hpinfo = &m[hosts];
@@ -512,31 +732,33 @@ AggregateIPFlows::handle_packet(Packet *p)
     // find relevant FlowInfo, if any
     FlowInfo *finfo;
     if (IP_FIRSTFRAG(iph)) {
-    const uint8_t *udp_ptr = reinterpret_cast<const uint8_t *>(iph) + (iph->ip_hl << 2);
-    if (udp_ptr + 4 > p->end_data()) {
-        // packet not big enough
-        return ACT_DROP;
-    }
-
-    uint32_t ports = *reinterpret_cast<const uint32_t *>(udp_ptr);
-    // 1.Jan.08: handle connections where IP addresses are the same (John
-    // Russell Lane)
-    if (hosts.a == hosts.b && ports_reverse_order(ports))
-        paint ^= 1;
-    if (paint & 1)
-        ports = flip_ports(ports);
+        const uint8_t *udp_ptr = reinterpret_cast<const uint8_t *>(iph) + (iph->ip_hl << 2);
+        if (udp_ptr + 4 > p->end_data()) {
+            // packet not big enough
+            if (!hpinfo->_flows && !hpinfo->_fragment_head)
+                m.erase(hosts);
+            return ACT_DROP;
+        }
 
-    finfo = find_flow_info(m, hpinfo, ports, paint & 1, p);
-    if (!finfo) {
-        click_chatter("out of memory!");
-        return ACT_DROP;
-    }
-    if (finfo->reverse())
-        paint ^= 1;
+        uint32_t ports = *reinterpret_cast<const uint32_t *>(udp_ptr);
+        // 1.Jan.08: handle connections where IP addresses are the same (John
+        // Russell Lane)
+        if (hosts.a == hosts.b && ports_reverse_order(ports))
+            paint ^= 1;
+        if (paint & 1)
+            ports = flip_ports(ports);
+
+        finfo = find_flow_info(s, udp, hpinfo, hosts, ports, paint & 1, p);
+        if (!finfo) {
+            click_chatter("out of memory!");
+            return ACT_DROP;
+        }
+        if (finfo->reverse())
+            paint ^= 1;
 
-    // set aggregate annotations
-    SET_AGGREGATE_ANNO(p, finfo->aggregate());
-    SET_PAINT_ANNO(p, paint);
+        // set aggregate annotations
+        SET_AGGREGATE_ANNO(p, finfo->aggregate());
+        SET_PAINT_ANNO(p, paint);
     } else {
         finfo = 0;
         SET_AGGREGATE_ANNO(p, 0);
@@ -545,25 +767,25 @@ AggregateIPFlows::handle_packet(Packet *p)
 
     // check for fragment
     if ((_fragments && IP_ISFRAG(iph)) || hpinfo->_fragment_head)
-        return handle_fragment(p, hpinfo);
+        return handle_fragment(s, p, hpinfo, hosts, udp);
     else if (!finfo) {
+        if (!hpinfo->_flows)
+            m.erase(hosts);
         return ACT_DROP;
     }
 
     // packet emit hook
-    _active_sec = p->timestamp_anno().sec();
-    packet_emit_hook(p, iph, finfo);
+    s._active_sec = p->timestamp_anno().sec();
+    packet_emit_hook(s, p, iph, finfo);
     return ACT_EMIT;
 }
 
 void
 AggregateIPFlows::push(int, Packet *p)
 {
-    int action = handle_packet(p);
-
-    // GC if necessary
-    if (_active_sec >= _gc_sec)
-	reap();
+    Shard *held = 0;
+    int action = handle_packet(p, held);
+    finish(held);
 
     if (action == ACT_EMIT)
 	output(0).push(p);
@@ -575,11 +797,9 @@ Packet *
 AggregateIPFlows::pull(int)
 {
     Packet *p = input(0).pull();
-    int action = (p ? handle_packet(p) : ACT_NONE);
-
-    // GC if necessary
-    if (_active_sec >= _gc_sec)
-	reap();
+    Shard *held = 0;
+    int action = (p ? handle_packet(p, held) : ACT_NONE);
+    finish(held);
 
     if (action == ACT_EMIT)
 	return p;
@@ -592,34 +812,46 @@ AggregateIPFlows::pull(int)
 void
 AggregateIPFlows::push_batch(int, PacketBatch *batch)
 {
-    CLASSIFY_EACH_PACKET(3,handle_packet,batch,[this](int action,PacketBatch* batch){
-        if (likely(action != ACT_NONE)) {
-            checked_output_push_batch(action, batch);
-        }
-    });
-    if (_active_sec >= _gc_sec)
-    reap();
+    Shard *held = 0;
+    PacketBatch *out[2] = {0, 0};
+    // Stored fragments are linked in their host pair, leave them alone
+    auto fnt = [this, &held](Packet *p) -> int {
+        int action = handle_packet(p, held);
+        return action == ACT_NONE ? -1 : action;
+    };
+    auto on_finish = [&out](int action, PacketBatch *subbatch) {
+        out[action] = subbatch;
+    };
+    CLASSIFY_EACH_PACKET_IGNORE(2, fnt, batch, on_finish);
+    finish(held);
+
+    if (out[ACT_EMIT])
+        output(0).push_batch(out[ACT_EMIT]);
+    if (out[ACT_DROP])
+        checked_output_push_batch(1, out[ACT_DROP]);
 }
 
 PacketBatch *
 AggregateIPFlows::pull_batch(int, int max)
 {
     PacketBatch *batch = input(0).pull_batch(max);
+    PacketBatch *out[2] = {0, 0};
+    Shard *held = 0;
     if (batch) {
-        auto on_finish = [this,&batch](int action,PacketBatch* subbatch){
-            if (likely(action == 0))
-                batch = subbatch;
-            else if (action == 1)
-                checked_output_push_batch(1,subbatch);
+        auto fnt = [this, &held](Packet *p) -> int {
+            int action = handle_packet(p, held);
+            return action == ACT_NONE ? -1 : action;
         };
-        CLASSIFY_EACH_PACKET(3,handle_packet,batch,on_finish);
+        auto on_finish = [&out](int action, PacketBatch *subbatch) {
+            out[action] = subbatch;
+        };
+        CLASSIFY_EACH_PACKET_IGNORE(2, fnt, batch, on_finish);
     }
+    finish(held);
 
-    // GC if necessary
-    if (_active_sec >= _gc_sec)
-    reap();
-
-    return batch;
+    if (out[ACT_DROP])
+        checked_output_push_batch(1, out[ACT_DROP]);
+    return out[ACT_EMIT];
 }
 #endif
 
@@ -630,13 +862,18 @@ AggregateIPFlows::write_handler(const String &, Element *e, void *thunk, ErrorHa
 {
     AggregateIPFlows *af = static_cast<AggregateIPFlows *>(e);
     switch ((intptr_t)thunk) {
-      case H_CLEAR: {
-	  int active_sec = af->_active_sec, gc_sec = af->_gc_sec;
-	  af->_active_sec = af->_gc_sec = 0x7FFFFFFF;
-	  af->reap();
-	  af->_active_sec = active_sec, af->_gc_sec = gc_sec;
-	  return 0;
-      }
+      case H_CLEAR:
+	for (int i = 0; i < af->_nshards; i++) {
+	    Shard &s = af->_shards[i];
+	    s._lock.acquire();
+	    af->clear_map(s, s._tcp_map);
+	    af->clear_map(s, s._udp_map);
+	    s._orphans[0].clear();
+	    s._orphans[1].clear();
+	    s._lock.release();
+	    af->finish(0);
+	}
+	return 0;
       default:
 	return -1;
     }
@@ -650,4 +887,5 @@ AggregateIPFlows::add_handlers()
 
 ELEMENT_REQUIRES(AggregateNotifier)
 EXPORT_ELEMENT(AggregateIPFlows)
+ELEMENT_MT_SAFE(AggregateIPFlows)
 CLICK_ENDDECLS
@@ -4,6 +4,8 @@
 #include <click/batchelement.hh>
 #include <click/ipflowid.hh>
 #include <click/hashtable.hh>
+#include <click/multithread.hh>
+#include <click/sync.hh>
 #include "aggregatenotifier.hh"
 CLICK_DECLS
 class HandlerCall;
@@ -95,7 +97,9 @@ The timeout for fragments, in seconds, Default is 30 seconds.
 
 =item REAP
 
-The garbage collection interval. Default is 20 minutes of packet time.
+The garbage collection interval, in seconds of packet time. Flows are deleted
+at most this long after they time out, even in the shards that receive no
+packets, as packet time is shared by all shards. Default is 1 second.
 
 =item ICMP
 
@@ -110,10 +114,25 @@ Boolean. If true, then try to assign aggregate annotations to all fragments.
 May only be set to true if AggregateIPFlows is running in a push context.
 Default is true in a push context and false in a pull context.
 
+=item SHARDS
+
+Integer. Number of independently locked parts of the flow table, a power of
+two. Default is 1 when Click runs a single thread, and 4 per thread
+otherwise.
+
 =back
 
 AggregateIPFlows is an AggregateNotifier, so AggregateListeners can request
-notifications when new aggregates are created and old ones are deleted.
+notifications when new aggregates are created and old ones are deleted. The
+notifications caused by a batch of packets are delivered together, from the
+thread that processed the batch, before the packets are emitted.
+
+AggregateIPFlows can be used by several threads at once. Host pairs are
+spread over SHARDS flow tables, each protected by a spinlock, and aggregate
+numbers come from a single atomic counter. A thread keeps the lock of a table
+while consecutive packets of a batch belong to it. Flows expire through a
+timer wheel rather than periodic scans of the tables, and host pairs are
+freed when their last flow expires.
 
 =h clear write-only
 
@@ -187,10 +206,15 @@ class AggregateIPFlows : public BatchElement, public AggregateNotifier { public:
 	Timestamp _last_timestamp;
 	unsigned _flow_over : 2;
 	bool _reverse : 1;
+	bool _udp : 1;
+	HostPair _hosts;
 	FlowInfo *_next;
-	// have 24 bytes; statistics would double
-	// + 8 + 8 = 16 bytes
-	FlowInfo(uint32_t ports, FlowInfo *next, uint32_t agg) : _ports(ports), _aggregate(agg), _flow_over(0), _next(next) { }
+	// timer wheel links
+	FlowInfo *_wnext;
+	FlowInfo **_wpprev;
+	FlowInfo(const HostPair &hosts, uint32_t ports, bool udp, FlowInfo *next, uint32_t agg)
+	    : _ports(ports), _aggregate(agg), _flow_over(0), _udp(udp), _hosts(hosts),
+	      _next(next), _wnext(0), _wpprev(0) { }
 	uint32_t aggregate() const { return _aggregate; }
 	bool reverse() const	{ return _reverse; }
     };
@@ -200,7 +224,7 @@ class AggregateIPFlows : public BatchElement, public AggregateNotifier { public:
 	Timestamp _first_timestamp;
 	uint32_t _filepos;
 	uint32_t _packets[2];
-	StatFlowInfo(uint32_t ports, FlowInfo *next, uint32_t agg) : FlowInfo(ports, next, agg) { _packets[0] = _packets[1] = 0; }
+	StatFlowInfo(const HostPair &hosts, uint32_t ports, bool udp, FlowInfo *next, uint32_t agg) : FlowInfo(hosts, ports, udp, next, agg) { _packets[0] = _packets[1] = 0; }
     };
 #endif
 
@@ -213,12 +237,38 @@ class AggregateIPFlows : public BatchElement, public AggregateNotifier { public:
     };
 
     typedef HashTable<HostPair, HostPairInfo> Map;
-    Map _tcp_map;
-    Map _udp_map;
 
-    uint32_t _next;
-    unsigned _active_sec;
-    unsigned _gc_sec;
+    enum { WHEEL_SIZE = 4096 };	// seconds, a power of two
+
+    struct Shard {
+	SimpleSpinlock _lock;
+	Map _tcp_map;
+	Map _udp_map;
+	unsigned _active_sec;
+	unsigned _gc_sec;
+	unsigned _wheel_sec;	// last second processed by the wheel
+	bool _started;
+	FlowInfo *_wheel[WHEEL_SIZE];
+	Vector<HostPair> _orphans[2];	// host pairs with only fragments
+	Shard();
+    };
+
+    // Work deferred until the thread releases its shard
+    struct ThreadState {
+	Vector<AggregateListener::Event> _events;
+	Packet *_emit_head;
+	Packet *_emit_tail;
+	ThreadState() : _emit_head(0), _emit_tail(0) { }
+    };
+
+    Shard *_shards;
+    int _nshards;
+    int _shard_shift;
+    per_thread<ThreadState> _thread_state;
+
+    atomic_uint32_t _next;
+    atomic_uint32_t _clock_sec;	// latest packet second of any shard
+    atomic_uint32_t _sweep_sec;	// when idle shards are next advanced
 
     uint32_t _tcp_timeout;
     uint32_t _tcp_done_timeout;
@@ -230,7 +280,7 @@ class AggregateIPFlows : public BatchElement, public AggregateNotifier { public:
 
     bool _handle_icmp_errors : 1;
     unsigned _fragments : 2;
-    bool _timestamp_warning : 1;
+    bool _timestamp_warning;
 
 #if CLICK_USERLEVEL
     FILE *_traceinfo_file;
@@ -242,24 +292,33 @@ class AggregateIPFlows : public BatchElement, public AggregateNotifier { public:
 
     static const click_ip *icmp_encapsulated_header(const Packet *);
 
+    inline Shard &shard(const HostPair &hosts) const;
     void clean_map(Map &);
-    void reap_map(Map &, uint32_t, uint32_t);
-    void reap();
+    void clear_map(Shard &, Map &);
+
+    inline void notify_later(uint32_t, AggregateListener::AggregateEvent, const Packet *);
+    void finish(Shard *held);
 
-    inline int relevant_timeout(const FlowInfo *, const Map &) const;
+    void arm(Shard &, FlowInfo *, unsigned sec);
+    inline void disarm(FlowInfo *);
+    void expire_flow(Shard &, FlowInfo *);
+    void advance_wheel(Shard &);
+    inline void release(Shard *);
+    void sweep_shards(unsigned sec);
+
+    inline int relevant_timeout(const FlowInfo *) const;
 #if CLICK_USERLEVEL
     void stat_new_flow_hook(const Packet *, FlowInfo *);
 #endif
-    inline void packet_emit_hook(const Packet *, const click_ip *, FlowInfo *);
-    inline void delete_flowinfo(const HostPair &, FlowInfo *, bool really_delete = true);
-    void emit_fragment_head(HostPairInfo *hpinfo);
-    FlowInfo *find_flow_info(Map &, HostPairInfo *, uint32_t ports, bool flipped, const Packet *);
-
-    FlowInfo *uncommon_case(FlowInfo *finfo, const click_ip *iph);
+    inline void packet_emit_hook(Shard &, const Packet *, const click_ip *, FlowInfo *);
+    inline void delete_flowinfo(FlowInfo *, bool really_delete = true);
+    void emit_fragment_head(Shard &, HostPairInfo *hpinfo);
+    FlowInfo *find_flow_info(Shard &, bool udp, HostPairInfo *, const HostPair &, uint32_t ports, bool flipped, const Packet *);
 
     enum { ACT_EMIT, ACT_DROP, ACT_NONE };
-    int handle_fragment(Packet *, HostPairInfo *);
-    int handle_packet(Packet *);
+    void emit_old_fragments(Shard &, HostPairInfo *);
+    int handle_fragment(Shard &, Packet *, HostPairInfo *, const HostPair &, bool udp);
+    int handle_packet(Packet *, Shard *&held);
 
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
 
@@ -8,6 +8,13 @@ AggregateListener::aggregate_notify(uint32_t, AggregateEvent, const Packet *)
 {
 }
 
+void
+AggregateListener::aggregate_notify_batch(const Event *e, int n)
+{
+    for (int i = 0; i < n; i++)
+	aggregate_notify(e[i].agg, e[i].event, e[i].packet);
+}
+
 void
 AggregateNotifier::add_listener(AggregateListener *l)
 {
@@ -13,6 +13,14 @@ class AggregateListener { public:
     enum AggregateEvent { NEW_AGG, DELETE_AGG };
     virtual void aggregate_notify(uint32_t, AggregateEvent, const Packet *);
 
+    struct Event {
+	uint32_t agg;
+	AggregateEvent event;
+	const Packet *packet;
+    };
+    // Default calls aggregate_notify() for each event, in order
+    virtual void aggregate_notify_batch(const Event *, int n);
+
 };
 
 class AggregateNotifier { public:
@@ -24,6 +32,7 @@ class AggregateNotifier { public:
     void remove_listener(AggregateListener *);
 
     void notify(uint32_t, AggregateListener::AggregateEvent, const Packet *) const;
+    void notify_batch(const AggregateListener::Event *, int n) const;
 
   private:
 
@@ -38,5 +47,13 @@ AggregateNotifier::notify(uint32_t agg, AggregateListener::AggregateEvent e, con
 	_listeners[i]->aggregate_notify(agg, e, p);
 }
 
+inline void
+AggregateNotifier::notify_batch(const AggregateListener::Event *e, int n) const
+{
+    if (n)
+	for (int i = 0; i < _listeners.size(); i++)
+	    _listeners[i]->aggregate_notify_batch(e, n);
+}
+
 CLICK_ENDDECLS
 #endif
@@ -113,7 +113,8 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _allow_nonexistent = allow_nonexistent;
     _have_timing = false;
     _multipacket = multipacket;
-    _have_flowid = _have_aggregate = _binary = false;
+    _have_flowid = _have_aggregate = _binary = _columnar = false;
+    _block_count = _block_pos = 0;
     _burst = burst;
     if (default_contents)
     bang_data(default_contents, errh);
@@ -155,6 +156,41 @@ FromIPSummaryDump::read_binary(String &result, ErrorHandler *errh)
     return (textual ? 2 : 1);
 }
 
+void
+FromIPSummaryDump::read_columnar(const String &block, ErrorHandler *errh)
+{
+    // block is the rest of a columnar block after its length word
+    _block_count = _block_pos = 0;
+    if (block.length() < IPSummaryDump::COLUMNAR_HEADER - 4) {
+        _ff.error(errh, "columnar block too short");
+        return;
+    }
+    const uint8_t *h = (const uint8_t *) block.data();
+    uint32_t count = GET4(h), flags = GET4(h + 4);
+    if ((flags & 255) != IPSummaryDump::COLUMNAR_CODEC_NONE) {
+        _ff.error(errh, "unknown columnar compression %u", flags & 255);
+        return;
+    }
+
+    _column_offset.clear();
+    _column_offset.push_back(0);
+    for (const IPSummaryDump::FieldReader * const *fp = _fields.begin(); fp != _fields.end(); ++fp) {
+        int size = IPSummaryDump::fixed_binary_size((*fp)->type);
+        if (size < 0 || !(*fp)->inb) {
+            _ff.error(errh, "field %s cannot be columnar", (*fp)->name);
+            return;
+        }
+        _column_offset.push_back(_column_offset.back() + size);
+    }
+    if ((uint64_t) count * _column_offset.back() != (uint64_t) block.length() - 8) {
+        _ff.error(errh, "bad columnar block length");
+        return;
+    }
+
+    _block = block;
+    _block_count = count;
+}
+
 int
 FromIPSummaryDump::initialize(ErrorHandler *errh)
 {
@@ -329,6 +365,18 @@ FromIPSummaryDump::bang_binary(const String &line, ErrorHandler *errh)
     _ff.set_lineno(1);
 }
 
+void
+FromIPSummaryDump::bang_columnar(const String &line, ErrorHandler *errh)
+{
+    Vector<String> words;
+    cp_spacevec(line, words);
+    if (words.size() != 1)
+    _ff.error(errh, "bad !columnar specification");
+    _binary = _columnar = true;
+    _ff.set_landmark_pattern("%f:block %l");
+    _ff.set_lineno(1);
+}
+
 static void
 set_checksums(WritablePacket *q, click_ip *iph)
 {
@@ -366,15 +414,25 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
     const char *end;
 
     while (1) {
-    if ((binary = _binary)) {
+    if (_block_pos < _block_count) {
+        // next record of the current columnar block
+        binary = true;
+        data = _block.begin();
+        end = _block.end();
+        break;
+    } else if ((binary = _binary)) {
         int result = read_binary(line, errh);
         if (result <= 0)
         goto eof;
-        else
+        else if (result == 1 && _columnar) {
+        read_columnar(line, errh);
+        continue;
+        } else
         binary = (result == 1);
     } else if (_ff.read_line(line, errh, true) <= 0) {
       eof:
         _ff.cleanup();
+        _block = String();
         return 0;
     }
 
@@ -399,6 +457,8 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
         bang_aggregate(line, errh);
         else if (data + 8 <= end && memcmp(data, "!binary", 7) == 0 && isspace((unsigned char) data[7]))
         bang_binary(line, errh);
+        else if (data + 10 <= end && memcmp(data, "!columnar", 9) == 0 && isspace((unsigned char) data[9]))
+        bang_columnar(line, errh);
         else if (data + 10 <= end && memcmp(data, "!contents", 9) == 0 && isspace((unsigned char) data[9]))
         bang_data(line, errh);
     }
@@ -422,6 +482,16 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
     if (_binary) {
     Vector<const unsigned char *> args;
     int nbytes;
+    if (_block_pos < _block_count) {
+        // each field is an array of fixed-size values after the header
+        const unsigned char *columns = (const unsigned char *) _block.data() + IPSummaryDump::COLUMNAR_HEADER - 4;
+        for (int i = 0; i < _fields.size(); i++) {
+        uint32_t size = _column_offset[i + 1] - _column_offset[i];
+        args.push_back(columns + _block_count * _column_offset[i] + _block_pos * size);
+        }
+        _block_pos++;
+        goto inject;
+    }
     for (const IPSummaryDump::FieldReader * const *fp = _fields.begin(); fp != _fields.end(); ++fp) {
         if (!(*fp)->inb)
         goto bad_field;
@@ -467,6 +537,7 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
         }
     }
 
+  inject:
     for (int *fip = _field_order.begin();
          fip != _field_order.end() && d.p;
          ++fip) {
@@ -32,6 +32,10 @@ FromIPSummaryDump reads from the file named FILENAME unless FILENAME is a
 single dash 'C<->', in which case it reads from the standard input. It will
 not uncompress the standard input, however.
 
+Binary and columnar dumps (see ToIPSummaryDump) are read too. Columnar dumps
+are read a block at a time, which is the fastest way to replay a large
+trace.
+
 Keyword arguments are:
 
 =over 8
@@ -203,6 +207,7 @@ class FromIPSummaryDump : public BatchElement, public IPSummaryDumpInfo { public
     bool _timing : 1;
     bool _have_timing : 1;
     bool _allow_nonexistent : 1;
+    bool _columnar : 1;
     Packet *_work_packet;
     uint32_t _multipacket_length;
     Timestamp _multipacket_timestamp_delta;
@@ -218,7 +223,14 @@ class FromIPSummaryDump : public BatchElement, public IPSummaryDumpInfo { public
 
     unsigned _burst;
 
+    // Current columnar block
+    String _block;
+    uint32_t _block_count;
+    uint32_t _block_pos;
+    Vector<uint32_t> _column_offset;
+
     int read_binary(String &, ErrorHandler *);
+    void read_columnar(const String &, ErrorHandler *);
 
     static int sort_fields_compare(const void *, const void *, void *);
     void bang_data(const String &, ErrorHandler *);
@@ -226,6 +238,7 @@ class FromIPSummaryDump : public BatchElement, public IPSummaryDumpInfo { public
     void bang_flowid(const String &, ErrorHandler *);
     void bang_aggregate(const String &, ErrorHandler *);
     void bang_binary(const String &, ErrorHandler *);
+    void bang_columnar(const String &, ErrorHandler *);
     void check_defaults();
     bool check_timing(Packet *p);
     Packet *read_packet(ErrorHandler *);
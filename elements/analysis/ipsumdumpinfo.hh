@@ -106,6 +106,28 @@ enum {
     B_NOTALLOWED = -1
 };
 
+// Size in bytes of the binary representation of a field of type @a type,
+// or -1 if the representation has variable size
+inline int fixed_binary_size(int type) {
+    switch (type) {
+    case B_0: case B_1: case B_2: case B_4: case B_6PTR: case B_8: case B_16:
+        return type;
+    case B_4NET:
+        return 4;
+    default:
+        return -1;
+    }
+}
+
+// Columnar dumps: after a '!columnar' line, the file consists of blocks.
+// Each block starts with a COLUMNAR_HEADER-byte header holding the block
+// length, including the header, the number of records N, and flags whose
+// low byte is the compression codec (only COLUMNAR_CODEC_NONE for now).
+// Then come the fields, in '!data' order, each stored as an array of N
+// fixed-size values.  A block length with the high-order bit set is a
+// metadata record, as in binary dumps.
+enum { COLUMNAR_HEADER = 12, COLUMNAR_CODEC_NONE = 0 };
+
 struct FieldWriter {
     const char *name;           // must come first
     int type;
@@ -105,22 +105,16 @@ MultiReplay::run_task(Task* task)
     }
 
     unsigned int n = 0;
-    while (_queue_current != 0 && n < _burst) {
-        Packet* p = _queue_current;
+    while (has_current() && n < _burst) {
+        Packet* p = current();
+        int port = PAINT_ANNO(p);
 
-        if (_output[PAINT_ANNO(p)].ring.is_full()) {
+        if (_output[port].ring.is_full()) {
             _notifier.sleep();
             return n > 0;
         } else {
-            _queue_current = p->next();
-            Packet* q;
-            if (_stop != 1 || _freeonterminate) {
-                q = p->clone(_quick_clone);
-            } else {
-                q = p;
-                _queue_head = _queue_current;
-            }
-            assert(_output[PAINT_ANNO(p)].ring.insert(q));
+            Packet* q = emit_current();
+            assert(_output[port].ring.insert(q));
             _notifier.wake();
         }
         n++;
@@ -132,7 +126,7 @@ MultiReplay::run_task(Task* task)
 }
 
 
-MultiReplayUnqueue::MultiReplayUnqueue()
+MultiReplayUnqueue::MultiReplayUnqueue() : _timing(0)
 {
 
 }
@@ -152,6 +146,7 @@ MultiReplayUnqueue::configure(Vector<String> &conf, ErrorHandler *errh)
     if (args
         .read("QUICK_CLONE", _quick_clone)
         .read("USE_SIGNAL",_use_signal)
+        .read("TIMING", _timing)
         .complete() < 0)
     return -1;
     return 0;
@@ -182,37 +177,48 @@ MultiReplayUnqueue::run_task(Task* task)
         return false;
     }
 
+    Timestamp now;
+    if (_timing > 0)
+        now = Timestamp::now_steady();
     unsigned int n = 0;
 #if HAVE_BATCH
     unsigned int c = 0;
+    int port = 0;
     PacketBatch* head = 0;
     Packet* last = 0;
 #endif
-    while (_queue_current != 0 && n < _burst) {
-        Packet* p = _queue_current;
+    while (has_current() && n < _burst) {
+        Packet* p = current();
 
-            _queue_current = p->next();
-            Packet* q;
-            if (_stop != 1 || _freeonterminate) {
-                q = p->clone(_quick_clone);
-            } else {
-                q = p;
-                _queue_head = _queue_current;
-            }
+            //If timing is activated, wait for the amount of time or resched
+            if (_timing > 0 && !wait_timing(p, now, _timing, [&]() {
+#if HAVE_BATCH
+                    if (head) {
+                        output_push_batch(port,head->make_tail(last,c));
+                        head = 0;
+                        c = 0;
+                    }
+#endif
+                }))
+                goto end;
+
+            Packet* q = emit_current();
 #if HAVE_BATCH
             if (head == 0) {
                 head = PacketBatch::start_head(q);
+                port = PAINT_ANNO(p);
                 if (_quick_clone)
-                    SET_PAINT_ANNO(head,PAINT_ANNO(p));
+                    SET_PAINT_ANNO(head,port);
                 last = head;
                 c = 1;
             } else {
                 //If next packet is for another output, send the pending batch and start a new one
-                if (PAINT_ANNO(p) != PAINT_ANNO(head)) {
-                    output_push_batch(PAINT_ANNO(head),head->make_tail(last,c));
+                if (PAINT_ANNO(p) != port) {
+                    output_push_batch(port,head->make_tail(last,c));
                     head = PacketBatch::start_head(q);
+                    port = PAINT_ANNO(p);
                     if (_quick_clone)
-                        SET_PAINT_ANNO(head,PAINT_ANNO(p));
+                        SET_PAINT_ANNO(head,port);
                     last = head;
                     c = 1;
                 } else {
@@ -231,15 +237,20 @@ MultiReplayUnqueue::run_task(Task* task)
 #if HAVE_BATCH
     //Flush pending batch
     if (head)
-        output_push_batch(PAINT_ANNO(head),head->make_tail(last,c));
+        output_push_batch(port,head->make_tail(last,c));
 #endif
 
-
+end:
     check_end_loop(task);
 
     return n > 0;
 }
 
+void
+MultiReplayUnqueue::add_handlers() {
+    ReplayBase::add_handlers();
+    add_data_handlers("timing", Handler::OP_READ | Handler::OP_WRITE, &_timing);
+}
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(MultiReplay)
@@ -64,6 +64,12 @@ class MultiReplayUnqueue : public ReplayBase { public:
 
     bool run_task(Task*);
 
+    void add_handlers() override;
+
+private:
+
+    unsigned _timing;
+
 };
 
 CLICK_ENDDECLS
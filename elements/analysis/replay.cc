@@ -23,7 +23,7 @@
 #include <click/standard/scheduleinfo.hh>
 CLICK_DECLS
 
-ReplayBase::ReplayBase() : _active(true), _loaded(false), _burst(64), _stop(-1), _quick_clone(false), _task(this), _limit(-1), _queue_head(0), _queue_current(0), _use_signal(false),_verbose(false),_freeonterminate(true), _lastsent_p(), _lastsent_real() {
+ReplayBase::ReplayBase() : _active(true), _loaded(false), _burst(64), _stop(-1), _quick_clone(false), _task(this), _limit(-1), _prefetch(4), _packets(), _queue_current(0), _use_signal(false),_verbose(false),_freeonterminate(true), _lastsent_p(), _lastsent_real() {
 #if HAVE_BATCH
     in_batch_mode = BATCH_MODE_YES;
 #endif
@@ -44,6 +44,7 @@ int ReplayBase::parse(Args* args) {
              .read("FREEONTERMINATE", _freeonterminate)
              .read("LIMIT", _limit)
              .read("ACTIVE",_active)
+             .read("PREFETCH", _prefetch)
              .execute() < 0) {
         return -1;
     }
@@ -53,18 +54,19 @@ int ReplayBase::parse(Args* args) {
 
 
 void ReplayBase::reset_time() {
-    if (_queue_current) {
-        _lastsent_p = _queue_current->timestamp_anno();
+    if (has_current() && current()) {
+        _lastsent_p = current()->timestamp_anno();
         _lastsent_real = Timestamp::now_steady();
     }
 }
 
 void ReplayBase::cleanup_packets() {
-    while (_queue_head) {
-        Packet* next = _queue_head->next();
-        _queue_head->kill();
-        _queue_head = next;
+    for (int i = 0; i < _packets.size(); i++) {
+        if (_packets[i])
+            _packets[i]->kill();
     }
+    _packets.clear();
+    _queue_current = 0;
 }
 
 void ReplayBase::cleanup(CleanupStage) {
@@ -106,6 +108,18 @@ ReplayBase::write_handler(const String & s_in, Element *e, void *thunk, ErrorHan
     }
 }
 
+String
+ReplayBase::read_handler(Element *e, void *thunk)
+{
+    ReplayBase *q = static_cast<ReplayBase *>(e);
+    switch (reinterpret_cast<intptr_t>(thunk)) {
+      case 0:
+          return String(q->_packets.size());
+      default:
+          return "<error>";
+    }
+}
+
 void
 ReplayBase::add_handlers()
 {
@@ -114,6 +128,8 @@ ReplayBase::add_handlers()
     add_data_handlers("loaded", Handler::OP_READ, &_loaded);
     add_data_handlers("active", Handler::OP_READ, &_active);
     add_data_handlers("stop", Handler::OP_READ | Handler::OP_WRITE, &_stop);
+    add_data_handlers("prefetch", Handler::OP_READ | Handler::OP_WRITE, &_prefetch);
+    add_read_handler("count", read_handler, 0);
 }
 
 Replay::Replay() : _queue(1024)
@@ -194,21 +210,12 @@ Replay::run_task(Task* task)
     }
 
     unsigned int n = 0;
-    while (_queue_current != 0 && n < _burst) {
-        Packet* p = _queue_current;
-
+    while (has_current() && n < _burst) {
         if (_output.ring.is_full()) {
             _notifier.sleep();
             return n > 0;
         } else {
-            _queue_current = p->next();
-            Packet* q;
-            if (_stop != 1 || _freeonterminate) {
-                q = p->clone(_quick_clone);
-            } else {
-                q = p;
-                _queue_head = _queue_current;
-            }
+            Packet* q = emit_current();
             assert(_output.ring.insert(q));
             _notifier.wake();
         }
@@ -276,18 +283,11 @@ ReplayUnqueue::run_task(Task* task)
     PacketBatch* head = 0;
     Packet* last = 0;
 #endif
-    while (_queue_current != 0 && n < _burst) {
-            Packet* p = _queue_current;
+    while (has_current() && n < _burst) {
+            Packet* p = current();
 
             //If timing is activated, wait for the amount of time or resched
-            if (_timing > 0) {
-                const unsigned min_timing = 1; //Amount of us between packets to ignore and sent right away
-                const unsigned min_sched = 10; //Amount of us that leads to rescheduling
-
-                Timestamp tdiff = p->timestamp_anno() - _lastsent_p;
-                long diff = tdiff.usecval();
-                long rdiff;
-                while (diff - (rdiff = ((long)(now - _lastsent_real).usecval() * _timing)) > min_timing) {
+            if (_timing > 0 && !wait_timing(p, now, _timing, [&]() {
 #if HAVE_BATCH
                     if (head) {
                         output_push_batch(0,head->make_tail(last,c));
@@ -295,22 +295,10 @@ ReplayUnqueue::run_task(Task* task)
                         c = 0;
                     }
 #endif
-                    if (diff - rdiff > min_sched) {
-                        goto end;
-                    }
-                    now = Timestamp::now_steady();
-                    click_relax_fence();
-                }
-            }
+                }))
+                goto end;
 
-            _queue_current = p->next();
-            Packet* q;
-            if (_stop != 1 || _freeonterminate) {
-                q = p->clone(_quick_clone);
-            } else {
-                q = p;
-                _queue_head = _queue_current;
-            }
+            Packet* q = emit_current();
 
 #if HAVE_BATCH
             if (head == 0) {
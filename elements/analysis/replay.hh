@@ -6,6 +6,7 @@
 #include <click/ring.hh>
 #include <click/vector.hh>
 #include <click/notifier.hh>
+#include <click/machine.hh>
 #include <strings.h>
 CLICK_DECLS
 
@@ -24,7 +25,12 @@ protected:
     inline bool load_packets();
     void cleanup_packets();
     inline void check_end_loop(Task* t);
+    inline bool has_current() const;
+    inline Packet* current() const;
+    inline Packet* emit_current();
+    template <typename F> inline bool wait_timing(Packet* p, Timestamp& now, unsigned timing, F flush);
     static int write_handler(const String &, Element *e, void *thunk, ErrorHandler *errh);
+    static String read_handler(Element *e, void *thunk);
     void add_handlers() override;
     void set_active(bool active);
 
@@ -43,9 +49,12 @@ protected:
     bool _quick_clone;
     Task _task;
     int _limit;
+    unsigned _prefetch;
 
-    Packet* _queue_head;
-    Packet* _queue_current;
+    //The trace is kept as a contiguous array so the next packets can be
+    //prefetched without chasing the next() pointers
+    Vector<Packet*> _packets;
+    int _queue_current;
     Timestamp _current;
     bool _use_signal;
     bool _verbose;
@@ -123,7 +132,6 @@ inline bool ReplayBase::load_packets() {
         bzero(p_input,sizeof(Packet*) * ninputs());
         int first_i = -1;
         Timestamp first_t;
-        Packet* queue_tail = 0;
         int count = 0;
 
         click_chatter("Loading %s with %d inputs.",name().c_str(),ninputs());
@@ -161,12 +169,8 @@ inline bool ReplayBase::load_packets() {
             }
             if (dry >= 0)
                 break;
-            if (!_queue_head) {
-                _queue_head = p_input[first_i];
-            } else {
-                queue_tail->set_next(p_input[first_i]);
-            }
-            queue_tail = p_input[first_i];
+            p_input[first_i]->set_next(0);
+            _packets.push_back(p_input[first_i]);
             SET_PAINT_ANNO(p_input[first_i],first_i);
             p_input[first_i] = 0;
             count++;
@@ -182,18 +186,82 @@ inline bool ReplayBase::load_packets() {
                 p_input[i]->kill();
         }
         _loaded = true;
-        _queue_current = _queue_head;
+        _queue_current = 0;
         reset_time();
         return true;
 }
 
+inline bool ReplayBase::has_current() const {
+    return _queue_current < _packets.size();
+}
+
+inline Packet* ReplayBase::current() const {
+    return _packets.unchecked_at(_queue_current);
+}
+
+/**
+ * Prefetch the upcoming packets, then advance in the trace and return the
+ * packet to send: a clone of the current one, or the loaded packet itself
+ * during the last loop if the trace is not kept until termination.
+ *
+ * The descriptors of the packets _prefetch*2 positions ahead and the data of
+ * the packets _prefetch positions ahead are prefetched before the current
+ * packet is cloned, so they are in cache by the time their turn comes.
+ */
+inline Packet* ReplayBase::emit_current() {
+    Packet* p = _packets.unchecked_at(_queue_current);
+    if (_prefetch) {
+        int pos = _queue_current + _prefetch;
+        if (pos < _packets.size()) {
+            click_prefetch0(_packets.unchecked_at(pos)->data());
+            pos += _prefetch;
+            if (pos < _packets.size())
+                click_prefetch0(_packets.unchecked_at(pos));
+        }
+    }
+    if (_stop != 1 || _freeonterminate) {
+        _queue_current++;
+        return p->clone(_quick_clone);
+    } else {
+        _packets.unchecked_at(_queue_current++) = 0;
+        return p;
+    }
+}
+
+/**
+ * Wait until @a p is due when replaying the trace @a timing times faster than
+ * its original speed. @a flush is called before busy-waiting so the packets
+ * already dequeued are not held back. Returns false if @a p is too far in the
+ * future, in which case the task should be rescheduled instead.
+ */
+template <typename F>
+inline bool ReplayBase::wait_timing(Packet* p, Timestamp& now, unsigned timing, F flush) {
+    const unsigned min_timing = 1; //Amount of us between packets to ignore and sent right away
+    const unsigned min_sched = 10; //Amount of us that leads to rescheduling
+
+    Timestamp tdiff = p->timestamp_anno() - _lastsent_p;
+    long diff = tdiff.usecval();
+    long rdiff;
+    while (diff - (rdiff = ((long)(now - _lastsent_real).usecval() * timing)) > min_timing) {
+        flush();
+        if (diff - rdiff > min_sched)
+            return false;
+        now = Timestamp::now_steady();
+        click_relax_fence();
+    }
+    return true;
+}
+
 inline void ReplayBase::check_end_loop(Task* t) {
-    if (unlikely(!_queue_current)) {
-        _queue_current = _queue_head;
+    if (unlikely(!has_current())) {
+        //During the last loop the packets were handed off instead of cloned
+        if (_stop == 1 && !_freeonterminate)
+            cleanup_packets();
+        _queue_current = 0;
         reset_time();
         if (_stop > 0)
             _stop--;
-        if (_stop == 0) {
+        if (_stop == 0 || _packets.empty()) {
             router()->please_stop_driver();
             _active = false;
             return;
@@ -0,0 +1,353 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * shardedreplay.{cc,hh} -- Replay a trace split by flow over multiple threads
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/error.hh>
+#include "shardedreplay.hh"
+#include <click/args.hh>
+#include <click/master.hh>
+#include <click/ipflowid.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+ShardedReplayUnqueue::ShardedReplayUnqueue() : _timing(0)
+{
+    _finished = 0;
+}
+
+ShardedReplayUnqueue::~ShardedReplayUnqueue()
+{
+}
+
+int
+ShardedReplayUnqueue::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Args args(conf, this, errh);
+    if (ReplayBase::parse(&args) != 0)
+        return -1;
+
+    if (args
+        .read("USE_SIGNAL", _use_signal)
+        .read("TIMING", _timing)
+        .read_all("THREAD", _threads)
+        .complete() < 0)
+        return -1;
+
+    if (_threads.size() == 0) {
+        for (int i = 0; i < noutputs(); i++)
+            _threads.push_back(i % master()->nthreads());
+    } else if (_threads.size() != noutputs())
+        return errh->error("THREAD must be given once per output");
+
+    for (int i = 0; i < _threads.size(); i++)
+        if (_threads[i] < 0 || _threads[i] >= master()->nthreads())
+            return errh->error("Thread %d does not exist", _threads[i]);
+    return 0;
+}
+
+bool
+ShardedReplayUnqueue::get_spawning_threads(Bitvector& bmp, bool isoutput, int port)
+{
+    if (isoutput && port >= 0 && port < _threads.size())
+        bmp[_threads[port]] = true;
+    return false;
+}
+
+int
+ShardedReplayUnqueue::initialize(ErrorHandler *)
+{
+    _input.resize(ninputs());
+    for (int i = 0 ; i < ninputs(); i++) {
+        _input[i].signal = Notifier::upstream_empty_signal(this, i, (Task*)NULL);
+    }
+    _shards.resize(noutputs());
+    for (int i = 0; i < _shards.size(); i++) {
+        Shard &s = _shards[i];
+        s.task = new Task(this);
+        s.task->initialize(this, false);
+        s.task->move_thread(_threads[i]);
+        s.thread = _threads[i];
+    }
+    //Only the first shard is scheduled, it loads the trace and then wakes
+    //up the others
+    if (_active)
+        _shards[0].task->reschedule();
+    return 0;
+}
+
+void
+ShardedReplayUnqueue::cleanup_shards()
+{
+    for (int i = 0; i < _shards.size(); i++) {
+        Vector<Packet*> &packets = _shards[i].packets;
+        for (int j = 0; j < packets.size(); j++)
+            if (packets[j])
+                packets[j]->kill();
+        packets.clear();
+        _shards[i].pos = 0;
+        _shards[i].loop = 0;
+    }
+}
+
+void
+ShardedReplayUnqueue::cleanup(CleanupStage)
+{
+    cleanup_shards();
+    for (int i = 0; i < _shards.size(); i++)
+        delete _shards[i].task;
+    ReplayBase::cleanup_packets();
+}
+
+/**
+ * Distribute the loaded packets among the shards according to their flow,
+ * keeping the order of the original trace inside each shard.
+ */
+void
+ShardedReplayUnqueue::shard_packets()
+{
+    int n = _shards.size();
+    for (int i = 0; i < _packets.size(); i++) {
+        Packet* p = _packets[i];
+        int id = 0;
+        if (n > 1 && p->has_network_header()) {
+            //Multiplicative hashing spreads the weak low bits of hashcode()
+            uint32_t h = IPFlowID(p).hashcode() * 2654435761U;
+            id = ((uint64_t)h * n) >> 32;
+        }
+        _shards[id].packets.push_back(p);
+    }
+    if (_packets.size() > 0) {
+        _first_p = _packets[0]->timestamp_anno();
+        _duration = _packets.back()->timestamp_anno() - _first_p;
+        //Like ReplayUnqueue, leave a gap between the last packet of a loop
+        //and the first one of the next, here the average inter-packet gap
+        _period = _duration;
+        if (_packets.size() > 1)
+            _period += _duration / (_packets.size() - 1);
+    }
+    _packets.clear();
+    _queue_current = 0;
+
+    _finished = 0;
+    for (int i = 0; i < n; i++) {
+        Shard &s = _shards[i];
+        s.pos = 0;
+        s.loop = 0;
+        s.count = 0;
+        s.stop = _stop;
+        if (s.packets.size() == 0 || s.stop == 0) {
+            s.stop = 0;
+            _finished++;
+        }
+        if (_verbose)
+            click_chatter("%p{element}: shard %d (thread %d) has %d packets",
+                          this, i, s.thread, s.packets.size());
+    }
+    _start_real = Timestamp::now_steady();
+}
+
+bool
+ShardedReplayUnqueue::run_task(Task* t)
+{
+    for (int i = 0; i < _shards.size(); i++)
+        if (_shards[i].task == t)
+            return run_shard(i, t);
+    return false;
+}
+
+bool
+ShardedReplayUnqueue::run_shard(int id, Task* t)
+{
+    if (!_active)
+        return false;
+
+    if (unlikely(!_loaded)) {
+        if (id != 0 || !load_packets())
+            return false;
+        shard_packets();
+        if (_finished == (uint32_t)_shards.size()) {
+            router()->please_stop_driver();
+            return false;
+        }
+        click_write_fence();
+        for (int i = 1; i < _shards.size(); i++)
+            _shards[i].task->reschedule();
+    }
+
+    Shard &s = _shards[id];
+    if (s.stop == 0)
+        return false;
+
+    Timestamp now;
+    if (_timing > 0)
+        now = Timestamp::now_steady();
+    unsigned int n = 0;
+#if HAVE_BATCH
+    PacketBatch* head = 0;
+    Packet* last = 0;
+#endif
+    while (s.pos < s.packets.size() && n < _burst) {
+        Packet* p = s.packets.unchecked_at(s.pos);
+
+        //If timing is activated, wait for the packet's time or resched
+        if (_timing > 0) {
+            const long min_timing = 1; //Amount of us between packets to ignore and sent right away
+            const long min_sched = 10; //Amount of us that leads to rescheduling
+
+            long due = (p->timestamp_anno() - _first_p + (_period * s.loop)).usecval();
+            long diff;
+            while ((diff = due - (long)(now - _start_real).usecval() * _timing) > min_timing) {
+                if (diff > min_sched || n > 0)
+                    goto flush;
+                now = Timestamp::now_steady();
+                click_relax_fence();
+            }
+        }
+
+        if (_prefetch && s.pos + (int)_prefetch < s.packets.size())
+            click_prefetch0(s.packets.unchecked_at(s.pos + _prefetch));
+
+        Packet* q;
+        if (s.stop != 1 || _freeonterminate) {
+            q = p->clone(_quick_clone);
+        } else {
+            q = p;
+            s.packets.unchecked_at(s.pos) = 0;
+        }
+        s.pos++;
+
+#if HAVE_BATCH
+        if (head == 0) {
+            head = PacketBatch::start_head(q);
+        } else {
+            last->set_next(q);
+        }
+        last = q;
+#else
+        output(id).push(q);
+#endif
+        n++;
+    }
+
+flush:
+#if HAVE_BATCH
+    if (head)
+        output_push_batch(id, head->make_tail(last, n));
+#endif
+    s.count += n;
+
+    if (s.pos == s.packets.size()) {
+        s.pos = 0;
+        s.loop++;
+        if (s.stop > 0)
+            s.stop--;
+        if (s.stop == 0) {
+            if (_finished.fetch_and_add(1) + 1 == (uint32_t)_shards.size())
+                router()->please_stop_driver();
+            return n > 0;
+        }
+    }
+
+    t->fast_reschedule();
+    return n > 0;
+}
+
+void
+ShardedReplayUnqueue::set_all_active(bool active)
+{
+    _active = active;
+    for (int i = 0; i < _shards.size(); i++) {
+        if (active && (_loaded || i == 0))
+            _shards[i].task->reschedule();
+        else if (!active)
+            _shards[i].task->unschedule();
+    }
+}
+
+String
+ShardedReplayUnqueue::read_handler(Element *e, void *thunk)
+{
+    ShardedReplayUnqueue *r = static_cast<ShardedReplayUnqueue *>(e);
+    switch (reinterpret_cast<intptr_t>(thunk)) {
+      case 0: {
+        int count = 0;
+        for (int i = 0; i < r->_shards.size(); i++)
+            count += r->_shards[i].packets.size();
+        return String(count);
+      }
+      case 1: {
+        StringAccum sa;
+        double elapsed = (Timestamp::now_steady() - r->_start_real).doubleval();
+        double duration = r->_period.doubleval();
+        for (int i = 0; i < r->_shards.size(); i++) {
+            const Shard &s = r->_shards[i];
+            sa << s.thread << ' ' << s.count << ' ';
+            if (r->_loaded && elapsed > 0)
+                sa << (uint64_t)(s.count / elapsed);
+            else
+                sa << 0;
+            sa << ' ';
+            if (r->_timing > 0 && duration > 0)
+                sa << (uint64_t)(s.packets.size() * r->_timing / duration);
+            else
+                sa << '-';
+            sa << '\n';
+        }
+        return sa.take_string();
+      }
+      default:
+        return "<error>";
+    }
+}
+
+int
+ShardedReplayUnqueue::write_handler(const String &s_in, Element *e, void *thunk, ErrorHandler *errh)
+{
+    ShardedReplayUnqueue *r = static_cast<ShardedReplayUnqueue *>(e);
+    String s = cp_uncomment(s_in);
+    switch (reinterpret_cast<intptr_t>(thunk)) {
+      case 0: {
+        bool active;
+        if (!BoolArg().parse(s, active))
+            return errh->error("type mismatch");
+        r->set_all_active(active);
+        return 0;
+      }
+      case 1:
+        r->cleanup_shards();
+        r->_loaded = false;
+        if (r->_active)
+            r->_shards[0].task->reschedule();
+        return 0;
+      default:
+        return errh->error("internal error");
+    }
+}
+
+void
+ShardedReplayUnqueue::add_handlers()
+{
+    ReplayBase::add_handlers();
+    //The packets live in the shards, override the handlers touching them
+    add_write_handler("active", write_handler, 0, Handler::BUTTON);
+    add_write_handler("reset", write_handler, 1, Handler::BUTTON);
+    add_data_handlers("timing", Handler::OP_READ | Handler::OP_WRITE, &_timing);
+    add_read_handler("count", read_handler, 0);
+    add_read_handler("rates", read_handler, 1);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(ShardedReplayUnqueue)
+ELEMENT_MT_SAFE(ShardedReplayUnqueue)
@@ -0,0 +1,152 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_SHARDEDREPLAY_HH
+#define CLICK_SHARDEDREPLAY_HH
+#include <click/batchelement.hh>
+#include <click/task.hh>
+#include <click/vector.hh>
+#include <click/atomic.hh>
+#include "replay.hh"
+CLICK_DECLS
+
+/*
+=c
+
+ShardedReplayUnqueue([I<keywords> STOP, TIMING, THREAD, BURST, ...])
+
+=s traces
+
+replay a trace split by flow across multiple threads
+
+=d
+
+Loads all packets from its inputs like MultiReplayUnqueue, then splits the
+trace by IP flow (5-tuple hash) in one shard per output. Each output is pushed
+by its own task, running on its own thread, so a single trace can be replayed
+by multiple cores, each one emitting to its own queue. All packets of a flow
+are emitted by the same thread, in order.
+
+Packets without an IP header annotation are all replayed by the first shard.
+
+Keyword arguments are:
+
+=over 8
+
+=item STOP
+
+Integer. Number of times the trace is replayed by each thread. When all
+threads are done, the driver is stopped. Default is -1, replay forever.
+
+=item TIMING
+
+Integer. If non-zero, packets are emitted according to their timestamp, the
+trace being replayed TIMING times faster than its original speed. All shards
+use the same time base, so the inter-packet timing of the original trace is
+preserved across threads. A new loop starts one average inter-packet gap
+after the last packet of the previous loop. Default is 0, replay as fast as
+possible.
+
+=item THREAD
+
+Integer. Thread handling an output, given once per output in the order of the
+outputs. Default is output I<i> is handled by thread I<i> modulo the number of
+threads.
+
+=item BURST
+
+Integer. Maximal number of packets emitted per task run by each thread.
+Default is 64.
+
+=item QUICK_CLONE, FREEONTERMINATE, LIMIT, ACTIVE, PREFETCH
+
+Same as MultiReplayUnqueue.
+
+=back
+
+=h rates read-only
+
+Returns one line per output with the thread id, the number of packets sent,
+the achieved rate and the target rate in packets per second. The target rate
+is only known when TIMING is set.
+
+=h count read-only
+
+Number of packets loaded.
+
+=h loaded read-only
+
+Returns true once the trace is loaded.
+
+=h active read/write
+
+Whether the trace is being replayed.
+
+=h stop read/write
+
+Number of remaining loops, taken into account when the trace is loaded.
+
+=h prefetch read/write
+
+Distance of the packets prefetched ahead.
+
+=h reset write-only
+
+Frees the loaded trace; it is loaded again from the inputs if active.
+
+=a
+
+MultiReplayUnqueue, ReplayUnqueue
+ */
+
+class ShardedReplayUnqueue : public ReplayBase { public:
+    ShardedReplayUnqueue() CLICK_COLD;
+    ~ShardedReplayUnqueue() CLICK_COLD;
+
+    const char *class_name() const	{ return "ShardedReplayUnqueue"; }
+    const char *port_count() const	{ return "1-/1-"; }
+    const char *processing() const	{ return PULL_TO_PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+
+    bool get_spawning_threads(Bitvector& bmp, bool isoutput, int port) override;
+
+    bool run_task(Task*);
+
+    void add_handlers() override CLICK_COLD;
+
+  private:
+
+    struct Shard {
+        Shard() : task(0), thread(0), pos(0), loop(0), stop(-1), count(0) {
+        }
+        Task* task;
+        int thread;
+        Vector<Packet*> packets;
+        int pos;
+        int loop;
+        int stop;
+        uint64_t count;
+    };
+
+    Vector<Shard> _shards;
+    Vector<int> _threads;
+    unsigned _timing;
+    atomic_uint32_t _finished;
+
+    Timestamp _first_p;
+    Timestamp _duration;
+    Timestamp _period;
+    Timestamp _start_real;
+
+    void shard_packets();
+    bool run_shard(int id, Task* t);
+    void set_all_active(bool active);
+    void cleanup_shards();
+
+    static int write_handler(const String &, Element *e, void *thunk, ErrorHandler *errh);
+    static String read_handler(Element *e, void *thunk);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -223,6 +223,7 @@ inline int TimestampDiff::smaction(Packet *p)
     }
 
     Timestamp diff = now - old;
+    _histogram.add(diff.usecval());
     if ((diff.msecval() > _max_delay_ms)) {
         if (_verbose) {
             click_chatter(
@@ -256,6 +257,19 @@ TimestampDiff::push_batch(int, PacketBatch *batch)
 }
 #endif
 
+void *TimestampDiff::cast(const char *name)
+{
+    if (strcmp(name, "MetricSource") == 0)
+        return static_cast<MetricSource *>(this);
+    return BatchElement::cast(name);
+}
+
+void TimestampDiff::add_metrics(MetricRegistry &registry)
+{
+    registry.add_histogram(this, "delay_us", _histogram,
+                           "Delay of packets since RecordTimestamp, in microseconds.");
+}
+
 RecordTimestamp* TimestampDiff::get_recordtimestamp_instance()
 {
     return _rt;
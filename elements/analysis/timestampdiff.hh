@@ -3,6 +3,7 @@
 
 #include <click/vector.hh>
 #include <click/batchelement.hh>
+#include <click/metrics.hh>
 
 CLICK_DECLS
 
@@ -42,12 +43,16 @@ Size of the reservoir. Defaults to 0.
 Integer. Maximum delay in milliseconds. If a packet exhibits such a delay (or greater),
 the user is notified. Defaults to 1000 ms (1 sec).
 
+The delays of all packets, including those above MAXDELAY, are also kept in
+a per-thread histogram published as the "delay_us" metric (see
+MetricsExporter).
+
 =a
 
-RecordTimestamp, NumberPacket
+RecordTimestamp, NumberPacket, MetricsExporter
 
 */
-class TimestampDiff : public BatchElement {
+class TimestampDiff : public BatchElement, public MetricSource {
 public:
     TimestampDiff() CLICK_COLD;
     ~TimestampDiff() CLICK_COLD;
@@ -60,6 +65,8 @@ public:
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
     int initialize(ErrorHandler *) CLICK_COLD;
     void add_handlers() CLICK_COLD;
+    void *cast(const char *name);
+    void add_metrics(MetricRegistry &registry) override;
     static int handler(int operation, String &data, Element *element,
             const Handler *handler, ErrorHandler *errh) CLICK_COLD;
 
@@ -70,6 +77,7 @@ public:
 
 private:
     Vector<unsigned> _delays;
+    MetricHistogram _histogram;
     int _offset;
     uint32_t _limit;
     bool _net_order;
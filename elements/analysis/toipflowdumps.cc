@@ -856,6 +856,20 @@ ToIPFlowDumps::aggregate_notify(uint32_t agg, AggregateEvent event, const Packet
     }
 }
 
+void
+ToIPFlowDumps::aggregate_notify_batch(const Event *e, int n)
+{
+    int old_size = _gc_aggs.size();
+    uint32_t now = click_jiffies();
+    for (int i = 0; i < n; i++)
+	if (e[i].event == DELETE_AGG && find_aggregate(e[i].agg, 0)) {
+	    _gc_aggs.push_back(e[i].agg);
+	    _gc_aggs.push_back(now);
+	}
+    if (_gc_aggs.size() != old_size && !_gc_timer.scheduled())
+	_gc_timer.schedule_after_msec(250);
+}
+
 void
 ToIPFlowDumps::gc_hook(Timer *t, void *thunk)
 {
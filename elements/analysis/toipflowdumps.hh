@@ -162,6 +162,7 @@ class ToIPFlowDumps : public Element, public AggregateListener { public:
     bool run_task(Task *);
 
     void aggregate_notify(uint32_t, AggregateEvent, const Packet *);
+    void aggregate_notify_batch(const Event *, int n);
 
     bool absolute_time() const		{ return _absolute_time; }
     bool absolute_seq() const		{ return _absolute_seq; }
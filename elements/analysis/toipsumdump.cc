@@ -31,8 +31,13 @@
 CLICK_DECLS
 
 ToIPSummaryDump::ToIPSummaryDump()
-    : _f(0), _task(this)
+    : _f(0), _task(this), _block_size(1024 * 1024), _block_rows(0)
+#if HAVE_MULTITHREAD
+    , _nblocks(16), _io_stop(false), _io_started(false), _fd(-1)
+#endif
 {
+    _block.data = 0;
+    _block.used = _block.count = 0;
 }
 
 ToIPSummaryDump::~ToIPSummaryDump()
@@ -50,6 +55,8 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool binary = false;
     bool header = true;
     bool extra_length = true;
+    bool columnar = false;
+    bool async = false;
 
     if (Args(conf, this, errh)
 	.read_mp("FILENAME", FilenameArg(), _filename)
@@ -64,6 +71,12 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("CAREFUL_TRUNC", careful_trunc)
 	.read("EXTRA_LENGTH", extra_length)
 	.read("BINARY", binary)
+	.read("COLUMNAR", columnar)
+	.read("ASYNC", async)
+	.read("BLOCK_SIZE", _block_size)
+#if HAVE_MULTITHREAD
+	.read("BLOCKS", _nblocks)
+#endif
 	.complete() < 0)
 	return -1;
 
@@ -94,6 +107,8 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	if ((s < 0 || !f->outb) && binary)
 	    errh->error("cannot use field %s with BINARY", word.c_str());
 	_binary_size += s;
+	if (columnar && (IPSummaryDump::fixed_binary_size(f->type) < 0 || !f->outb))
+	    errh->error("cannot use field %s with COLUMNAR", word.c_str());
 
 	// remove _multipacket if packet count specified
 	if (strcmp(f->name, "count") == 0)
@@ -102,11 +117,36 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     if (_fields.size() == 0)
 	errh->error("no contents specified");
 
+    if (columnar && !errh->nerrors()) {
+	_column_offset.clear();
+	_column_offset.push_back(0);
+	for (int i = 0; i < _fields.size(); i++)
+	    _column_offset.push_back(_column_offset.back() + IPSummaryDump::fixed_binary_size(_fields[i]->type));
+	if (_column_offset.back() == 0)
+	    errh->error("COLUMNAR requires fields with binary data");
+	else if (_block_size <= IPSummaryDump::COLUMNAR_HEADER
+		 || !(_block_rows = (_block_size - IPSummaryDump::COLUMNAR_HEADER) / _column_offset.back()))
+	    errh->error("BLOCK_SIZE is too small");
+    }
+
+    if (async) {
+#if HAVE_MULTITHREAD
+	if (_nblocks < 2 || _nblocks >= max_blocks)
+	    errh->error("BLOCKS must be between 2 and %d", max_blocks - 1);
+	if (_block_size < 1024)
+	    errh->error("BLOCK_SIZE is too small");
+#else
+	errh->error("ASYNC requires multithreading support");
+#endif
+    }
+
     _verbose = verbose;
     _bad_packets = bad_packets;
     _careful_trunc = careful_trunc;
     _multipacket = multipacket;
-    _binary = binary;
+    _binary = binary || columnar;
+    _columnar = columnar;
+    _async = async;
     _header = header;
     _extra_length = extra_length;
 
@@ -162,24 +202,236 @@ ToIPSummaryDump::initialize(ErrorHandler *errh)
     sa << '\n';
 
     // binary marker
-    if (_binary)
+    if (_columnar)
+	sa << "!columnar\n";
+    else if (_binary)
 	sa << "!binary\n";
 
     // print output
     if (_header)
 	ignore_result(fwrite(sa.data(), 1, sa.length(), _f));
 
+    if (_columnar && !_async) {
+	if (!(_block.data = (unsigned char *) malloc(_block_size)))
+	    return errh->error("out of memory");
+    }
+#if HAVE_MULTITHREAD
+    if (_async && initialize_async(errh) < 0)
+	return -1;
+#endif
+
+    _mt = !_async && get_passing_threads().weight() > 1;
     return 0;
 }
 
 void
 ToIPSummaryDump::cleanup(CleanupStage)
 {
+#if HAVE_MULTITHREAD
+    if (_async)
+	cleanup_async();
+#endif
+    if (_f && _block.data)
+	flush_block();
+    free(_block.data);
+    _block.data = 0;
     if (_f && _f != stdout)
 	fclose(_f);
     _f = 0;
 }
 
+#if HAVE_MULTITHREAD
+int
+ToIPSummaryDump::initialize_async(ErrorHandler *errh)
+{
+    fflush(_f);
+    _fd = fileno(_f);
+
+    _blocks.resize(_nblocks);
+    for (unsigned i = 0; i < _nblocks; i++) {
+	Block &b = _blocks[i];
+	if (posix_memalign((void **) &b.data, 4096, _block_size) != 0) {
+	    b.data = 0;
+	    return errh->error("could not allocate ASYNC blocks");
+	}
+	b.used = 0;
+	b.count = 0;
+	_free_blocks.insert(&b);
+    }
+
+    _io_stop = false;
+    if (pthread_create(&_io_thread, 0, io_thread, this) != 0)
+	return errh->error("could not start I/O thread: %s", strerror(errno));
+    _io_started = true;
+    return 0;
+}
+
+void
+ToIPSummaryDump::cleanup_async()
+{
+    // the router is stopped, so no thread fills its block anymore
+    for (unsigned i = 0; i < _async_state.weight(); i++) {
+	AsyncState &s = _async_state.get_value(i);
+	if (s.block) {
+	    if (s.block->used || s.block->count)
+		_full_blocks.insert(s.block);
+	    else
+		_free_blocks.insert(s.block);
+	    s.block = 0;
+	}
+    }
+    if (_io_started) {
+	click_fence();
+	_io_stop = true;
+	pthread_join(_io_thread, 0);
+	_io_started = false;
+    }
+    for (int i = 0; i < _blocks.size(); i++)
+	free(_blocks[i].data);
+    _blocks.clear();
+}
+
+void *
+ToIPSummaryDump::io_thread(void *arg)
+{
+    ToIPSummaryDump *td = static_cast<ToIPSummaryDump *>(arg);
+    while (1) {
+	Block *b = td->_full_blocks.extract();
+	if (!b) {
+	    if (!td->_io_stop) {
+		usleep(200);
+		continue;
+	    }
+	    // the last blocks may have been queued just before the stop
+	    click_fence();
+	    if (!(b = td->_full_blocks.extract()))
+		break;
+	}
+	td->io_write_block(b);
+	b->used = 0;
+	b->count = 0;
+	td->_free_blocks.insert(b);
+    }
+    return 0;
+}
+
+void
+ToIPSummaryDump::io_write_block(Block *b)
+{
+    // columnar blocks are laid out here, off the packet path
+    if (_columnar && b->count)
+	columnar_finish(*b);
+    if (!_active)
+	return;
+
+    const unsigned char *data = b->data;
+    uint32_t len = b->used;
+    while (len > 0) {
+	ssize_t w = write(_fd, data, len);
+	if (w < 0) {
+	    if (errno == EINTR || errno == EAGAIN)
+		continue;
+	    _active = false;
+	    click_chatter("ToIPSummaryDump(%s): %s", _filename.c_str(), strerror(errno));
+	    return;
+	}
+	data += w;
+	len -= w;
+    }
+    _output_count += b->count;
+}
+
+/** @brief Return the block of thread state @a s, with room for a record of
+ * @a len bytes, or null if no block is free. */
+ToIPSummaryDump::Block *
+ToIPSummaryDump::async_block(AsyncState &s, uint32_t len)
+{
+    if (len > _block_size) {
+	s.drops++;
+	return 0;
+    }
+    // submit the current block when full or when it waited for more than a
+    // second, so records of slow threads still reach the file
+    if (s.block && (block_full(*s.block, len)
+		    || click_jiffies() - s.block->start > (click_jiffies_t) CLICK_HZ)) {
+	_full_blocks.insert(s.block);
+	s.block = 0;
+    }
+    if (!s.block) {
+	if (!(s.block = _free_blocks.extract())) {
+	    s.drops++;
+	    return 0;
+	}
+	s.block->start = click_jiffies();
+    }
+    return s.block;
+}
+
+void
+ToIPSummaryDump::async_write_packet(Packet *p)
+{
+    AsyncState &s = *_async_state;
+    s.sa.clear();
+    s.bad_sa.clear();
+    if (!summary(p, s.sa, (_bad_packets ? &s.bad_sa : 0)))
+	return;
+    if (_bad_packets && s.bad_sa)
+	write_meta(s.bad_sa.data(), s.bad_sa.length(), false);
+
+    if (Block *b = async_block(s, s.sa.length())) {
+	if (_columnar)
+	    columnar_put(*b, s.sa.data());
+	else {
+	    memcpy(b->data + b->used, s.sa.data(), s.sa.length());
+	    b->used += s.sa.length();
+	    b->count++;
+	}
+    }
+}
+#endif
+
+/** @brief Store the binary @a row at the end of columnar block @a b, which
+ * must not be full. */
+void
+ToIPSummaryDump::columnar_put(Block &b, const char *row) const
+{
+    unsigned char *cols = b.data + IPSummaryDump::COLUMNAR_HEADER;
+    for (int i = 0; i < _fields.size(); i++) {
+	uint32_t size = _column_offset[i + 1] - _column_offset[i];
+	memcpy(cols + _block_rows * _column_offset[i] + b.count * size,
+	       row + _column_offset[i], size);
+    }
+    b.count++;
+}
+
+/** @brief Lay out columnar block @a b for writing: move the columns of a
+ * partial block next to each other, and fill in the block header. */
+void
+ToIPSummaryDump::columnar_finish(Block &b) const
+{
+    unsigned char *cols = b.data + IPSummaryDump::COLUMNAR_HEADER;
+    if (b.count < _block_rows)
+	for (int i = 1; i < _fields.size(); i++)
+	    memmove(cols + b.count * _column_offset[i],
+		    cols + _block_rows * _column_offset[i],
+		    b.count * (_column_offset[i + 1] - _column_offset[i]));
+    b.used = IPSummaryDump::COLUMNAR_HEADER + b.count * _column_offset.back();
+    uint32_t *h = reinterpret_cast<uint32_t *>(b.data);
+    h[0] = htonl(b.used);
+    h[1] = htonl(b.count);
+    h[2] = htonl(IPSummaryDump::COLUMNAR_CODEC_NONE);
+}
+
+void
+ToIPSummaryDump::flush_block()
+{
+    if (_block.count) {
+	columnar_finish(_block);
+	ignore_result(fwrite(_block.data, 1, _block.used, _f));
+	_block.used = _block.count = 0;
+    }
+}
+
 bool
 ToIPSummaryDump::summary(Packet* p, StringAccum& sa, StringAccum* bad_sa) const
 {
@@ -188,7 +440,14 @@ ToIPSummaryDump::summary(Packet* p, StringAccum& sa, StringAccum* bad_sa) const
     for (int i = 0; i < _prepare_fields.size(); i++)
 	_prepare_fields[i]->prepare(d, _prepare_fields[i]);
 
-    if (_binary) {
+    if (_columnar) {
+	for (int i = 0; i < _fields.size(); i++) {
+	    d.clear_values();
+	    bool ok = _fields[i]->extract(d, _fields[i]);
+	    _fields[i]->outb(d, ok, _fields[i]);
+	}
+	return sa.length() == (int) _column_offset.back();
+    } else if (_binary) {
 	sa.extend(4);
 	for (int i = 0; i < _fields.size(); i++) {
 	    d.clear_values();
@@ -245,19 +504,39 @@ ToIPSummaryDump::write_packet(Packet* p, int multipacket)
 	}
 
     } else {
+#if HAVE_MULTITHREAD
+	if (_async) {
+	    async_write_packet(p);
+	    return;
+	}
+#endif
+	if (_mt)
+	    _lock.acquire();
 	_sa.clear();
 	_bad_sa.clear();
 
-	summary(p, _sa, (_bad_packets ? &_bad_sa : 0));
-
-	if (_bad_packets && _bad_sa)
-	    write_line(_bad_sa.take_string());
-	ignore_result(fwrite(_sa.data(), 1, _sa.length(), _f));
-
-	_output_count++;
+	if (summary(p, _sa, (_bad_packets ? &_bad_sa : 0))) {
+	    if (_bad_packets && _bad_sa)
+		write_meta(_bad_sa.data(), _bad_sa.length(), false);
+	    write_record(_sa);
+	    _output_count++;
+	}
+	if (_mt)
+	    _lock.release();
     }
 }
 
+void
+ToIPSummaryDump::write_record(const StringAccum &sa)
+{
+    if (_columnar) {
+	if (block_full(_block, sa.length()))
+	    flush_block();
+	columnar_put(_block, sa.data());
+    } else
+	ignore_result(fwrite(sa.data(), 1, sa.length(), _f));
+}
+
 void
 ToIPSummaryDump::push(int, Packet *p)
 {
@@ -283,16 +562,58 @@ ToIPSummaryDump::run_task(Task *)
 	return false;
 }
 
+/** @brief Write the @a len bytes of text at @a s as a metadata record,
+ * prefixed with '#' if @a note is true. */
+void
+ToIPSummaryDump::write_meta(const char *s, uint32_t len, bool note)
+{
+    StringAccum rec;
+    if (_binary)
+	rec.extend(4);
+    if (note)
+	rec << '#';
+    rec.append(s, len);
+    if (s[len - 1] != '\n')
+	rec << '\n';
+    // the record length includes the marker, as FromIPSummaryDump expects
+    if (_binary)
+	*reinterpret_cast<uint32_t *>(rec.data()) = htonl(rec.length() | 0x80000000U);
+
+#if HAVE_MULTITHREAD
+    if (_async) {
+	// in columnar files, metadata goes in a block of its own after the
+	// records of this thread
+	AsyncState &st = *_async_state;
+	if (_columnar && st.block && st.block->count) {
+	    _full_blocks.insert(st.block);
+	    st.block = 0;
+	}
+	if (Block *b = async_block(st, rec.length())) {
+	    memcpy(b->data + b->used, rec.data(), rec.length());
+	    b->used += rec.length();
+	    if (_columnar) {
+		_full_blocks.insert(b);
+		st.block = 0;
+	    }
+	}
+	return;
+    }
+#endif
+    if (_columnar)
+	flush_block();
+    ignore_result(fwrite(rec.data(), 1, rec.length(), _f));
+}
+
 void
 ToIPSummaryDump::write_line(const String& s)
 {
     if (s.length()) {
 	assert(s.back() == '\n');
-	if (_binary) {
-	    uint32_t marker = htonl(s.length() | 0x80000000U);
-	    ignore_result(fwrite(&marker, 4, 1, _f));
-	}
-	ignore_result(fwrite(s.data(), 1, s.length(), _f));
+	if (_mt)
+	    _lock.acquire();
+	write_meta(s.data(), s.length(), false);
+	if (_mt)
+	    _lock.release();
     }
 }
 
@@ -300,15 +621,11 @@ void
 ToIPSummaryDump::add_note(const String &s)
 {
     if (s.length()) {
-	int extra = 1 + (s.back() == '\n' ? 0 : 1);
-	if (_binary) {
-	    uint32_t marker = htonl((s.length() + extra) | 0x80000000U);
-	    ignore_result(fwrite(&marker, 4, 1, _f));
-	}
-	fputc('#', _f);
-	ignore_result(fwrite(s.data(), 1, s.length(), _f));
-	if (extra > 1)
-	    fputc('\n', _f);
+	if (_mt)
+	    _lock.acquire();
+	write_meta(s.data(), s.length(), true);
+	if (_mt)
+	    _lock.release();
     }
 }
 
@@ -316,19 +633,42 @@ int
 ToIPSummaryDump::flush_handler(const String &, Element *e, void *, ErrorHandler *)
 {
     ToIPSummaryDump *tod = (ToIPSummaryDump *) e;
-    if (tod->_f)
+    if (tod->_f && !tod->_async) {
+	if (tod->_mt)
+	    tod->_lock.acquire();
+	if (tod->_block.data)
+	    tod->flush_block();
 	fflush(tod->_f);
+	if (tod->_mt)
+	    tod->_lock.release();
+    }
     return 0;
 }
 
+#if HAVE_MULTITHREAD
+String
+ToIPSummaryDump::read_handler(Element *e, void *)
+{
+    ToIPSummaryDump *tod = static_cast<ToIPSummaryDump *>(e);
+    uint64_t drops = 0;
+    for (unsigned i = 0; i < tod->_async_state.weight(); i++)
+	drops += tod->_async_state.get_value(i).drops;
+    return String(drops);
+}
+#endif
+
 void
 ToIPSummaryDump::add_handlers()
 {
     if (input_is_pull(0))
 	add_task_handlers(&_task);
     add_write_handler("flush", flush_handler);
+#if HAVE_MULTITHREAD
+    add_read_handler("drops", read_handler);
+#endif
 }
 
 ELEMENT_REQUIRES(userlevel IPSummaryDump IPSummaryDump_Anno IPSummaryDump_IP IPSummaryDump_TCP IPSummaryDump_UDP IPSummaryDump_ICMP IPSummaryDump_Payload IPSummaryDump_Link)
 EXPORT_ELEMENT(ToIPSummaryDump)
+ELEMENT_MT_SAFE(ToIPSummaryDump)
 CLICK_ENDDECLS
@@ -5,7 +5,13 @@
 #include <click/task.hh>
 #include <click/straccum.hh>
 #include <click/notifier.hh>
+#include <click/sync.hh>
+#include <click/ring.hh>
+#include <click/multithread.hh>
 #include "ipsumdumpinfo.hh"
+#if HAVE_MULTITHREAD
+# include <pthread.h>
+#endif
 CLICK_DECLS
 
 /*
@@ -23,7 +29,8 @@ Writes summary information about incoming packets to FILENAME in a simple
 ASCII format---each line corresponds to a packet.  The FIELDS keyword
 argument determines what information is written.  Writes to standard output if
 FILENAME is a single dash `C<->'.  The BINARY keyword argument writes a packed
-binary format to save space.
+binary format to save space, and the COLUMNAR keyword argument a blocked,
+column-oriented binary format that is faster to write and to read back.
 
 ToIPSummaryDump uses packets' extra-length and extra-packet-count annotations.
 
@@ -137,6 +144,32 @@ of the dump. Ignored if HEADER is false.
 Boolean. If true, then output packet records in a binary format (explained
 below). Defaults to false.
 
+=item COLUMNAR
+
+Boolean. If true, then output packet records in a columnar binary format
+(explained below): records are gathered in blocks of up to BLOCK_SIZE bytes,
+where each field is stored as an array of fixed-size values. Every field
+must have a fixed binary size. Defaults to false.
+
+=item ASYNC
+
+Boolean. If true, the threads passing packets only format the records into
+per-thread blocks of memory, which are written to the file by a dedicated I/O
+thread. When no free block is available because the I/O thread cannot keep
+up, records are not written and counted in the "drops" handler instead of
+stalling the data path. Records from different threads are not ordered by
+time in the file. Only available with multithreading support. Default is
+false.
+
+=item BLOCK_SIZE
+
+Integer. Size in bytes of the blocks used in COLUMNAR and ASYNC modes.
+Default is 1MB.
+
+=item BLOCKS
+
+Integer. Number of blocks used in ASYNC mode. Default is 16.
+
 =item MULTIPACKET
 
 Boolean. If true, and the FIELDS option doesn't contain 'C<count>', then
@@ -338,9 +371,35 @@ The data stored in a metadata record is just an ASCII string, ending with
 newline, same as in a regular ASCII IPSummaryDump file. 'C<!bad>' records, for
 example, are stored this way.
 
+=head1 COLUMNAR FORMAT
+
+Columnar IPSummaryDump files begin with ASCII lines, like binary files, but
+the line 'C<!columnar>' replaces 'C<!binary>'. The rest of the file consists
+of blocks:
+
+   +---------------+---------------+---------------+-----------...
+   |X| block length|  record count |     flags     |  columns
+   +---------------+---------------+---------------+-----------...
+    <---4 bytes---> <---4 bytes---> <---4 bytes--->
+
+The block length includes the 12-byte header. The low-order byte of the flags
+is the compression codec of the columns; it is always 0, no compression. The
+columns follow in the order of the 'C<!data>' line: the column of a field of
+Length bytes (see the table above) holds the values of that field for all the
+records of the block, and is record count times Length bytes long. Fields with
+variable length are not allowed. As in binary files, a block with the
+high-order bit 'C<X>' set is a metadata record containing ASCII text.
+
 =h flush write-only
 
-Flush all internal buffers to disk.
+Flush all internal buffers to disk. In ASYNC mode, the records still in the
+per-thread blocks are only written when the blocks fill up, after a second,
+or when the router stops.
+
+=h drops read-only
+
+Returns the number of records not written in ASYNC mode because of a lack of
+free blocks.
 
 =a
 
@@ -366,6 +425,7 @@ class ToIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
 
     String filename() const		{ return _filename; }
     uint32_t output_count() const	{ return _output_count; }
+    // Notes and lines are ordered with the records of the calling thread
     void add_note(const String &);
     void write_line(const String &);
 
@@ -383,20 +443,76 @@ class ToIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     bool _binary : 1;
     bool _header : 1;
     bool _extra_length : 1;
+    bool _columnar : 1;
+    bool _async : 1;
+    bool _mt : 1;
     int32_t _binary_size;
     uint32_t _output_count;
     Task _task;
     NotifierSignal _signal;
+    Spinlock _lock;
 
     StringAccum _sa;
     StringAccum _bad_sa;
 
     String _banner;
 
+    // A block holds either columnar records, when count is nonzero in
+    // COLUMNAR mode, or used bytes of formatted records and metadata
+    struct Block {
+	unsigned char *data;
+	uint32_t used;
+	uint32_t count;
+	click_jiffies_t start;
+    };
+
+    uint32_t _block_size;
+    uint32_t _block_rows;
+    Vector<uint32_t> _column_offset;	// offsets of the fields in a row
+    Block _block;
+
     bool summary(Packet* p, StringAccum& sa, StringAccum* bad_sa) const;
     void write_packet(Packet* p, int multipacket);
+    void write_record(const StringAccum &sa);
+    void write_meta(const char *s, uint32_t len, bool note);
+    void columnar_put(Block &b, const char *row) const;
+    void columnar_finish(Block &b) const;
+    void flush_block();
+    bool block_full(const Block &b, uint32_t len) const {
+	return _columnar ? b.count == _block_rows : b.used + len > _block_size;
+    }
     static int flush_handler(const String &, Element *, void *, ErrorHandler *);
 
+#if HAVE_MULTITHREAD
+    struct AsyncState {
+	AsyncState() : block(0), drops(0) {
+	}
+	Block *block;
+	uint64_t drops;
+	StringAccum sa;
+	StringAccum bad_sa;
+    };
+    enum { max_blocks = 256 };
+
+    unsigned _nblocks;
+    Vector<Block> _blocks;
+    MPMCRing<Block*, max_blocks> _free_blocks;
+    MPMCRing<Block*, max_blocks> _full_blocks;
+    per_thread<AsyncState> _async_state;
+    pthread_t _io_thread;
+    volatile bool _io_stop;
+    bool _io_started;
+    int _fd;
+
+    void async_write_packet(Packet *);
+    Block *async_block(AsyncState &s, uint32_t len);
+    static void *io_thread(void *);
+    void io_write_block(Block *);
+    int initialize_async(ErrorHandler *);
+    void cleanup_async();
+    static String read_handler(Element *, void *);
+#endif
+
 };
 
 CLICK_ENDDECLS
@@ -132,18 +132,26 @@ CoDel::pull(int)
 Packet *
 CoDel::dequeue_and_track_sojourn_time(Timestamp now, bool &retVal)
 {
-    _ok_to_drop = 0;
     Packet *p = input(0).pull();
+    track_sojourn_time(p, now, retVal);
+    return p;
+}
+
+// helper: tracks if the sojourn time of a dequeued packet is above the target //
+void
+CoDel::track_sojourn_time(Packet *p, Timestamp now, bool &retVal)
+{
+    _ok_to_drop = 0;
 
     if (p == NULL) {
         // if no packet then reset _first_above_time
         _first_above_time.assign(0, 0);
         retVal = false;
-        return NULL;
+        return;
     } else if (!FIRST_TIMESTAMP_ANNO(p).sec()) {
         // if FIRST_TIMESTAMP_ANNO not set, then do nothing; imp else CoDel would misbehave!
         retVal = false;
-        return p;
+        return;
     } else {
         Timestamp sojourn_time = now - FIRST_TIMESTAMP_ANNO(p);
 
@@ -166,7 +174,6 @@ CoDel::dequeue_and_track_sojourn_time(Timestamp now, bool &retVal)
         }
     }
     retVal = true;
-    return p;
 }
 
 // heavy-lifter - calls dequeue_and_track_sojourn_time and drops packets, if required //
@@ -233,6 +240,90 @@ CoDel::delegate_codel()
     return p;
 }
 
+#if HAVE_BATCH
+// batch version of delegate_codel: walks the packets of pulled batches,
+// taking for each the decision delegate_codel would take at the same point //
+PacketBatch *
+CoDel::pull_batch(int, unsigned max)
+{
+    // what delegate_codel did to the previous packet of the batch
+    enum { FRESH, IN_DROP_LOOP, ENTERED } phase = FRESH;
+    Timestamp now = Timestamp::now();
+    Packet *first = 0, *last = 0;
+    unsigned count = 0;
+
+    while (count < max) {
+        unsigned want = max - count;
+        PacketBatch *batch = input(0).pull_batch(want);
+        unsigned got = batch ? batch->count() : 0;
+        Packet *next;
+        for (Packet *p = batch; p; p = next) {
+            next = p->next();
+            bool ret_val;
+            track_sojourn_time(p, now, ret_val);
+            bool drop = false;
+
+            if (phase == FRESH) {
+                if (!ret_val)
+                    _dropping = false;
+                else if (_dropping) {
+                    if (!_ok_to_drop)
+                        _dropping = false;
+                    else if (now >= _drop_next) {
+                        drop = true;
+                        ++_state_drops;
+                        phase = IN_DROP_LOOP;
+                    }
+                } else if (_ok_to_drop && ((now - _drop_next < _codel_interval_ts) || (now - _first_above_time >= _codel_interval_ts))) {
+                    drop = true;
+                    _dropping = true;
+                    if (now - _drop_next < _codel_interval_ts) {
+                        _state_drops = (_state_drops > 2) ? (_state_drops - 2) : 1;
+                    } else {
+                        _state_drops = 1;
+                    }
+                    _drop_next = control_law(now);
+                    phase = ENTERED;
+                }
+            } else if (phase == IN_DROP_LOOP) {
+                if (!_ok_to_drop)
+                    _dropping = false;
+                else {
+                    _drop_next = control_law(_drop_next);
+                    if (now >= _drop_next) {
+                        drop = true;
+                        ++_state_drops;
+                    }
+                }
+            }
+
+            if (drop) {
+                handle_drop(p);
+                continue;
+            }
+            phase = FRESH;
+            if (last)
+                last->set_next(p);
+            else
+                first = p;
+            last = p;
+            count++;
+        }
+        if (got < want) {
+            // the queue is empty
+            bool ret_val;
+            track_sojourn_time(0, now, ret_val);
+            _dropping = false;
+            break;
+        }
+    }
+
+    if (!first)
+        return 0;
+    return PacketBatch::make_from_simple_list(first, last, count);
+}
+#endif
+
 // determines the next drop time of the packet - scaling done to allow usage of int_sqrt to minimize floating point arithmetic, etc. //
 Timestamp
 CoDel::control_law(Timestamp t)
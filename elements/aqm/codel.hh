@@ -1,6 +1,6 @@
 #ifndef CLICK_CODEL_HH
 #define CLICK_CODEL_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/ewma.hh>
 #include <click/timestamp.hh>
 CLICK_DECLS
@@ -30,7 +30,9 @@ this annotation with the sojourn time experienced by the corresponding
 packet for (possible) statistical use thereafter.
 
 By default, the Queues are found with flow-based router context and only the
-upstream queues are searched. CoDel is a pull element.
+upstream queues are searched. CoDel is a pull element. When pulled in
+batches, it pulls batches from its input and applies the same dropping
+decisions to each packet in turn.
 
 Arguments are:
 
@@ -85,7 +87,7 @@ ACM Queue, 2012, vol.10, no.5. L<http://queue.acm.org/detail.cfm?id=2209336>
 
 Appendix: CoDel Pseudocode. L<http://queue.acm.org/appendices/codel.html>. */
 
-class CoDel : public Element { public:
+class CoDel : public BatchElement { public:
 
     CoDel() CLICK_COLD;
     ~CoDel() CLICK_COLD;
@@ -105,6 +107,9 @@ class CoDel : public Element { public:
 
     void handle_drop(Packet *);
     Packet *pull(int port);
+#if HAVE_BATCH
+    PacketBatch *pull_batch(int port, unsigned max) override;
+#endif
 
   protected:
 
@@ -123,6 +128,7 @@ class CoDel : public Element { public:
     Packet * delegate_codel();
     Timestamp control_law(Timestamp);
     Packet * dequeue_and_track_sojourn_time(Timestamp, bool &);
+    void track_sojourn_time(Packet *, Timestamp, bool &);
     static String read_handler(Element *, void *) CLICK_COLD;
     int finish_configure(const String &queues, ErrorHandler *errh);
 };
@@ -0,0 +1,365 @@
+/*
+ * fqcodel.{cc,hh} -- FQ-CoDel packet scheduler and AQM
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fqcodel.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/integers.hh>
+#include <click/packet_anno.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+FQCoDel::FQCoDel()
+    : _quantum(1514), _limit(10240), _length(0), _drops(0), _overlimit_drops(0)
+{
+}
+
+void *
+FQCoDel::cast(const char *n)
+{
+    if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_empty_note);
+    else
+	return Element::cast(n);
+}
+
+int
+FQCoDel::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t nflows = 1024, seed = 0;
+    String fields = "5tuple", algorithm = "crc32c";
+    _target = Timestamp::make_msec(0, 5);
+    _interval = Timestamp::make_msec(0, 100);
+    if (Args(conf, this, errh)
+	.read("FLOWS", nflows)
+	.read("QUANTUM", _quantum)
+	.read("LIMIT", _limit)
+	.read("TARGET", _target)
+	.read("INTERVAL", _interval)
+	.read("FIELDS", AnyArg(), fields)
+	.read("HASH", WordArg(), algorithm)
+	.read("SEED", seed)
+	.complete() < 0)
+	return -1;
+    if (nflows == 0 || nflows > 65536)
+	return errh->error("FLOWS must be between 1 and 65536");
+    if (_quantum <= 0)
+	return errh->error("bad QUANTUM");
+    if (_limit == 0)
+	return errh->error("bad LIMIT");
+    if (_hash.configure(algorithm, fields, false, seed, String(), errh) < 0)
+	return -1;
+    if (!_hash.fields())
+	return errh->error("FIELDS must not be empty");
+
+    _flows.resize(nflows);
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+    return 0;
+}
+
+int
+FQCoDel::initialize(ErrorHandler *)
+{
+    for (int i = 0; i < _flows.size(); i++) {
+	Flow &f = _flows[i];
+	f.head = f.tail = 0;
+	f.bytes = 0;
+	f.deficit = 0;
+	f.list = L_NONE;
+	f.next = -1;
+	f.count = f.lastcount = 0;
+	f.dropping = false;
+    }
+    for (int l = 0; l < 3; l++)
+	_lists[l].head = _lists[l].tail = -1;
+    return 0;
+}
+
+void
+FQCoDel::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _flows.size(); i++)
+	while (Packet *p = _flows[i].head) {
+	    _flows[i].head = p->next();
+	    p->kill();
+	}
+}
+
+inline int
+FQCoDel::classify(Packet *p) const
+{
+    if (!p->has_network_header())
+	return 0;
+    return ((uint64_t) _hash.hash_flow(p) * _flows.size()) >> 32;
+}
+
+inline void
+FQCoDel::list_push(int list, int i)
+{
+    FlowList &l = _lists[list];
+    _flows[i].list = list;
+    _flows[i].next = -1;
+    if (l.tail >= 0)
+	_flows[l.tail].next = i;
+    else
+	l.head = i;
+    l.tail = i;
+}
+
+inline int
+FQCoDel::list_pop(int list)
+{
+    FlowList &l = _lists[list];
+    int i = l.head;
+    l.head = _flows[i].next;
+    if (l.head < 0)
+	l.tail = -1;
+    _flows[i].list = L_NONE;
+    return i;
+}
+
+inline void
+FQCoDel::enqueue(Packet *p, const Timestamp &now)
+{
+    int i = classify(p);
+    Flow &f = _flows[i];
+    SET_FIRST_TIMESTAMP_ANNO(p, now);
+    p->set_next(0);
+    if (f.tail)
+	f.tail->set_next(p);
+    else
+	f.head = p;
+    f.tail = p;
+    f.bytes += p->length();
+    if (f.list == L_NONE) {
+	list_push(L_NEW, i);
+	f.deficit = _quantum;
+    }
+    if (++_length > _limit)
+	drop_fattest();
+}
+
+inline Packet *
+FQCoDel::pop(Flow &f)
+{
+    Packet *p = f.head;
+    if (p) {
+	f.head = p->next();
+	if (!f.head)
+	    f.tail = 0;
+	p->set_next(0);
+	f.bytes -= p->length();
+	_length--;
+    }
+    return p;
+}
+
+void
+FQCoDel::drop_fattest()
+{
+    int fattest = 0;
+    for (int i = 1; i < _flows.size(); i++)
+	if (_flows[i].bytes > _flows[fattest].bytes)
+	    fattest = i;
+    if (Packet *p = pop(_flows[fattest])) {
+	p->kill();
+	_drops++;
+	_overlimit_drops++;
+    }
+}
+
+void
+FQCoDel::push(int, Packet *p)
+{
+    bool was_empty = !_length;
+    enqueue(p, Timestamp::now());
+    if (was_empty)
+	_empty_note.wake();
+}
+
+#if HAVE_BATCH
+void
+FQCoDel::push_batch(int, PacketBatch *batch)
+{
+    bool was_empty = !_length;
+    Timestamp now = Timestamp::now();
+    Packet *next;
+    for (Packet *p = batch; p; p = next) {
+	next = p->next();
+	enqueue(p, now);
+    }
+    if (was_empty)
+	_empty_note.wake();
+}
+#endif
+
+bool
+FQCoDel::should_drop(Flow &f, Packet *p, const Timestamp &now)
+{
+    if (!p) {
+	f.first_above_time = Timestamp();
+	return false;
+    }
+    if (now - FIRST_TIMESTAMP_ANNO(p) < _target || f.bytes <= MTU) {
+	f.first_above_time = Timestamp();
+	return false;
+    }
+    if (!f.first_above_time) {
+	f.first_above_time = now + _interval;
+	return false;
+    }
+    return now >= f.first_above_time;
+}
+
+Timestamp
+FQCoDel::control_law(const Timestamp &t, uint32_t count) const
+{
+    // interval / sqrt(count), with 8 bits of fraction in the square root
+    uint64_t nsec = (uint64_t) _interval.nsecval() * 256
+	/ int_sqrt((uint64_t) count << 16);
+    return t + Timestamp::make_nsec(nsec / Timestamp::nsec_per_sec,
+				    nsec % Timestamp::nsec_per_sec);
+}
+
+Packet *
+FQCoDel::codel_dequeue(Flow &f, const Timestamp &now)
+{
+    Packet *p = pop(f);
+    bool ok_to_drop = should_drop(f, p, now);
+
+    if (f.dropping) {
+	if (!ok_to_drop)
+	    f.dropping = false;
+	else
+	    while (now >= f.drop_next && f.dropping) {
+		p->kill();
+		_drops++;
+		f.count++;
+		p = pop(f);
+		if (!should_drop(f, p, now))
+		    f.dropping = false;
+		else
+		    f.drop_next = control_law(f.drop_next, f.count);
+	    }
+    } else if (ok_to_drop) {
+	p->kill();
+	_drops++;
+	p = pop(f);
+	should_drop(f, p, now);
+	f.dropping = true;
+	// Resume the previous drop rate if the flow was dropping recently
+	uint32_t delta = f.count - f.lastcount;
+	if (delta > 1 && now - f.drop_next < _interval * 16)
+	    f.count = delta;
+	else
+	    f.count = 1;
+	f.lastcount = f.count;
+	f.drop_next = control_law(now, f.count);
+    }
+    return p;
+}
+
+Packet *
+FQCoDel::dequeue(const Timestamp &now)
+{
+    while (1) {
+	int list;
+	if (_lists[L_NEW].head >= 0)
+	    list = L_NEW;
+	else if (_lists[L_OLD].head >= 0)
+	    list = L_OLD;
+	else
+	    return 0;
+
+	int i = _lists[list].head;
+	Flow &f = _flows[i];
+	if (f.deficit <= 0) {
+	    f.deficit += _quantum;
+	    list_push(L_OLD, list_pop(list));
+	    continue;
+	}
+
+	Packet *p = codel_dequeue(f, now);
+	if (!p) {
+	    // An empty new flow goes through the old list once, so that a
+	    // flow cannot stay new by sending one packet per round
+	    list_pop(list);
+	    if (list == L_NEW)
+		list_push(L_OLD, i);
+	    continue;
+	}
+	f.deficit -= p->length();
+	return p;
+    }
+}
+
+Packet *
+FQCoDel::pull(int)
+{
+    Packet *p = dequeue(Timestamp::now());
+    if (!p)
+	_empty_note.sleep();
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+FQCoDel::pull_batch(int, unsigned max)
+{
+    Timestamp now = Timestamp::now();
+    PacketBatch *batch;
+    MAKE_BATCH(dequeue(now), batch, max);
+    if (!_length)
+	_empty_note.sleep();
+    return batch;
+}
+#endif
+
+enum { h_length, h_drops, h_overlimit_drops, h_active_flows };
+
+String
+FQCoDel::read_handler(Element *e, void *thunk)
+{
+    FQCoDel *fq = static_cast<FQCoDel *>(e);
+    switch ((intptr_t) thunk) {
+    case h_length:
+	return String(fq->_length);
+    case h_drops:
+	return String(fq->_drops);
+    case h_overlimit_drops:
+	return String(fq->_overlimit_drops);
+    case h_active_flows: {
+	int n = 0;
+	for (int i = 0; i < fq->_flows.size(); i++)
+	    n += fq->_flows[i].list != L_NONE;
+	return String(n);
+    }
+    default:
+	return String();
+    }
+}
+
+void
+FQCoDel::add_handlers()
+{
+    add_read_handler("length", read_handler, h_length);
+    add_read_handler("drops", read_handler, h_drops);
+    add_read_handler("overlimit_drops", read_handler, h_overlimit_drops);
+    add_read_handler("active_flows", read_handler, h_active_flows);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(FlowHash int64)
+EXPORT_ELEMENT(FQCoDel)
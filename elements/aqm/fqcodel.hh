@@ -0,0 +1,169 @@
+#ifndef CLICK_FQCODEL_HH
+#define CLICK_FQCODEL_HH
+#include <click/batchelement.hh>
+#include <click/notifier.hh>
+#include <click/timestamp.hh>
+#include "elements/standard/flowhash.hh"
+CLICK_DECLS
+
+/*
+=c
+
+FQCoDel([I<keywords> FLOWS, QUANTUM, LIMIT, TARGET, INTERVAL, FIELDS, HASH, SEED])
+
+=s aqm
+
+flow queuing with CoDel on each flow queue
+
+=d
+
+Implements the FQ-CoDel (Flow Queue CoDel) packet scheduler and active queue
+management algorithm of RFC 8290. FQCoDel is a queue: packets pushed on its
+input are hashed into one of FLOWS flow queues, and pulled from its output
+by deficit round robin between the flow queues, giving priority to the flows
+that just became active so that sparse flows see little delay. Each flow
+queue runs its own CoDel instance, which drops packets when the time they
+spent in the queue stays above TARGET for INTERVAL.
+
+FQCoDel stores the time packets are enqueued in their "first timestamp"
+annotation.
+
+When pulled in batches, FQCoDel dequeues up to a whole batch per call; the
+order of packets and the dropping decisions are the same as with single
+pulls.
+
+Keyword arguments are:
+
+=over 8
+
+=item FLOWS
+
+Integer. Number of flow queues. Default is 1024.
+
+=item QUANTUM
+
+Integer. Bytes dequeued from a flow queue per round. Default is 1514.
+
+=item LIMIT
+
+Integer. Maximum number of packets stored. When exceeded, the packet at the
+head of the flow queue with the most bytes is dropped. Default is 10240.
+
+=item TARGET
+
+Time. Target sojourn time of the CoDel instances. Default is 5 ms.
+
+=item INTERVAL
+
+Time. Interval of the CoDel instances. Default is 100 ms.
+
+=item FIELDS, HASH, SEED
+
+Hash parameters used to assign packets to flow queues, as for HashSwitch.
+Default is FIELDS 5tuple, HASH crc32c. Packets without an IP header
+annotation go to the first flow queue.
+
+=back
+
+=h length read-only
+
+Number of packets stored.
+
+=h drops read-only
+
+Number of packets dropped, by CoDel or because LIMIT was exceeded.
+
+=h overlimit_drops read-only
+
+Number of packets dropped because LIMIT was exceeded.
+
+=h active_flows read-only
+
+Number of flow queues scheduled.
+
+=e
+
+  ... -> FQCoDel(QUANTUM 300) -> LinkUnqueue(5ms, 10Mbps) -> ...
+
+=a CoDel, DRRSched, HashSwitch
+
+T. Hoeiland-Joergensen, P. McKenney, D. Taht, J. Gettys and E. Dumazet.
+I<The Flow Queue CoDel Packet Scheduler and Active Queue Management
+Algorithm>. RFC 8290, 2018. */
+
+class FQCoDel : public BatchElement { public:
+
+    FQCoDel() CLICK_COLD;
+
+    const char *class_name() const		{ return "FQCoDel"; }
+    const char *port_count() const		{ return PORTS_1_1; }
+    const char *processing() const		{ return PUSH_TO_PULL; }
+    void *cast(const char *);
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *);
+    Packet *pull(int port);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *);
+    PacketBatch *pull_batch(int port, unsigned max) override;
+#endif
+
+  private:
+
+    enum { L_NONE, L_NEW, L_OLD };
+    enum { MTU = 1514 };
+
+    struct Flow {
+	Packet *head;
+	Packet *tail;
+	uint32_t bytes;
+	int deficit;
+	int list;
+	int next;
+	// CoDel state
+	Timestamp first_above_time;
+	Timestamp drop_next;
+	uint32_t count;
+	uint32_t lastcount;
+	bool dropping;
+    };
+
+    struct FlowList {
+	int head;
+	int tail;
+    };
+
+    FlowHash _hash;
+    Vector<Flow> _flows;
+    FlowList _lists[3];
+    int _quantum;
+    uint32_t _limit;
+    uint32_t _length;
+    Timestamp _target;
+    Timestamp _interval;
+    ActiveNotifier _empty_note;
+
+    uint32_t _drops;
+    uint32_t _overlimit_drops;
+
+    inline int classify(Packet *p) const;
+    inline void enqueue(Packet *p, const Timestamp &now);
+    inline Packet *pop(Flow &f);
+    inline void list_push(int list, int i);
+    inline int list_pop(int list);
+    void drop_fattest();
+    bool should_drop(Flow &f, Packet *p, const Timestamp &now);
+    Timestamp control_law(const Timestamp &t, uint32_t count) const;
+    Packet *codel_dequeue(Flow &f, const Timestamp &now);
+    Packet *dequeue(const Timestamp &now);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
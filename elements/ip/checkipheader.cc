@@ -171,6 +171,9 @@ CheckIPHeader::drop(Reason reason, Packet *p, bool batch)
 inline CheckIPHeader::Reason CheckIPHeader::valid(Packet* p) {
   const click_ip *ip = reinterpret_cast<const click_ip *>(p->data() + _offset);
   unsigned plen = p->length() - _offset;
+  // segmented packets: the header must be in the first segment, the rest
+  // of the datagram may follow in the next ones
+  unsigned tlen = p->total_length() - _offset;
   unsigned hlen, len;
 
   // cast to int so very large plen is interpreted as negative
@@ -185,8 +188,10 @@ inline CheckIPHeader::Reason CheckIPHeader::valid(Packet* p) {
     return BAD_HLEN;
 
   len = ntohs(ip->ip_len);
-  if (len > plen || len < hlen)
+  if (len > tlen || len < hlen)
     return BAD_IP_LEN;
+  if (hlen > plen)
+    return BAD_HLEN;
 
   if (_checksum) {
     int val;
@@ -221,8 +226,8 @@ inline CheckIPHeader::Reason CheckIPHeader::valid(Packet* p) {
   p->set_ip_header(ip, hlen);
 
   // shorten packet according to IP length field -- 7/28/2000
-  if (plen > len)
-    p->take(plen - len);
+  if (tlen > len)
+    p->trim(_offset + len);
 
   // set destination IP address annotation if it doesn't exist already --
   // 9/26/2001
@@ -241,7 +246,9 @@ CheckIPHeader::simple_action_batch(PacketBatch* head) {
 	int c = head->count();
 	Reason r;
 	int dropped = 0;
+	PacketPrefetcher prefetcher(head);
 	while (current != NULL) {
+		prefetcher.advance();
 		if ((r = valid(current)) == NREASONS) {
 			last = current;
 			current = current->next();
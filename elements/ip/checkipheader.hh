@@ -26,6 +26,10 @@ length, if the IP length is shorter than the nominal packet length (due to
 Ethernet padding, for example). Also sets the destination IP address
 annotation to the actual destination IP address.
 
+Packets made of several segments, such as jumbo frames received by
+FromDPDKDevice, are checked against their total length. Their IP header must
+be in the first segment.
+
 CheckIPHeader emits valid packets on output 0. Invalid packets are pushed out
 on output 1, unless output 1 was unused; if so, drops invalid packets.
 
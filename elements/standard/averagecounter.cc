@@ -173,6 +173,22 @@ AverageCounter::add_handlers()
   add_write_handler("reset", averagecounter_reset_write_handler, 0, Handler::BUTTON);
 }
 
+void *
+AverageCounter::cast(const char *name)
+{
+  if (strcmp(name, "MetricSource") == 0)
+    return static_cast<MetricSource *>(this);
+  else
+    return BatchElement::cast(name);
+}
+
+void
+AverageCounter::add_metrics(MetricRegistry &registry)
+{
+  registry.add_counter(this, "count", _count, "Packets counted.");
+  registry.add_counter(this, "byte_count", _byte_count, "Bytes counted.");
+}
+
 AverageCounterMP::AverageCounterMP()
 {
     _mp = true;
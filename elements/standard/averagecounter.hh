@@ -4,6 +4,7 @@
 #include <click/ewma.hh>
 #include <click/atomic.hh>
 #include <click/timer.hh>
+#include <click/metrics.hh>
 CLICK_DECLS
 
 /*
@@ -40,7 +41,7 @@ CLICK_DECLS
  * Resets the count and rate to zero.
  */
 
-class AverageCounter : public BatchElement { public:
+class AverageCounter : public BatchElement, public MetricSource { public:
 
     AverageCounter() CLICK_COLD;
 
@@ -57,6 +58,8 @@ class AverageCounter : public BatchElement { public:
 
     int initialize(ErrorHandler *) CLICK_COLD;
     void add_handlers() CLICK_COLD;
+    void *cast(const char *name);
+    void add_metrics(MetricRegistry &registry) override;
 
     inline void add_count(uint64_t,uint64_t);
 
@@ -253,10 +253,11 @@ Classifier::add_handlers()
 void
 Classifier::push_batch(int, PacketBatch * batch)
 {
-	CLASSIFY_EACH_PACKET(	(noutputs() + 1),
+	CLASSIFY_EACH_PACKET_PREFETCH(	(noutputs() + 1),
 							_prog.match,
 							batch,
-							checked_output_push_batch);
+							checked_output_push_batch,
+							PacketPrefetcher::default_distance);
 
 }
 
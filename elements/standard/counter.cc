@@ -42,10 +42,28 @@ CounterBase::cast(const char *name)
 {
     if (strcmp("CounterBase", name) == 0)
         return (CounterBase *)this;
+    else if (strcmp("MetricSource", name) == 0)
+        return static_cast<MetricSource *>(this);
     else
         return Element::cast(name);
 }
 
+uint64_t
+CounterBase::read_metric(Element *e, intptr_t thunk)
+{
+    stats s = static_cast<CounterBase *>(e)->read();
+    return thunk ? s._byte_count : s._count;
+}
+
+void
+CounterBase::add_metrics(MetricRegistry &registry)
+{
+    registry.add_function(this, "count", MetricRegistry::COUNTER,
+                          read_metric, 0, "Packets counted.");
+    registry.add_function(this, "byte_count", MetricRegistry::COUNTER,
+                          read_metric, 1, "Bytes counted.");
+}
+
 int
 CounterBase::configure(Vector<String> &conf, ErrorHandler *errh)
 {
@@ -250,6 +268,9 @@ CounterBase::llrpc(unsigned command, void *data)
 
 Counter::Counter()
 {
+#if HAVE_BATCH
+    receives_array = true;
+#endif
 }
 
 Counter::~Counter()
@@ -273,31 +294,56 @@ Counter::simple_action(Packet *p)
 
 
 #if HAVE_BATCH
+inline void
+Counter::count_batch(unsigned count, counter_int_type byte_count)
+{
+    _count += count;
+    _byte_count += byte_count;
+
+    if (likely(_simple))
+        return;
+    _rate.update(count);
+    _byte_rate.update(byte_count);
+
+    check_handlers(_count, _byte_count);
+}
+
 PacketBatch*
 Counter::simple_action_batch(PacketBatch *batch)
 {
     if (unlikely(_batch_precise)) {
-        FOR_EACH_PACKET(batch,p)
+        FOR_EACH_PACKET_PREFETCH(batch,p,PacketPrefetcher::default_distance)
                                 Counter::simple_action(p);
         return batch;
     }
 
     counter_int_type bc = 0;
-    FOR_EACH_PACKET(batch,p) {
+    FOR_EACH_PACKET_PREFETCH(batch,p,PacketPrefetcher::default_distance) {
         bc += p->length();
     }
 
-    _count += batch->count();
-    _byte_count += bc;
-
-    if (likely(_simple))
-        return batch;
-    _rate.update(batch->count());
-    _byte_rate.update(bc);
-
-    check_handlers(_count, _byte_count);
+    count_batch(batch->count(), bc);
     return batch;
 }
+
+void
+Counter::push_array(int port, PacketArray &array)
+{
+    if (unlikely(_batch_precise)) {
+        FOR_EACH_PACKET_ARRAY(array,p)
+                                Counter::simple_action(p);
+    } else {
+        counter_int_type bc = 0;
+        unsigned distance = PacketPrefetcher::default_distance;
+        for (unsigned i = 0; i < array.count(); i++) {
+            if (distance && i + distance < array.count())
+                PacketPrefetcher::prefetch_metadata(array[i + distance]);
+            bc += array[i]->length();
+        }
+        count_batch(array.count(), bc);
+    }
+    output_push_array(port, array);
+}
 #endif
 
 void
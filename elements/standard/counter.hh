@@ -6,6 +6,7 @@
 #include <click/llrpc.h>
 #include <click/sync.hh>
 #include <click/handlercall.hh>
+#include <click/metrics.hh>
 
 CLICK_DECLS
 
@@ -119,7 +120,7 @@ components.
  * independently of the storage type
  */
 
-class CounterBase : public BatchElement { public:
+class CounterBase : public BatchElement, public MetricSource { public:
 
 	CounterBase() CLICK_COLD;
     ~CounterBase() CLICK_COLD;
@@ -156,6 +157,12 @@ class CounterBase : public BatchElement { public:
     void* cast(const char *name);
     bool do_mt_safe_check(ErrorHandler* errh);
 
+    /**
+     * Publish the count and byte count. The default uses read(); counters
+     *   with stable storage register it directly.
+     */
+    void add_metrics(MetricRegistry &registry) override;
+
     virtual int can_atomic() { return 0; } CLICK_COLD;
     virtual void reset() {
         if (likely(_simple))
@@ -196,6 +203,7 @@ class CounterBase : public BatchElement { public:
     bool _simple;
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String&, Element*, void*, ErrorHandler*) CLICK_COLD;
+    static uint64_t read_metric(Element *, intptr_t);
 };
 
 class Counter : public CounterBase { public:
@@ -218,6 +226,7 @@ class Counter : public CounterBase { public:
     Packet *simple_action(Packet *);
 #if HAVE_BATCH
     PacketBatch *simple_action_batch(PacketBatch* batch);
+    void push_array(int port, PacketArray &array) override;
 #endif
 
     void reset();
@@ -234,6 +243,11 @@ class Counter : public CounterBase { public:
         return {_count, _byte_count};
     }
 
+    void add_metrics(MetricRegistry &registry) override {
+        registry.add_counter(this, "count", _count, "Packets counted.");
+        registry.add_counter(this, "byte_count", _byte_count, "Bytes counted.");
+    }
+
     stats atomic_read() {  //This is NOT atomic
         return Counter::read();
     }
@@ -250,6 +264,10 @@ class Counter : public CounterBase { public:
 protected:
     counter_int_type _count;
     counter_int_type _byte_count;
+
+#if HAVE_BATCH
+    inline void count_batch(unsigned count, counter_int_type byte_count);
+#endif
 };
 
 template <typename T>
@@ -273,6 +291,13 @@ class CounterMPBase : public CounterBase { public:
 
     int can_atomic() { return 2; } CLICK_COLD;
 
+    void add_metrics(MetricRegistry &registry) override {
+        registry.add_per_thread(this, "count", MetricRegistry::COUNTER,
+                                _stats, &stats::_count, "Packets counted.");
+        registry.add_per_thread(this, "byte_count", MetricRegistry::COUNTER,
+                                _stats, &stats::_byte_count, "Bytes counted.");
+    }
+
     Packet *simple_action(Packet *);
 #if HAVE_BATCH
     PacketBatch *simple_action_batch(PacketBatch* batch);
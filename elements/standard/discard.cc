@@ -25,6 +25,9 @@ CLICK_DECLS
 Discard::Discard()
     : _task(this), _count(0), _burst(1), _active(true)
 {
+#if HAVE_BATCH
+    receives_array = true;
+#endif
 }
 
 int
@@ -64,6 +67,13 @@ Discard::push_batch(int, PacketBatch *head)
     _count+=head->count();
     head->fast_kill();
 }
+
+void
+Discard::push_array(int, PacketArray &array)
+{
+    _count += array.count();
+    array.fast_kill();
+}
 #endif
 void
 Discard::push(int, Packet *p)
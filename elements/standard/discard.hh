@@ -64,6 +64,7 @@ class Discard : public BatchElement { public:
 
 #if HAVE_BATCH
     void push_batch(int, PacketBatch*);
+    void push_array(int, PacketArray&);
 #endif
     void push(int, Packet *);
 
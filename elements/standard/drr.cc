@@ -42,10 +42,22 @@ int
 DRRSched::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _notifier.initialize(Notifier::EMPTY_NOTIFIER, router());
-    if (Args(conf, this, errh).read_p("QUANTUM", _quantum).complete() < 0)
+    String quanta;
+    if (Args(conf, this, errh)
+	.read_p("QUANTUM", _quantum)
+	.read("QUANTA", AnyArg(), quanta)
+	.complete() < 0)
 	return -1;
     if (_quantum <= 0)
 	return errh->error("bad QUANTUM");
+    Vector<String> words;
+    cp_spacevec(quanta, words);
+    if (words.size() > ninputs())
+	return errh->error("more QUANTA than inputs");
+    _quanta.assign(ninputs(), _quantum);
+    for (int i = 0; i < words.size(); i++)
+	if (!IntArg().parse(words[i], _quanta[i]) || _quanta[i] <= 0)
+	    return errh->error("bad QUANTA");
     return 0;
 }
 
@@ -57,6 +69,7 @@ DRRSched::initialize(ErrorHandler *errh)
     for (int i = 0; i < ninputs(); i++) {
 	_pi[i].head = 0;
 	_pi[i].deficit = 0;
+	_pi[i].quantum = _quanta[i];
 	_pi[i].signal = Notifier::upstream_empty_signal(this, i, &_notifier);
     }
     _next = 0;
@@ -68,8 +81,10 @@ DRRSched::cleanup(CleanupStage)
 {
     if (_pi) {
 	for (int j = 0; j < ninputs(); j++)
-	    if (_pi[j].head)
-		_pi[j].head->kill();
+	    while (Packet *p = _pi[j].head) {
+		_pi[j].head = p->next();
+		p->kill();
+	    }
 	delete[] _pi;
     }
 }
@@ -86,7 +101,8 @@ DRRSched::pull(int)
 	portinfo &pi = _pi[_next];
 	Packet *p;
 	if ((p = pi.head)) {
-	    pi.head = 0;
+	    pi.head = p->next();
+	    p->set_next(0);
 	    signals_on = true;
 	} else if (pi.signal) {
 	    p = input(_next).pull();
@@ -100,18 +116,76 @@ DRRSched::pull(int)
 	    pi.deficit -= p->length();
 	    _notifier.set_active(true);
 	    return p;
-	} else
+	} else {
+	    p->set_next(pi.head);
 	    pi.head = p;
+	}
 
 	_next++;
 	if (_next >= n)
 	    _next = 0;
-	_pi[_next].deficit += _quantum;
+	_pi[_next].deficit += _pi[_next].quantum;
     }
 
     _notifier.set_active(signals_on);
     return 0;
 }
 
+#if HAVE_BATCH
+PacketBatch *
+DRRSched::pull_batch(int, unsigned max)
+{
+    int n = ninputs();
+    bool signals_on = false;
+    Packet *first = 0, *last = 0;
+    unsigned count = 0;
+
+    // Serve inputs in turn until the batch is full, or until each input was
+    // visited once without sending anything.
+    for (int idle = 0; idle < n; ) {
+	portinfo &pi = _pi[_next];
+	bool sent = false;
+	while (1) {
+	    if (!pi.head) {
+		if (pi.signal) {
+		    pi.head = input(_next).pull_batch(max - count);
+		    signals_on = true;
+		}
+		if (!pi.head) {
+		    pi.deficit = 0;
+		    break;
+		}
+	    }
+	    signals_on = true;
+	    Packet *p = pi.head;
+	    if (p->length() > pi.deficit)
+		break;
+	    pi.deficit -= p->length();
+	    pi.head = p->next();
+	    if (last)
+		last->set_next(p);
+	    else
+		first = p;
+	    last = p;
+	    sent = true;
+	    if (++count == max)
+		goto out;
+	}
+
+	idle = sent ? 0 : idle + 1;
+	_next++;
+	if (_next >= n)
+	    _next = 0;
+	_pi[_next].deficit += _pi[_next].quantum;
+    }
+
+  out:
+    _notifier.set_active(signals_on);
+    if (!first)
+	return 0;
+    return PacketBatch::make_from_simple_list(first, last, count);
+}
+#endif
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(DRRSched)
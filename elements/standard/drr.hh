@@ -1,13 +1,13 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_DRR_HH
 #define CLICK_DRR_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/notifier.hh>
 CLICK_DECLS
 
 /*
  * =c
- * DRRSched([QUANTUM])
+ * DRRSched([QUANTUM, I<keywords> QUANTA])
  * =s scheduling
  * pulls from inputs with deficit round robin scheduling
  * =io
@@ -28,8 +28,18 @@ CLICK_DECLS
  *
  * Integer. Quantum (in bytes) added to each round. Defaults to 500.
  *
+ * =item QUANTA
+ *
+ * Space-separated list of integers, the quantum of each input, so that
+ * inputs get bandwidth in proportion to their quanta. Inputs not listed use
+ * QUANTUM.
+ *
  * =back
  *
+ * When pulled in batches, DRRSched pulls batches from its inputs and keeps
+ * the packets that do not fit in the deficit of an input for its next turn,
+ * so the bandwidth shares are the same as with single pulls.
+ *
  * =n
  *
  * DRRSched is a notifier signal, active iff any of the upstream notifiers
@@ -38,7 +48,7 @@ CLICK_DECLS
  * =a PrioSched, StrideSched, RoundRobinSched
  */
 
-class DRRSched : public Element { public:
+class DRRSched : public BatchElement { public:
 
     DRRSched() CLICK_COLD;
 
@@ -53,16 +63,21 @@ class DRRSched : public Element { public:
     void cleanup(CleanupStage) CLICK_COLD;
 
     Packet *pull(int port);
+#if HAVE_BATCH
+    PacketBatch *pull_batch(int port, unsigned max) override;
+#endif
 
   private:
 
     struct portinfo {
-	Packet *head;
+	Packet *head;	// List of pulled packets waiting for deficit.
 	unsigned deficit;
+	unsigned quantum;
 	NotifierSignal signal;
     };
 
     int _quantum;   // Number of bytes to send per round.
+    Vector<int> _quanta;
     portinfo *_pi;
     Notifier _notifier;
     int _next;      // Next input to consider.
@@ -0,0 +1,251 @@
+/*
+ * flowhash.{cc,hh} -- configurable flow hashing
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flowhash.hh"
+#include <click/error.hh>
+#include <click/confparse.hh>
+CLICK_DECLS
+
+const unsigned char FlowHash::default_rss_key[RSS_KEY_LENGTH] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+// Reflected CRC-32C table, polynomial 0x82F63B78
+const uint32_t FlowHash::crc32c_table[256] = {
+    0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4, 0xC79A971F, 0x35F1141C,
+    0x26A1E7E8, 0xD4CA64EB, 0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B,
+    0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24, 0x105EC76F, 0xE235446C,
+    0xF165B798, 0x030E349B, 0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+    0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54, 0x5D1D08BF, 0xAF768BBC,
+    0xBC267848, 0x4E4DFB4B, 0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A,
+    0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35, 0xAA64D611, 0x580F5512,
+    0x4B5FA6E6, 0xB93425E5, 0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+    0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45, 0xF779DEAE, 0x05125DAD,
+    0x1642AE59, 0xE4292D5A, 0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A,
+    0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595, 0x417B1DBC, 0xB3109EBF,
+    0xA0406D4B, 0x522BEE48, 0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+    0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687, 0x0C38D26C, 0xFE53516F,
+    0xED03A29B, 0x1F682198, 0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927,
+    0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38, 0xDBFC821C, 0x2997011F,
+    0x3AC7F2EB, 0xC8AC71E8, 0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+    0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096, 0xA65C047D, 0x5437877E,
+    0x4767748A, 0xB50CF789, 0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859,
+    0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46, 0x7198540D, 0x83F3D70E,
+    0x90A324FA, 0x62C8A7F9, 0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+    0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36, 0x3CDB9BDD, 0xCEB018DE,
+    0xDDE0EB2A, 0x2F8B6829, 0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C,
+    0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93, 0x082F63B7, 0xFA44E0B4,
+    0xE9141340, 0x1B7F9043, 0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+    0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3, 0x55326B08, 0xA759E80B,
+    0xB4091BFF, 0x466298FC, 0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C,
+    0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033, 0xA24BB5A6, 0x502036A5,
+    0x4370C551, 0xB11B4652, 0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+    0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D, 0xEF087A76, 0x1D63F975,
+    0x0E330A81, 0xFC588982, 0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D,
+    0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622, 0x38CC2A06, 0xCAA7A905,
+    0xD9F75AF1, 0x2B9CD9F2, 0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+    0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530, 0x0417B1DB, 0xF67C32D8,
+    0xE52CC12C, 0x1747422F, 0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF,
+    0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0, 0xD3D3E1AB, 0x21B862A8,
+    0x32E8915C, 0xC083125F, 0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+    0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90, 0x9E902E7B, 0x6CFBAD78,
+    0x7FAB5E8C, 0x8DC0DD8F, 0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE,
+    0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1, 0x69E9F0D5, 0x9B8273D6,
+    0x88D28022, 0x7AB90321, 0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+    0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81, 0x34F4F86A, 0xC69F7B69,
+    0xD5CF889D, 0x27A40B9E, 0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E,
+    0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351
+};
+
+static int
+hexvalue(char c)
+{
+    if (c >= '0' && c <= '9')
+	return c - '0';
+    else if (c >= 'a' && c <= 'f')
+	return c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+	return c - 'A' + 10;
+    return -1;
+}
+
+FlowHash::FlowHash()
+    : _algorithm(CRC32C), _fields(0), _symmetric(false), _seed(0),
+      _toeplitz_len(0)
+{
+}
+
+/** @brief Configure the hash.
+ * @param algorithm one of "sum", "crc32c", "toeplitz" and "xxhash"
+ * @param fields space-separated 5-tuple fields among "src", "dst", "sport",
+ *   "dport" and "proto", or "5tuple" for all of them; empty to hash raw bytes
+ * @param symmetric hash both directions of a flow the same way
+ * @param seed seed of CRC32C and XXHASH
+ * @param key Toeplitz key in hexadecimal, empty for the default RSS key */
+int
+FlowHash::configure(const String &algorithm, const String &fields, bool symmetric,
+		    uint32_t seed, const String &key, ErrorHandler *errh)
+{
+    String a = algorithm.lower();
+    if (a == "sum")
+	_algorithm = SUM;
+    else if (a == "crc32c" || a == "crc")
+	_algorithm = CRC32C;
+    else if (a == "toeplitz" || a == "rss")
+	_algorithm = TOEPLITZ;
+    else if (a == "xxhash" || a == "xxh32")
+	_algorithm = XXHASH;
+    else
+	return errh->error("unknown hash algorithm %<%s%>", algorithm.c_str());
+
+    _fields = 0;
+    Vector<String> words;
+    cp_spacevec(fields, words);
+    for (int i = 0; i < words.size(); i++) {
+	String w = words[i].lower();
+	if (w == "src")
+	    _fields |= F_SRC;
+	else if (w == "dst")
+	    _fields |= F_DST;
+	else if (w == "sport")
+	    _fields |= F_SPORT;
+	else if (w == "dport")
+	    _fields |= F_DPORT;
+	else if (w == "proto")
+	    _fields |= F_PROTO;
+	else if (w == "5tuple")
+	    _fields |= F_5TUPLE;
+	else
+	    return errh->error("unknown field %<%s%>", words[i].c_str());
+    }
+    _symmetric = symmetric;
+    _seed = seed;
+
+    _toeplitz.clear();
+    _toeplitz_len = 0;
+    if (_algorithm == TOEPLITZ) {
+	Vector<unsigned char> k;
+	if (!key) {
+	    for (int i = 0; i < RSS_KEY_LENGTH; i++)
+		k.push_back(default_rss_key[i]);
+	} else {
+	    String hex = cp_unquote(key);
+	    if (hex.length() % 2)
+		return errh->error("KEY must have an even number of hexadecimal digits");
+	    for (int i = 0; i < hex.length(); i += 2) {
+		int hi = hexvalue(hex[i]), lo = hexvalue(hex[i + 1]);
+		if (hi < 0 || lo < 0)
+		    return errh->error("KEY must be hexadecimal");
+		k.push_back(hi * 16 + lo);
+	    }
+	    if (k.size() < MAX_TUPLE + 4)
+		return errh->error("KEY must be at least %d bytes long", MAX_TUPLE + 4);
+	}
+	// Byte i of value v contributes the xor of the 32-bit key windows
+	// starting at the bits set in v, so the whole key is usable
+	_toeplitz_len = k.size() - 4;
+	_toeplitz.resize(_toeplitz_len * 256);
+	for (int i = 0; i < _toeplitz_len; i++) {
+	    uint32_t w[8];
+	    for (int j = 0; j < 8; j++) {
+		const unsigned char *x = k.begin() + i;
+		w[j] = ((uint32_t) x[0] << 24) | (x[1] << 16) | (x[2] << 8) | x[3];
+		if (j)
+		    w[j] = (w[j] << j) | (x[4] >> (8 - j));
+	    }
+	    for (int v = 0; v < 256; v++) {
+		uint32_t h = 0;
+		for (int j = 0; j < 8; j++)
+		    if (v & (0x80 >> j))
+			h ^= w[j];
+		_toeplitz[i * 256 + v] = h;
+	    }
+	}
+    }
+    return 0;
+}
+
+/** @brief Return the Toeplitz hash of @a data with @a key.
+ *
+ * The key must be at least @a len + 4 bytes long. */
+uint32_t
+FlowHash::toeplitz(const unsigned char *key, int keylen, const unsigned char *data, int len)
+{
+    if (keylen < len + 4)
+	len = keylen - 4;
+    uint32_t h = 0;
+    uint32_t v = (key[0] << 24) | (key[1] << 16) | (key[2] << 8) | key[3];
+    for (int i = 0; i < len; i++) {
+	for (int bit = 7; bit >= 0; bit--) {
+	    if (data[i] & (1 << bit))
+		h ^= v;
+	    v <<= 1;
+	    if (key[i + 4] & (1 << bit))
+		v |= 1;
+	}
+    }
+    return h;
+}
+
+static inline uint32_t
+xxh_rotl(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t
+xxh_read32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/** @brief Return the XXH32 hash of @a data with @a seed. */
+uint32_t
+FlowHash::xxhash32(const unsigned char *data, int len, uint32_t seed)
+{
+    const uint32_t p1 = 2654435761U, p2 = 2246822519U, p3 = 3266489917U,
+	p4 = 668265263U, p5 = 374761393U;
+    const unsigned char *end = data + len;
+    uint32_t h;
+    if (len >= 16) {
+	uint32_t v1 = seed + p1 + p2, v2 = seed + p2, v3 = seed, v4 = seed - p1;
+	for (; data + 16 <= end; data += 16) {
+	    v1 = xxh_rotl(v1 + xxh_read32(data) * p2, 13) * p1;
+	    v2 = xxh_rotl(v2 + xxh_read32(data + 4) * p2, 13) * p1;
+	    v3 = xxh_rotl(v3 + xxh_read32(data + 8) * p2, 13) * p1;
+	    v4 = xxh_rotl(v4 + xxh_read32(data + 12) * p2, 13) * p1;
+	}
+	h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+    } else
+	h = seed + p5;
+    h += len;
+    for (; data + 4 <= end; data += 4)
+	h = xxh_rotl(h + xxh_read32(data) * p3, 17) * p4;
+    for (; data < end; data++)
+	h = xxh_rotl(h + *data * p5, 11) * p1;
+    h ^= h >> 15;
+    h *= p2;
+    h ^= h >> 13;
+    h *= p3;
+    h ^= h >> 16;
+    return h;
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(FlowHash)
@@ -0,0 +1,200 @@
+#ifndef CLICK_FLOWHASH_HH
+#define CLICK_FLOWHASH_HH
+#include <click/glue.hh>
+#include <click/vector.hh>
+#include <click/string.hh>
+#include <click/packet.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#if CLICK_USERLEVEL && defined(__SSE4_2__)
+# include <nmmintrin.h>
+#endif
+CLICK_DECLS
+class ErrorHandler;
+
+/** @class FlowHash
+ * @brief Configurable hash of packet contents or flows, for load balancing.
+ *
+ * FlowHash hashes either raw bytes, or a set of fields of the IP 5-tuple
+ * taken from the IP header annotation. The 5-tuple is laid out as source
+ * address, destination address, source port, destination port and protocol,
+ * in network byte order, keeping only the configured fields. This is the
+ * input of the Toeplitz hash of NIC receive side scaling (RSS), so with
+ * fields "src dst sport dport" and the same key, the Toeplitz hash matches
+ * the NIC's. In symmetric mode, both directions of a flow are hashed the
+ * same way by ordering the addresses and ports first.
+ *
+ * The algorithms are:
+ *
+ * - SUM: the sum of the bytes, the historical HashSwitch hash.
+ * - CRC32C: CRC-32C (Castagnoli), with the SSE4.2 instruction when the
+ *   compiler targets it.
+ * - TOEPLITZ: the RSS Toeplitz hash, using a per-byte lookup table built
+ *   from the key. Default key is the usual 40-byte RSS key. A key of N
+ *   bytes hashes at most N - 4 bytes of input, see max_length().
+ * - XXHASH: XXH32.
+ */
+class FlowHash { public:
+
+    enum Algorithm { SUM, CRC32C, TOEPLITZ, XXHASH };
+    enum Field { F_SRC = 1, F_DST = 2, F_SPORT = 4, F_DPORT = 8, F_PROTO = 16,
+		 F_5TUPLE = 31 };
+    enum { MAX_TUPLE = 13, RSS_KEY_LENGTH = 40 };
+
+    FlowHash();
+
+    int configure(const String &algorithm, const String &fields, bool symmetric,
+		  uint32_t seed, const String &key, ErrorHandler *errh);
+
+    Algorithm algorithm() const		{ return _algorithm; }
+    int fields() const			{ return _fields; }
+    inline int max_length() const;
+
+    inline uint32_t hash(const unsigned char *data, int len) const;
+    inline uint32_t hash_flow(const Packet *p) const;
+    inline int tuple(const Packet *p, unsigned char *buf) const;
+
+    static inline uint32_t crc32c(const unsigned char *data, int len, uint32_t seed = 0);
+    static uint32_t xxhash32(const unsigned char *data, int len, uint32_t seed = 0);
+    static uint32_t toeplitz(const unsigned char *key, int keylen,
+			     const unsigned char *data, int len);
+
+    static const unsigned char default_rss_key[RSS_KEY_LENGTH];
+
+  private:
+
+    Algorithm _algorithm;
+    int _fields;
+    bool _symmetric;
+    uint32_t _seed;
+    Vector<uint32_t> _toeplitz;
+    int _toeplitz_len;
+
+    static const uint32_t crc32c_table[256];
+
+    inline uint32_t toeplitz(const unsigned char *data, int len) const;
+
+};
+
+/** @brief Return the CRC-32C of @a data, starting from @a seed. */
+inline uint32_t
+FlowHash::crc32c(const unsigned char *data, int len, uint32_t seed)
+{
+    uint32_t c = ~seed;
+#if CLICK_USERLEVEL && defined(__SSE4_2__)
+    for (; len >= 4; data += 4, len -= 4)
+	c = _mm_crc32_u32(c, *reinterpret_cast<const uint32_t *>(data));
+    for (; len > 0; data++, len--)
+	c = _mm_crc32_u8(c, *data);
+#else
+    for (; len > 0; data++, len--)
+	c = crc32c_table[(c ^ *data) & 0xFF] ^ (c >> 8);
+#endif
+    return ~c;
+}
+
+/** @brief Return the maximal number of bytes hash() takes into account,
+ * the key length minus 4 for TOEPLITZ. */
+inline int
+FlowHash::max_length() const
+{
+    return _algorithm == TOEPLITZ ? _toeplitz_len : 0x7FFFFFFF;
+}
+
+/** @brief Toeplitz hash of @a data with the configured key, at most
+ * max_length() bytes. */
+inline uint32_t
+FlowHash::toeplitz(const unsigned char *data, int len) const
+{
+    if (len > _toeplitz_len)
+	len = _toeplitz_len;
+    uint32_t h = 0;
+    const uint32_t *t = _toeplitz.begin();
+    for (int i = 0; i < len; i++, t += 256)
+	h ^= t[data[i]];
+    return h;
+}
+
+/** @brief Hash @a len bytes at @a data with the configured algorithm. */
+inline uint32_t
+FlowHash::hash(const unsigned char *data, int len) const
+{
+    switch (_algorithm) {
+    case CRC32C:
+	return crc32c(data, len, _seed);
+    case TOEPLITZ:
+	return toeplitz(data, len);
+    case XXHASH:
+	return xxhash32(data, len, _seed);
+    default: {
+	uint32_t d = 0;
+	for (int i = 0; i < len; i++)
+	    d += data[i];
+	return d;
+    }
+    }
+}
+
+/** @brief Store the configured 5-tuple fields of @a p in @a buf.
+ * @return the number of bytes stored, or -1 if @a p has no IP header
+ *
+ * Ports are zero for protocols without ports and non-first fragments. */
+inline int
+FlowHash::tuple(const Packet *p, unsigned char *buf) const
+{
+    if (!p->has_network_header())
+	return -1;
+    const click_ip *ip = p->ip_header();
+    uint32_t src = ip->ip_src.s_addr, dst = ip->ip_dst.s_addr;
+    uint16_t sport = 0, dport = 0;
+    if ((_fields & (F_SPORT | F_DPORT))
+	&& (ip->ip_p == IP_PROTO_TCP || ip->ip_p == IP_PROTO_UDP
+	    || ip->ip_p == IP_PROTO_SCTP || ip->ip_p == IP_PROTO_DCCP)
+	&& IP_FIRSTFRAG(ip)
+	&& p->transport_length() >= 4) {
+	const click_tcp *th = p->tcp_header();
+	sport = th->th_sport;
+	dport = th->th_dport;
+    }
+    if (_symmetric && (ntohl(src) > ntohl(dst)
+		       || (src == dst && ntohs(sport) > ntohs(dport)))) {
+	uint32_t a = src; src = dst; dst = a;
+	uint16_t b = sport; sport = dport; dport = b;
+    }
+    unsigned char *x = buf;
+    if (_fields & F_SRC) {
+	memcpy(x, &src, 4);
+	x += 4;
+    }
+    if (_fields & F_DST) {
+	memcpy(x, &dst, 4);
+	x += 4;
+    }
+    if (_fields & F_SPORT) {
+	memcpy(x, &sport, 2);
+	x += 2;
+    }
+    if (_fields & F_DPORT) {
+	memcpy(x, &dport, 2);
+	x += 2;
+    }
+    if (_fields & F_PROTO)
+	*x++ = ip->ip_p;
+    return x - buf;
+}
+
+/** @brief Hash the configured 5-tuple fields of @a p.
+ *
+ * Packets without an IP header annotation hash to 0. */
+inline uint32_t
+FlowHash::hash_flow(const Packet *p) const
+{
+    unsigned char buf[MAX_TUPLE];
+    int len = tuple(p, buf);
+    if (len < 0)
+	return 0;
+    return hash(buf, len);
+}
+
+CLICK_ENDDECLS
+#endif
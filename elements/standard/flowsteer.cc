@@ -0,0 +1,269 @@
+/*
+ * flowsteer.{cc,hh} -- load-aware flow steering
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flowsteer.hh"
+#include "pipeliner.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/standard/storage.hh>
+CLICK_DECLS
+
+FlowSteer::FlowSteer()
+    : _mask(0), _interval(100), _threshold(0x14000), _moves(16),
+      _timer(this), _migrations(0), _forced(0)
+{
+}
+
+int
+FlowSteer::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _max = noutputs();
+    String algorithm = "crc32c", fields = "5tuple", key, queues;
+    bool symmetric = false;
+    uint32_t seed = 0, table = 512, gap = 500;
+    if (Args(conf, this, errh)
+	.read("FIELDS", AnyArg(), fields)
+	.read("HASH", WordArg(), algorithm)
+	.read("SYMMETRIC", symmetric)
+	.read("SEED", seed)
+	.read("KEY", AnyArg(), key)
+	.read("TABLE", table)
+	.read("MAX", _max)
+	.read("INTERVAL", _interval)
+	.read("THRESHOLD", FixedPointArg(16), _threshold)
+	.read("MOVES", _moves)
+	.read("GAP", gap)
+	.read("QUEUES", AnyArg(), queues)
+	.complete() < 0)
+	return -1;
+
+    if (_hash.configure(algorithm, fields, symmetric, seed, key, errh) < 0)
+	return -1;
+    if (!_hash.fields())
+	return errh->error("FIELDS must not be empty");
+    if (!table || (table & (table - 1)) || table > 65536)
+	return errh->error("TABLE must be a power of two up to 65536");
+    if (_max <= 0 || _max > noutputs())
+	return errh->error("MAX must be between 1 and the number of outputs");
+    if (_threshold < 0x10000)
+	return errh->error("THRESHOLD must be at least 1");
+    _gap = Timestamp::make_usec(gap);
+
+    Vector<String> eids;
+    cp_spacevec(queues, eids);
+    if (eids.size() && eids.size() != _max)
+	return errh->error("QUEUES must list one element per output");
+    for (int i = 0; i < eids.size(); i++)
+	if (Element *e = router()->find(eids[i], this, errh))
+	    _queue_elements.push_back(e);
+    if (eids.size() != _queue_elements.size())
+	return -1;
+
+    _buckets.resize(table);
+    for (uint32_t i = 0; i < table; i++) {
+	_buckets[i].output = _buckets[i].target = i % _max;
+	_buckets[i].migrations = 0;
+    }
+    _mask = table - 1;
+    return 0;
+}
+
+int
+FlowSteer::initialize(ErrorHandler *errh)
+{
+    for (int i = 0; i < _queue_elements.size(); i++) {
+	Element *e = _queue_elements[i];
+	if (Pipeliner *p = (Pipeliner *) e->cast("Pipeliner")) {
+	    _queues.push_back(0);
+	    _pipeliners.push_back(p);
+	} else if (Storage *s = (Storage *) e->cast("Storage")) {
+	    _queues.push_back(s);
+	    _pipeliners.push_back(0);
+	} else
+	    return errh->error("%<%s%> is not a Storage or Pipeliner element", e->name().c_str());
+    }
+
+    for (unsigned i = 0; i < _counts.weight(); i++)
+	_counts.get_value(i).resize(_buckets.size(), 0);
+    _seen.resize(_buckets.size(), 0);
+    _load.resize(_buckets.size(), 0);
+    _out_load.resize(_max, 0);
+
+    _timer.initialize(this);
+    if (_interval)
+	_timer.schedule_after_msec(_interval);
+    return 0;
+}
+
+/** @brief Return the output of moving bucket @a k, which switches to its
+ * target if it did not receive packets for GAP. */
+int
+FlowSteer::switch_output(Bucket &k)
+{
+    uint16_t target = k.target;
+    click_read_fence();
+    Timestamp now = Timestamp::now_steady();
+    if (now - k.last >= _gap) {
+	k.output = target;
+	return target;
+    }
+    k.last = now;
+    return k.output;
+}
+
+void
+FlowSteer::push(int, Packet *p)
+{
+    output(process(p)).push(p);
+}
+
+#if HAVE_BATCH
+void
+FlowSteer::push_batch(int, PacketBatch *batch)
+{
+    auto fnt = [this](Packet *p) { return process(p); };
+    CLASSIFY_EACH_PACKET(_max + 1, fnt, batch, checked_output_push_batch);
+}
+#endif
+
+void
+FlowSteer::rebalance()
+{
+    int n = _buckets.size();
+
+    // Collect the load of the last interval, and finish the moves of
+    // buckets that never paused
+    for (int o = 0; o < _max; o++)
+	_out_load[o] = 0;
+    for (int b = 0; b < n; b++) {
+	uint32_t total = 0;
+	for (unsigned i = 0; i < _counts.weight(); i++)
+	    total += _counts.get_value(i).unchecked_at(b);
+	_load[b] = total - _seen[b];
+	_seen[b] = total;
+
+	Bucket &k = _buckets[b];
+	if (k.target != k.output) {
+	    k.output = k.target;
+	    _forced++;
+	}
+	_out_load[k.output] += _load[b];
+    }
+    for (int o = 0; o < _queues.size(); o++)
+	_out_load[o] += _pipeliners[o] ? _pipeliners[o]->n_backlog() : _queues[o]->size();
+
+    uint64_t total = 0;
+    for (int o = 0; o < _max; o++)
+	total += _out_load[o];
+    uint64_t limit = (total * _threshold / _max) >> 16;
+
+    Timestamp now = Timestamp::now_steady();
+    for (int m = 0; m < _moves; m++) {
+	int omax = 0, omin = 0;
+	for (int o = 1; o < _max; o++) {
+	    if (_out_load[o] > _out_load[omax])
+		omax = o;
+	    if (_out_load[o] < _out_load[omin])
+		omin = o;
+	}
+	if (_out_load[omax] <= limit)
+	    break;
+
+	// Move the largest bucket that still leaves omin below omax
+	uint64_t room = _out_load[omax] - _out_load[omin];
+	int best = -1;
+	for (int b = 0; b < n; b++)
+	    if (_buckets[b].target == omax && _load[b] && _load[b] < room
+		&& (best < 0 || _load[b] > _load[best]))
+		best = b;
+	if (best < 0)
+	    break;
+
+	Bucket &k = _buckets[best];
+	k.last = now;
+	click_write_fence();
+	k.target = omin;
+	k.migrations++;
+	_migrations++;
+	_out_load[omax] -= _load[best];
+	_out_load[omin] += _load[best];
+    }
+}
+
+void
+FlowSteer::run_timer(Timer *)
+{
+    rebalance();
+    _timer.reschedule_after_msec(_interval);
+}
+
+enum { h_buckets, h_load, h_migrations, h_forced, h_table, h_rebalance };
+
+String
+FlowSteer::read_handler(Element *e, void *thunk)
+{
+    FlowSteer *fs = static_cast<FlowSteer *>(e);
+    StringAccum sa;
+    switch ((intptr_t) thunk) {
+    case h_buckets:
+	for (int b = 0; b < fs->_buckets.size(); b++) {
+	    const Bucket &k = fs->_buckets[b];
+	    sa << b << ' ' << k.output << ' ' << k.target << ' '
+	       << (fs->_load.size() ? fs->_load[b] : 0) << ' ' << k.migrations << '\n';
+	}
+	break;
+    case h_load:
+	for (int o = 0; o < fs->_out_load.size(); o++)
+	    sa << (o ? " " : "") << fs->_out_load[o];
+	break;
+    case h_migrations:
+	sa << fs->_migrations;
+	break;
+    case h_forced:
+	sa << fs->_forced;
+	break;
+    case h_table:
+	for (int b = 0; b < fs->_buckets.size(); b++)
+	    sa << fs->_buckets[b].output << '\n';
+	break;
+    }
+    return sa.take_string();
+}
+
+int
+FlowSteer::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    FlowSteer *fs = static_cast<FlowSteer *>(e);
+    fs->rebalance();
+    return 0;
+}
+
+void
+FlowSteer::add_handlers()
+{
+    add_read_handler("buckets", read_handler, h_buckets);
+    add_read_handler("load", read_handler, h_load);
+    add_read_handler("migrations", read_handler, h_migrations);
+    add_read_handler("forced", read_handler, h_forced);
+    add_read_handler("table", read_handler, h_table);
+    add_write_handler("rebalance", write_handler, h_rebalance);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(FlowHash Pipeliner)
+EXPORT_ELEMENT(FlowSteer)
+ELEMENT_MT_SAFE(FlowSteer)
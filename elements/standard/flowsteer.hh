@@ -0,0 +1,195 @@
+#ifndef CLICK_FLOWSTEER_HH
+#define CLICK_FLOWSTEER_HH
+#include <click/batchelement.hh>
+#include <click/multithread.hh>
+#include <click/timer.hh>
+#include <click/timestamp.hh>
+#include "flowhash.hh"
+CLICK_DECLS
+class Storage;
+class Pipeliner;
+
+/*
+=c
+
+FlowSteer(I<keywords> FIELDS, HASH, SYMMETRIC, SEED, KEY, TABLE, MAX, INTERVAL, THRESHOLD, MOVES, GAP, QUEUES)
+
+=s threads
+
+load-aware flow steering
+
+=d
+
+Spreads flows over its outputs, typically each leading to a Pipeliner served
+by a different thread, and moves flows away from overloaded outputs.
+
+Like HashSwitch with an indirection table, FlowSteer hashes the fields of
+each packet given by FIELDS, and the low bits of the hash select a bucket of
+an indirection table of TABLE entries holding output numbers, like the RSS
+redirection table of NICs. Every INTERVAL milliseconds, FlowSteer computes
+the load of each output, the packets its buckets received during the
+interval plus the packets waiting in its queue if QUEUES is given. While the
+most loaded output exceeds the mean load by a factor THRESHOLD, its most
+loaded bucket that does not overshoot is moved to the least loaded output.
+Elephant flows colliding on an output thus end up on different outputs.
+
+To keep packets of a flow in order, a bucket does not change output right
+away: it switches on its first packet arriving at least GAP microseconds
+after the previous one, once the packets in flight on the old output are
+probably processed. A bucket that never pauses switches at the next interval.
+
+Keyword arguments are:
+
+=over 8
+
+=item FIELDS, HASH, SYMMETRIC, SEED, KEY
+
+Hash parameters, as for HashSwitch. Default is FIELDS 5tuple, HASH crc32c.
+
+=item TABLE
+
+Integer, a power of two. Number of buckets. Default is 512.
+
+=item MAX
+
+Integer. Number of outputs used. Default is the number of outputs.
+
+=item INTERVAL
+
+Integer. Milliseconds between two rebalancings. 0 disables periodic
+rebalancing, see the C<rebalance> handler. Default is 100.
+
+=item THRESHOLD
+
+Real number, at least 1. Buckets are moved only from outputs whose load is
+above THRESHOLD times the mean load. Default is 1.25.
+
+=item MOVES
+
+Integer. Maximum number of buckets moved per rebalancing. Default is 16.
+
+=item GAP
+
+Integer. Microseconds of inactivity after which a bucket being moved
+switches output. Default is 500.
+
+=item QUEUES
+
+Space-separated list of Storage or Pipeliner elements, one per used output,
+whose backlog is added to the load of the output.
+
+=back
+
+Packets without an IP header annotation go to output 0.
+
+=h buckets read-only
+
+One line per bucket, as "BUCKET OUTPUT TARGET LOAD MIGRATIONS": the output
+the bucket currently uses, the output it is moving to (the same if it is not
+moving), the packets it received during the last interval, and the number of
+times it was moved.
+
+=h load read-only
+
+The load of each output during the last interval, space-separated.
+
+=h migrations read-only
+
+Number of bucket moves.
+
+=h forced read-only
+
+Number of bucket moves that had to switch output without waiting for a pause.
+
+=h table read-only
+
+The output of each bucket, one per line.
+
+=h rebalance write-only
+
+Runs a rebalancing now.
+
+=e
+
+  fs :: FlowSteer(FIELDS 5tuple, QUEUES p0 p1);
+  fs[0] -> p0 :: Pipeliner -> ...;
+  fs[1] -> p1 :: Pipeliner -> ...;
+
+=a
+
+HashSwitch, Pipeliner, CPUSwitch
+*/
+
+class FlowSteer : public BatchElement { public:
+
+    FlowSteer() CLICK_COLD;
+
+    const char *class_name() const	{ return "FlowSteer"; }
+    const char *port_count() const	{ return "1/1-"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *) override;
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *) override;
+#endif
+    void run_timer(Timer *);
+
+  private:
+
+    struct Bucket {
+	volatile uint16_t output;
+	volatile uint16_t target;
+	uint32_t migrations;
+	Timestamp last;
+    };
+
+    FlowHash _hash;
+    Vector<Bucket> _buckets;
+    uint32_t _mask;
+    per_thread<Vector<uint32_t> > _counts;
+    Vector<uint32_t> _seen;
+    Vector<uint32_t> _load;
+    Vector<uint64_t> _out_load;
+
+    int _max;
+    uint32_t _interval;
+    uint32_t _threshold;
+    int _moves;
+    Timestamp _gap;
+    Vector<Element *> _queue_elements;
+    Vector<Storage *> _queues;
+    Vector<Pipeliner *> _pipeliners;
+    Timer _timer;
+
+    uint64_t _migrations;
+    uint64_t _forced;
+
+    inline int process(Packet *p);
+    int switch_output(Bucket &k);
+    void rebalance();
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+/** @brief Return the output of packet @a p, and count it in its bucket. */
+inline int
+FlowSteer::process(Packet *p)
+{
+    if (!p->has_network_header())
+	return 0;
+    uint32_t b = _hash.hash_flow(p) & _mask;
+    _counts->unchecked_at(b)++;
+    Bucket &k = _buckets.unchecked_at(b);
+    if (likely(k.target == k.output))
+	return k.output;
+    return switch_output(k);
+}
+
+CLICK_ENDDECLS
+#endif
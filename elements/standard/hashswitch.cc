@@ -23,9 +23,10 @@
 #include "hashswitch.hh"
 #include <click/error.hh>
 #include <click/args.hh>
+#include <click/straccum.hh>
 CLICK_DECLS
 
-HashSwitch::HashSwitch() : _offset(-1)
+HashSwitch::HashSwitch() : _offset(-1), _length(0), _table_mask(0)
 {
 }
 
@@ -33,36 +34,77 @@ int
 HashSwitch::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _max = noutputs();
+    String algorithm = "sum", fields, key;
+    bool symmetric = false;
+    uint32_t seed = 0, table = 0;
     if (Args(conf, this, errh)
-        .read_mp("OFFSET", _offset)
-        .read_mp("LENGTH", _length)
+        .read_p("OFFSET", _offset)
+        .read_p("LENGTH", _length)
+        .read("HASH", WordArg(), algorithm)
+        .read("FIELDS", AnyArg(), fields)
+        .read("SYMMETRIC", symmetric)
+        .read("SEED", seed)
+        .read("KEY", AnyArg(), key)
         .read("MAX", _max)
+        .read("TABLE", table)
         .complete() < 0)
     return -1;
 
-    if (_length == 0)
+    if (_hash.configure(algorithm, fields, symmetric, seed, key, errh) < 0)
+        return -1;
+    if (_hash.fields()) {
+        if (_offset >= 0)
+            return errh->error("FIELDS and OFFSET are exclusive");
+    } else if (_offset < 0)
+        return errh->error("OFFSET and LENGTH, or FIELDS, must be given");
+    else if (_length <= 0)
         return errh->error("length must be > 0");
+    else if (_length > _hash.max_length())
+        return errh->error("LENGTH must be at most %d, the KEY length minus 4", _hash.max_length());
+    if (symmetric && !_hash.fields())
+        return errh->error("SYMMETRIC requires FIELDS");
+    if (_max <= 0 || _max > noutputs())
+        return errh->error("MAX must be between 1 and the number of outputs");
 
+    _table.clear();
+    if (table) {
+        if (table & (table - 1))
+            return errh->error("TABLE must be a power of two");
+        _table.resize(table);
+        for (uint32_t i = 0; i < table; i++)
+            _table[i] = i % _max;
+        _table_mask = table - 1;
+    }
     return 0;
 }
 
+inline int
+HashSwitch::select(uint32_t h) const
+{
+    if (_table.size())
+        return _table.unchecked_at(h & _table_mask);
+    int n = _max;
+    if (_hash.algorithm() == FlowHash::SUM) {
+        if (n == 2 || n == 4 || n == 8)
+            return (h ^ (h>>4)) & (n-1);
+        else
+            return (h % n);
+    }
+    return ((uint64_t) h * n) >> 32;
+}
+
 int
 HashSwitch::process(Packet *p)
 {
-    const unsigned char *data = p->data();
+    if (_hash.fields()) {
+        if (!p->has_network_header())
+            return 0;
+        return select(_hash.hash_flow(p));
+    }
     int o = _offset, l = _length;
     if ((int)p->length() < o + l)
         return 0;
-    else {
-        int d = 0;
-        for (int i = o; i < o + l; i++)
-            d += data[i];
-        int n = _max;
-        if (n == 2 || n == 4 || n == 8)
-            return (d ^ (d>>4)) & (n-1);
-        else
-            return (d % n);
-    }
+    return select(_hash.hash(p->data() + o, l));
 }
 
 void
@@ -75,11 +117,104 @@ HashSwitch::push(int port, Packet *p)
 void
 HashSwitch::push_batch(int port, PacketBatch *batch)
 {
-    auto fnt = [this, port](Packet *p) { return process(p); };
+    // Hash blocks of packets in a tight loop ahead of the classification,
+    // so hashes of independent packets overlap
+    int outs[BATCH_AHEAD];
+    int i = 0, n = 0;
+    Packet *next = batch;
+    auto fnt = [&](Packet *) {
+        if (i == n) {
+            for (n = 0; next && n < BATCH_AHEAD; next = next->next(), n++)
+                outs[n] = process(next);
+            i = 0;
+        }
+        return outs[i++];
+    };
     CLASSIFY_EACH_PACKET(_max + 1, fnt, batch, checked_output_push_batch);
 }
 #endif
 
+/** @brief Spread the table entries over @a outputs, moving as few entries
+ * as possible. */
+int
+HashSwitch::set_outputs(const Vector<int> &outputs)
+{
+    int size = _table.size(), n = outputs.size();
+    Vector<int> quota(noutputs(), 0), count(noutputs(), 0);
+    for (int i = 0; i < n; i++)
+        quota[outputs[i]] = size / n + (i < size % n);
+
+    // Keep the entries of enabled outputs up to their quota
+    Vector<int> moved;
+    for (int e = 0; e < size; e++) {
+        int o = _table[e];
+        if (count[o] < quota[o])
+            count[o]++;
+        else
+            moved.push_back(e);
+    }
+    int o = 0;
+    for (int i = 0; i < moved.size(); i++) {
+        while (count[outputs[o]] >= quota[outputs[o]])
+            o++;
+        _table[moved[i]] = outputs[o];
+        count[outputs[o]]++;
+    }
+    return 0;
+}
+
+enum { h_outputs, h_table };
+
+String
+HashSwitch::read_handler(Element *e, void *thunk)
+{
+    HashSwitch *hs = static_cast<HashSwitch *>(e);
+    StringAccum sa;
+    if ((intptr_t) thunk == h_outputs) {
+        Vector<bool> used(hs->noutputs(), false);
+        for (int i = 0; i < hs->_table.size(); i++)
+            used[hs->_table[i]] = true;
+        for (int o = 0; o < used.size(); o++)
+            if (used[o])
+                sa << (sa.length() ? " " : "") << o;
+    } else
+        for (int i = 0; i < hs->_table.size(); i++)
+            sa << hs->_table[i] << '\n';
+    return sa.take_string();
+}
+
+int
+HashSwitch::write_handler(const String &str, Element *e, void *, ErrorHandler *errh)
+{
+    HashSwitch *hs = static_cast<HashSwitch *>(e);
+    if (!hs->_table.size())
+        return errh->error("no indirection table, set TABLE");
+    Vector<String> words;
+    cp_spacevec(str, words);
+    Vector<int> outputs;
+    Vector<bool> seen(hs->noutputs(), false);
+    for (int i = 0; i < words.size(); i++) {
+        int o;
+        if (!IntArg().parse(words[i], o) || o < 0 || o >= hs->noutputs())
+            return errh->error("bad output %<%s%>", words[i].c_str());
+        if (!seen[o])
+            outputs.push_back(o);
+        seen[o] = true;
+    }
+    if (!outputs.size())
+        return errh->error("at least one output must be used");
+    return hs->set_outputs(outputs);
+}
+
+void
+HashSwitch::add_handlers()
+{
+    add_read_handler("outputs", read_handler, h_outputs);
+    add_write_handler("outputs", write_handler, h_outputs);
+    add_read_handler("table", read_handler, h_table);
+}
+
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(FlowHash)
 EXPORT_ELEMENT(HashSwitch)
 ELEMENT_MT_SAFE(HashSwitch)
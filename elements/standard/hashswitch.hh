@@ -1,23 +1,96 @@
 #ifndef CLICK_HASHSWITCH_HH
 #define CLICK_HASHSWITCH_HH
 #include <click/batchelement.hh>
+#include "flowhash.hh"
 CLICK_DECLS
 
 /*
  * =c
- * HashSwitch(OFFSET, LENGTH)
+ * HashSwitch([OFFSET, LENGTH, I<keywords> HASH, FIELDS, SYMMETRIC, SEED, KEY, MAX, TABLE])
  * =s classification
  * classifies packets by hash of contents
  * =d
  * Can have any number of outputs.
  * Chooses the output on which to emit each packet based on
- * a hash of the LENGTH bytes starting at OFFSET.
- * Could be used for stochastic fair queuing.
+ * a hash of the LENGTH bytes starting at OFFSET, or of the IP 5-tuple
+ * fields given by FIELDS.
+ * Could be used for stochastic fair queuing, or to spread flows over
+ * threads.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item HASH
+ *
+ * Hash algorithm: C<sum> (the sum of the bytes, the historical hash of
+ * HashSwitch), C<crc32c> (CRC-32C, using SSE4.2 when the compiler targets
+ * it), C<toeplitz> (the RSS hash of NICs) or C<xxhash> (XXH32). Default is
+ * C<sum>, so existing configurations keep sending flows to the same outputs,
+ * but it spreads flows poorly: C<crc32c> is recommended for new ones.
+ *
+ * =item FIELDS
+ *
+ * Space-separated list of IP 5-tuple fields to hash, among C<src>, C<dst>,
+ * C<sport>, C<dport> and C<proto>, or C<5tuple> for all of them. The fields
+ * are read through the IP header annotation, and hashed in that order in
+ * network byte order, which is also the input of NIC receive side scaling:
+ * with C<HASH toeplitz>, C<FIELDS src dst sport dport> and TABLE set to the
+ * size of the NIC's redirection table, packets go to the output numbered
+ * like the queue the NIC would pick with the same key and a default table.
+ * Ports are zero for protocols without ports and fragments.
+ * Packets without an IP header annotation go to output 0. Replaces OFFSET
+ * and LENGTH.
+ *
+ * =item SYMMETRIC
+ *
+ * Boolean. If true, both directions of a flow go to the same output. Only
+ * with FIELDS. Default is false.
+ *
+ * =item SEED
+ *
+ * Integer. Seed of the C<crc32c> and C<xxhash> hashes. Default is 0.
+ *
+ * =item KEY
+ *
+ * Hexadecimal string. Key of the C<toeplitz> hash, at least 17 bytes long.
+ * Default is the usual 40-byte RSS key, starting with 6d5a56da. A key of
+ * N bytes hashes at most N - 4 bytes, so LENGTH must not exceed N - 4.
+ *
+ * =item MAX
+ *
+ * Integer. Number of outputs used. Default is the number of outputs.
+ *
+ * =item TABLE
+ *
+ * Integer, a power of two. If non-zero, the low bits of the hash select
+ * one of TABLE entries of an indirection table holding output numbers, like
+ * the RSS redirection table of NICs. Entry I<i> initially holds output
+ * I<i> modulo MAX. Outputs can then be enabled or disabled at runtime through the
+ * C<outputs> handler, moving only the flows of the entries that must change
+ * output. Default is 0, the output is selected from the hash directly.
+ *
+ * =back
+ *
+ * =h outputs read/write
+ *
+ * Space-separated list of the outputs in use. Only with TABLE. When written,
+ * entries of disabled outputs and of outputs above their fair share are
+ * moved to the outputs below their fair share, other entries are kept.
+ *
+ * =h table read-only
+ *
+ * The indirection table, one output number per entry.
+ *
  * =e
  * This element expects IP packets and chooses the output
  * based on a hash of the IP destination address:
  *
  *   HashSwitch(16, 4)
+ *
+ * This one spreads TCP and UDP flows, in both directions, over 4 outputs:
+ *
+ *   HashSwitch(FIELDS 5tuple, SYMMETRIC true)
  * =a
  * Switch, RoundRobinSwitch, StrideSwitch, RandomSwitch
  */
@@ -27,6 +100,17 @@ class HashSwitch : public BatchElement {
     int _offset;
     int _length;
     int _max;
+    FlowHash _hash;
+    Vector<uint16_t> _table;
+    uint32_t _table_mask;
+
+    enum { BATCH_AHEAD = 64 };
+
+    inline int select(uint32_t h) const;
+    int set_outputs(const Vector<int> &outputs);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
 
  public:
 
@@ -37,6 +121,7 @@ class HashSwitch : public BatchElement {
     const char *processing() const        { return PUSH; }
 
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
 
     int process(Packet *);
     void push(int port, Packet *);
@@ -0,0 +1,277 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * htb.{cc,hh} -- hierarchical token bucket rate limiter
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "htb.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+HTB::HTB()
+    : _classes(0), _nclasses(0), _bulk(16384), _aggregate(false)
+{
+}
+
+HTB::~HTB()
+{
+    delete[] _classes;
+}
+
+int
+HTB::parse_rates(Vector<String> &words, ClassSpec &spec, ErrorHandler *errh)
+{
+    spec.ceil = spec.burst = 0;
+    if (words.size() < 1 || words.size() > 3
+	|| !BandwidthArg().parse(words[0], spec.rate)
+	|| (words.size() > 1 && !BandwidthArg().parse(words[1], spec.ceil))
+	|| (words.size() > 2 && !IntArg().parse(words[2], spec.burst)))
+	return errh->error("expected RATE [CEIL [BURST]]");
+    if (!spec.rate)
+	return errh->error("RATE must be positive");
+    if (!spec.ceil)
+	spec.ceil = spec.rate;
+    else if (spec.ceil < spec.rate)
+	return errh->error("CEIL must be at least RATE");
+    return 0;
+}
+
+int
+HTB::parse_class(const String &str, Vector<ClassSpec> &specs, ErrorHandler *errh)
+{
+    Vector<String> words;
+    cp_spacevec(str, words);
+    if (words.size() < 3)
+	return errh->error("expected NAME PARENT RATE [CEIL [BURST]]");
+
+    ClassSpec spec;
+    spec.parent = -1;
+    if (words[1] != "-") {
+	for (int i = 0; i < specs.size() && spec.parent < 0; i++)
+	    if (specs[i].name == words[1])
+		spec.parent = i;
+	if (spec.parent < 0)
+	    return errh->error("unknown parent class %<%s%>", words[1].c_str());
+    }
+    Vector<String> rates;
+    for (int i = 2; i < words.size(); i++)
+	rates.push_back(words[i]);
+    if (parse_rates(rates, spec, errh) < 0)
+	return -1;
+
+    String name = words[0];
+    int count = 1, star = name.find_left('*');
+    if (star >= 0) {
+	if (!IntArg().parse(name.substring(star + 1), count) || count <= 0)
+	    return errh->error("bad class count in %<%s%>", name.c_str());
+	name = name.substring(0, star);
+    }
+    for (int i = 0; i < count; i++) {
+	spec.name = star >= 0 ? name + String(i) : name;
+	for (int j = 0; j < specs.size(); j++)
+	    if (specs[j].name == spec.name)
+		return errh->error("class %<%s%> redefined", spec.name.c_str());
+	specs.push_back(spec);
+    }
+    return 0;
+}
+
+void
+HTB::set_rates(Class &c, uint32_t rate, uint32_t ceil, uint32_t burst)
+{
+    c.rate = rate;
+    c.ceil = ceil;
+    c.burst = burst ? burst : ceil / 50;
+    if (c.burst < MIN_BURST)
+	c.burst = MIN_BURST;
+    // The rate bucket holds the same time worth of tokens as the ceil bucket
+    uint32_t rate_burst = (uint64_t) c.burst * rate / ceil;
+    if (rate_burst < MIN_BURST)
+	rate_burst = MIN_BURST;
+    c.rate_tb.assign(rate, rate_burst, bulk(rate_burst));
+    c.ceil_tb.assign(ceil, c.burst, bulk(c.burst));
+}
+
+int
+HTB::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Vector<String> class_conf;
+    if (Args(this, errh).bind(conf)
+	.read_all("CLASS", AnyArg(), class_conf)
+	.read("BULK", _bulk)
+	.read("AGGREGATE", _aggregate)
+	.consume() < 0)
+	return -1;
+    // Positional arguments are classes too
+    for (int i = 0; i < conf.size(); i++)
+	if (conf[i])
+	    class_conf.push_back(conf[i]);
+    if (!class_conf.size())
+	return errh->error("no classes");
+
+    Vector<ClassSpec> specs;
+    for (int i = 0; i < class_conf.size(); i++)
+	if (parse_class(cp_unquote(class_conf[i]), specs, errh) < 0)
+	    return -1;
+
+    delete[] _classes;
+    _nclasses = specs.size();
+    _classes = new Class[_nclasses];
+    Vector<bool> has_child(_nclasses, false);
+    _leaves.clear();
+    for (int i = 0; i < _nclasses; i++) {
+	Class &c = _classes[i];
+	static_cast<ClassSpec &>(c) = specs[i];
+	c.depth = c.parent < 0 ? 1 : _classes[c.parent].depth + 1;
+	if (c.depth > MAX_DEPTH)
+	    return errh->error("class %<%s%> is too deep", c.name.c_str());
+	if (c.parent >= 0) {
+	    has_child[c.parent] = true;
+	    if (c.ceil > _classes[c.parent].ceil)
+		errh->warning("class %<%s%> has a CEIL above its parent's", c.name.c_str());
+	}
+	set_rates(c, c.rate, c.ceil, c.burst);
+    }
+    for (int i = 0; i < _nclasses; i++)
+	if (!has_child[i])
+	    _leaves.push_back(i);
+    return 0;
+}
+
+int
+HTB::initialize(ErrorHandler *)
+{
+    for (unsigned i = 0; i < _state.weight(); i++)
+	_state.get_value(i).resize(_nclasses);
+    return 0;
+}
+
+/** @brief Return 0 if @a p conforms and was accounted for, 1 otherwise. */
+inline int
+HTB::process(Packet *p)
+{
+    uint32_t leaf = _aggregate ? AGGREGATE_ANNO(p) : PAINT_ANNO(p);
+    if (unlikely(leaf >= (uint32_t) _leaves.size()))
+	return 1;
+
+    ClassState *state = _state->data();
+    uint32_t len = p->length();
+    int path[MAX_DEPTH], rated[MAX_DEPTH];
+    int n = 0, nrated = 0, lender = -1;
+    int leaf_class = _leaves.unchecked_at(leaf);
+
+    for (int c = leaf_class; c >= 0; c = _classes[c].parent) {
+	Class &k = _classes[c];
+	ClassState &s = state[c];
+	if (!s.ceil.remove_if(k.ceil_tb, len))
+	    goto fail;
+	path[n++] = c;
+	// Classes above the lender are charged too, when they have tokens
+	if (s.rate.remove_if(k.rate_tb, len)) {
+	    rated[nrated++] = c;
+	    if (lender < 0)
+		lender = c;
+	}
+    }
+    if (lender < 0)
+	goto fail;
+
+    for (int i = 0; i < n; i++) {
+	state[path[i]].packets++;
+	state[path[i]].bytes += len;
+    }
+    if (lender != leaf_class)
+	state[leaf_class].borrowed++;
+    return 0;
+
+  fail:
+    for (int i = 0; i < n; i++)
+	state[path[i]].ceil.refund(len);
+    for (int i = 0; i < nrated; i++)
+	state[rated[i]].rate.refund(len);
+    state[leaf_class].drops++;
+    return 1;
+}
+
+void
+HTB::push(int, Packet *p)
+{
+    checked_output_push(process(p), p);
+}
+
+#if HAVE_BATCH
+void
+HTB::push_batch(int, PacketBatch *batch)
+{
+    auto fnt = [this](Packet *p) { return process(p); };
+    CLASSIFY_EACH_PACKET(2, fnt, batch, checked_output_push_batch);
+}
+#endif
+
+String
+HTB::read_handler(Element *e, void *)
+{
+    HTB *h = static_cast<HTB *>(e);
+    StringAccum sa;
+    for (int c = 0; c < h->_nclasses; c++) {
+	uint64_t packets = 0, bytes = 0, borrowed = 0, drops = 0;
+	for (unsigned i = 0; i < h->_state.weight(); i++) {
+	    const ClassState &s = h->_state.get_value(i)[c];
+	    packets += s.packets;
+	    bytes += s.bytes;
+	    borrowed += s.borrowed;
+	    drops += s.drops;
+	}
+	const Class &k = h->_classes[c];
+	sa << k.name << ' ' << BandwidthArg::unparse(k.rate) << ' '
+	   << BandwidthArg::unparse(k.ceil) << ' ' << packets << ' ' << bytes
+	   << ' ' << borrowed << ' ' << drops << '\n';
+    }
+    return sa.take_string();
+}
+
+int
+HTB::write_handler(const String &str, Element *e, void *, ErrorHandler *errh)
+{
+    HTB *h = static_cast<HTB *>(e);
+    Vector<String> words;
+    cp_spacevec(str, words);
+    if (!words.size())
+	return errh->error("expected NAME RATE [CEIL [BURST]]");
+    for (int c = 0; c < h->_nclasses; c++)
+	if (h->_classes[c].name == words[0]) {
+	    ClassSpec spec;
+	    Vector<String> rates;
+	    for (int i = 1; i < words.size(); i++)
+		rates.push_back(words[i]);
+	    if (h->parse_rates(rates, spec, errh) < 0)
+		return -1;
+	    h->set_rates(h->_classes[c], spec.rate, spec.ceil, spec.burst);
+	    return 0;
+	}
+    return errh->error("unknown class %<%s%>", words[0].c_str());
+}
+
+void
+HTB::add_handlers()
+{
+    add_read_handler("stats", read_handler, 0);
+    add_write_handler("set", write_handler, 0);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(HTB)
+ELEMENT_MT_SAFE(HTB)
@@ -0,0 +1,180 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_HTB_HH
+#define CLICK_HTB_HH
+#include <click/batchelement.hh>
+#include <click/tokenbucket.hh>
+#include <click/multithread.hh>
+CLICK_DECLS
+
+/*
+=c
+
+HTB(CLASS, ..., I<keywords> BULK, AGGREGATE)
+
+=s shaping
+
+hierarchical token bucket rate limiter
+
+=d
+
+Limits the rate of classes of packets arranged in a tree, like the
+hierarchical token bucket (HTB) queuing discipline of Linux. Each class has
+a guaranteed RATE and a CEIL rate it can reach by borrowing the unused rate
+of its ancestors. Packets pushed on the input belong to the leaf class
+numbered by their paint annotation, or by their aggregate annotation if
+AGGREGATE is true: leaf classes are numbered from 0 in the order they are
+declared.
+
+A packet conforms if each class from its leaf to the root has CEIL tokens
+for it, and if its leaf, or the nearest ancestor that can lend, has RATE
+tokens for it. The packet then consumes CEIL tokens of all these classes, and
+RATE tokens of its leaf or of the lender and of all the classes above it, so
+that a parent's rate accounts for what its children send. Conforming packets
+are emitted on output 0, other packets on output 1 if it exists, and are
+dropped otherwise.
+
+HTB can be used by many threads at once without a global lock: the token
+buckets of each class are shared, and each thread takes tokens from them in
+bulk into its own caches (see SharedTokenBucket). Tokens held in the caches
+of threads allow bursts up to BULK bytes per thread larger than configured.
+
+Each CLASS argument is a space-separated list "NAME PARENT RATE [CEIL
+[BURST]]":
+
+=over 8
+
+=item NAME
+
+Name of the class. A name ending with "*COUNT", like "sub*1000", declares
+COUNT leaf classes named "sub0" to "sub999" with the same parameters.
+
+=item PARENT
+
+Name of a previously declared class, or "-" for a root class.
+
+=item RATE, CEIL
+
+Bandwidths. Guaranteed and maximum rate of the class. CEIL defaults to RATE,
+so that the class never borrows.
+
+=item BURST
+
+Integer. Capacity of the CEIL token bucket of the class, in bytes. Defaults
+to 20 ms of CEIL, and at least 3000 bytes. The RATE token bucket holds the
+same time worth of tokens, and at least 3000 bytes.
+
+=back
+
+Keyword arguments are:
+
+=over 8
+
+=item BULK
+
+Integer. Maximum number of tokens, in bytes, a thread takes at once from a
+class bucket. Never more than a quarter of the class BURST. Default is 16384.
+
+=item AGGREGATE
+
+Boolean. If true, the leaf class is given by the aggregate annotation instead
+of the paint annotation. Default is false.
+
+=back
+
+Packets whose leaf class does not exist are emitted on output 1 (or dropped)
+as non-conforming.
+
+=h stats read-only
+
+One line per class: "NAME RATE CEIL PACKETS BYTES BORROWED DROPS", where
+PACKETS and BYTES count conforming packets of the class and its descendants,
+BORROWED counts packets of the class sent thanks to an ancestor's rate, and
+DROPS counts non-conforming packets of the class.
+
+=h set write-only
+
+Changes the rates of a class, as "NAME RATE [CEIL [BURST]]". The buckets of
+the class become full. Each bucket is updated under its lock, so rates can
+be changed while packets flow; tokens already taken by the threads' caches
+are still spent.
+
+=e
+
+A gateway guaranteeing 7.5 Mbps to each of two subscribers sharing 15 Mbps,
+and letting each use the whole 15 Mbps when the other is idle:
+
+  HTB(CLASS all - 15Mbps,
+      CLASS sub*2 all 7.5Mbps 15Mbps)
+
+=a BandwidthRatedSplitter, BandwidthShaper, DRRSched
+*/
+
+class HTB : public BatchElement { public:
+
+    HTB() CLICK_COLD;
+    ~HTB() CLICK_COLD;
+
+    const char *class_name() const	{ return "HTB"; }
+    const char *port_count() const	{ return "1/1-2"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *) override;
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *) override;
+#endif
+
+  private:
+
+    enum { MAX_DEPTH = 16, MIN_BURST = 3000 };
+
+    struct ClassSpec {
+	String name;
+	int parent;
+	uint32_t rate;
+	uint32_t ceil;
+	uint32_t burst;
+    };
+
+    struct Class : public ClassSpec {
+	int depth;
+	SharedTokenBucket rate_tb;
+	SharedTokenBucket ceil_tb;
+    };
+
+    // Per-thread state of a class
+    struct ClassState {
+	SharedTokenBucket::cache_type rate;
+	SharedTokenBucket::cache_type ceil;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t borrowed;
+	uint64_t drops;
+	ClassState() : packets(0), bytes(0), borrowed(0), drops(0) { }
+    };
+
+    Class *_classes;
+    int _nclasses;
+    Vector<int> _leaves;
+    uint32_t _bulk;
+    bool _aggregate;
+    per_thread<Vector<ClassState> > _state;
+
+    uint32_t bulk(uint32_t burst) const {
+	return _bulk < burst / 4 ? _bulk : burst / 4;
+    }
+    void set_rates(Class &c, uint32_t rate, uint32_t ceil, uint32_t burst);
+    int parse_class(const String &str, Vector<ClassSpec> &specs, ErrorHandler *errh);
+    int parse_rates(Vector<String> &words, ClassSpec &spec, ErrorHandler *errh);
+    inline int process(Packet *p);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,41 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * linearize.{cc,hh} -- element merges the segments of packets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "linearize.hh"
+CLICK_DECLS
+
+Linearize::Linearize()
+{
+}
+
+#if HAVE_BATCH
+PacketBatch *
+Linearize::simple_action_batch(PacketBatch *head)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(Linearize::simple_action, head, [](Packet *){});
+    return head;
+}
+#endif
+
+Packet *
+Linearize::simple_action(Packet *p)
+{
+    return p->linearize();
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(Linearize)
+ELEMENT_MT_SAFE(Linearize)
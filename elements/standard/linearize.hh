@@ -0,0 +1,40 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_LINEARIZE_HH
+#define CLICK_LINEARIZE_HH
+#include <click/batchelement.hh>
+CLICK_DECLS
+
+/*
+ * =c
+ * Linearize()
+ * =s basicmod
+ * merges the segments of packets
+ * =d
+ * Copies the data of segmented packets, such as jumbo frames received by
+ * FromDPDKDevice with SEGMENTS set, into a single buffer (see
+ * Packet::next_segment). Use it before elements that read or change the
+ * payload of packets, like checksum or encryption elements. Elements that
+ * only look at headers do not need it. Single-segment packets are passed
+ * through unchanged. Drops packets if memory is lacking.
+ * =e
+ *   FromDPDKDevice(0, MTU 9000) -> Strip(14) -> CheckIPHeader
+ *     -> Linearize -> SetUDPChecksum -> ...
+ * =a FromDPDKDevice
+ */
+
+class Linearize : public BatchElement { public:
+
+    Linearize() CLICK_COLD;
+
+    const char *class_name() const		{ return "Linearize"; }
+    const char *port_count() const		{ return PORTS_1_1; }
+
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *);
+#endif
+    Packet *simple_action(Packet *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,190 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * metricsexporter.{cc,hh} -- exports element metrics in bulk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "metricsexporter.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/hashmap.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+static const char * const type_names[] = { "counter", "gauge", "histogram" };
+
+MetricsExporter::MetricsExporter()
+    : _prefix("click")
+{
+}
+
+int
+MetricsExporter::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Vector<String> names;
+    String elements;
+    if (Args(conf, this, errh)
+	.read("ELEMENTS", AnyArg(), elements)
+	.read("PREFIX", _prefix)
+	.complete() < 0)
+	return -1;
+
+    cp_spacevec(elements, names);
+    for (int i = 0; i < names.size(); i++)
+	if (Element *e = router()->find(names[i], this, errh))
+	    _elements.push_back(e);
+	else
+	    return -1;
+    if (!names.size())
+	for (int i = 0; i < router()->nelements(); i++)
+	    _elements.push_back(router()->element(i));
+    _prefix = sanitize(_prefix);
+    return 0;
+}
+
+String
+MetricsExporter::sanitize(const String &name)
+{
+    StringAccum sa;
+    for (const char *s = name.begin(); s != name.end(); ++s)
+	if (isalnum((unsigned char) *s) || *s == '_' || *s == ':')
+	    sa << *s;
+	else
+	    sa << '_';
+    return sa.take_string();
+}
+
+int
+MetricsExporter::initialize(ErrorHandler *)
+{
+    for (int i = 0; i < _elements.size(); i++)
+	if (MetricSource *s = static_cast<MetricSource *>(_elements[i]->cast("MetricSource")))
+	    s->add_metrics(_registry);
+
+    // Precompute everything but the values
+    const Vector<MetricRegistry::Metric> &metrics = _registry.metrics();
+    HashMap<String, int> family_index(-1);
+    int offset = 0;
+    for (int i = 0; i < metrics.size(); i++) {
+	const MetricRegistry::Metric &m = metrics[i];
+	String name = _prefix + "_" + sanitize(m.name);
+	if (m.type == MetricRegistry::COUNTER)
+	    name += "_total";
+	int &f = family_index.find_force(name);
+	if (f < 0) {
+	    f = _families.size();
+	    _families.push_back(Family());
+	    Family &fam = _families.back();
+	    fam.name = name;
+	    StringAccum sa;
+	    if (m.help)
+		sa << "# HELP " << name << ' ' << m.help << '\n';
+	    sa << "# TYPE " << name << ' ' << type_names[m.type] << '\n';
+	    fam.header = sa.take_string();
+	}
+	_families[f].metrics.push_back(i);
+
+	StringAccum sa;
+	sa << "element=\"";
+	String ename = m.element->name();
+	for (const char *s = ename.begin(); s != ename.end(); ++s) {
+	    if (*s == '\\' || *s == '"')
+		sa << '\\';
+	    sa << *s;
+	}
+	sa << '"';
+	_labels.push_back(sa.take_string());
+	_offsets.push_back(offset);
+	offset += m.nvalues();
+    }
+    for (int b = 0; b < MetricHistogram::NBUCKETS - 1; b++)
+	_bounds[b] = String((uint64_t) 1 << b);
+    _bounds[MetricHistogram::NBUCKETS - 1] = "+Inf";
+    return 0;
+}
+
+String
+MetricsExporter::prometheus() const
+{
+    Vector<uint64_t> values(_registry.nvalues(), 0);
+    _registry.snapshot(values.begin());
+
+    StringAccum sa;
+    for (const Family *f = _families.begin(); f != _families.end(); ++f) {
+	sa << f->header;
+	for (int i = 0; i < f->metrics.size(); i++) {
+	    int m = f->metrics[i];
+	    const uint64_t *v = values.begin() + _offsets[m];
+	    const String &label = _labels[m];
+	    if (_registry.metrics()[m].type != MetricRegistry::HISTOGRAM) {
+		sa << f->name << '{' << label << "} " << *v << '\n';
+		continue;
+	    }
+	    uint64_t count = 0;
+	    for (int b = 0; b < MetricHistogram::NBUCKETS; b++) {
+		count += v[b];
+		sa << f->name << "_bucket{" << label << ",le=\"" << _bounds[b]
+		   << "\"} " << count << '\n';
+	    }
+	    sa << f->name << "_sum{" << label << "} " << v[MetricHistogram::NBUCKETS] << '\n'
+	       << f->name << "_count{" << label << "} " << count << '\n';
+	}
+    }
+    return sa.take_string();
+}
+
+enum { h_prometheus, h_snapshot, h_metrics };
+
+String
+MetricsExporter::read_handler(Element *e, void *thunk)
+{
+    MetricsExporter *me = static_cast<MetricsExporter *>(e);
+    const MetricRegistry &r = me->_registry;
+    switch ((intptr_t) thunk) {
+    case h_prometheus:
+	return me->prometheus();
+    case h_snapshot: {
+	Vector<uint64_t> values(2 + r.nvalues(), 0);
+	uint32_t header[2] = { SNAPSHOT_MAGIC, (uint32_t) r.nvalues() };
+	memcpy(&values[0], header, 8);
+	values[1] = Timestamp::now().nsecval();
+	r.snapshot(values.begin() + 2);
+	return String((const char *) values.begin(), values.size() * 8);
+    }
+    case h_metrics: {
+	StringAccum sa;
+	for (int i = 0; i < r.metrics().size(); i++) {
+	    const MetricRegistry::Metric &m = r.metrics()[i];
+	    sa << me->_offsets[i] << ' ' << m.element->name() << ' ' << m.name
+	       << ' ' << type_names[m.type] << ' ' << m.nvalues() << '\n';
+	}
+	return sa.take_string();
+    }
+    default:
+	return String();
+    }
+}
+
+void
+MetricsExporter::add_handlers()
+{
+    add_read_handler("prometheus", read_handler, h_prometheus);
+    add_read_handler("snapshot", read_handler, h_snapshot, Handler::f_raw);
+    add_read_handler("metrics", read_handler, h_metrics);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(MetricsExporter)
+ELEMENT_MT_SAFE(MetricsExporter)
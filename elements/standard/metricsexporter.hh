@@ -0,0 +1,121 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_METRICSEXPORTER_HH
+#define CLICK_METRICSEXPORTER_HH
+#include <click/element.hh>
+#include <click/metrics.hh>
+CLICK_DECLS
+
+/*
+=c
+
+MetricsExporter([I<keywords> ELEMENTS, PREFIX])
+
+=s information
+
+exports element metrics in bulk
+
+=d
+
+Collects the metrics published by the elements of the router, such as the
+packet and byte counts of Counter and AverageCounter elements or the delay
+histogram of TimestampDiff, and exports all of them at once through its
+handlers. Reading the metrics only loads the values registered by the
+elements, summing per-thread copies: no element handler is called and no
+lock of the data path is taken, so the metrics of thousands of elements can
+be scraped every second without disturbing packet processing.
+
+Elements publish metrics through the MetricSource interface of
+<click/metrics.hh>. Metrics are collected once, after all elements are
+initialized.
+
+Keyword arguments are:
+
+=over 8
+
+=item ELEMENTS
+
+Space-separated list of element names. Export only the metrics of these
+elements. By default, the metrics of all elements are exported.
+
+=item PREFIX
+
+String. Prefix of the exported metric names. Default is "click".
+
+=back
+
+=h prometheus read-only
+
+Returns all metrics in the Prometheus text exposition format. A metric NAME
+of element E is exported as "PREFIX_NAME{element="E"}", with a "_total"
+suffix for counters. Histograms are exported as cumulative "le" buckets
+with their sum and count. Use HTTPServer to let Prometheus scrape it, for
+instance with ALIAS_MAP "metrics:exporter/prometheus".
+
+=h snapshot read-only
+
+Returns all metric values in binary, for fast polling through ControlSocket:
+a 16-byte header made of the 32-bit magic number 0x4D455452, the 32-bit
+number of values N, and the 64-bit time of the snapshot in nanoseconds since
+the epoch, followed by N 64-bit values. All numbers are in host byte order.
+The values are in the order given by the "metrics" handler.
+
+=h metrics read-only
+
+Returns one line per metric, "INDEX ELEMENT NAME TYPE COUNT", where INDEX is
+the position of the first value of the metric in the snapshot and COUNT its
+number of values. TYPE is "counter", "gauge" or "histogram". A histogram has
+MetricHistogram::NBUCKETS bucket counts, not cumulative, followed by the sum
+of the values. The first bucket counts values up to 1, bucket I values up to
+2^I, and the last one all larger values.
+
+=e
+
+  c :: Counter;
+  exporter :: MetricsExporter;
+  HTTPServer(PORT 9100, ALIAS_MAP "metrics:exporter/prometheus");
+
+=a
+
+HTTPServer, ControlSocket, Counter, AverageCounter, TimestampDiff */
+
+class MetricsExporter : public Element { public:
+
+    MetricsExporter() CLICK_COLD;
+
+    const char *class_name() const	{ return "MetricsExporter"; }
+    const char *port_count() const	{ return PORTS_0_0; }
+    int configure_phase() const		{ return CONFIGURE_PHASE_LAST; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    const MetricRegistry &registry() const	{ return _registry; }
+
+  private:
+
+    enum { SNAPSHOT_MAGIC = 0x4D455452 };
+
+    MetricRegistry _registry;
+    Vector<Element *> _elements;
+    String _prefix;
+
+    // Prometheus families: the metrics of the same name, exported together
+    struct Family {
+	String header;
+	String name;
+	Vector<int> metrics;
+    };
+    Vector<Family> _families;
+    Vector<String> _labels;
+    Vector<int> _offsets;
+    String _bounds[MetricHistogram::NBUCKETS];
+
+    static String sanitize(const String &name);
+    String prometheus() const;
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
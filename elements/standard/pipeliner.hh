@@ -70,6 +70,13 @@ public:
         return total;
     }
 
+    unsigned long n_backlog() {
+        unsigned long total = 0;
+        for (unsigned i = 0; i < storage.weight(); i++)
+            total += storage.get_value(i).count();
+        return total;
+    }
+
     static String dropped_handler(Element *e, void *)
     {
         Pipeliner *p = static_cast<Pipeliner *>(e);
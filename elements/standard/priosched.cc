@@ -53,6 +53,30 @@ PrioSched::pull(int)
     return 0;
 }
 
+#if HAVE_BATCH
+PacketBatch *
+PrioSched::pull_batch(int, unsigned max)
+{
+    PacketBatch *batch = 0;
+    for (int i = 0; i < ninputs(); i++)
+	if (_signals[i]) {
+	    unsigned want = max - (batch ? batch->count() : 0);
+	    PacketBatch *b = input(i).pull_batch(want);
+	    if (!b)
+		continue;
+	    unsigned got = b->count();
+	    if (batch)
+		batch->append_batch(b);
+	    else
+		batch = b;
+	    // A short batch means input i is empty
+	    if (got == want)
+		break;
+	}
+    return batch;
+}
+#endif
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(PrioSched)
 ELEMENT_MT_SAFE(PrioSched)
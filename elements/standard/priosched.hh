@@ -1,7 +1,7 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_PRIOSCHED_HH
 #define CLICK_PRIOSCHED_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/notifier.hh>
 CLICK_DECLS
 
@@ -16,13 +16,16 @@ CLICK_DECLS
  * The packet from the first successful pull is returned.
  * This amounts to a strict priority scheduler.
  *
+ * When pulled in batches, PrioSched fills the batch from input 0 first, and
+ * from the next inputs only once the previous ones are empty.
+ *
  * The inputs usually come from Queues or other pull schedulers.
  * PrioSched uses notification to avoid pulling from empty inputs.
  *
  * =a Queue, RoundRobinSched, StrideSched, DRRSched, SimplePrioSched
  */
 
-class PrioSched : public Element { public:
+class PrioSched : public BatchElement { public:
 
     PrioSched() CLICK_COLD;
 
@@ -35,6 +38,9 @@ class PrioSched : public Element { public:
     void cleanup(CleanupStage) CLICK_COLD;
 
     Packet *pull(int port);
+#if HAVE_BATCH
+    PacketBatch *pull_batch(int port, unsigned max) override;
+#endif
 
   private:
 
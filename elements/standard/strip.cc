@@ -37,11 +37,8 @@ Strip::configure(Vector<String> &conf, ErrorHandler *errh)
 PacketBatch *
 Strip::simple_action_batch(PacketBatch *head)
 {
-	Packet* current = head;
-	while (current != NULL) {
-		current->pull(_nbytes);
-		current = current->next();
-	}
+	FOR_EACH_PACKET_PREFETCH(head, p, PacketPrefetcher::default_distance)
+		p->pull(_nbytes);
 	return head;
 }
 #endif
@@ -33,7 +33,6 @@ CLICK_DECLS
 const unsigned FastTCPFlows::NO_LIMIT;
 
 FastTCPFlows::FastTCPFlows()
-  : _flows(0)
 {
 #if HAVE_BATCH
   in_batch_mode = BATCH_MODE_YES;
@@ -41,6 +40,7 @@ FastTCPFlows::FastTCPFlows()
   _rate_limited = true;
   _first = _last = 0;
   _count = 0;
+  _nthreads = 1;
 }
 
 FastTCPFlows::~FastTCPFlows()
@@ -52,8 +52,10 @@ FastTCPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
 {
   _cksum = true;
   _active = true;
+  _burst = 32;
   unsigned rate;
   int limit;
+  String flow_dist = "UNIFORM", size_dist = "FIXED";
   if (Args(conf, this, errh)
       .read_mp("RATE", rate)
       .read_mp("LIMIT", limit)
@@ -65,8 +67,13 @@ FastTCPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
       .read_mp("FLOWS", _nflows)
       .read_mp("FLOWSIZE", _flowsize)
       .read_p("ACTIVE", _active)
+      .read("FLOW_DIST", AnyArg(), flow_dist)
+      .read("SIZE_DIST", AnyArg(), size_dist)
+      .read("BURST", _burst)
       .complete() < 0)
     return -1;
+  if (_nflows == 0)
+    return errh->error("FLOWS must be positive");
   if (_flowsize < 3) {
     click_chatter("warning: flow size < 3, defaulting to 3");
     _flowsize = 3;
@@ -75,260 +82,259 @@ FastTCPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
     click_chatter("warning: packet length < 60, defaulting to 60");
     _len = 60;
   }
+  if (_flow_dist.configure_popularity(cp_unquote(flow_dist), _nflows, errh) < 0
+      || _size_dist.configure_size(cp_unquote(size_dist), _flowsize, errh) < 0)
+    return -1;
   _ethh.ether_type = htons(0x0800);
-  if(rate != 0){
-    _rate_limited = true;
-    _rate.set_rate(rate, errh);
-  } else {
-    _rate_limited = false;
-  }
+  _rate = rate;
+  _rate_limited = (rate != 0);
   _limit = (limit >= 0 ? limit : NO_LIMIT);
   return 0;
 }
 
 void
-FastTCPFlows::change_ports(int flow)
+FastTCPFlows::set_rate(unsigned rate)
 {
-  unsigned short sport = (click_random() >> 2) % 0xFFFF;
-  unsigned short dport = (click_random() >> 2) % 0xFFFF;
-  WritablePacket *q = _flows[flow].syn_packet->uniqueify(); // better not fail
-  _flows[flow].syn_packet = q;
-  click_ip *ip =
-    reinterpret_cast<click_ip *>(q->data()+14);
-  click_tcp *tcp = reinterpret_cast<click_tcp *>(ip + 1);
-  tcp->th_sport = sport;
-  tcp->th_dport = dport;
-  tcp->th_sum = 0;
-  unsigned short len = _len-14-sizeof(click_ip);
-  unsigned csum = click_in_cksum((uint8_t *)tcp, len);
-  tcp->th_sum = click_in_cksum_pseudohdr(csum, ip, len);
-
-  q = _flows[flow].data_packet->uniqueify(); // better not fail
-  _flows[flow].data_packet = q;
-  ip = reinterpret_cast<click_ip *>(q->data()+14);
-  tcp = reinterpret_cast<click_tcp *>(ip + 1);
-  tcp->th_sport = sport;
-  tcp->th_dport = dport;
-  tcp->th_sum = 0;
-  len = _len-14-sizeof(click_ip);
-  csum = click_in_cksum((uint8_t *)tcp, len);
-  tcp->th_sum = click_in_cksum_pseudohdr(csum, ip, len);
+  _rate = rate;
+  _rate_limited = (rate != 0);
+  // See FastUDPFlows::set_rate()
+  unsigned thread_rate = (rate + _nthreads - 1) / _nthreads;
+  unsigned capacity = thread_rate / CLICK_HZ * 2;
+  if (capacity < _burst)
+    capacity = _burst;
+  for (unsigned i = 0; i < _state.weight(); i++) {
+    TokenBucket &tb = _state.get_value(i).tb;
+    tb.assign(thread_rate, capacity);
+    tb.set_full();
+  }
+}
 
-  q = _flows[flow].fin_packet->uniqueify(); // better not fail
-  _flows[flow].fin_packet = q;
-  ip = reinterpret_cast<click_ip *>(q->data()+14);
-  tcp = reinterpret_cast<click_tcp *>(ip + 1);
-  tcp->th_sport = sport;
-  tcp->th_dport = dport;
-  tcp->th_sum = 0;
-  len = _len-14-sizeof(click_ip);
-  csum = click_in_cksum((uint8_t *)tcp, len);
-  tcp->th_sum = click_in_cksum_pseudohdr(csum, ip, len);
+void
+FastTCPFlows::change_ports(flow_t &f, uint32_t &random)
+{
+  uint16_t sport = (FlowDistribution::random(random) >> 2) % 0xFFFF;
+  uint16_t dport = (FlowDistribution::random(random) >> 2) % 0xFFFF;
+  Packet **packets[3] = { &f.syn_packet, &f.data_packet, &f.fin_packet };
+  for (int i = 0; i < 3; i++) {
+    WritablePacket *q = (*packets[i])->uniqueify(); // better not fail
+    *packets[i] = q;
+    click_tcp *tcp = reinterpret_cast<click_tcp *>(q->data() + 14 + sizeof(click_ip));
+    click_update_in_cksum(&tcp->th_sum, tcp->th_sport, sport);
+    click_update_in_cksum(&tcp->th_sum, tcp->th_dport, dport);
+    tcp->th_sport = sport;
+    tcp->th_dport = dport;
+  }
 }
 
-Packet *
-FastTCPFlows::get_packet()
+inline Packet *
+FastTCPFlows::get_packet(state_t &s, bool closing)
 {
-  if (_limit != NO_LIMIT && _count >= _limit) {
-    for (unsigned i=0; i<_nflows; i++) {
-      if (_flows[i].flow_count != _flowsize) {
-	_flows[i].flow_count = _flowsize;
-	return _flows[i].fin_packet->clone();
+  if (closing) {
+    for (; s.next_fin < _nflows; s.next_fin++) {
+      flow_t &f = s.flows[s.next_fin];
+      if (f.flow_count != f.flow_size) {
+	f.flow_count = f.flow_size;
+	return f.fin_packet->clone();
       }
     }
-    _sent_all_fins = true;
+    s.sent_all_fins = true;
     return 0;
   }
   else {
-    int flow = (click_random() >> 2) % _nflows;
-    if (_flows[flow].flow_count == _flowsize) {
-      change_ports(flow);
-      _flows[flow].flow_count = 0;
+    flow_t &f = s.flows[_flow_dist.sample(FlowDistribution::random(s.random))];
+    if (f.flow_count == f.flow_size) {
+      change_ports(f, s.random);
+      f.flow_count = 0;
+      f.flow_size = _size_dist.sample(FlowDistribution::random(s.random));
     }
-    _flows[flow].flow_count++;
-    if (_flows[flow].flow_count == 1) {
-      return _flows[flow].syn_packet->clone();
-    } else if (_flows[flow].flow_count == _flowsize) {
-      return _flows[flow].fin_packet->clone();
+    f.flow_count++;
+    if (f.flow_count == 1) {
+      return f.syn_packet->clone();
+    } else if (f.flow_count == f.flow_size) {
+      return f.fin_packet->clone();
     } else {
-      return _flows[flow].data_packet->clone();
+      return f.data_packet->clone();
     }
   }
 }
 
+static WritablePacket *
+make_tcp_packet(unsigned plen, const click_ether &ethh, struct in_addr sipaddr,
+		struct in_addr dipaddr, uint16_t sport, uint16_t dport,
+		uint8_t flags)
+{
+  WritablePacket *q = Packet::make(plen);
+  memcpy(q->data(), &ethh, 14);
+  click_ip *ip = reinterpret_cast<click_ip *>(q->data()+14);
+  click_tcp *tcp = reinterpret_cast<click_tcp *>(ip + 1);
+  // set up IP header
+  ip->ip_v = 4;
+  ip->ip_hl = sizeof(click_ip) >> 2;
+  ip->ip_len = htons(plen-14);
+  ip->ip_id = 0;
+  ip->ip_p = IP_PROTO_TCP;
+  ip->ip_src = sipaddr;
+  ip->ip_dst = dipaddr;
+  ip->ip_tos = 0;
+  ip->ip_off = 0;
+  ip->ip_ttl = 250;
+  ip->ip_sum = 0;
+  ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
+  q->set_dst_ip_anno(IPAddress(dipaddr));
+  q->set_ip_header(ip, sizeof(click_ip));
+  // set up TCP header
+  tcp->th_sport = sport;
+  tcp->th_dport = dport;
+  tcp->th_seq = click_random();
+  tcp->th_ack = click_random();
+  tcp->th_off = sizeof(click_tcp) >> 2;
+  tcp->th_flags = flags;
+  tcp->th_win = 65535;
+  tcp->th_urp = 0;
+  tcp->th_sum = 0;
+  unsigned short len = plen-14-sizeof(click_ip);
+  unsigned csum = click_in_cksum((uint8_t *)tcp, len);
+  tcp->th_sum = click_in_cksum_pseudohdr(csum, ip, len);
+  return q;
+}
 
-int
-FastTCPFlows::initialize(ErrorHandler *)
+void
+FastTCPFlows::build_flows(state_t &s)
 {
-  _count = 0;
-  _sent_all_fins = false;
-  _flows = new flow_t[_nflows];
+  s.random = click_random() | 1;
+  s.next_fin = 0;
+  s.sent_all_fins = false;
+  s.flows = new flow_t[_nflows];
 
   for (unsigned i=0; i<_nflows; i++) {
-    unsigned short sport = (click_random() >> 2) % 0xFFFF;
-    unsigned short dport = (click_random() >> 2) % 0xFFFF;
-
-    // SYN packet
-    WritablePacket *q = Packet::make(_len);
-    _flows[i].syn_packet = q;
-    memcpy((void*)_flows[i].syn_packet->data(), &_ethh, 14);
-    click_ip *ip =
-      reinterpret_cast<click_ip *>(q->data()+14);
-    click_tcp *tcp = reinterpret_cast<click_tcp *>(ip + 1);
-    // set up IP header
-    ip->ip_v = 4;
-    ip->ip_hl = sizeof(click_ip) >> 2;
-    ip->ip_len = htons(_len-14);
-    ip->ip_id = 0;
-    ip->ip_p = IP_PROTO_TCP;
-    ip->ip_src = _sipaddr;
-    ip->ip_dst = _dipaddr;
-    ip->ip_tos = 0;
-    ip->ip_off = 0;
-    ip->ip_ttl = 250;
-    ip->ip_sum = 0;
-    ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
-    _flows[i].syn_packet->set_dst_ip_anno(IPAddress(_dipaddr));
-    _flows[i].syn_packet->set_ip_header(ip, sizeof(click_ip));
-    // set up TCP header
-    tcp->th_sport = sport;
-    tcp->th_dport = dport;
-    tcp->th_seq = click_random();
-    tcp->th_ack = click_random();
-    tcp->th_off = sizeof(click_tcp) >> 2;
-    tcp->th_flags = TH_SYN;
-    tcp->th_win = 65535;
-    tcp->th_urp = 0;
-    tcp->th_sum = 0;
-    unsigned short len = _len-14-sizeof(click_ip);
-    unsigned csum = click_in_cksum((uint8_t *)tcp, len);
-    tcp->th_sum = click_in_cksum_pseudohdr(csum, ip, len);
-
+    unsigned short sport = (FlowDistribution::random(s.random) >> 2) % 0xFFFF;
+    unsigned short dport = (FlowDistribution::random(s.random) >> 2) % 0xFFFF;
+    flow_t &f = s.flows[i];
+    f.syn_packet = make_tcp_packet(_len, _ethh, _sipaddr, _dipaddr, sport, dport, TH_SYN);
     // DATA packet with PUSH and ACK
-    q = Packet::make(_len);
-    _flows[i].data_packet = q;
-    memcpy(q->data(), &_ethh, 14);
-    ip = reinterpret_cast<click_ip *>(q->data()+14);
-    tcp = reinterpret_cast<click_tcp *>(ip + 1);
-    // set up IP header
-    ip->ip_v = 4;
-    ip->ip_hl = sizeof(click_ip) >> 2;
-    ip->ip_len = htons(_len-14);
-    ip->ip_id = 0;
-    ip->ip_p = IP_PROTO_TCP;
-    ip->ip_src = _sipaddr;
-    ip->ip_dst = _dipaddr;
-    ip->ip_tos = 0;
-    ip->ip_off = 0;
-    ip->ip_ttl = 250;
-    ip->ip_sum = 0;
-    ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
-    _flows[i].data_packet->set_dst_ip_anno(IPAddress(_dipaddr));
-    _flows[i].data_packet->set_ip_header(ip, sizeof(click_ip));
-    // set up TCP header
-    tcp->th_sport = sport;
-    tcp->th_dport = dport;
-    tcp->th_seq = click_random();
-    tcp->th_ack = click_random();
-    tcp->th_off = sizeof(click_tcp) >> 2;
-    tcp->th_flags = TH_PUSH | TH_ACK;
-    tcp->th_win = 65535;
-    tcp->th_urp = 0;
-    tcp->th_sum = 0;
-    len = _len-14-sizeof(click_ip);
-    csum = click_in_cksum((uint8_t *)tcp, len);
-    tcp->th_sum = click_in_cksum_pseudohdr(csum, ip, len);
-
-    // FIN packet
-    q = Packet::make(_len);
-    _flows[i].fin_packet = q;
-    memcpy(q->data(), &_ethh, 14);
-    ip = reinterpret_cast<click_ip *>(q->data()+14);
-    tcp = reinterpret_cast<click_tcp *>(ip + 1);
-    // set up IP header
-    ip->ip_v = 4;
-    ip->ip_hl = sizeof(click_ip) >> 2;
-    ip->ip_len = htons(_len-14);
-    ip->ip_id = 0;
-    ip->ip_p = IP_PROTO_TCP;
-    ip->ip_src = _sipaddr;
-    ip->ip_dst = _dipaddr;
-    ip->ip_tos = 0;
-    ip->ip_off = 0;
-    ip->ip_ttl = 250;
-    ip->ip_sum = 0;
-    ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
-    _flows[i].fin_packet->set_dst_ip_anno(IPAddress(_dipaddr));
-    _flows[i].fin_packet->set_ip_header(ip, sizeof(click_ip));
-    // set up TCP header
-    tcp->th_sport = sport;
-    tcp->th_dport = dport;
-    tcp->th_seq = click_random();
-    tcp->th_ack = click_random();
-    tcp->th_off = sizeof(click_tcp) >> 2;
-    tcp->th_flags = TH_FIN;
-    tcp->th_win = 65535;
-    tcp->th_urp = 0;
-    tcp->th_sum = 0;
-    len = _len-14-sizeof(click_ip);
-    csum = click_in_cksum((uint8_t *)tcp, len);
-    tcp->th_sum = click_in_cksum_pseudohdr(csum, ip, len);
-
-    _flows[i].flow_count = 0;
+    f.data_packet = make_tcp_packet(_len, _ethh, _sipaddr, _dipaddr, sport, dport, TH_PUSH | TH_ACK);
+    f.fin_packet = make_tcp_packet(_len, _ethh, _sipaddr, _dipaddr, sport, dport, TH_FIN);
+    f.flow_count = 0;
+    f.flow_size = _size_dist.sample(FlowDistribution::random(s.random));
   }
-  _last_flow = 0;
+}
+
+int
+FastTCPFlows::initialize(ErrorHandler *)
+{
+  _count = 0;
+  Bitvector threads = get_passing_threads();
+  _nthreads = threads.weight() ? threads.weight() : 1;
+  for (unsigned i = 0; i < _state.weight(); i++)
+    if (i < (unsigned) threads.size() && threads[i])
+      build_flows(_state.get_value(i));
+  set_rate(_rate);
   return 0;
 }
 
 void
 FastTCPFlows::cleanup(CleanupStage)
 {
-  if (_flows) {
-    for (unsigned i=0; i<_nflows; i++) {
-      _flows[i].syn_packet->kill();
-      _flows[i].data_packet->kill();
-      _flows[i].fin_packet->kill();
+  for (unsigned t = 0; t < _state.weight(); t++) {
+    state_t &s = _state.get_value(t);
+    if (s.flows) {
+      for (unsigned i=0; i<_nflows; i++) {
+	s.flows[i].syn_packet->kill();
+	s.flows[i].data_packet->kill();
+	s.flows[i].fin_packet->kill();
+      }
+      delete[] s.flows;
+      s.flows = 0;
     }
-    delete[] _flows;
-    _flows = 0;
   }
 }
 
-Packet *
-FastTCPFlows::pull(int)
+/** @brief Return how many packets, up to @a max, may be sent now, and
+ * account for them. Sets @a closing if the limit is reached and these
+ * packets are FINs closing the open flows. */
+inline unsigned
+FastTCPFlows::admit(state_t &s, unsigned max, bool &closing)
 {
-  Packet *p = 0;
-
   if (!_active)
     return 0;
-  if (_limit != NO_LIMIT && _count >= _limit && _sent_all_fins)
+  if (unlikely(!s.flows))
+    build_flows(s);
+  if (s.sent_all_fins)
     return 0;
 
-  if(_rate_limited){
-    if (_rate.need_update(Timestamp::now())) {
-      _rate.update();
-      p = get_packet();
-    }
+  if (_rate_limited) {
+    s.tb.refill();
+    unsigned avail = s.tb.size();
+    if (avail < max)
+      max = avail;
+    if (!max)
+      return 0;
+  }
+
+  uint32_t c, n = max;
+  closing = false;
+  if (_limit != NO_LIMIT) {
+    do {
+      c = _count.value();
+      closing = (c >= _limit);
+      n = (closing || _limit - c >= max ? max : _limit - c);
+    } while (_count.compare_swap(c, c + n) != c);
   } else
-    p = get_packet();
+    c = _count.fetch_and_add(n);
 
-  if(p) {
-    _count++;
-    if(_count == 1)
-      _first = click_jiffies();
-    if(_limit != NO_LIMIT && _count >= _limit)
-      _last = click_jiffies();
-  }
+  if (c == 0)
+    _first = click_jiffies();
+  if (_limit != NO_LIMIT && !closing && c + n >= _limit)
+    _last = click_jiffies();
+  return n;
+}
 
-  return(p);
+Packet *
+FastTCPFlows::pull(int)
+{
+  state_t &s = *_state;
+  bool closing;
+  if (!admit(s, 1, closing))
+    return 0;
+  Packet *p = get_packet(s, closing);
+  if (p) {
+    if (_rate_limited)
+      s.tb.remove(1);
+  } else
+    _count--;
+  return p;
 }
 
 #if HAVE_BATCH
 PacketBatch *
-FastTCPFlows::pull_batch(int port, unsigned max) {
-      PacketBatch *batch;
-      MAKE_BATCH(FastTCPFlows::pull(port), batch, max);
-      return batch;
+FastTCPFlows::pull_batch(int, unsigned max) {
+  state_t &s = *_state;
+  bool closing;
+  unsigned n = admit(s, max, closing);
+  if (!n)
+    return 0;
+
+  PacketBatch *head = 0;
+  Packet *last = 0;
+  unsigned count = 0;
+  for (; count < n; count++) {
+    Packet *p = get_packet(s, closing);
+    if (!p)
+      break;
+    if (head)
+      last->set_next(p);
+    else
+      head = PacketBatch::start_head(p);
+    last = p;
+  }
+  // Only FINs may run out: give back the unused count
+  if (count < n)
+    _count -= n - count;
+  if (_rate_limited)
+    s.tb.remove(count);
+  if (head)
+    head->make_tail(last, count);
+  return head;
 }
 #endif
 
@@ -338,7 +344,10 @@ FastTCPFlows::reset()
   _count = 0;
   _first = 0;
   _last = 0;
-  _sent_all_fins = false;
+  for (unsigned i = 0; i < _state.weight(); i++) {
+    _state.get_value(i).next_fin = 0;
+    _state.get_value(i).sent_all_fins = false;
+  }
 }
 
 static String
@@ -391,10 +400,7 @@ FastTCPFlows_rate_write_handler
   unsigned rate;
   if (!IntArg().parse(s, rate))
     return errh->error("rate parameter must be integer >= 0");
-  if (rate > GapRate::MAX_RATE)
-    // report error rather than pin to max
-    return errh->error("rate too large; max is %u", GapRate::MAX_RATE);
-  c->_rate.set_rate(rate);
+  c->set_rate(rate);
   return 0;
 }
 
@@ -424,3 +430,4 @@ FastTCPFlows::add_handlers()
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(FastTCPFlows)
+ELEMENT_MT_SAFE(FastTCPFlows)
@@ -2,10 +2,13 @@
 #define FASTTCPFLOWS_HH
 #include <click/batchelement.hh>
 #include <click/glue.hh>
-#include <click/gaprate.hh>
+#include <click/atomic.hh>
+#include <click/multithread.hh>
+#include <click/tokenbucket.hh>
 #include <click/packet.hh>
 #include <clicknet/ether.h>
 #include <clicknet/tcp.h>
+#include "flowdistribution.hh"
 
 CLICK_DECLS
 
@@ -14,7 +17,8 @@ CLICK_DECLS
  * FastTCPFlows(RATE, LIMIT, LENGTH,
  *              SRCETH, SRCIP,
  *              DSTETH, DSTIP,
- *              FLOWS, FLOWSIZE [, ACTIVE])
+ *              FLOWS, FLOWSIZE [, ACTIVE,
+ *              I<keywords> FLOW_DIST, SIZE_DIST, BURST])
  * =s tcp
  * creates packets flows with static TCP/IP/Ethernet headers
  * =d
@@ -28,13 +32,20 @@ CLICK_DECLS
  * copying or cloning. Therefore, the packet returned by FastTCPFlows should
  * not be modified.
  *
- * FastTCPFlows sents packets at RATE packets per second. It will send LIMIT
- * number of packets in total. Each flow is limited to FLOWSIZE number of
- * packets. After FLOWSIZE number of packets are sent, the sort and dst port
- * will be modified. FLOWSIZE must be greater than or equal to 3. For each
+ * FastTCPFlows sents packets at RATE packets per second, or as fast as
+ * possible if RATE is 0. It will send LIMIT number of packets in total, plus
+ * the FIN packets closing the flows still open. Each flow is limited to
+ * FLOWSIZE number of packets. After FLOWSIZE number of packets are sent, the
+ * sort and dst port will be modified in place, and the TCP checksums updated
+ * incrementally. FLOWSIZE must be greater than or equal to 3. For each
  * flow, a SYN packet, a DATA packet, and a FIN packet are sent. These packets
  * have the invalid sequence numbers, in order to avoid recomputing checksum.
  *
+ * In batch mode, FastTCPFlows produces whole batches at once. Like
+ * FastUDPFlows, it can be pulled by several threads, each with its own FLOWS
+ * flows and share of RATE. The FLOW_DIST, SIZE_DIST and BURST keyword
+ * arguments are those of FastUDPFlows.
+ *
  * After FastTCPFlows has sent LIMIT packets, it will calculate the average
  * send rate (packets per second) between the first and last packets sent and
  * make that available in the rate handler.
@@ -56,38 +67,56 @@ CLICK_DECLS
  *               1:1:1:1:1:1, 2.0.0.2,
  *               100, 10)
  *    -> ToDevice;
+ *
+ * =a FastUDPFlows
  */
 class FastTCPFlows : public BatchElement {
 
   bool _rate_limited;
-  bool _sent_all_fins;
   unsigned _len;
   click_ether _ethh;
   struct in_addr _sipaddr;
   struct in_addr _dipaddr;
   unsigned int _nflows;
-  unsigned int _last_flow;
   unsigned int _flowsize;
   bool _cksum;
+  unsigned _burst;
+  unsigned _nthreads;
   click_jiffies_t _first;
   click_jiffies_t _last;
+  FlowDistribution _flow_dist;
+  FlowDistribution _size_dist;
 
   struct flow_t {
     Packet *syn_packet;
     Packet *fin_packet;
     Packet *data_packet;
     unsigned flow_count;
+    unsigned flow_size;
   };
-  flow_t *_flows;
-  void change_ports(int);
-  Packet *get_packet();
+
+  // Flows and rate of a thread
+  struct state_t {
+    flow_t *flows;
+    uint32_t random;
+    unsigned next_fin;
+    bool sent_all_fins;
+    TokenBucket tb;
+    state_t() : flows(0), random(0), next_fin(0), sent_all_fins(false) { }
+  };
+  per_thread<state_t> _state;
+
+  void build_flows(state_t &s);
+  void change_ports(flow_t &f, uint32_t &random);
+  inline unsigned admit(state_t &s, unsigned max, bool &closing);
+  inline Packet *get_packet(state_t &s, bool closing);
 
  public:
 
   static const unsigned NO_LIMIT = 0xFFFFFFFFU;
 
-  GapRate _rate;
-  unsigned _count;
+  unsigned _rate;
+  atomic_uint32_t _count;
   unsigned _limit;
   bool _active;
 
@@ -107,9 +136,10 @@ class FastTCPFlows : public BatchElement {
   PacketBatch *pull_batch(int, unsigned);
 #endif
 
+  void set_rate(unsigned rate);
   void add_handlers() CLICK_COLD;
   void reset();
-  unsigned count() { return _count; }
+  unsigned count() { return _count.value(); }
   click_jiffies_t first() { return _first; }
   click_jiffies_t last() { return _last; }
 };
@@ -34,7 +34,6 @@ CLICK_DECLS
 const unsigned FastUDPFlows::NO_LIMIT;
 
 FastUDPFlows::FastUDPFlows()
-  : _flows(0)
 {
 #if HAVE_BATCH
   in_batch_mode = BATCH_MODE_YES;
@@ -43,6 +42,7 @@ FastUDPFlows::FastUDPFlows()
   _first = _last = 0;
   _count = 0;
   _stop = false;
+  _nthreads = 1;
 }
 
 FastUDPFlows::~FastUDPFlows()
@@ -54,9 +54,11 @@ FastUDPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
 {
   _cksum = true;
   _active = true;
+  _burst = 32;
   unsigned rate;
   int limit;
   int len;
+  String flow_dist = "UNIFORM", size_dist = "FIXED";
   if (Args(conf, this, errh)
       .read_mp("RATE", rate)
       .read_mp("LIMIT", limit)
@@ -70,68 +72,86 @@ FastUDPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
       .read_p("CHECKSUM", _cksum)
       .read_p("ACTIVE", _active)
       .read_p("STOP", _stop)
+      .read("FLOW_DIST", AnyArg(), flow_dist)
+      .read("SIZE_DIST", AnyArg(), size_dist)
+      .read("BURST", _burst)
       .complete() < 0)
     return -1;
+  if (_nflows == 0)
+    return errh->error("FLOWS must be positive");
+  if (_flow_dist.configure_popularity(cp_unquote(flow_dist), _nflows, errh) < 0
+      || _size_dist.configure_size(cp_unquote(size_dist), _flowsize, errh) < 0)
+    return -1;
   set_length(len);
   _ethh.ether_type = htons(0x0800);
-  if(rate != 0){
-    _rate_limited = true;
-    _rate.set_rate(rate, errh);
-  } else {
-    _rate_limited = false;
-  }
+  _rate = rate;
+  _rate_limited = (rate != 0);
   _limit = (limit >= 0 ? limit : NO_LIMIT);
   return 0;
 }
 
 void
-FastUDPFlows::change_ports(int flow)
+FastUDPFlows::set_rate(unsigned rate)
+{
+  _rate = rate;
+  _rate_limited = (rate != 0);
+  // Each thread sends its share of the rate, and keeps at least two jiffies
+  // worth of tokens so that it can reach the rate with one batch per jiffy
+  unsigned thread_rate = (rate + _nthreads - 1) / _nthreads;
+  unsigned capacity = thread_rate / CLICK_HZ * 2;
+  if (capacity < _burst)
+    capacity = _burst;
+  for (unsigned i = 0; i < _state.weight(); i++) {
+    TokenBucket &tb = _state.get_value(i).tb;
+    tb.assign(thread_rate, capacity);
+    tb.set_full();
+  }
+}
+
+void
+FastUDPFlows::change_ports(flow_t &f, uint32_t &random)
 {
-  WritablePacket *q = _flows[flow].packet->uniqueify(); // better not fail
-  _flows[flow].packet = q;
-  click_ip *ip = reinterpret_cast<click_ip *>(q->data()+14);
-  click_udp *udp = reinterpret_cast<click_udp *>(ip + 1);
-
-  udp->uh_sport = (click_random() >> 2) % 0xFFFF;
-  udp->uh_dport = (click_random() >> 2) % 0xFFFF;
-  udp->uh_sum = 0;
-  unsigned short len = _len-14-sizeof(click_ip);
+  WritablePacket *q = f.packet->uniqueify(); // better not fail
+  f.packet = q;
+  click_udp *udp = reinterpret_cast<click_udp *>(q->data() + 14 + sizeof(click_ip));
+
+  uint16_t sport = (FlowDistribution::random(random) >> 2) % 0xFFFF;
+  uint16_t dport = (FlowDistribution::random(random) >> 2) % 0xFFFF;
+  // Only the ports change: update the checksum rather than recomputing it
+  // over the whole payload
   if (_cksum) {
-    unsigned csum = click_in_cksum((uint8_t *)udp, len);
-    udp->uh_sum = click_in_cksum_pseudohdr(csum, ip, len);
-  } else
-    udp->uh_sum = 0;
+    click_update_in_cksum(&udp->uh_sum, udp->uh_sport, sport);
+    click_update_in_cksum(&udp->uh_sum, udp->uh_dport, dport);
+    if (udp->uh_sum == 0)
+      udp->uh_sum = 0xFFFF;
+  }
+  udp->uh_sport = sport;
+  udp->uh_dport = dport;
 }
 
-Packet *
-FastUDPFlows::get_packet()
+inline Packet *
+FastUDPFlows::get_packet(state_t &s)
 {
-#if 0
-  int flow = _last_flow;
-  _last_flow = _last_flow+1;
-  if (_last_flow >= _nflows) _last_flow = 0;
-#else
-  int flow = (click_random() >> 2) % _nflows;
-#endif
+  flow_t &f = s.flows[_flow_dist.sample(FlowDistribution::random(s.random))];
 
-  if (_flows[flow].flow_count == _flowsize) {
-    change_ports(flow);
-    _flows[flow].flow_count = 0;
+  if (f.flow_count >= f.flow_size) {
+    change_ports(f, s.random);
+    f.flow_count = 0;
+    f.flow_size = _size_dist.sample(FlowDistribution::random(s.random));
   }
-  _flows[flow].flow_count++;
-  return _flows[flow].packet->clone();
+  f.flow_count++;
+  return f.packet->clone();
 }
 
-
-int
-FastUDPFlows::initialize(ErrorHandler *)
+void
+FastUDPFlows::build_flows(state_t &s)
 {
-  _count = 0;
-  _flows = new flow_t[_nflows];
+  s.random = click_random() | 1;
+  s.flows = new flow_t[_nflows];
 
   for (unsigned i=0; i<_nflows; i++) {
     WritablePacket *q = Packet::make(_len);
-    _flows[i].packet = q;
+    s.flows[i].packet = q;
     memcpy(q->data(), &_ethh, 14);
     click_ip *ip = reinterpret_cast<click_ip *>(q->data()+14);
     click_udp *udp = reinterpret_cast<click_udp *>(ip + 1);
@@ -149,36 +169,55 @@ FastUDPFlows::initialize(ErrorHandler *)
     ip->ip_ttl = 250;
     ip->ip_sum = 0;
     ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
-    _flows[i].packet->set_dst_ip_anno(IPAddress(_dipaddr));
-    _flows[i].packet->set_ip_header(ip, sizeof(click_ip));
+    q->set_dst_ip_anno(IPAddress(_dipaddr));
+    q->set_ip_header(ip, sizeof(click_ip));
 
     // set up UDP header
-    udp->uh_sport = (click_random() >> 2) % 0xFFFF;
-    udp->uh_dport = (click_random() >> 2) % 0xFFFF;
+    udp->uh_sport = (FlowDistribution::random(s.random) >> 2) % 0xFFFF;
+    udp->uh_dport = (FlowDistribution::random(s.random) >> 2) % 0xFFFF;
     udp->uh_sum = 0;
     unsigned short len = _len-14-sizeof(click_ip);
     udp->uh_ulen = htons(len);
     if (_cksum) {
       unsigned csum = click_in_cksum((uint8_t *)udp, len);
       udp->uh_sum = click_in_cksum_pseudohdr(csum, ip, len);
+      if (udp->uh_sum == 0)
+        udp->uh_sum = 0xFFFF;
     } else
       udp->uh_sum = 0;
-    _flows[i].flow_count = 0;
+    s.flows[i].flow_count = 0;
+    s.flows[i].flow_size = _size_dist.sample(FlowDistribution::random(s.random));
   }
-  _last_flow = 0;
+}
+
+int
+FastUDPFlows::initialize(ErrorHandler *)
+{
+  _count = 0;
+  // Build the flows of the threads known to pull from us now; others build
+  // theirs on their first pull
+  Bitvector threads = get_passing_threads();
+  _nthreads = threads.weight() ? threads.weight() : 1;
+  for (unsigned i = 0; i < _state.weight(); i++)
+    if (i < (unsigned) threads.size() && threads[i])
+      build_flows(_state.get_value(i));
+  set_rate(_rate);
   return 0;
 }
 
 void
 FastUDPFlows::cleanup_flows() {
-    if (_flows) {
-        for (unsigned i=0; i<_nflows; i++) {
-            _flows[i].packet->kill();
-            _flows[i].packet=0;
-        }
-        delete[] _flows;
-        _flows = 0;
+  for (unsigned t = 0; t < _state.weight(); t++) {
+    state_t &s = _state.get_value(t);
+    if (s.flows) {
+      for (unsigned i=0; i<_nflows; i++) {
+        s.flows[i].packet->kill();
+        s.flows[i].packet=0;
+      }
+      delete[] s.flows;
+      s.flows = 0;
     }
+  }
 }
 
 void
@@ -187,41 +226,74 @@ FastUDPFlows::cleanup(CleanupStage)
 	cleanup_flows();
 }
 
-Packet *
-FastUDPFlows::pull(int)
+/** @brief Return how many packets, up to @a max, may be sent now, and
+ * account for them. */
+inline unsigned
+FastUDPFlows::admit(state_t &s, unsigned max)
 {
-  Packet *p = 0;
-
-  if (!_active || (_limit != NO_LIMIT && _count >= _limit)) return 0;
+  if (!_active)
+    return 0;
+
+  if (_rate_limited) {
+    s.tb.refill();
+    unsigned avail = s.tb.size();
+    if (avail < max)
+      max = avail;
+    if (!max)
+      return 0;
+  }
 
-  if(_rate_limited){
-    if (_rate.need_update(Timestamp::now())) {
-      _rate.update();
-      p = get_packet();
-    }
+  uint32_t c, n = max;
+  if (_limit != NO_LIMIT) {
+    do {
+      c = _count.value();
+      if (c >= _limit)
+        return 0;
+      n = (_limit - c < max ? _limit - c : max);
+    } while (_count.compare_swap(c, c + n) != c);
   } else
-    p = get_packet();
-
-  if(p) {
-    _count++;
-    if(_count == 1)
-      _first = click_jiffies();
-    if(_limit != NO_LIMIT && _count >= _limit) {
-      _last = click_jiffies();
-      if (_stop)
-          router()->please_stop_driver();
-    }
+    c = _count.fetch_and_add(n);
+
+  if (unlikely(!s.flows))
+    build_flows(s);
+  if (_rate_limited)
+    s.tb.remove(n);
+  if (c == 0)
+    _first = click_jiffies();
+  if (_limit != NO_LIMIT && c + n >= _limit) {
+    _last = click_jiffies();
+    if (_stop)
+      router()->please_stop_driver();
   }
+  return n;
+}
 
-  return(p);
+Packet *
+FastUDPFlows::pull(int)
+{
+  state_t &s = *_state;
+  if (admit(s, 1))
+    return get_packet(s);
+  return 0;
 }
 
 #if HAVE_BATCH
 PacketBatch *
-FastUDPFlows::pull_batch(int port, unsigned max) {
-    PacketBatch *batch;
-    MAKE_BATCH(FastUDPFlows::pull(port), batch, max);
-    return batch;
+FastUDPFlows::pull_batch(int, unsigned max) {
+  state_t &s = *_state;
+  unsigned n = admit(s, max);
+  if (!n)
+    return 0;
+
+  PacketBatch *head = PacketBatch::start_head(get_packet(s));
+  Packet *last = head;
+  for (unsigned i = 1; i < n; i++) {
+    Packet *p = get_packet(s);
+    last->set_next(p);
+    last = p;
+  }
+  head->make_tail(last, n);
+  return head;
 }
 #endif
 
@@ -284,10 +356,7 @@ FastUDPFlows_rate_write_handler
   unsigned rate;
   if (!IntArg().parse(s, rate))
     return errh->error("rate parameter must be integer >= 0");
-  if (rate > GapRate::MAX_RATE)
-    // report error rather than pin to max
-    return errh->error("rate too large; max is %u", GapRate::MAX_RATE);
-  c->_rate.set_rate(rate);
+  c->set_rate(rate);
   return 0;
 }
 
@@ -335,3 +404,4 @@ FastUDPFlows::add_handlers()
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(FastUDPFlows)
+ELEMENT_MT_SAFE(FastUDPFlows)
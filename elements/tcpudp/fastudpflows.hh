@@ -2,10 +2,13 @@
 #define FASTUDPFLOWS_HH
 #include <click/batchelement.hh>
 #include <click/glue.hh>
-#include <click/gaprate.hh>
+#include <click/atomic.hh>
+#include <click/multithread.hh>
+#include <click/tokenbucket.hh>
 #include <click/packet.hh>
 #include <clicknet/ether.h>
 #include <clicknet/udp.h>
+#include "flowdistribution.hh"
 
 CLICK_DECLS
 
@@ -14,7 +17,8 @@ CLICK_DECLS
  * FastUDPFlows(RATE, LIMIT, LEN,
  *              SRCETH, SRCIP,
  *              DSTETH, DSTIP,
- *              FLOWS, FLOWSIZE [, CHECKSUM, ACTIVE])
+ *              FLOWS, FLOWSIZE [, CHECKSUM, ACTIVE, STOP,
+ *              I<keywords> FLOW_DIST, SIZE_DIST, BURST])
  * =s udp
  * creates packets flows with static UDP/IP/Ethernet headers
  * =d
@@ -28,17 +32,47 @@ CLICK_DECLS
  * skbuff created and returns the skbuff object w/o copying or cloning.
  * Therefore, the packet returned by FastUDPFlows should not be modified.
  *
- * FastUDPFlows sents packets at RATE packets per second. It will send LIMIT
- * number of packets in total. Each flow is limited to FLOWSIZE number of
- * packets. After FLOWSIZE number of packets are sent, the sort and dst port
- * will be modified.
+ * FastUDPFlows sents packets at RATE packets per second, or as fast as
+ * possible if RATE is 0. It will send LIMIT number of packets in total. Each
+ * flow is limited to FLOWSIZE number of packets. After FLOWSIZE number of
+ * packets are sent, the sort and dst port will be modified in place, and the
+ * UDP checksum updated incrementally.
  *
  * After FastUDPFlows has sent LIMIT packets, it will calculate the average
  * send rate (packets per second) between the first and last packets sent and
- * make that available in the rate handler.
+ * make that available in the rate handler. If STOP is true, it then stops
+ * the driver.
  *
  * By default FastUDPFlows is ACTIVE.
  *
+ * In batch mode, FastUDPFlows produces whole batches at once, checking the
+ * rate and the limit once per batch. It can be pulled by several threads:
+ * each thread has its own FLOWS flows and sends at RATE divided by the
+ * number of threads that pull from it, while LIMIT is shared.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item FLOW_DIST
+ *
+ * Popularity of the flows: UNIFORM picks each flow with the same
+ * probability, "ZIPF S" picks the Ith flow with a probability proportional
+ * to 1/I^S. Default is UNIFORM.
+ *
+ * =item SIZE_DIST
+ *
+ * Size of the flows: FIXED sends FLOWSIZE packets per flow, "PARETO A"
+ * draws the size of each new flow from a Pareto distribution of shape A and
+ * minimum FLOWSIZE. Default is FIXED.
+ *
+ * =item BURST
+ *
+ * Integer. Maximum number of packets sent at once to catch up with RATE.
+ * Never less than two jiffies' worth of packets. Default is 32.
+ *
+ * =back
+ *
  * =h count read-only
  * Returns the total number of packets that have been generated.
  * =h rate read/write
@@ -54,6 +88,8 @@ CLICK_DECLS
  *               1:1:1:1:1:1, 2.0.0.2,
  *               100, 10)
  *    -> ToDevice;
+ *
+ * =a FastTCPFlows, FastUDPSource
  */
 
 class FastUDPFlows : public BatchElement {
@@ -64,19 +100,34 @@ class FastUDPFlows : public BatchElement {
   struct in_addr _sipaddr;
   struct in_addr _dipaddr;
   unsigned int _nflows;
-  unsigned int _last_flow;
   unsigned int _flowsize;
   bool _cksum;
+  unsigned _burst;
+  unsigned _nthreads;
   click_jiffies_t _first;
   click_jiffies_t _last;
+  FlowDistribution _flow_dist;
+  FlowDistribution _size_dist;
 
   struct flow_t {
       Packet *packet;
       unsigned flow_count;
+      unsigned flow_size;
   };
-  flow_t *_flows;
-  void change_ports(int);
-  Packet *get_packet();
+
+  // Flows and rate of a thread
+  struct state_t {
+      flow_t *flows;
+      uint32_t random;
+      TokenBucket tb;
+      state_t() : flows(0), random(0) { }
+  };
+  per_thread<state_t> _state;
+
+  void build_flows(state_t &s);
+  void change_ports(flow_t &f, uint32_t &random);
+  inline unsigned admit(state_t &s, unsigned max);
+  inline Packet *get_packet(state_t &s);
 
   void set_length(unsigned len) {
       if (len < 60) {
@@ -90,8 +141,8 @@ class FastUDPFlows : public BatchElement {
 
   static const unsigned NO_LIMIT = 0xFFFFFFFFU;
 
-  GapRate _rate;
-  unsigned _count;
+  unsigned _rate;
+  atomic_uint32_t _count;
   unsigned _limit;
   bool _active;
   bool _stop;
@@ -113,11 +164,12 @@ class FastUDPFlows : public BatchElement {
 #endif
 
   void cleanup_flows();
+  void set_rate(unsigned rate);
   static int length_write_handler (const String &s, Element *e, void *, ErrorHandler *errh);
 
   void add_handlers() CLICK_COLD;
   void reset();
-  unsigned count() { return _count; }
+  unsigned count() { return _count.value(); }
   click_jiffies_t first() { return _first; }
   click_jiffies_t last() { return _last; }
 };
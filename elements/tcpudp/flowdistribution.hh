@@ -0,0 +1,168 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLOWDISTRIBUTION_HH
+#define CLICK_FLOWDISTRIBUTION_HH
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/vector.hh>
+#if HAVE_FLOAT_TYPES
+# include <math.h>
+#endif
+CLICK_DECLS
+
+/*
+ * FlowDistribution
+ *
+ * Distribution of flow popularity or of flow sizes, for the FastUDPFlows and
+ * FastTCPFlows traffic generators. It is configured from a string:
+ *
+ *   UNIFORM      popularity: every flow is picked with the same probability
+ *   ZIPF S       popularity: flow I is picked with a probability
+ *                proportional to 1/(I+1)^S
+ *   FIXED        size: every flow has the configured size
+ *   PARETO A     size: Pareto distribution of shape A whose minimum is the
+ *                configured size
+ *
+ * Distributions are turned into integer tables at configuration time, so
+ * that sampling costs a random number and a table lookup (a binary search
+ * for ZIPF) and uses no floating point. ZIPF and PARETO are only available
+ * when floating point is, for instance at user level.
+ */
+
+class FlowDistribution { public:
+
+    enum Type { FIXED, UNIFORM, ZIPF, PARETO };
+
+    FlowDistribution()
+	: _type(FIXED), _n(1) {
+    }
+
+    Type type() const {
+	return _type;
+    }
+
+    /** @brief Configure a popularity distribution over @a nflows flows. */
+    int configure_popularity(const String &str, uint32_t nflows, ErrorHandler *errh);
+
+    /** @brief Configure a size distribution of minimum @a size. */
+    int configure_size(const String &str, uint32_t size, ErrorHandler *errh);
+
+    /** @brief Return a sample given the 32-bit random number @a r. */
+    inline uint32_t sample(uint32_t r) const;
+
+    /** @brief Return the next number of the xorshift generator @a state,
+     * which must not be 0. Each thread should use its own state. */
+    static inline uint32_t random(uint32_t &state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+    }
+
+  private:
+
+    enum { PARETO_ORDER = 10 };
+
+    Type _type;
+    uint32_t _n;
+    // ZIPF: cumulative probabilities scaled to 2^32; PARETO: 2^PARETO_ORDER
+    // quantiles of the distribution
+    Vector<uint32_t> _table;
+
+    int parse(const String &str, const char *types, ErrorHandler *errh);
+
+};
+
+inline uint32_t
+FlowDistribution::sample(uint32_t r) const
+{
+    switch (_type) {
+    case UNIFORM:
+	return ((uint64_t) r * _n) >> 32;
+    case ZIPF: {
+	// first flow whose cumulative probability is above r
+	uint32_t lo = 0, hi = _n - 1;
+	while (lo < hi) {
+	    uint32_t mid = (lo + hi) / 2;
+	    if (_table.unchecked_at(mid) > r)
+		hi = mid;
+	    else
+		lo = mid + 1;
+	}
+	return lo;
+    }
+    case PARETO:
+	return _table.unchecked_at(r >> (32 - PARETO_ORDER));
+    default:
+	return _n;
+    }
+}
+
+inline int
+FlowDistribution::parse(const String &str, const char *types, ErrorHandler *errh)
+{
+    Vector<String> words;
+    cp_spacevec(str, words);
+    String type = words.size() ? words[0].upper() : String("");
+    Type t;
+    if (type == "UNIFORM")
+	t = UNIFORM;
+    else if (type == "ZIPF")
+	t = ZIPF;
+    else if (type == "FIXED")
+	t = FIXED;
+    else if (type == "PARETO")
+	t = PARETO;
+    else
+	return errh->error("bad distribution %<%s%>, expected %s", str.c_str(), types);
+    if (!strstr(types, type.c_str()))
+	return errh->error("bad distribution %<%s%>, expected %s", str.c_str(), types);
+    if (words.size() != (t == ZIPF || t == PARETO ? 2 : 1))
+	return errh->error("bad distribution %<%s%>", str.c_str());
+    _type = t;
+    if (t == UNIFORM || t == FIXED)
+	return 0;
+#if HAVE_FLOAT_TYPES
+    double param;
+    if (!DoubleArg().parse(words[1], param) || param <= 0)
+	return errh->error("%s parameter must be a positive number", type.c_str());
+    _table.clear();
+    if (t == ZIPF) {
+	double total = 0;
+	for (uint32_t i = 0; i < _n; i++)
+	    total += pow(i + 1, -param);
+	double cum = 0;
+	for (uint32_t i = 0; i < _n; i++) {
+	    cum += pow(i + 1, -param);
+	    double v = cum / total * 4294967296.0;
+	    _table.push_back(v >= 4294967295.0 ? 0xFFFFFFFFU : (uint32_t) v);
+	}
+	_table.back() = 0xFFFFFFFFU;
+    } else {
+	for (uint32_t i = 0; i < (1U << PARETO_ORDER); i++) {
+	    double u = (i + 0.5) / (1U << PARETO_ORDER);
+	    double v = ceil(_n * pow(1 - u, -1 / param));
+	    _table.push_back(v >= 4294967295.0 ? 0xFFFFFFFFU : (uint32_t) v);
+	}
+    }
+    return 0;
+#else
+    return errh->error("%s requires floating point", type.c_str());
+#endif
+}
+
+inline int
+FlowDistribution::configure_popularity(const String &str, uint32_t nflows, ErrorHandler *errh)
+{
+    _n = nflows ? nflows : 1;
+    return parse(str, "UNIFORM or ZIPF", errh);
+}
+
+inline int
+FlowDistribution::configure_size(const String &str, uint32_t size, ErrorHandler *errh)
+{
+    _n = size;
+    return parse(str, "FIXED or PARETO", errh);
+}
+
+CLICK_ENDDECLS
+#endif
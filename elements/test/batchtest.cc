@@ -18,11 +18,20 @@
 
 #include <click/config.h>
 #include "batchtest.hh"
+#include <click/args.hh>
 
 CLICK_DECLS
 
 BatchTest::BatchTest()
+    : _array(false)
 {
+    receives_array = true;
+}
+
+int
+BatchTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh).read("ARRAY", _array).complete();
 }
 
 void
@@ -36,7 +45,21 @@ void
 BatchTest::push_batch(int port,PacketBatch* batch)
 {
     click_chatter("%p{element}: Batch push of %d packets",this,batch->count());
-    output_push_batch(port, batch);
+    if (_array) {
+        PacketArray array;
+        while (batch) {
+            batch = array.append_batch(batch);
+            output_push_array(port, array);
+        }
+    } else
+        output_push_batch(port, batch);
+}
+
+void
+BatchTest::push_array(int port,PacketArray& array)
+{
+    click_chatter("%p{element}: Array push of %d packets",this,array.count());
+    output_push_array(port, array);
 }
 
 Packet*
@@ -7,12 +7,28 @@ CLICK_DECLS
 /*
 =c
 
-BatchTest()
+BatchTest([I<keywords> ARRAY])
 
 =s test
 
 Displays push packet or push batch depending on the type of function called
 
+=d
+
+Displays push packet, push batch, push array, pull packet or pull batch
+depending on the type of function called.
+
+Keyword arguments are:
+
+=over 8
+
+=item ARRAY
+
+Boolean. If true, pushed batches are passed downstream as a PacketArray.
+Default is false.
+
+=back
+
 */
 
 class BatchTest : public BatchElement { public:
@@ -23,10 +39,17 @@ class BatchTest : public BatchElement { public:
     const char *port_count() const    { return PORTS_1_1; }
     const char *processing() const    { return AGNOSTIC; }
 
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
     void push(int, Packet *) override;
     void push_batch(int, PacketBatch *) override;
+    void push_array(int, PacketArray &) override;
     Packet* pull(int) override;
     PacketBatch* pull_batch(int, unsigned) override;
+
+  private:
+
+    bool _array;
 };
 
 /*
@@ -0,0 +1,79 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CACHEMISSCOUNTERS_HH
+#define CLICK_CACHEMISSCOUNTERS_HH
+#include <click/straccum.hh>
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+# include <sys/ioctl.h>
+# include <unistd.h>
+#endif
+CLICK_DECLS
+
+/*
+ * CacheMissCounters counts the level 1 data cache and last level cache read
+ * misses of the calling thread with Linux hardware performance counters, for
+ * the benchmark elements. Counters that cannot be opened, for instance in
+ * virtual machines, are reported as n/a.
+ */
+class CacheMissCounters { public:
+
+    CacheMissCounters() {
+#ifdef __linux__
+	_fds[0] = open_counter(PERF_COUNT_HW_CACHE_L1D);
+	_fds[1] = open_counter(PERF_COUNT_HW_CACHE_LL);
+	for (int i = 0; i < 2; i++)
+	    if (_fds[i] >= 0) {
+		ioctl(_fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	    }
+#endif
+    }
+
+    ~CacheMissCounters() {
+#ifdef __linux__
+	for (int i = 0; i < 2; i++)
+	    if (_fds[i] >= 0)
+		close(_fds[i]);
+#endif
+    }
+
+    /* Append the number of misses per packet since construction to sa. */
+    void report(StringAccum &sa, double npackets) {
+#ifdef __linux__
+	static const char * const names[] = { "l1d_misses_per_packet", "llc_misses_per_packet" };
+	for (int i = 0; i < 2; i++) {
+	    uint64_t misses;
+	    if (_fds[i] >= 0 && read(_fds[i], &misses, sizeof(misses)) == sizeof(misses))
+		sa << names[i] << ' ' << misses / npackets << '\n';
+	    else
+		sa << names[i] << " n/a\n";
+	}
+#else
+	(void) sa, (void) npackets;
+#endif
+    }
+
+  private:
+
+#ifdef __linux__
+    int _fds[2];
+
+    static int open_counter(uint64_t cache) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof(attr);
+	attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+	    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,93 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * flowhashtest.{cc,hh} -- regression test element for FlowHash
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flowhashtest.hh"
+#include "elements/standard/flowhash.hh"
+#include <click/error.hh>
+#include <click/ipaddress.hh>
+CLICK_DECLS
+
+FlowHashTest::FlowHashTest()
+{
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+// 66.9.149.187:2794 -> 161.142.100.80:1766
+static const unsigned char ipv4_tuple[] = {
+    66, 9, 149, 187, 161, 142, 100, 80, 0x0a, 0xea, 0x06, 0xe6
+};
+
+// [3ffe:2501:200:1fff::7]:2794 -> [3ffe:2501:200:3::1]:1766
+static const unsigned char ipv6_tuple[] = {
+    0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x1f, 0xff,
+    0, 0, 0, 0, 0, 0, 0, 7,
+    0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x00, 0x03,
+    0, 0, 0, 0, 0, 0, 0, 1,
+    0x0a, 0xea, 0x06, 0xe6
+};
+
+int
+FlowHashTest::initialize(ErrorHandler *errh)
+{
+    FlowHash h;
+    CHECK(h.configure("toeplitz", String(), false, 0, String(), errh) >= 0);
+    CHECK(h.max_length() == 36);
+    CHECK(h.hash(ipv4_tuple, 8) == 0x323e8fc2);
+    CHECK(h.hash(ipv4_tuple, 12) == 0x51ccc178);
+    CHECK(h.hash(ipv6_tuple, 32) == 0x2cc18cd5);
+    CHECK(h.hash(ipv6_tuple, 36) == 0x40207d3d);
+
+    // The configured key is used beyond the 13 bytes of an IPv4 5-tuple
+    String key;
+    for (int i = 0; i < 26; i++)
+	key += "6d5a";
+    unsigned char kb[52];
+    for (int i = 0; i < 52; i += 2) {
+	kb[i] = 0x6d;
+	kb[i + 1] = 0x5a;
+    }
+    CHECK(h.configure("toeplitz", String(), false, 0, key, errh) >= 0);
+    CHECK(h.max_length() == 48);
+    CHECK(h.hash(ipv6_tuple, 36) == FlowHash::toeplitz(kb, 52, ipv6_tuple, 36));
+    CHECK(h.hash(ipv6_tuple, 36) != 0x40207d3d);
+
+    // Fields are taken from the IP header in RSS order
+    CHECK(h.configure("toeplitz", "src dst sport dport", false, 0, String(), errh) >= 0);
+    WritablePacket *p = Packet::make(sizeof(click_ip) + sizeof(click_tcp));
+    CHECK(p);
+    memset(p->data(), 0, p->length());
+    click_ip *ip = reinterpret_cast<click_ip *>(p->data());
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(click_ip) >> 2;
+    ip->ip_p = IP_PROTO_TCP;
+    ip->ip_src = IPAddress("66.9.149.187").in_addr();
+    ip->ip_dst = IPAddress("161.142.100.80").in_addr();
+    click_tcp *th = reinterpret_cast<click_tcp *>(ip + 1);
+    th->th_sport = htons(2794);
+    th->th_dport = htons(1766);
+    p->set_ip_header(ip, sizeof(click_ip));
+    uint32_t flow = h.hash_flow(p);
+    p->kill();
+    CHECK(flow == 0x51ccc178);
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(FlowHash)
+EXPORT_ELEMENT(FlowHashTest)
@@ -0,0 +1,40 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLOWHASHTEST_HH
+#define CLICK_FLOWHASHTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FlowHashTest()
+
+=s test
+
+runs regression tests for FlowHash
+
+=d
+
+FlowHashTest runs FlowHash regression tests at initialization time. It checks
+the Toeplitz hash against the RSS verification vectors published by
+Microsoft, for IPv4 and IPv6 inputs, with raw bytes and with 5-tuple fields,
+and checks that a configured key is used for inputs of any length. It does
+not route packets.
+
+=a
+
+HashSwitch
+*/
+
+class FlowHashTest : public Element { public:
+
+    FlowHashTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "FlowHashTest"; }
+
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,209 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * hashtablebench.{cc,hh} -- benchmark concurrent hash tables
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "hashtablebench.hh"
+#include <click/hashtablelf.hh>
+#include <click/hashtablemp.hh>
+#include <click/ipflowid.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/timestamp.hh>
+#include <pthread.h>
+CLICK_DECLS
+
+HashTableBench::HashTableBench()
+    : _nkeys(1000000), _nlookups(10000000), _max_threads(32), _bulk(32)
+{
+}
+
+int
+HashTableBench::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String tables = "lf mp rw";
+    if (Args(conf, this, errh)
+        .read("TABLES", AnyArg(), tables)
+        .read("KEYS", _nkeys)
+        .read("LOOKUPS", _nlookups)
+        .read("THREADS", _max_threads)
+        .read("BULK", _bulk)
+        .complete() < 0)
+        return -1;
+    cp_spacevec(tables, _tables);
+    for (int i = 0; i < _tables.size(); i++)
+        if (_tables[i] != "lf" && _tables[i] != "mp" && _tables[i] != "rw")
+            return errh->error("unknown table %<%s%>", _tables[i].c_str());
+    if (_nkeys == 0 || _max_threads < 1)
+        return errh->error("KEYS and THREADS must be positive");
+    return 0;
+}
+
+namespace {
+
+enum { BENCH_LF, BENCH_MP, BENCH_RW };
+
+struct BenchJob {
+    int kind;
+    void *table;
+    const Vector<IPFlowID> *keys;
+    uint32_t nlookups;
+    int bulk;
+    uint32_t seed;
+    pthread_barrier_t *barrier;
+    uint64_t found;
+    uint64_t done;
+};
+
+void *
+bench_thread(void *arg)
+{
+    BenchJob *j = static_cast<BenchJob *>(arg);
+    const Vector<IPFlowID> &keys = *j->keys;
+    uint32_t seed = j->seed;
+    uint64_t found = 0;
+    enum { MAX_BULK = 256 };
+    IPFlowID batch[MAX_BULK];
+    int values[MAX_BULK];
+    bool hit[MAX_BULK];
+    int bulk = j->bulk > MAX_BULK ? MAX_BULK : j->bulk;
+
+    pthread_barrier_wait(j->barrier);
+    if (j->kind == BENCH_LF && bulk > 1) {
+        HashTableLF<IPFlowID, int> *t = static_cast<HashTableLF<IPFlowID, int> *>(j->table);
+        for (uint32_t n = 0; n < j->nlookups; n += bulk) {
+            for (int i = 0; i < bulk; i++) {
+                seed = seed * 1103515245 + 12345;
+                batch[i] = keys[(seed >> 4) % keys.size()];
+            }
+            found += t->find_bulk(batch, bulk, values, hit);
+            j->done += bulk;
+        }
+    } else {
+        for (uint32_t n = 0; n < j->nlookups; n++) {
+            seed = seed * 1103515245 + 12345;
+            const IPFlowID &key = keys[(seed >> 4) % keys.size()];
+            if (j->kind == BENCH_LF) {
+                int v;
+                found += static_cast<HashTableLF<IPFlowID, int> *>(j->table)->find(key, v);
+            } else if (j->kind == BENCH_MP) {
+                HashTableMP<IPFlowID, int>::ptr p = static_cast<HashTableMP<IPFlowID, int> *>(j->table)->find(key);
+                found += (bool) p;
+            } else {
+                RWHashTableMP<IPFlowID, int>::ptr p = static_cast<RWHashTableMP<IPFlowID, int> *>(j->table)->find(key);
+                found += (bool) p;
+            }
+        }
+        j->done = j->nlookups;
+    }
+    j->found = found;
+    return 0;
+}
+
+}
+
+String
+HashTableBench::run()
+{
+    Vector<IPFlowID> keys;
+    uint32_t seed = 42;
+    for (uint32_t i = 0; i < _nkeys; i++) {
+        seed = seed * 1103515245 + 12345;
+        keys.push_back(IPFlowID(IPAddress(htonl(0x0A000000 | (seed & 0xFFFFFF))), htons(i & 0xFFFF),
+                                IPAddress(htonl(0xC0A80000 | (i >> 16))), htons(80)));
+    }
+
+    StringAccum sa;
+    for (int ti = 0; ti < _tables.size(); ti++) {
+        int kind;
+        void *table;
+        if (_tables[ti] == "lf") {
+            HashTableLF<IPFlowID, int> *t = new HashTableLF<IPFlowID, int>(_nkeys);
+            for (uint32_t i = 0; i < _nkeys; i++)
+                t->insert(keys[i], i);
+            kind = BENCH_LF;
+            table = t;
+        } else if (_tables[ti] == "mp") {
+            HashTableMP<IPFlowID, int> *t = new HashTableMP<IPFlowID, int>();
+            t->rehash(_nkeys);
+            for (uint32_t i = 0; i < _nkeys; i++)
+                t->find_insert(keys[i], i);
+            kind = BENCH_MP;
+            table = t;
+        } else {
+            RWHashTableMP<IPFlowID, int> *t = new RWHashTableMP<IPFlowID, int>();
+            t->rehash(_nkeys);
+            for (uint32_t i = 0; i < _nkeys; i++)
+                t->find_insert(keys[i], i);
+            kind = BENCH_RW;
+            table = t;
+        }
+
+        for (int nthreads = 1; nthreads <= _max_threads; nthreads *= 2) {
+            Vector<BenchJob> jobs(nthreads, BenchJob());
+            Vector<pthread_t> threads(nthreads, pthread_t());
+            pthread_barrier_t barrier;
+            pthread_barrier_init(&barrier, 0, nthreads + 1);
+            for (int i = 0; i < nthreads; i++) {
+                jobs[i].kind = kind;
+                jobs[i].table = table;
+                jobs[i].keys = &keys;
+                jobs[i].nlookups = _nlookups;
+                jobs[i].bulk = _bulk;
+                jobs[i].seed = i + 1;
+                jobs[i].barrier = &barrier;
+                pthread_create(&threads[i], 0, bench_thread, &jobs[i]);
+            }
+            pthread_barrier_wait(&barrier);
+            Timestamp start = Timestamp::now_steady();
+            uint64_t found = 0, done = 0;
+            for (int i = 0; i < nthreads; i++) {
+                pthread_join(threads[i], 0);
+                found += jobs[i].found;
+                done += jobs[i].done;
+            }
+            double elapsed = (Timestamp::now_steady() - start).doubleval();
+            pthread_barrier_destroy(&barrier);
+            if (found != done)
+                click_chatter("%p{element}: %s missed keys", this, _tables[ti].c_str());
+            sa << _tables[ti] << ' ' << nthreads << ' '
+               << (elapsed > 0 ? done / elapsed / 1e6 : 0.) << '\n';
+        }
+
+        if (kind == BENCH_LF)
+            delete static_cast<HashTableLF<IPFlowID, int> *>(table);
+        else if (kind == BENCH_MP)
+            delete static_cast<HashTableMP<IPFlowID, int> *>(table);
+        else
+            delete static_cast<RWHashTableMP<IPFlowID, int> *>(table);
+    }
+    return sa.take_string();
+}
+
+String
+HashTableBench::read_handler(Element *e, void *)
+{
+    return static_cast<HashTableBench *>(e)->run();
+}
+
+void
+HashTableBench::add_handlers()
+{
+    add_read_handler("run", read_handler, 0);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel umultithread)
+EXPORT_ELEMENT(HashTableBench)
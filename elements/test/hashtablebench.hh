@@ -0,0 +1,86 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_HASHTABLEBENCH_HH
+#define CLICK_HASHTABLEBENCH_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+HashTableBench([I<keywords> TABLES, KEYS, LOOKUPS, THREADS, BULK])
+
+=s test
+
+benchmarks concurrent hash tables
+
+=d
+
+HashTableBench compares the lookup throughput of the concurrent hash tables
+HashTableLF, HashTableMP and RWHashTableMP. Each table is filled with KEYS
+IP flow IDs, then looked up by 1, 2, 4, ... up to THREADS threads in
+parallel, each thread doing LOOKUPS lookups of random keys. The benchmark is
+run when the C<run> handler is read. It does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item TABLES
+
+Space-separated list of tables to benchmark, among C<lf> (HashTableLF),
+C<mp> (HashTableMP) and C<rw> (RWHashTableMP). Default is C<lf mp rw>.
+
+=item KEYS
+
+Integer. Number of keys in the tables. Default is 1000000.
+
+=item LOOKUPS
+
+Integer. Number of lookups per thread. Default is 10000000.
+
+=item THREADS
+
+Integer. Maximal number of threads. Default is 32.
+
+=item BULK
+
+Integer. If greater than 1, HashTableLF is looked up by batches of BULK keys
+with find_bulk(). Default is 32.
+
+=back
+
+=h run read-only
+
+Runs the benchmark and returns one line per table and number of threads, with
+the table, the number of threads and the aggregated throughput in millions of
+lookups per second.
+
+=a
+
+HashTableLFTest
+*/
+
+class HashTableBench : public Element { public:
+
+    HashTableBench() CLICK_COLD;
+
+    const char *class_name() const		{ return "HashTableBench"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+  private:
+
+    Vector<String> _tables;
+    uint32_t _nkeys;
+    uint32_t _nlookups;
+    int _max_threads;
+    int _bulk;
+
+    String run();
+    static String read_handler(Element *e, void *thunk);
+
+};
+
+CLICK_ENDDECLS
+#endif
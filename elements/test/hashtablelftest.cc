@@ -0,0 +1,220 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * hashtablelftest.{cc,hh} -- regression test element for HashTableLF<K, V>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "hashtablelftest.hh"
+#include <click/hashtablelf.hh>
+#include <click/ipflowid.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/atomic.hh>
+#if HAVE_MULTITHREAD
+# include <pthread.h>
+#endif
+CLICK_DECLS
+
+HashTableLFTest::HashTableLFTest()
+    : _nthreads(4)
+{
+}
+
+int
+HashTableLFTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh).read_p("THREADS", _nthreads).complete();
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+namespace {
+
+// b is always ~a, so a torn read is detected
+struct TestValue {
+    uint64_t a;
+    uint64_t b;
+    TestValue() : a(0), b(~0ULL) {
+    }
+    TestValue(uint64_t x) : a(x), b(~x) {
+    }
+    bool valid() const {
+        return b == ~a;
+    }
+};
+
+enum { NSTABLE = 4096, NVOLATILE = 4096 };
+
+struct ConcurrentTest {
+    HashTableLF<uint32_t, TestValue> table;
+    volatile bool stop;
+    atomic_uint32_t errors;
+    atomic_uint32_t lookups;
+
+    ConcurrentTest() : table(0), stop(false) {
+        errors = 0;
+        lookups = 0;
+    }
+};
+
+#if HAVE_MULTITHREAD
+void *
+reader_thread(void *arg)
+{
+    ConcurrentTest *t = static_cast<ConcurrentTest *>(arg);
+    uint32_t keys[32];
+    TestValue values[32];
+    bool found[32];
+    uint32_t n = 0, errors = 0, seed = (uintptr_t) arg;
+    while (!t->stop) {
+        // stable keys are always present, with value key * generation
+        for (int i = 0; i < 32; i++) {
+            seed = seed * 1103515245 + 12345;
+            keys[i] = (seed >> 8) % NSTABLE;
+        }
+        int nfound = t->table.find_bulk(keys, 32, values, found);
+        if (nfound != 32)
+            errors++;
+        for (int i = 0; i < 32; i++)
+            if (!values[i].valid() || values[i].a % (keys[i] + 1) != 0)
+                errors++;
+        // volatile keys come and go, but are never torn
+        for (int i = 0; i < 32; i++) {
+            uint32_t k = NSTABLE + (seed + i * 97) % NVOLATILE;
+            TestValue v;
+            if (t->table.find(k, v) && (!v.valid() || v.a != k))
+                errors++;
+        }
+        n += 64;
+    }
+    t->errors += errors;
+    t->lookups += n;
+    return 0;
+}
+#endif
+
+}
+
+int
+HashTableLFTest::initialize(ErrorHandler *errh)
+{
+    // single thread
+    {
+        HashTableLF<IPFlowID, int> h;
+        CHECK(h.empty());
+        IPFlowID f1(IPAddress(0x01020304), 1000, IPAddress(0x05060708), 80);
+        IPFlowID f2(IPAddress(0x01020304), 1001, IPAddress(0x05060708), 80);
+        int v = 0;
+        CHECK(!h.find(f1, v));
+        CHECK(h.insert(f1, 1));
+        CHECK(!h.insert(f1, 2));
+        CHECK(h.find(f1, v) && v == 1);
+        CHECK(!h.contains(f2));
+        CHECK(h.find_insert(f2, 3) == 3);
+        CHECK(h.find_insert(f2, 4) == 3);
+        h.set(f2, 5);
+        CHECK(h.find(f2, v) && v == 5);
+        CHECK(h.size() == 2);
+        CHECK(h.find_remove(f1, v) && v == 1);
+        CHECK(!h.erase(f1));
+        CHECK(!h.contains(f1) && h.contains(f2));
+        CHECK(h.size() == 1);
+        h.clear();
+        CHECK(h.empty() && !h.contains(f2));
+    }
+
+    {
+        HashTableLF<uint32_t, uint32_t> h;
+        const uint32_t n = 100000;
+        for (uint32_t i = 0; i < n; i++)
+            CHECK(h.insert(i * 7, i));
+        CHECK(h.size() == n);
+        CHECK(h.capacity() >= n);
+        uint32_t v;
+        for (uint32_t i = 0; i < n; i++)
+            CHECK(h.find(i * 7, v) && v == i);
+        for (uint32_t i = 0; i < n; i++)
+            CHECK(!h.contains(i * 7 + 1));
+        // remove every other key, the others must stay reachable
+        for (uint32_t i = 0; i < n; i += 2)
+            CHECK(h.erase(i * 7));
+        CHECK(h.size() == n / 2);
+        for (uint32_t i = 0; i < n; i++)
+            CHECK(h.contains(i * 7) == (i % 2 == 1));
+
+        uint32_t keys[100], values[100];
+        bool found[100];
+        for (int i = 0; i < 100; i++)
+            keys[i] = i * 7;
+        CHECK(h.find_bulk(keys, 100, values, found) == 50);
+        for (int i = 0; i < 100; i++)
+            CHECK(found[i] == (i % 2 == 1) && (!found[i] || values[i] == (uint32_t) i));
+
+        // for_each may update and remove
+        struct {
+            bool operator()(const uint32_t &k, uint32_t &v) {
+                v++;
+                return k % 3 != 0;
+            }
+        } f;
+        h.for_each(f);
+        for (uint32_t i = 1; i < n; i += 2)
+            CHECK(h.find(i * 7, v) == (i % 3 != 0) && (i % 3 == 0 || v == i + 1));
+
+        h.rehash(4 * n);
+        CHECK(h.capacity() >= 4 * n);
+        for (uint32_t i = 1; i < n; i += 2)
+            CHECK(h.contains(i * 7) == (i % 3 != 0));
+    }
+
+#if HAVE_MULTITHREAD
+    if (_nthreads > 0) {
+        ConcurrentTest t;
+        for (uint32_t k = 0; k < NSTABLE; k++)
+            t.table.insert(k, TestValue(k + 1));
+
+        Vector<pthread_t> threads(_nthreads, pthread_t());
+        for (int i = 0; i < _nthreads; i++)
+            if (pthread_create(&threads[i], 0, reader_thread, &t) != 0)
+                return errh->error("cannot create thread");
+
+        // grow from a tiny table while inserting, updating and removing
+        uint32_t seed = 1;
+        for (uint64_t gen = 2; gen < 200; gen++) {
+            for (uint32_t k = 0; k < NSTABLE; k += 7)
+                t.table.set(k, TestValue((uint64_t) k * gen + gen));
+            for (uint32_t i = 0; i < NVOLATILE; i++) {
+                seed = seed * 1103515245 + 12345;
+                uint32_t k = NSTABLE + (seed >> 8) % NVOLATILE;
+                if (seed & 0x100000)
+                    t.table.insert(k, TestValue(k));
+                else
+                    t.table.erase(k);
+            }
+        }
+        t.stop = true;
+        for (int i = 0; i < _nthreads; i++)
+            pthread_join(threads[i], 0);
+
+        CHECK(t.errors == 0);
+        CHECK(t.lookups > 0);
+    }
+#endif
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(HashTableLFTest)
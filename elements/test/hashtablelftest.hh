@@ -0,0 +1,55 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_HASHTABLELFTEST_HH
+#define CLICK_HASHTABLELFTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+HashTableLFTest([I<keywords> THREADS])
+
+=s test
+
+runs regression tests for HashTableLF<K, V>
+
+=d
+
+HashTableLFTest runs HashTableLF regression tests at initialization time. It
+first checks the table from a single thread, then runs THREADS reader threads
+looking up keys while the main thread inserts, updates and removes keys and
+grows the table, checking that readers never see a torn or stale value. It
+does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item THREADS
+
+Integer. Number of concurrent reader threads. Default is 4.
+
+=back
+
+=a
+
+HashTableBench
+*/
+
+class HashTableLFTest : public Element { public:
+
+    HashTableLFTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "HashTableLFTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+  private:
+
+    int _nthreads;
+
+};
+
+CLICK_ENDDECLS
+#endif
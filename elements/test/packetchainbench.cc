@@ -0,0 +1,172 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * packetchainbench.{cc,hh} -- benchmark an element chain on packets that are
+ * not in the cache
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "packetchainbench.hh"
+#include "cachemisscounters.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/timestamp.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+PacketChainBench::PacketChainBench()
+    : _npackets(65536), _burst(32), _nrounds(10),
+      _distance(CLICK_BATCH_PREFETCH_DISTANCE)
+{
+    in_batch_mode = BATCH_MODE_YES;
+}
+
+int
+PacketChainBench::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+        .read("PACKETS", _npackets)
+        .read("BURST", _burst)
+        .read("ROUNDS", _nrounds)
+        .read("DISTANCE", _distance)
+        .complete() < 0)
+        return -1;
+    if (_npackets < 1 || _burst < 1 || _nrounds < 1)
+        return errh->error("PACKETS, BURST and ROUNDS must be positive");
+    return 0;
+}
+
+void
+PacketChainBench::push(int, Packet *p)
+{
+    _returned.push_back(PacketBatch::make_from_packet(p));
+}
+
+void
+PacketChainBench::push_batch(int, PacketBatch *batch)
+{
+    _returned.push_back(batch);
+}
+
+static WritablePacket *
+make_udp_packet()
+{
+    WritablePacket *p = Packet::make(sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp) + 18);
+    if (!p)
+        return 0;
+    memset(p->data(), 0, p->length());
+    click_ether *ethh = reinterpret_cast<click_ether *>(p->data());
+    ethh->ether_dhost[5] = 2;
+    ethh->ether_shost[5] = 1;
+    ethh->ether_type = htons(ETHERTYPE_IP);
+    click_ip *iph = reinterpret_cast<click_ip *>(ethh + 1);
+    iph->ip_v = 4;
+    iph->ip_hl = sizeof(click_ip) >> 2;
+    iph->ip_len = htons(p->length() - sizeof(click_ether));
+    iph->ip_ttl = 64;
+    iph->ip_p = IP_PROTO_UDP;
+    iph->ip_src.s_addr = htonl(0x0A000001);
+    iph->ip_dst.s_addr = htonl(0x0A000002);
+    iph->ip_sum = click_in_cksum((const unsigned char *) iph, sizeof(click_ip));
+    click_udp *udph = reinterpret_cast<click_udp *>(iph + 1);
+    udph->uh_sport = htons(1234);
+    udph->uh_dport = htons(5678);
+    udph->uh_ulen = htons(p->length() - sizeof(click_ether) - sizeof(click_ip));
+    return p;
+}
+
+String
+PacketChainBench::run()
+{
+    Vector<Packet *> packets;
+    for (uint32_t i = 0; i < _npackets; i++) {
+        WritablePacket *p = make_udp_packet();
+        if (!p) {
+            for (int j = 0; j < packets.size(); j++)
+                packets[j]->kill();
+            return "out of memory\n";
+        }
+        packets.push_back(p);
+    }
+
+    // shuffle the packets, so that hardware prefetchers cannot guess the
+    // next one
+    uint32_t seed = 42;
+    for (uint32_t i = _npackets - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t j = (seed >> 8) % (i + 1);
+        Packet *tmp = packets[i];
+        packets[i] = packets[j];
+        packets[j] = tmp;
+    }
+
+    // Batches are built once: the benchmark itself must not touch the
+    // packets between rounds, or they would be in the cache when the chain
+    // gets them
+    Vector<PacketBatch *> batches;
+    for (int i = 0; i < packets.size(); i += _burst) {
+        int n = packets.size() - i < (int) _burst ? packets.size() - i : _burst;
+        for (int j = 0; j < n - 1; j++)
+            packets[i + j]->set_next(packets[i + j + 1]);
+        batches.push_back(PacketBatch::make_from_simple_list(packets[i], packets[i + n - 1], n));
+    }
+
+    unsigned old_distance = PacketPrefetcher::default_distance;
+    PacketPrefetcher::default_distance = _distance;
+    _returned.reserve(batches.size());
+
+    CacheMissCounters counters;
+    Timestamp start = Timestamp::now_steady();
+    for (uint32_t r = 0; r < _nrounds; r++) {
+        _returned.clear();
+        for (int i = 0; i < batches.size(); i++)
+            output_push_batch(0, batches[i]);
+        batches.swap(_returned);
+    }
+    double elapsed = (Timestamp::now_steady() - start).doubleval();
+    double hops = (double) _npackets * _nrounds;
+
+    PacketPrefetcher::default_distance = old_distance;
+
+    StringAccum sa;
+    uint32_t n = 0;
+    for (int i = 0; i < batches.size(); i++) {
+        n += batches[i]->count();
+        batches[i]->kill();
+    }
+    _returned.clear();
+    if (n != _npackets)
+        sa << "lost_packets " << (_npackets - n) << '\n';
+    sa << "ns_per_packet " << elapsed * 1e9 / hops << '\n';
+    counters.report(sa, hops);
+    return sa.take_string();
+}
+
+String
+PacketChainBench::read_handler(Element *e, void *)
+{
+    return static_cast<PacketChainBench *>(e)->run();
+}
+
+void
+PacketChainBench::add_handlers()
+{
+    add_read_handler("run", read_handler, 0);
+    add_data_handlers("distance", Handler::f_read | Handler::f_write, &_distance);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel batch)
+EXPORT_ELEMENT(PacketChainBench)
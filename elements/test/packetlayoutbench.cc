@@ -0,0 +1,139 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * packetlayoutbench.{cc,hh} -- benchmark the cache footprint of Packet
+ * metadata
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "packetlayoutbench.hh"
+#include "cachemisscounters.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/timestamp.hh>
+#include <click/packet_anno.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+PacketLayoutBench::PacketLayoutBench()
+    : _npackets(262144), _nrounds(10)
+{
+}
+
+int
+PacketLayoutBench::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+        .read("PACKETS", _npackets)
+        .read("ROUNDS", _nrounds)
+        .complete() < 0)
+        return -1;
+    if (_npackets < 2 || _nrounds < 1)
+        return errh->error("PACKETS must be at least 2 and ROUNDS at least 1");
+    return 0;
+}
+
+namespace {
+
+unsigned char shared_buffer[64];
+
+}
+
+String
+PacketLayoutBench::run()
+{
+    Vector<Packet *> packets(_npackets, (Packet *) 0);
+    for (uint32_t i = 0; i < _npackets; i++) {
+        WritablePacket *p = Packet::make(shared_buffer, sizeof(shared_buffer),
+                                         Packet::empty_destructor, 0, 0, 0);
+        if (!p) {
+            for (uint32_t j = 0; j < i; j++)
+                packets[j]->kill();
+            return "out of memory\n";
+        }
+        p->set_network_header(p->data(), 0);
+        packets[i] = p;
+    }
+
+    // link the packets in random order, so that hardware prefetchers cannot
+    // guess the next one
+    uint32_t seed = 42;
+    for (uint32_t i = _npackets - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t j = (seed >> 8) % (i + 1);
+        Packet *tmp = packets[i];
+        packets[i] = packets[j];
+        packets[j] = tmp;
+    }
+    for (uint32_t i = 0; i < _npackets; i++)
+        packets[i]->set_next(i + 1 < _npackets ? packets[i + 1] : 0);
+    SET_BATCH_COUNT_ANNO(packets[0], _npackets);
+
+    CacheMissCounters counters;
+    uint64_t sum = 0;
+    Timestamp start = Timestamp::now_steady();
+    for (uint32_t r = 0; r < _nrounds; r++)
+        for (Packet *p = packets[0]; p; p = p->next())
+            sum += p->length() + p->dst_ip_anno().addr() + PAINT_ANNO(p)
+                + BATCH_COUNT_ANNO(p) + (p->network_header() - p->data())
+                + p->timestamp_anno().sec();
+    double elapsed = (Timestamp::now_steady() - start).doubleval();
+    double hops = (double) _npackets * _nrounds;
+
+    StringAccum sa;
+    sa << "ns_per_packet " << elapsed * 1e9 / hops << '\n';
+    counters.report(sa, hops);
+    if (sum == 0)
+        click_chatter("%p{element}: unexpected sum", this);
+
+    for (uint32_t i = 0; i < _npackets; i++)
+        packets[i]->kill();
+    return sa.take_string();
+}
+
+String
+PacketLayoutBench::layout()
+{
+    WritablePacket *p = Packet::make(shared_buffer, sizeof(shared_buffer),
+                                     Packet::empty_destructor, 0, 0, 0);
+    if (!p)
+        return "out of memory\n";
+    const unsigned char *base = reinterpret_cast<const unsigned char *>(p);
+    StringAccum sa;
+    sa << "size " << sizeof(Packet) << '\n'
+       << "anno " << (p->anno_u8() - base) << '\n'
+       << "next " << (reinterpret_cast<unsigned char *>(&p->next()) - base) << '\n'
+       << "prev " << (reinterpret_cast<unsigned char *>(&p->prev()) - base) << '\n'
+       << "timestamp " << (reinterpret_cast<unsigned char *>(&p->timestamp_anno()) - base) << '\n'
+       << "cache_aligned " << ((uintptr_t) base % CLICK_CACHE_LINE_SIZE == 0 ? "true" : "false") << '\n';
+    p->kill();
+    return sa.take_string();
+}
+
+String
+PacketLayoutBench::read_handler(Element *e, void *thunk)
+{
+    PacketLayoutBench *b = static_cast<PacketLayoutBench *>(e);
+    return thunk ? b->layout() : b->run();
+}
+
+void
+PacketLayoutBench::add_handlers()
+{
+    add_read_handler("run", read_handler, 0);
+    add_read_handler("layout", read_handler, 1);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(PacketLayoutBench)
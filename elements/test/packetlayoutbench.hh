@@ -0,0 +1,79 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_PACKETLAYOUTBENCH_HH
+#define CLICK_PACKETLAYOUTBENCH_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+PacketLayoutBench([I<keywords> PACKETS, ROUNDS])
+
+=s test
+
+benchmarks the cache footprint of Packet metadata
+
+=d
+
+PacketLayoutBench measures what it costs to reach the metadata of packets
+that are not in the cache, as every element of a chain does on fresh packets.
+It makes PACKETS packets pointing to a shared buffer, links them in random
+order, and walks the list ROUNDS times. For each packet, it reads the fields
+most elements use on every hop: the next pointer, the data pointer and
+length, the destination IP, paint and batch count annotations, the network
+header and the timestamp. The packet data itself is not touched. The
+benchmark is run when the C<run> handler is read. It does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item PACKETS
+
+Integer. Number of packets. Should be large enough for their metadata not to
+fit in the caches. Default is 262144.
+
+=item ROUNDS
+
+Integer. Number of walks through the packets. Default is 10.
+
+=back
+
+=h run read-only
+
+Runs the benchmark and returns the number of nanoseconds per packet, and
+the number of level 1 data cache and last level cache read misses per packet
+if the hardware performance counters are available.
+
+=h layout read-only
+
+Returns the size of a Packet and the offset of its public fields. Fields in
+the same 64-byte cache line cost a single miss.
+
+=a
+PacketTest
+*/
+
+class PacketLayoutBench : public Element { public:
+
+    PacketLayoutBench() CLICK_COLD;
+
+    const char *class_name() const		{ return "PacketLayoutBench"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+  private:
+
+    uint32_t _npackets;
+    uint32_t _nrounds;
+
+    String run();
+    String layout();
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -87,6 +87,54 @@ PacketTest::initialize(ErrorHandler *errh)
     p1->kill();
     p3->kill();
 
+    // test uniqueify() of a shared packet: headroom and data survive
+    p1 = Packet::make(10, lowers, 40, 200);
+    memcpy(p1->data() - 10, lowers + 40, 10);
+    p = p1;
+    Packet *c = p->clone();
+    p3 = c->push(4);
+    CHECK(p3 != p && !p->shared() && !p3->shared());
+    CHECK(p3->length() == 44);
+    CHECK_DATA(p3->data() + 4, lowers, 40);
+    CHECK_DATA(p3->data() - 6, lowers + 40, 10);
+    p3->kill();
+    c = p->clone();
+    p3 = c->put(220);
+    CHECK(p3->length() == 260);
+    CHECK_DATA(p3->data(), lowers, 40);
+    CHECK_DATA(p->data(), lowers, 40);
+    p3->kill();
+    p->kill();
+
+    // test segmented packets
+    p = Packet::make(10, lowers, 20, 0);
+    p->append_segment(Packet::make(0, lowers + 20, 10, 0));
+    p->append_segment(Packet::make(0, lowers + 30, 22, 0));
+    CHECK(p->length() == 20 && p->total_length() == 52);
+    CHECK(p->next_segment() && p->next_segment()->next_segment());
+    c = p->clone();
+    CHECK(c->total_length() == 52);
+    CHECK(c->next_segment() != p->next_segment());
+    CHECK(c->next_segment()->data() == p->next_segment()->data());
+    p3 = c->push(2);
+    CHECK(p3->total_length() == 54 && p3->next_segment());
+    p3->kill();
+    p = p->pullup(25);
+    CHECK(p && p->length() == 25 && p->total_length() == 52);
+    CHECK_DATA(p->data(), lowers, 25);
+    CHECK_DATA(p->next_segment()->data(), lowers + 25, 5);
+    c = p->clone();
+    c->trim(28);
+    CHECK(c->total_length() == 28 && !c->next_segment()->next_segment());
+    c = c->linearize();
+    CHECK(c && !c->next_segment() && c->length() == 28);
+    CHECK_DATA(c->data(), lowers, 28);
+    c->kill();
+    p = p->linearize();
+    CHECK(p && !p->next_segment() && p->length() == 52);
+    CHECK_DATA(p->data(), lowers, 52);
+    CHECK(!p->pullup(53));
+
 #if 0
     // time cloning
     p = Packet::make(4);
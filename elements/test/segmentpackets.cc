@@ -0,0 +1,59 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * segmentpackets.{cc,hh} -- test element that splits packets into segments
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "segmentpackets.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+SegmentPackets::SegmentPackets()
+{
+}
+
+int
+SegmentPackets::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh).read_mp("LENGTH", _length).complete() < 0)
+	return -1;
+    if (_length == 0)
+	return errh->error("LENGTH must be positive");
+    return 0;
+}
+
+Packet *
+SegmentPackets::simple_action(Packet *p)
+{
+    if (p->next_segment() && !(p = p->linearize()))
+	return 0;
+    if (p->length() <= _length)
+	return p;
+
+    for (uint32_t off = _length; off < p->length(); off += _length) {
+	uint32_t n = p->length() - off < _length ? p->length() - off : _length;
+	WritablePacket *s = Packet::make(0, p->data() + off, n, 0);
+	if (!s) {
+	    p->kill();
+	    return 0;
+	}
+	p->append_segment(s);
+    }
+    p->take(p->length() - _length);
+    return p;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(SegmentPackets)
@@ -0,0 +1,49 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_SEGMENTPACKETS_HH
+#define CLICK_SEGMENTPACKETS_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+SegmentPackets(LENGTH)
+
+=s test
+
+splits packets into segments
+
+=d
+
+SegmentPackets turns each packet into a segmented packet, as devices receive
+jumbo frames: the packet keeps its first LENGTH bytes, and the rest of its
+data is copied into following segments of at most LENGTH bytes each (see
+Packet::next_segment). Packets of at most LENGTH bytes are left alone. Use it
+to test how elements handle segmented packets.
+
+=e
+
+  FromDump(trace) -> SegmentPackets(64) -> CheckIPHeader(14) -> ToDump(out)
+
+=a Linearize
+*/
+
+class SegmentPackets : public Element { public:
+
+    SegmentPackets() CLICK_COLD;
+
+    const char *class_name() const		{ return "SegmentPackets"; }
+    const char *port_count() const		{ return PORTS_1_1; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+
+    Packet *simple_action(Packet *p);
+
+  private:
+
+    uint32_t _length;
+
+};
+
+CLICK_ENDDECLS
+#endif
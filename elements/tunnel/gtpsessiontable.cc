@@ -0,0 +1,407 @@
+/*
+ * gtpsessiontable.{cc,hh} -- GTP-U gateway session table
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <clicknet/gtp.h>
+#include <clicknet/udp.h>
+#include <clicknet/ip.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include "gtpsessiontable.hh"
+CLICK_DECLS
+
+GTPSessionTable::GTPSessionTable()
+    : _sessions(0), _count(0), _scan_pos(0), _timer(this), _expired(0)
+{
+    _ip_id = 0;
+}
+
+GTPSessionTable::~GTPSessionTable()
+{
+}
+
+int
+GTPSessionTable::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _capacity = 65536;
+    _src = IPAddress();
+    _sport = _dport = 2152;
+    _timeout = 0;
+    _scan = 65536;
+    if (Args(conf, this, errh)
+	.read("CAPACITY", _capacity)
+	.read("SRC", _src)
+	.read("SPORT", IPPortArg(IP_PROTO_UDP), _sport)
+	.read("DPORT", IPPortArg(IP_PROTO_UDP), _dport)
+	.read("TIMEOUT", SecondsArg(), _timeout)
+	.read("SCAN", _scan)
+	.complete() < 0)
+	return -1;
+    if (_capacity == 0)
+	return errh->error("CAPACITY must be positive");
+    return 0;
+}
+
+int
+GTPSessionTable::initialize(ErrorHandler *errh)
+{
+    _sessions = (Session *) CLICK_LALLOC(sizeof(Session) * _capacity);
+    if (!_sessions)
+	return errh->error("out of memory");
+    memset((void *) _sessions, 0, sizeof(Session) * _capacity);
+    _timer.initialize(this);
+    if (_timeout)
+	_timer.schedule_after_msec(SCAN_MSEC);
+    return 0;
+}
+
+void
+GTPSessionTable::cleanup(CleanupStage)
+{
+    if (_sessions)
+	CLICK_LFREE(_sessions, sizeof(Session) * _capacity);
+    _sessions = 0;
+}
+
+/** @brief Add or replace the session of @a teid. Writers must hold _lock. */
+int
+GTPSessionTable::add_session(uint32_t teid, IPAddress ue, IPAddress peer,
+			     uint32_t peer_teid, ErrorHandler *errh)
+{
+    if (teid >= _capacity)
+	return errh->error("TEID %u out of range", teid);
+    if (!ue)
+	return errh->error("UE address must not be 0.0.0.0");
+    uint32_t old_teid;
+    if (_ue_map.find(ue, old_teid) && old_teid != teid)
+	remove_session(old_teid);
+    Session &s = _sessions[teid];
+    if (s.ue && s.ue != ue.addr())
+	_ue_map.erase(IPAddress(s.ue));
+    if (!s.ue)
+	_count++;
+    s.version = s.version + 1;
+    click_write_fence();
+    s.ue = ue.addr();
+    s.peer = peer.addr();
+    s.peer_teid = peer_teid;
+    s.last_seen = click_jiffies();
+    click_write_fence();
+    s.version = s.version + 1;
+    _ue_map.set(ue, teid);
+    return 0;
+}
+
+/** @brief Remove the session of @a teid. Writers must hold _lock. */
+bool
+GTPSessionTable::remove_session(uint32_t teid)
+{
+    if (teid >= _capacity || !_sessions[teid].ue)
+	return false;
+    Session &s = _sessions[teid];
+    IPAddress ue(s.ue);
+    s.version = s.version + 1;
+    click_write_fence();
+    s.ue = 0;
+    click_write_fence();
+    s.version = s.version + 1;
+    uint32_t mapped;
+    if (_ue_map.find(ue, mapped) && mapped == teid)
+	_ue_map.erase(ue);
+    _count--;
+    return true;
+}
+
+inline uint32_t
+GTPSessionTable::uplink_teid(Packet *p) const
+{
+    const click_ip *ip = reinterpret_cast<const click_ip *>(p->data());
+    unsigned hlen = ip->ip_hl << 2;
+    if (p->length() < hlen + sizeof(click_udp) + sizeof(click_gtp)
+	|| ip->ip_p != IP_PROTO_UDP)
+	return _capacity;
+    const click_gtp *gtp = reinterpret_cast<const click_gtp *>(p->data() + hlen + sizeof(click_udp));
+    return ntohl(gtp->gtp_teid);
+}
+
+Packet *
+GTPSessionTable::uplink(Packet *p)
+{
+    uint32_t teid = p->length() >= sizeof(click_ip) ? uplink_teid(p) : _capacity;
+    Session s;
+    if (teid >= _capacity || !read_session(teid, s)) {
+	++*_unknown;
+	p->kill();
+	return 0;
+    }
+    touch(teid);
+
+    const click_ip *ip = reinterpret_cast<const click_ip *>(p->data());
+    unsigned sz = (ip->ip_hl << 2) + sizeof(click_udp);
+    const click_gtp *gtp = reinterpret_cast<const click_gtp *>(p->data() + sz);
+    sz += sizeof(click_gtp);
+    if (gtp->gtp_flags)
+	sz += 4;
+    if (p->length() < sz + sizeof(click_ip)) {
+	++*_unknown;
+	p->kill();
+	return 0;
+    }
+    p->pull(sz);
+    const click_ip *inner = reinterpret_cast<const click_ip *>(p->data());
+    p->set_ip_header(inner, inner->ip_hl << 2);
+    SET_AGGREGATE_ANNO(p, teid);
+    return p;
+}
+
+Packet *
+GTPSessionTable::downlink(Packet *p, bool found, uint32_t teid)
+{
+    Session s;
+    // The session may have been removed or replaced since the UE lookup
+    if (!found || !read_session(teid, s)
+	|| s.ue != reinterpret_cast<const click_ip *>(p->data())->ip_dst.s_addr) {
+	++*_unknown;
+	p->kill();
+	return 0;
+    }
+    touch(teid);
+
+    WritablePacket *q = p->push(ENCAP_LEN);
+    if (!q)
+	return 0;
+    click_ip *ip = reinterpret_cast<click_ip *>(q->data());
+    click_udp *udp = reinterpret_cast<click_udp *>(ip + 1);
+    click_gtp *gtp = reinterpret_cast<click_gtp *>(udp + 1);
+
+    gtp->gtp_v = 1;
+    gtp->gtp_pt = 1;
+    gtp->gtp_reserved = 0;
+    gtp->gtp_flags = 0;
+    gtp->gtp_msg_type = 0xff;
+    gtp->gtp_msg_len = htons(q->length() - ENCAP_LEN);
+    gtp->gtp_teid = htonl(s.peer_teid);
+
+    udp->uh_sport = htons(_sport);
+    udp->uh_dport = htons(_dport);
+    udp->uh_ulen = htons(q->length() - sizeof(click_ip));
+    udp->uh_sum = 0;
+
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(click_ip) >> 2;
+    ip->ip_tos = 0;
+    ip->ip_len = htons(q->length());
+    ip->ip_id = htons(_ip_id.fetch_and_add(1));
+    ip->ip_off = 0;
+    ip->ip_ttl = 250;
+    ip->ip_p = IP_PROTO_UDP;
+    ip->ip_src = _src.in_addr();
+    ip->ip_dst.s_addr = s.peer;
+    ip->ip_sum = 0;
+#if HAVE_FAST_CHECKSUM
+    ip->ip_sum = ip_fast_csum((unsigned char *)ip, sizeof(click_ip) >> 2);
+#else
+    ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
+#endif
+    q->set_ip_header(ip, sizeof(click_ip));
+    q->set_dst_ip_anno(IPAddress(s.peer));
+    return q;
+}
+
+void
+GTPSessionTable::push(int port, Packet *p)
+{
+    if (port == 0)
+	p = uplink(p);
+    else {
+	uint32_t teid = 0;
+	bool found = p->length() >= sizeof(click_ip)
+	    && _ue_map.find(IPAddress(reinterpret_cast<const click_ip *>(p->data())->ip_dst), teid);
+	p = downlink(p, found, teid);
+    }
+    if (p)
+	output(port).push(p);
+}
+
+#if HAVE_BATCH
+void
+GTPSessionTable::push_batch(int port, PacketBatch *batch)
+{
+    if (port == 0) {
+	// Prefetch all sessions of the batch before touching any
+	FOR_EACH_PACKET(batch, p)
+	    if (p->length() >= sizeof(click_ip)) {
+		uint32_t teid = uplink_teid(p);
+		if (teid < _capacity)
+		    click_prefetch0(&_sessions[teid]);
+	    }
+	auto fnt = [this](Packet *p) { return uplink(p); };
+	EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet *) {});
+    } else {
+	// Look up the UEs of BULK packets at once, then prefetch their sessions
+	IPAddress ues[BULK];
+	uint32_t teids[BULK];
+	bool found[BULK];
+	int i = 0, n = 0;
+	Packet *next = batch;
+	auto fnt = [&](Packet *p) -> Packet * {
+	    if (i == n) {
+		for (n = 0; next && n < BULK; next = next->next(), n++)
+		    ues[n] = next->length() >= sizeof(click_ip)
+			? IPAddress(reinterpret_cast<const click_ip *>(next->data())->ip_dst)
+			: IPAddress();
+		_ue_map.find_bulk(ues, n, teids, found);
+		for (int j = 0; j < n; j++)
+		    if (found[j])
+			click_prefetch0(&_sessions[teids[j]]);
+		i = 0;
+	    }
+	    int k = i++;
+	    return downlink(p, found[k], teids[k]);
+	};
+	EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet *) {});
+    }
+    if (batch)
+	output_push_batch(port, batch);
+}
+#endif
+
+void
+GTPSessionTable::run_timer(Timer *)
+{
+    click_jiffies_t now = click_jiffies();
+    click_jiffies_t timeout = _timeout * CLICK_HZ;
+    _lock.acquire();
+    for (uint32_t n = 0; n < _scan && n < _capacity; n++) {
+	Session &s = _sessions[_scan_pos];
+	if (s.ue && click_jiffies_less(s.last_seen + timeout, now)
+	    && remove_session(_scan_pos))
+	    _expired++;
+	if (++_scan_pos == _capacity)
+	    _scan_pos = 0;
+    }
+    _lock.release();
+    _timer.reschedule_after_msec(SCAN_MSEC);
+}
+
+enum { h_count, h_unknown, h_expired, h_add, h_add_range, h_remove, h_clear };
+
+String
+GTPSessionTable::read_handler(Element *e, void *thunk)
+{
+    GTPSessionTable *t = static_cast<GTPSessionTable *>(e);
+    switch ((intptr_t) thunk) {
+    case h_count:
+	return String(t->_count);
+    case h_unknown: {
+	uint64_t n = 0;
+	for (unsigned i = 0; i < t->_unknown.weight(); i++)
+	    n += t->_unknown.get_value(i);
+	return String(n);
+    }
+    case h_expired:
+	return String(t->_expired);
+    default:
+	return String();
+    }
+}
+
+int
+GTPSessionTable::write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh)
+{
+    GTPSessionTable *t = static_cast<GTPSessionTable *>(e);
+    int r = 0;
+    t->_lock.acquire();
+    switch ((intptr_t) thunk) {
+    case h_add: {
+	Vector<String> lines = cp_uncomment(str).split('\n');
+	for (int i = 0; i < lines.size(); i++) {
+	    if (!cp_uncomment(lines[i]))
+		continue;
+	    uint32_t teid, peer_teid;
+	    IPAddress ue, peer;
+	    if (Args(t, errh).push_back_words(lines[i])
+		.read_mp("TEID", teid)
+		.read_mp("UE", ue)
+		.read_mp("PEER", peer)
+		.read_mp("PEER_TEID", peer_teid)
+		.complete() < 0
+		|| t->add_session(teid, ue, peer, peer_teid, errh) < 0)
+		r = -EINVAL;
+	}
+	break;
+    }
+    case h_add_range: {
+	uint32_t count, teid, peer_teid;
+	IPAddress ue, peer;
+	if (Args(t, errh).push_back_words(str)
+	    .read_mp("COUNT", count)
+	    .read_mp("TEID", teid)
+	    .read_mp("UE", ue)
+	    .read_mp("PEER", peer)
+	    .read_mp("PEER_TEID", peer_teid)
+	    .complete() < 0) {
+	    r = -EINVAL;
+	    break;
+	}
+	if (teid + (uint64_t) count > t->_capacity) {
+	    r = errh->error("TEID %u out of range", teid + count - 1);
+	    break;
+	}
+	if (t->_ue_map.capacity() < t->_ue_map.size() + count)
+	    t->_ue_map.rehash(t->_ue_map.size() + count);
+	uint32_t ue_base = ntohl(ue.addr());
+	for (uint32_t i = 0; i < count && r == 0; i++)
+	    r = t->add_session(teid + i, IPAddress(htonl(ue_base + i)), peer, peer_teid + i, errh);
+	break;
+    }
+    case h_remove: {
+	Vector<String> words;
+	cp_spacevec(str, words);
+	for (int i = 0; i < words.size(); i++) {
+	    uint32_t teid;
+	    if (!IntArg().parse(words[i], teid))
+		r = errh->error("expected TEID");
+	    else
+		t->remove_session(teid);
+	}
+	break;
+    }
+    case h_clear:
+	for (uint32_t teid = 0; teid < t->_capacity; teid++)
+	    t->remove_session(teid);
+	break;
+    }
+    t->_lock.release();
+    return r;
+}
+
+void
+GTPSessionTable::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("unknown", read_handler, h_unknown);
+    add_read_handler("expired", read_handler, h_expired);
+    add_write_handler("add", write_handler, h_add);
+    add_write_handler("add_range", write_handler, h_add_range);
+    add_write_handler("remove", write_handler, h_remove);
+    add_write_handler("clear", write_handler, h_clear, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(GTPSessionTable)
+ELEMENT_MT_SAFE(GTPSessionTable)
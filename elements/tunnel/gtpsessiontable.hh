@@ -0,0 +1,202 @@
+#ifndef CLICK_GTPSESSIONTABLE_HH
+#define CLICK_GTPSESSIONTABLE_HH
+#include <click/batchelement.hh>
+#include <click/ipaddress.hh>
+#include <click/hashtablelf.hh>
+#include <click/multithread.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+/*
+=c
+
+GTPSessionTable(I<keywords> CAPACITY, SRC, SPORT, DPORT, TIMEOUT, SCAN)
+
+=s gtp
+
+GTP-U gateway session table
+
+=d
+
+Terminates GTP-U tunnels for a set of sessions provisioned at runtime through
+handlers. A session maps a local tunnel endpoint identifier (TEID) to the
+inner IP address of the user equipment (UE), and to the address and TEID of
+the remote tunnel endpoint (the peer).
+
+Input 0 takes GTP-U packets starting at their outer IP header. Packets whose
+TEID belongs to a session are decapsulated and emitted on output 0, with
+their IP header annotation set to the inner header and their aggregate
+annotation set to the TEID. Input 1 takes inner IP packets. Packets whose
+destination address is the UE of a session are encapsulated in GTP-U, UDP
+and IP headers for the peer of the session, and emitted on output 1. Other
+packets are dropped and counted.
+
+Sessions are stored in a table indexed directly by TEID, so uplink lookups
+cost a single memory access, and the UE addresses are indexed by a
+HashTableLF, looked up in bulk for each batch with prefetching. Neither
+lookup takes a lock: sessions can be added and removed through handlers at
+any time without stalling the data path.
+
+Keyword arguments are:
+
+=over 8
+
+=item CAPACITY
+
+Integer. Number of entries of the TEID table. Valid TEIDs are between 0 and
+CAPACITY - 1. Default is 65536.
+
+=item SRC
+
+IP address. Source address of the encapsulated packets. Default is 0.0.0.0.
+
+=item SPORT, DPORT
+
+Integers. UDP ports of the encapsulated packets. Default is 2152.
+
+=item TIMEOUT
+
+Integer. Sessions that did not see any packet for TIMEOUT seconds are
+removed. Default is 0, sessions never expire.
+
+=item SCAN
+
+Integer. Number of TEID table entries checked for expiry every 100ms, so
+that expiry never stalls a thread for long. Default is 65536.
+
+=back
+
+=h add write-only
+
+Adds sessions, one per line, as "TEID UE PEER PEER_TEID". A session for a
+TEID or a UE that already has a session replaces it.
+
+=h add_range write-only
+
+Adds sessions in bulk, as "COUNT TEID UE PEER PEER_TEID". The I<i>-th
+session gets TEID + I<i>, UE + I<i>, PEER and PEER_TEID + I<i>.
+
+=h remove write-only
+
+Removes the sessions of a space-separated list of TEIDs.
+
+=h clear write-only
+
+Removes all sessions.
+
+=h count read-only
+
+Number of sessions.
+
+=h unknown read-only
+
+Number of packets dropped because they matched no session.
+
+=h expired read-only
+
+Number of sessions removed by expiry.
+
+=a
+
+GTPEncap, GTPDecap, GTPTable, HashTableLF
+*/
+
+class GTPSessionTable : public BatchElement { public:
+
+    GTPSessionTable() CLICK_COLD;
+    ~GTPSessionTable() CLICK_COLD;
+
+    const char *class_name() const	{ return "GTPSessionTable"; }
+    const char *port_count() const	{ return "2/2"; }
+    const char *flow_code() const	{ return "xy/xy"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *) override;
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *) override;
+#endif
+    void run_timer(Timer *);
+
+  private:
+
+    struct Session {
+	volatile uint32_t version;
+	uint32_t ue;
+	uint32_t peer;
+	uint32_t peer_teid;
+	volatile click_jiffies_t last_seen;
+    };
+
+    enum { ENCAP_LEN = 36, BULK = 32, SCAN_MSEC = 100 };
+
+    Session *_sessions;
+    uint32_t _capacity;
+    HashTableLF<IPAddress, uint32_t> _ue_map;
+    SimpleSpinlock _lock;
+    uint32_t _count;
+
+    IPAddress _src;
+    uint16_t _sport;
+    uint16_t _dport;
+    uint32_t _timeout;
+    uint32_t _scan;
+    uint32_t _scan_pos;
+    Timer _timer;
+    atomic_uint32_t _ip_id;
+
+    per_thread<uint64_t> _unknown;
+    uint64_t _expired;
+
+    inline bool read_session(uint32_t teid, Session &s) const;
+    inline void touch(uint32_t teid);
+    inline uint32_t uplink_teid(Packet *p) const;
+    Packet *uplink(Packet *p);
+    Packet *downlink(Packet *p, bool found, uint32_t teid);
+
+    int add_session(uint32_t teid, IPAddress ue, IPAddress peer, uint32_t peer_teid, ErrorHandler *errh);
+    bool remove_session(uint32_t teid);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+/** @brief Copy the session of @a teid in @a s.
+ * @return true iff @a teid has a session. */
+inline bool
+GTPSessionTable::read_session(uint32_t teid, Session &s) const
+{
+    const Session &e = _sessions[teid];
+    uint32_t v;
+    do {
+	while ((v = e.version) & 1)
+	    click_relax_fence();
+	click_read_fence();
+	s.ue = e.ue;
+	s.peer = e.peer;
+	s.peer_teid = e.peer_teid;
+	click_read_fence();
+    } while (unlikely(e.version != v));
+    return s.ue != 0;
+}
+
+/** @brief Record activity on the session of @a teid. Only writes when the
+ * time changed, to keep the session's cache line shared. */
+inline void
+GTPSessionTable::touch(uint32_t teid)
+{
+    if (_timeout) {
+	click_jiffies_t now = click_jiffies();
+	if (_sessions[teid].last_seen != now)
+	    _sessions[teid].last_seen = now;
+    }
+}
+
+CLICK_ENDDECLS
+#endif
@@ -65,7 +65,21 @@ String DPDKInfo::read_handler(Element *e, void * thunk)
 #else
                 int avail = rte_mempool_avail_count(DPDKDevice::_pktmbuf_pools[i]);
 #endif
-                acc << "0 " << String(avail) << "\n";
+                acc << String(i) << " " << String(avail) << "\n";
+            }
+            break;
+        case h_pool_usage:
+            for (unsigned i = 0; i < DPDKDevice::_nr_pktmbuf_pools; i++) {
+                struct rte_mempool *mp = DPDKDevice::_pktmbuf_pools[i];
+                if (!mp)
+                    continue;
+#if RTE_VERSION < RTE_VERSION_NUM(17,02,0,0)
+                int avail = rte_mempool_count(mp);
+#else
+                int avail = rte_mempool_avail_count(mp);
+#endif
+                acc << String(i) << " " << String(mp->size - avail)
+                    << " " << String(avail) << "\n";
             }
             break;
         case h_pools:
@@ -83,6 +97,7 @@ String DPDKInfo::read_handler(Element *e, void * thunk)
 void DPDKInfo::add_handlers() {
     add_read_handler("pool_count", read_handler, h_pool_count);
     add_read_handler("pools", read_handler, h_pools);
+    add_read_handler("pool_usage", read_handler, h_pool_usage);
 }
 
 DPDKInfo* DPDKInfo::instance = 0;
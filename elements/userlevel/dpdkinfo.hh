@@ -103,6 +103,22 @@ Defaults to 0 as there is no need to share something privately.
 This element is only available at user level, when compiled with DPDK
 support.
 
+=h pool_count read-only
+
+One line per NUMA socket: the socket number and the number of buffers
+available in its packet pool.
+
+=h pools read-only
+
+The names of the packet pools, one per line.
+
+=h pool_usage read-only
+
+One line per NUMA socket: the socket number, the number of buffers in use
+and the number of buffers available in its packet pool. Buffers in use
+include packets being received or sent, and packets made with
+Packet::make_dpdk.
+
 =e
 
   DPDKInfo(NB_MBUF 1048576, MBUF_SIZE 4096, MBUF_CACHE_SIZE 512)
@@ -118,7 +134,7 @@ public:
 
     int configure(Vector<String> &conf, ErrorHandler *errh);
 
-    enum {h_pool_count, h_pools};
+    enum {h_pool_count, h_pools, h_pool_usage};
     static String read_handler(Element *e, void * thunk);
     void add_handlers() override;
 
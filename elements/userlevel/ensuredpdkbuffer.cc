@@ -68,22 +68,18 @@ EnsureDPDKBuffer::smaction(Packet* p) {
             click_chatter("%p{element} : Not a DPDK packet",this);
         return 0;
     } else {
-        struct rte_mbuf* mbuf = DPDKDevice::get_pkt();
-        if (!mbuf) {
+        WritablePacket* q = Packet::make_dpdk(-1, 0, 0, 0, 0);
+        if (!q) {
             p->kill();
             if (_warn_count++ < 5)
                 click_chatter("%s : No more DPDK Buffer ! Dropping packet.",name().c_str());
             return 0;
         }
-        WritablePacket* q = WritablePacket::make(
-                (unsigned char*)mbuf->buf_addr,
-                DPDKDevice::MBUF_DATA_SIZE,
-                DPDKDevice::free_pkt,
-                (void*)mbuf);
-        if (q->copy(p,rte_pktmbuf_headroom(mbuf) + _extra_headroom)) {
+        if (q->copy(p,RTE_PKTMBUF_HEADROOM + _extra_headroom)) {
             p->kill();
             return q;
         } else {
+            q->kill();
             p->kill();
             return 0;
         }
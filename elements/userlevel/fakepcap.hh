@@ -10,6 +10,21 @@ CLICK_DECLS
 #define FAKE_PCAP_VERSION_MAJOR		2
 #define FAKE_PCAP_VERSION_MINOR		4
 
+/* pcapng block types and constants */
+#define FAKE_PCAPNG_SHB			0x0A0D0D0A	/* section header */
+#define FAKE_PCAPNG_IDB			1	/* interface description */
+#define FAKE_PCAPNG_PB			2	/* packet (obsolete) */
+#define FAKE_PCAPNG_SPB			3	/* simple packet */
+#define FAKE_PCAPNG_EPB			6	/* enhanced packet */
+#define FAKE_PCAPNG_BYTE_ORDER_MAGIC	0x1A2B3C4D
+#define FAKE_PCAPNG_VERSION_MAJOR	1
+#define FAKE_PCAPNG_VERSION_MINOR	0
+#define FAKE_PCAPNG_OPT_ENDOFOPT	0
+#define FAKE_PCAPNG_OPT_COMMENT		1
+#define FAKE_PCAPNG_OPT_EPB_FLAGS	2
+#define FAKE_PCAPNG_OPT_IF_TSRESOL	9
+#define FAKE_PCAPNG_OPT_IF_TSOFFSET	14
+
 /* Canonical (pcap file) data link types (may differ from host versions) */
 #define FAKE_DLT_NONE			(-1)	/* Unknown */
 #define FAKE_DLT_NULL			0	/* Null encapsulation */
@@ -79,6 +94,42 @@ struct fake_modified_pcap_pkthdr {
 	uint8_t pad;		/* pad to a 4-byte boundary */
 };
 
+/*
+ * pcapng files are a sequence of blocks, all starting with this header and
+ * ending with a copy of total_length.
+ */
+struct fake_pcapng_block_header {
+	uint32_t type;
+	uint32_t total_length;
+};
+
+/* Section header block, same size as a pcap file header. */
+struct fake_pcapng_shb {
+	struct fake_pcapng_block_header h;
+	uint32_t byte_order_magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	uint32_t section_length[2];	/* 64-bit, -1 if unknown */
+};
+
+/* Interface description block, after the block header. */
+struct fake_pcapng_idb {
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+};
+
+/* Enhanced packet block, after the block header. The obsolete packet block
+   has the same layout, with a 16-bit interface ID followed by a 16-bit drop
+   count. */
+struct fake_pcapng_epb {
+	uint32_t interface_id;
+	uint32_t ts_high;
+	uint32_t ts_low;
+	uint32_t caplen;
+	uint32_t len;
+};
+
 // Parsing and unparsing.
 int fake_pcap_parse_dlt(const String&);
 String fake_pcap_unparse_dlt(int);
@@ -58,12 +58,15 @@
 #  undef ether_addr
 # endif
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+# include <sys/mman.h>
+#endif
 
 CLICK_DECLS
 
 FromDevice::FromDevice()
     :
-#if FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
       _task(this),
 #endif
 #if FROMDEVICE_ALLOW_PCAP
@@ -74,6 +77,9 @@ FromDevice::FromDevice()
 #if FROMDEVICE_ALLOW_LINUX || FROMDEVICE_ALLOW_PCAP
     _fd = -1;
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    _ring = 0;
+#endif
 }
 
 FromDevice::~FromDevice()
@@ -91,7 +97,14 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     _force_ip = false;
     _burst = 1;
     String bpf_filter, capture, encap_type;
-    bool has_encap;
+    bool has_encap, has_burst;
+#if FROMDEVICE_ALLOW_MMAP
+    String fanout_mode = "HASH";
+    _fanout = -1;
+    _block_size = 1 << 18;
+    _nblocks = 32;
+    _block_timeout = 1;
+#endif
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _ifname)
 	.read_p("PROMISC", promisc)
@@ -105,8 +118,15 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("OUTBOUND", outbound)
 	.read("HEADROOM", _headroom)
 	.read("ENCAP", WordArg(), encap_type).read_status(has_encap)
-	.read("BURST", _burst)
+	.read("BURST", _burst).read_status(has_burst)
 	.read("TIMESTAMP", timestamp)
+#if FROMDEVICE_ALLOW_MMAP
+	.read("FANOUT", _fanout)
+	.read("FANOUT_MODE", WordArg(), fanout_mode)
+	.read("BLOCK_SIZE", _block_size)
+	.read("BLOCKS", _nblocks)
+	.read("BLOCK_TIMEOUT", _block_timeout)
+#endif
 	.complete() < 0)
 	return -1;
     if (_snaplen > 65535 || _snaplen < 14)
@@ -116,6 +136,26 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     if (_burst <= 0)
 	return errh->error("BURST out of range");
     _protocol = htons(_protocol);
+#if FROMDEVICE_ALLOW_MMAP
+    if (_fanout > 0xFFFF)
+	return errh->error("FANOUT out of range");
+    fanout_mode = fanout_mode.upper();
+    if (fanout_mode == "HASH")
+	_fanout_mode = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+    else if (fanout_mode == "CPU")
+	_fanout_mode = PACKET_FANOUT_CPU;
+    else if (fanout_mode == "LB")
+	_fanout_mode = PACKET_FANOUT_LB;
+    else if (fanout_mode == "QM")
+	_fanout_mode = PACKET_FANOUT_QM;
+    else
+	return errh->error("bad FANOUT_MODE");
+    if (_block_size < (unsigned) getpagesize() || (_block_size & (_block_size - 1))
+	|| _block_size < (unsigned) _snaplen + TPACKET3_HDRLEN)
+	return errh->error("BLOCK_SIZE must be a power of 2, at least a page and SNAPLEN");
+    if (_nblocks < 2)
+	return errh->error("BLOCKS must be at least 2");
+#endif
 
 #if FROMDEVICE_ALLOW_PCAP
     _bpf_filter = bpf_filter;
@@ -142,6 +182,10 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     else if (capture == "LINUX")
 	_method = method_linux;
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    else if (capture == "MMAP")
+	_method = method_mmap;
+#endif
 #if FROMDEVICE_ALLOW_PCAP
     else if (capture == "PCAP")
 	_method = method_pcap;
@@ -151,6 +195,17 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 
     if (bpf_filter && _method != method_pcap)
 	errh->warning("not using METHOD PCAP, BPF filter ignored");
+#if FROMDEVICE_ALLOW_MMAP
+    if (_fanout >= 0 && _method != method_mmap)
+	errh->warning("not using METHOD MMAP, FANOUT ignored");
+    if (_method == method_mmap) {
+# if HAVE_BATCH
+	in_batch_mode = BATCH_MODE_YES;
+# endif
+	if (!has_burst)
+	    _burst = 32;
+    }
+#endif
 
     _sniffer = sniffer;
     _promisc = promisc;
@@ -231,6 +286,120 @@ FromDevice::set_promiscuous(int fd, String ifname, bool promisc)
 }
 #endif /* FROMDEVICE_ALLOW_LINUX */
 
+#if FROMDEVICE_ALLOW_MMAP
+int
+FromDevice::open_ring(ErrorHandler *errh)
+{
+    const char *ifname = _ifname.c_str();
+    int version = TPACKET_V3;
+    if (setsockopt(_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+	return errh->error("%s: TPACKET_V3: %s", ifname, strerror(errno));
+# ifdef PACKET_IGNORE_OUTGOING
+    // Saves copying outgoing packets to the ring; older kernels ignore it,
+    // and read_ring() filters them anyway
+    int yes = 1;
+    if (!_outbound)
+	(void) setsockopt(_fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &yes, sizeof(yes));
+# endif
+
+    // With TPACKET_V3, packets are packed in blocks; the frame size only
+    // has to divide the block size
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = _block_size;
+    req.tp_block_nr = _nblocks;
+    req.tp_frame_size = 2048;
+    req.tp_frame_nr = (_block_size / req.tp_frame_size) * _nblocks;
+    req.tp_retire_blk_tov = _block_timeout;
+    if (setsockopt(_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+	return errh->error("%s: PACKET_RX_RING: %s", ifname, strerror(errno));
+    void *ring = mmap(0, (size_t) _block_size * _nblocks, PROT_READ | PROT_WRITE,
+		      MAP_SHARED, _fd, 0);
+    if (ring == MAP_FAILED)
+	return errh->error("%s: mmap: %s", ifname, strerror(errno));
+    _ring = static_cast<unsigned char *>(ring);
+    _block = 0;
+    _ring_packet = 0;
+    _ring_left = 0;
+
+    if (_fanout >= 0) {
+	int arg = _fanout | (_fanout_mode << 16);
+	if (setsockopt(_fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0)
+	    return errh->error("%s: PACKET_FANOUT %d: %s", ifname, _fanout, strerror(errno));
+    }
+    return 0;
+}
+
+/* Emit at most one burst of packets from the ring, as a batch, and return
+ * the number of packets read. Blocks go back to the kernel once all their
+ * packets are read. */
+int
+FromDevice::read_ring()
+{
+    int n = 0;
+# if HAVE_BATCH
+    BATCH_CREATE_INIT(batch);
+# endif
+    while (n < _burst) {
+	struct tpacket_block_desc *bd = reinterpret_cast<struct tpacket_block_desc *>
+	    (_ring + (size_t) _block * _block_size);
+	if (!_ring_packet) {
+	    if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+		break;
+	    _ring_left = bd->hdr.bh1.num_pkts;
+	    _ring_packet = reinterpret_cast<struct tpacket3_hdr *>
+		(reinterpret_cast<unsigned char *>(bd) + bd->hdr.bh1.offset_to_first_pkt);
+	}
+
+	if (_ring_left) {
+	    struct tpacket3_hdr *h = _ring_packet;
+	    unsigned char *frame = reinterpret_cast<unsigned char *>(h);
+	    const sockaddr_ll *sa = reinterpret_cast<const sockaddr_ll *>
+		(frame + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+	    ++n;
+	    if ((sa->sll_pkttype != PACKET_OUTGOING || _outbound)
+		&& (_protocol == 0 || _protocol == sa->sll_protocol)) {
+		uint32_t len = h->tp_snaplen;
+		if (len > (uint32_t) _snaplen)
+		    len = _snaplen;
+		if (WritablePacket *p = Packet::make(_headroom, frame + h->tp_mac, len, 0)) {
+		    if (h->tp_len > len)
+			SET_EXTRA_LENGTH_ANNO(p, h->tp_len - len);
+		    p->set_packet_type_anno((Packet::PacketType) sa->sll_pkttype);
+		    if (_timestamp)
+			p->timestamp_anno() = Timestamp::make_nsec(h->tp_sec, h->tp_nsec);
+		    p->set_mac_header(p->data());
+		    ++_count;
+		    if (!_force_ip || fake_pcap_force_ip(p, _datalink)) {
+# if HAVE_BATCH
+			BATCH_CREATE_APPEND(batch, p);
+# else
+			output(0).push(p);
+# endif
+		    } else
+			checked_output_push(1, p);
+		}
+	    }
+	    _ring_packet = reinterpret_cast<struct tpacket3_hdr *>(frame + h->tp_next_offset);
+	    --_ring_left;
+	}
+
+	if (!_ring_left) {
+	    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	    _ring_packet = 0;
+	    if (++_block == _nblocks)
+		_block = 0;
+	}
+    }
+# if HAVE_BATCH
+    BATCH_CREATE_FINISH(batch);
+    if (batch)
+	output_push_batch(0, batch);
+# endif
+    return n;
+}
+#endif /* FROMDEVICE_ALLOW_MMAP */
+
 #if FROMDEVICE_ALLOW_PCAP
 const char*
 FromDevice::fetch_pcap_error(pcap_t* pcap, const char *ebuf)
@@ -381,7 +550,8 @@ FromDevice::initialize(ErrorHandler *errh)
 #endif
 
 #if FROMDEVICE_ALLOW_LINUX
-    if (_method == method_default || _method == method_linux) {
+    if (_method == method_default || _method == method_linux
+	|| _method == method_mmap) {
 	_fd = open_packet_socket(_ifname, errh);
 	if (_fd < 0)
 	    return -1;
@@ -395,12 +565,18 @@ FromDevice::initialize(ErrorHandler *errh)
 	    _was_promisc = promisc_ok;
 
 	_datalink = FAKE_DLT_EN10MB;
-	_method = method_linux;
+# if FROMDEVICE_ALLOW_MMAP
+	if (_method == method_mmap) {
+	    if (open_ring(errh) < 0)
+		return -1;
+	} else
+# endif
+	    _method = method_linux;
     }
 #endif
 
-#if FROMDEVICE_ALLOW_PCAP
-    if (_method == method_pcap)
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
+    if (_method == method_pcap || _method == method_mmap)
 	ScheduleInfo::initialize_task(this, &_task, false, errh);
 #endif
 #if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_LINUX
@@ -420,8 +596,13 @@ FromDevice::cleanup(CleanupStage stage)
 {
     if (stage >= CLEANUP_INITIALIZED && !_sniffer)
 	KernelFilter::device_filter(_ifname, false, ErrorHandler::default_handler());
+#if FROMDEVICE_ALLOW_MMAP
+    if (_ring)
+	munmap(_ring, (size_t) _block_size * _nblocks);
+    _ring = 0;
+#endif
 #if FROMDEVICE_ALLOW_LINUX
-    if (_fd >= 0 && _method == method_linux) {
+    if (_fd >= 0 && (_method == method_linux || _method == method_mmap)) {
 	if (_was_promisc >= 0)
 	    set_promiscuous(_fd, _ifname, _was_promisc);
 	close(_fd);
@@ -499,6 +680,10 @@ FromDevice::selected(int, int)
 	    ErrorHandler::default_handler()->error("%p{element}: %s", this, pcap_geterr(_pcap));
     }
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap && read_ring() > 0)
+	_task.reschedule();
+#endif
 #if FROMDEVICE_ALLOW_LINUX
     int nlinux = 0;
     while (_method == method_linux && nlinux < _burst) {
@@ -532,17 +717,28 @@ FromDevice::selected(int, int)
 #endif
 }
 
-#if FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
 bool
 FromDevice::run_task(Task *)
 {
     // Read and push() at most one burst of packets.
     int r = 0;
+# if FROMDEVICE_ALLOW_PCAP
     if (_method == method_pcap) {
 	r = pcap_dispatch(_pcap, _burst, FromDevice_get_packet, (u_char *) this);
 	if (r < 0 && ++_pcap_complaints < 5)
 	    ErrorHandler::default_handler()->error("%p{element}: %s", this, pcap_geterr(_pcap));
     }
+# endif
+# if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+	if (read_ring() > 0) {
+	    _task.fast_reschedule();
+	    return true;
+	}
+	return false;
+    }
+# endif
     if (r > 0) {
 	_count += r;
 	_task.fast_reschedule();
@@ -564,7 +760,7 @@ FromDevice::kernel_drops(bool& known, int& max_drops) const
     }
 #endif
 #if FROMDEVICE_ALLOW_LINUX && defined(PACKET_STATISTICS)
-    if (_method == method_linux) {
+    if (_method == method_linux || _method == method_mmap) {
         struct tpacket_stats stats;
         socklen_t statsize = sizeof(stats);
         if (getsockopt(_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &statsize) >= 0)
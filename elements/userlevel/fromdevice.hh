@@ -1,10 +1,12 @@
 #ifndef CLICK_FROMDEVICE_USERLEVEL_HH
 #define CLICK_FROMDEVICE_USERLEVEL_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include "elements/userlevel/kernelfilter.hh"
 
 #ifdef __linux__
 # define FROMDEVICE_ALLOW_LINUX 1
+# define FROMDEVICE_ALLOW_MMAP 1
+struct tpacket3_hdr;
 #endif
 
 #if HAVE_PCAP
@@ -18,8 +20,10 @@ int pcap_setnonblock(pcap_t *p, int nonblock, char *errbuf);
 }
 #endif
 
-#if FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
 # include <click/task.hh>
+#endif
+#if FROMDEVICE_ALLOW_PCAP
 extern "C" {
 void FromDevice_get_packet(u_char*, const struct pcap_pkthdr*, const u_char*);
 }
@@ -90,8 +94,13 @@ but the IP header annotation has been set appropriately.) Default is false.
 =item METHOD
 
 Word.  Defines the capture method FromDevice will use to read packets from the
-device.  Linux targets generally support PCAP and LINUX; other targets support
-only PCAP.  Defaults to PCAP.
+device.  Linux targets generally support PCAP, LINUX and MMAP; other targets
+support only PCAP.  Defaults to PCAP.
+
+MMAP reads packets from a TPACKET_V3 ring shared with the kernel, without a
+system call per packet: the kernel fills blocks of packets, and FromDevice
+emits them in batches of up to BURST packets. This is much faster than LINUX
+or PCAP on interfaces without special driver support.
 
 =item BPF_FILTER
 
@@ -115,6 +124,34 @@ false.
 Integer. If set and nonzero, then only emit packets with this link-level
 protocol. Only affects METHOD LINUX. Default is 0.
 
+=item FANOUT
+
+Integer. Only affects METHOD MMAP. If set, the socket joins the packet fanout
+group with this identifier: the packets of the interface are spread among
+the FromDevice elements of the group, typically one per thread, according to
+FANOUT_MODE. All the elements of a group must use the same FANOUT_MODE.
+
+=item FANOUT_MODE
+
+Word. How packets are spread among a FANOUT group: HASH, by flow hash; CPU,
+by the CPU that received the packet; LB, round robin; or QM, by the receive
+queue. Default is HASH.
+
+=item BLOCK_SIZE
+
+Unsigned. Only affects METHOD MMAP. Size in bytes of a ring block, a power of
+2 of at least one page. Default is 262144.
+
+=item BLOCKS
+
+Unsigned. Only affects METHOD MMAP. Number of blocks of the ring. Default
+is 32.
+
+=item BLOCK_TIMEOUT
+
+Unsigned. Only affects METHOD MMAP. Time in milliseconds after which the
+kernel hands a block that is not full to FromDevice. Default is 1.
+
 =item HEADROOM
 
 Integer. Amount of bytes of headroom to leave before the packet data. Defaults
@@ -122,7 +159,8 @@ to roughly 28.
 
 =item BURST
 
-Integer. Maximum number of packets to read per scheduling. Defaults to 1.
+Integer. Maximum number of packets to read per scheduling. Defaults to 1, or
+32 with METHOD MMAP.
 
 =item TIMESTAMP
 
@@ -160,7 +198,7 @@ Returns a string indicating the encapsulation type on this link. Can be
 
 =a ToDevice.u, FromDump, ToDump, KernelFilter, FromDevice(n) */
 
-class FromDevice : public Element { public:
+class FromDevice : public BatchElement { public:
 
     FromDevice() CLICK_COLD;
     ~FromDevice() CLICK_COLD;
@@ -193,11 +231,12 @@ class FromDevice : public Element { public:
 
 #if FROMDEVICE_ALLOW_LINUX
     int linux_fd() const		{ return _method == method_linux ? _fd : -1; }
+    bool linux_mmap() const		{ return _method == method_mmap; }
     static int open_packet_socket(String, ErrorHandler *);
     static int set_promiscuous(int, String, bool);
 #endif
 
-#if FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
     bool run_task(Task *task);
 #endif
 
@@ -208,8 +247,10 @@ class FromDevice : public Element { public:
 #if FROMDEVICE_ALLOW_LINUX || FROMDEVICE_ALLOW_PCAP
     int _fd;
 #endif
-#if FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_MMAP
     Task _task;
+#endif
+#if FROMDEVICE_ALLOW_PCAP
     void emit_packet(WritablePacket *p, int extra_len, const Timestamp &ts);
     pcap_t *_pcap;
     int _pcap_complaints;
@@ -242,11 +283,27 @@ class FromDevice : public Element { public:
     int _snaplen;
     uint16_t _protocol;
     unsigned _headroom;
-    enum { method_default, method_pcap, method_linux };
+    enum { method_default, method_pcap, method_linux, method_mmap };
     int _method;
 #if FROMDEVICE_ALLOW_PCAP
     String _bpf_filter;
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    int _fanout;
+    int _fanout_mode;
+    unsigned _block_size;
+    unsigned _nblocks;
+    unsigned _block_timeout;
+    // Ring, current block, and next packet of the block with the number of
+    // packets left after it
+    unsigned char *_ring;
+    unsigned _block;
+    struct tpacket3_hdr *_ring_packet;
+    uint32_t _ring_left;
+
+    int open_ring(ErrorHandler *errh);
+    int read_ring();
+#endif
 
     static String read_handler(Element*, void*) CLICK_COLD;
     static int write_handler(const String&, Element*, void*, ErrorHandler*) CLICK_COLD;
@@ -54,6 +54,7 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     uint16_t mtu = 0;
     bool has_mac = false;
     bool has_mtu = false;
+    bool segments = false;
     FlowControlMode fc_mode(FC_UNSET);
 
     if (Args(this, errh).bind(conf)
@@ -70,6 +71,7 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("MTU", mtu).read_status(has_mtu)
         .read("MAXQUEUES",maxqueues)
         .read("PAUSE", fc_mode)
+        .read("SEGMENTS", segments)
         .complete() < 0)
         return -1;
 
@@ -111,6 +113,9 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     if (fc_mode != FC_UNSET)
         _dev->set_init_fc_mode(fc_mode);
 
+    if (segments)
+        _dev->set_multi_segment();
+
     return 0;
 }
 
@@ -153,18 +158,56 @@ void FromDPDKDevice::cleanup(CleanupStage)
     cleanup_tasks();
 }
 
+#if !CLICK_PACKET_USE_DPDK && HAVE_ZEROCOPY
+/* Turn the following mbufs of the received chain @a mb into segments of
+ * @a p, its first mbuf being already owned by @a p. Each mbuf is detached
+ * from the chain, so that each segment frees its own. */
+bool FromDPDKDevice::make_segments(Packet *p, struct rte_mbuf *mb)
+{
+    struct rte_mbuf *m = mb->next;
+    mb->next = 0;
+    mb->nb_segs = 1;
+    rte_pktmbuf_pkt_len(mb) = rte_pktmbuf_data_len(mb);
+    Packet *last = p;
+    while (m) {
+        struct rte_mbuf *next = m->next;
+        m->next = 0;
+        m->nb_segs = 1;
+        rte_pktmbuf_pkt_len(m) = rte_pktmbuf_data_len(m);
+        Packet *s = Packet::make(rte_pktmbuf_mtod(m, unsigned char *),
+                                 rte_pktmbuf_data_len(m),
+                                 DPDKDevice::free_pkt, m,
+                                 rte_pktmbuf_headroom(m),
+                                 rte_pktmbuf_tailroom(m));
+        if (!s) {
+            rte_pktmbuf_free(m);
+            if (next)
+                rte_pktmbuf_free(next);
+            return false;
+        }
+        last->append_segment(s);
+        last = s;
+        m = next;
+    }
+    return true;
+}
+#endif
+
 bool FromDPDKDevice::run_task(Task *t)
 {
-    struct rte_mbuf *pkts[_burst];
+#if HAVE_BATCH
+    // Packets are handed to vector-aware elements in an array
+    PacketArray batch;
+    unsigned burst = (unsigned) _burst < PacketArray::capacity ? _burst : PacketArray::capacity;
+#else
+    unsigned burst = _burst;
+#endif
+    struct rte_mbuf *pkts[burst];
     int ret = 0;
 
     for (int iqueue = queue_for_thisthread_begin();
             iqueue<=queue_for_thisthread_end(); iqueue++) {
-#if HAVE_BATCH
-         PacketBatch* head = 0;
-         WritablePacket *last;
-#endif
-        unsigned n = rte_eth_rx_burst(_dev->port_id, iqueue, pkts, _burst);
+        unsigned n = rte_eth_rx_burst(_dev->port_id, iqueue, pkts, burst);
         for (unsigned i = 0; i < n; ++i) {
             unsigned char* data = rte_pktmbuf_mtod(pkts[i], unsigned char *);
             rte_prefetch0(data);
@@ -178,9 +221,20 @@ bool FromDPDKDevice::run_task(Task *t)
                      rte_pktmbuf_headroom(pkts[i]),
                      rte_pktmbuf_tailroom(pkts[i])
                      );
+            if (unlikely(pkts[i]->next) && !make_segments(p, pkts[i])) {
+                p->kill();
+                add_dropped(1);
+                continue;
+            }
 #else
-            WritablePacket *p = Packet::make(data,
+            WritablePacket *p = Packet::make(
                                      (uint32_t)rte_pktmbuf_pkt_len(pkts[i]));
+            unsigned char *d = p->data();
+            for (struct rte_mbuf *m = pkts[i]; m; m = m->next) {
+                memcpy(d, rte_pktmbuf_mtod(m, unsigned char *),
+                       rte_pktmbuf_data_len(m));
+                d += rte_pktmbuf_data_len(m);
+            }
             rte_pktmbuf_free(pkts[i]);
             data = p->data();
 #endif
@@ -196,20 +250,14 @@ bool FromDPDKDevice::run_task(Task *t)
                 SET_PAINT_ANNO(p, iqueue);
             }
 #if HAVE_BATCH
-            if (head == NULL)
-                head = PacketBatch::start_head(p);
-            else
-                last->set_next(p);
-            last = p;
+            batch.push_back(p);
 #else
             output(0).push(p);
 #endif
         }
 #if HAVE_BATCH
-        if (head) {
-            head->make_tail(last,n);
-            output_push_batch(0,head);
-        }
+        if (n)
+            output_push_array(0, batch);
 #endif
         if (n) {
             add_count(n);
@@ -86,7 +86,16 @@ Colon-separated string. The device's MAC address.
 
 =item MTU
 
-Integer. The maximum transfer unit of the device.
+Integer. The maximum transfer unit of the device. If frames of this size do
+not fit in a DPDK buffer, SEGMENTS is set.
+
+=item SEGMENTS
+
+Boolean. If true, frames larger than a DPDK buffer, such as jumbo frames, are
+received as packets made of several segments, without copy (see
+Packet::next_segment), and the device sends segmented packets. Elements that
+only read headers handle such packets unchanged. Defaults to false, unless
+the MTU requires it.
 
 =item PAUSE
 
@@ -168,6 +177,9 @@ private:
     static int write_handler(
         const String &, Element *, void *, ErrorHandler *
     ) CLICK_COLD;
+#if !CLICK_PACKET_USE_DPDK && HAVE_ZEROCOPY
+    static bool make_segments(Packet *p, struct rte_mbuf *mb);
+#endif
     static String status_handler(Element *e, void *thunk) CLICK_COLD;
     static String statistics_handler(Element *e, void *thunk) CLICK_COLD;
     static int xstats_handler(int operation, String &input, Element *e,
@@ -28,11 +28,10 @@
 #include <click/handlercall.hh>
 #include <click/packet_anno.hh>
 #include <click/userutils.hh>
+#include <click/master.hh>
 #include <clicknet/ether.h>
-#if CLICK_NS
-# include <click/master.hh>
-#endif
 #include "fakepcap.hh"
+#include "pcapindex.hh"
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -51,13 +50,15 @@ CLICK_DECLS
 #define MAX_MTU 9000
 
 FromDump::FromDump()
-    : _packet(0), _end_h(0), _count(0), _timer(this), _task(this), _preload_head(0), _force_len(DISABLED)
+    : _packet(0), _force_len(DISABLED), _end_h(0), _count(0), _timer(this), _task(this), _preload_head(0),
+      _index(0), _index_pos(0), _index_loading(false)
 {
 }
 
 FromDump::~FromDump()
 {
     delete _end_h;
+    delete _index;
 }
 
 void *
@@ -92,6 +93,10 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
 #endif
     _packet_filepos = 0;
     _preload = 0;
+    _use_index = false;
+    _zero_copy = false;
+    _paint_interface = false;
+    _load_threads = master()->nthreads();
 
     if (_ff.configure_keywords(conf, this, errh) < 0)
 	return -1;
@@ -114,6 +119,10 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
 #endif
     .read("FILEPOS", _packet_filepos)
     .read("PRELOAD", _preload)
+    .read("INDEX", _use_index)
+    .read("LOAD_THREADS", _load_threads)
+    .read("ZERO_COPY", _zero_copy)
+    .read("PAINT_INTERFACE", _paint_interface)
     .complete() < 0)
 	return -1;
 
@@ -157,6 +166,9 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
     else if (_have_last_time)
 	_end_h = new HandlerCall(name() + ".active false");
 
+    if (_zero_copy)
+	_use_index = true;
+
     // set other variables
     _have_any_times = false;
     _timing = timing;
@@ -259,6 +271,15 @@ FromDump::initialize(ErrorHandler *errh)
     if (!fh)
 	return _ff.error(errh, "not a tcpdump file (too short)");
 
+    _pcapng = false;
+    if (fh->magic == FAKE_PCAPNG_SHB) {
+	if (_use_index)
+	    return _ff.error(errh, "INDEX does not support pcapng files");
+	if (initialize_pcapng(reinterpret_cast<const fake_pcapng_shb *>(fh), errh) < 0)
+	    return -1;
+	goto check_linktype;
+    }
+
     if (fh->magic == FAKE_PCAP_MAGIC || fh->magic == FAKE_PCAP_MAGIC_NANO || fh->magic == FAKE_MODIFIED_PCAP_MAGIC)
 	_swapped = false;
     else {
@@ -281,6 +302,7 @@ FromDump::initialize(ErrorHandler *errh)
     // map possible host link types to global link types
     _linktype = fake_pcap_canonical_dlt(fh->linktype, true);
 
+  check_linktype:
     // if forcing IP packets, check datalink type to ensure we understand it
     if (_force_ip) {
 	   if (!fake_pcap_dlt_force_ipable(_linktype))
@@ -290,6 +312,16 @@ FromDump::initialize(ErrorHandler *errh)
         _force_ip = true;
     }
 
+    if (_use_index) {
+	_index = new PcapIndex;
+	if (_index->open(_ff.filename(), _swapped, _minor_version, _extra_pkthdr_crap,
+			 _have_nanosecond_timestamps, errh) < 0)
+	    return -1;
+	_index_loading = true;
+	_load_start = Timestamp::now_steady();
+	return _index->start(_load_threads, _preload, _zero_copy, errh);
+    }
+
     // maybe skip ahead in the file
     int result;
     if (_packet_filepos != 0) {
@@ -341,6 +373,8 @@ FromDump::take_state(Element *e, ErrorHandler *errh)
     _swapped = o->_swapped;
     _extra_pkthdr_crap = o->_extra_pkthdr_crap;
     _minor_version = o->_minor_version;
+    _pcapng = o->_pcapng;
+    _interfaces = o->_interfaces;
 
     _linktype = o->_linktype;
     if (_linktype == FAKE_DLT_RAW)
@@ -355,6 +389,8 @@ FromDump::take_state(Element *e, ErrorHandler *errh)
 void
 FromDump::cleanup(CleanupStage)
 {
+    if (_index)
+	_index->cleanup();
     _ff.cleanup();
     if (_packet)
 	_packet->kill();
@@ -403,6 +439,11 @@ FromDump::read_packet(ErrorHandler *errh)
 		return true;
 	}
 
+    if (_index)
+	return read_index_packet(errh);
+    if (_pcapng)
+	return read_pcapng_packet(errh);
+
     // record file position
     _packet_filepos = _ff.file_pos();
 
@@ -439,41 +480,348 @@ FromDump::read_packet(ErrorHandler *errh)
     // compensate for modified pcap versions
     _ff.shift_pos(_extra_pkthdr_crap);
 
-    // check times
-  check_times:
+    // check times and sampling
     ts = fake_bpf_timeval_union::make_timestamp(&ph->ts, _have_nanosecond_timestamps);
+    int check = check_record(ts, errh);
+    if (check <= 0) {
+	_ff.shift_pos(caplen + skiplen);
+	return check == 0;
+    }
+
+    // create packet
+    p = _ff.get_packet(caplen, ts.sec(), ts.subsec(), errh);
+    if (!p)
+	return false;
+
+    _ff.shift_pos(skiplen);
+    return finish_packet(p, len, caplen);
+}
+
+static inline uint32_t
+pcapng_u32(uint32_t x, bool swapped)
+{
+    return swapped ? SWAPLONG(x) : x;
+}
+
+static inline uint16_t
+pcapng_u16(uint16_t x, bool swapped)
+{
+    return swapped ? SWAPSHORT(x) : x;
+}
+
+/* Find option @a code among the pcapng options in @a opt. */
+static bool
+find_pcapng_option(const String &opt, bool swapped, int code, String &value)
+{
+    const char *s = opt.begin(), *end = opt.end();
+    while (s + 4 <= end) {
+	uint16_t h[2];
+	memcpy(h, s, 4);
+	int c = pcapng_u16(h[0], swapped), len = pcapng_u16(h[1], swapped);
+	if (c == FAKE_PCAPNG_OPT_ENDOFOPT || s + 4 + len > end)
+	    break;
+	if (c == code) {
+	    value = opt.substring(s + 4, s + 4 + len);
+	    return true;
+	}
+	s += 4 + ((len + 3) & ~3);
+    }
+    return false;
+}
+
+/** Start a pcapng section whose header block is @a shb, the file being
+ * positioned right after the fixed part of that block. */
+int
+FromDump::read_pcapng_section(const fake_pcapng_shb *shb, ErrorHandler *errh)
+{
+    if (shb->byte_order_magic == FAKE_PCAPNG_BYTE_ORDER_MAGIC)
+	_swapped = false;
+    else if (shb->byte_order_magic == SWAPLONG(FAKE_PCAPNG_BYTE_ORDER_MAGIC))
+	_swapped = true;
+    else
+	return _ff.error(errh, "not a pcapng file (bad byte order magic)");
+    if (pcapng_u16(shb->version_major, _swapped) != FAKE_PCAPNG_VERSION_MAJOR)
+	return _ff.error(errh, "unknown pcapng major version %d", pcapng_u16(shb->version_major, _swapped));
+    uint32_t total = pcapng_u32(shb->h.total_length, _swapped);
+    if (total < sizeof(*shb) + 4 || total % 4 != 0)
+	return _ff.error(errh, "bad pcapng section header");
+    // interface IDs are local to a section
+    _interfaces.clear();
+    _ff.shift_pos(total - sizeof(*shb));
+    return 0;
+}
+
+int
+FromDump::initialize_pcapng(const fake_pcapng_shb *shb, ErrorHandler *errh)
+{
+    _pcapng = true;
+    _extra_pkthdr_crap = 0;
+    _minor_version = FAKE_PCAP_VERSION_MINOR;
+    _have_nanosecond_timestamps = false;
+    if (read_pcapng_section(shb, errh) < 0)
+	return -1;
+
+    // interface descriptions come before the packets that refer to them;
+    // reading blocks moves the packet position, which holds FILEPOS
+    off_t filepos = _packet_filepos;
+    PcapngRecord r;
+    while (_interfaces.size() == 0) {
+	int result = read_pcapng_block(r, errh);
+	if (result < 0)
+	    return _ff.error(errh, "no interface description in pcapng file");
+	else if (result > 0)
+	    return _ff.error(errh, "packet before interface description");
+    }
+    _linktype = _interfaces[0].linktype;
+    _packet_filepos = filepos;
+    return 0;
+}
+
+Timestamp
+FromDump::pcapng_timestamp(const Interface &ifc, uint64_t ticks)
+{
+    uint64_t sec = ticks / ifc.ts_units, frac = ticks % ifc.ts_units;
+    uint32_t nsec;
+    if (ifc.ts_units <= 1000000000 && 1000000000 % ifc.ts_units == 0)
+	nsec = frac * (1000000000 / ifc.ts_units);
+    else
+	nsec = (uint32_t) ((double) frac * 1000000000 / ifc.ts_units);
+    return Timestamp::make_nsec(sec + ifc.ts_offset, nsec);
+}
+
+/** Read one pcapng block. Returns -1 at the end of the file or on error, 0
+ * after a block without packet, and 1 after the fixed part of a packet
+ * block, described in @a r. */
+int
+FromDump::read_pcapng_block(PcapngRecord &r, ErrorHandler *errh)
+{
+    _packet_filepos = _ff.file_pos();
+
+    fake_pcapng_shb buf;
+    const fake_pcapng_block_header *bh = reinterpret_cast<const fake_pcapng_block_header *>(_ff.get_aligned(sizeof(*bh), &buf));
+    if (!bh)
+	return -1;
+    uint32_t type = pcapng_u32(bh->type, _swapped);
+    uint32_t total = pcapng_u32(bh->total_length, _swapped);
+
+    if (type == FAKE_PCAPNG_SHB) {
+	// the byte order may change with the new section
+	buf.h = *bh;
+	const uint8_t *rest = _ff.get_aligned(sizeof(buf) - sizeof(*bh), &buf.byte_order_magic, errh);
+	if (!rest)
+	    return -1;
+	memmove(&buf.byte_order_magic, rest, sizeof(buf) - sizeof(*bh));
+	return read_pcapng_section(&buf, errh) < 0 ? -1 : 0;
+    }
+
+    if (total < 12 || total % 4 != 0) {
+	_ff.error(errh, "bad pcapng block; giving up");
+	return -1;
+    }
+    // length of the block body, without header and trailing length
+    uint32_t body = total - 12;
+
+    if (type == FAKE_PCAPNG_IDB) {
+	fake_pcapng_idb swapped_ib;
+	const fake_pcapng_idb *ib;
+	if (body < sizeof(*ib)
+	    || !(ib = reinterpret_cast<const fake_pcapng_idb *>(_ff.get_aligned(sizeof(*ib), &swapped_ib, errh))))
+	    return -1;
+	Interface ifc;
+	ifc.linktype = fake_pcap_canonical_dlt(pcapng_u16(ib->linktype, _swapped), true);
+	ifc.snaplen = pcapng_u32(ib->snaplen, _swapped);
+	ifc.ts_units = 1000000;
+	ifc.ts_offset = 0;
+	String opt = _ff.get_string(body - sizeof(*ib), errh), value;
+	if (find_pcapng_option(opt, _swapped, FAKE_PCAPNG_OPT_IF_TSRESOL, value) && value.length() >= 1) {
+	    uint8_t resol = value[0];
+	    if (resol & 0x80) {
+		if ((resol & 0x7F) < 64)
+		    ifc.ts_units = (uint64_t) 1 << (resol & 0x7F);
+	    } else if (resol <= 19) {
+		ifc.ts_units = 1;
+		while (resol-- > 0)
+		    ifc.ts_units *= 10;
+	    }
+	}
+	if (find_pcapng_option(opt, _swapped, FAKE_PCAPNG_OPT_IF_TSOFFSET, value) && value.length() >= 8) {
+	    uint32_t w[2];
+	    memcpy(w, value.data(), 8);
+	    if (_swapped)
+		ifc.ts_offset = ((int64_t) SWAPLONG(w[0]) << 32) | SWAPLONG(w[1]);
+	    else
+		memcpy(&ifc.ts_offset, w, 8);
+	}
+	_ff.shift_pos(4);
+	_interfaces.push_back(ifc);
+	return 0;
+    }
+
+    if (type == FAKE_PCAPNG_EPB || type == FAKE_PCAPNG_PB) {
+	fake_pcapng_epb swapped_eb;
+	const fake_pcapng_epb *eb;
+	if (body < sizeof(*eb)
+	    || !(eb = reinterpret_cast<const fake_pcapng_epb *>(_ff.get_aligned(sizeof(*eb), &swapped_eb, errh))))
+	    return -1;
+	if (type == FAKE_PCAPNG_EPB)
+	    r.interface = pcapng_u32(eb->interface_id, _swapped);
+	else {
+	    uint16_t id;
+	    memcpy(&id, &eb->interface_id, sizeof(id));
+	    r.interface = pcapng_u16(id, _swapped);
+	}
+	r.caplen = pcapng_u32(eb->caplen, _swapped);
+	r.len = pcapng_u32(eb->len, _swapped);
+	uint32_t padded = (r.caplen + 3) & ~3U;
+	if (r.interface >= (uint32_t) _interfaces.size() || padded > body - sizeof(*eb)) {
+	    _ff.error(errh, "bad pcapng packet block; giving up");
+	    return -1;
+	}
+	uint64_t ticks = ((uint64_t) pcapng_u32(eb->ts_high, _swapped) << 32) | pcapng_u32(eb->ts_low, _swapped);
+	r.ts = pcapng_timestamp(_interfaces[r.interface], ticks);
+	r.pad = padded - r.caplen;
+	r.optlen = body - sizeof(*eb) - padded;
+	return 1;
+    }
+
+    if (type == FAKE_PCAPNG_SPB) {
+	uint32_t swapped_len;
+	const uint32_t *lp;
+	if (body < 4 || _interfaces.size() == 0
+	    || !(lp = reinterpret_cast<const uint32_t *>(_ff.get_aligned(4, &swapped_len, errh))))
+	    return -1;
+	// simple packets carry neither timestamp nor captured length
+	r.interface = 0;
+	r.len = pcapng_u32(*lp, _swapped);
+	r.caplen = body - 4;
+	if (r.caplen > r.len)
+	    r.caplen = r.len;
+	if (_interfaces[0].snaplen && r.caplen > _interfaces[0].snaplen)
+	    r.caplen = _interfaces[0].snaplen;
+	r.ts = Timestamp();
+	r.pad = body - 4 - r.caplen;
+	r.optlen = 0;
+	return 1;
+    }
+
+    // skip other blocks
+    _ff.shift_pos(total - sizeof(*bh));
+    return 0;
+}
+
+/** Read the next packet from a pcapng file; same as read_packet(). */
+bool
+FromDump::read_pcapng_packet(ErrorHandler *errh)
+{
+    PcapngRecord r;
+    int result;
+    while ((result = read_pcapng_block(r, errh)) == 0)
+	/* skip blocks without packet */;
+    if (result < 0)
+	return false;
+
+    _linktype = _interfaces[r.interface].linktype;
+    int check = check_record(r.ts, errh);
+    if (check <= 0) {
+	_ff.shift_pos(r.caplen + r.pad + r.optlen + 4);
+	return check == 0;
+    }
+
+    Packet *p = _ff.get_packet(r.caplen, r.ts.sec(), r.ts.subsec(), errh);
+    if (!p)
+	return false;
+    _ff.shift_pos(r.pad);
+
+    // direction and reception type flags map to the packet type annotation
+    String opt, value;
+    if (r.optlen)
+	opt = _ff.get_string(r.optlen, errh);
+    _ff.shift_pos(4);
+    if (find_pcapng_option(opt, _swapped, FAKE_PCAPNG_OPT_EPB_FLAGS, value) && value.length() >= 4) {
+	uint32_t flags;
+	memcpy(&flags, value.data(), 4);
+	flags = pcapng_u32(flags, _swapped);
+	if ((flags & 3) == 2)
+	    p->set_packet_type_anno(Packet::OUTGOING);
+	else if (((flags >> 2) & 7) == 2)
+	    p->set_packet_type_anno(Packet::MULTICAST);
+	else if (((flags >> 2) & 7) == 3)
+	    p->set_packet_type_anno(Packet::BROADCAST);
+	else if (((flags >> 2) & 7) == 4)
+	    p->set_packet_type_anno(Packet::OTHERHOST);
+    }
+    if (_paint_interface)
+	SET_PAINT_ANNO(p, r.interface);
+
+    if (r.len < r.caplen)
+	r.len = r.caplen;
+    return finish_packet(p, r.len, r.caplen);
+}
+
+/** Decide whether to emit a record with timestamp @a ts.
+ *
+ * Returns 1 if the record must be emitted, 0 if it must be skipped and -1
+ * if reading must stop. */
+int
+FromDump::check_record(const Timestamp &ts, ErrorHandler *errh)
+{
+  check_times:
     if (!_have_any_times)
 	prepare_times(ts);
     if (_have_first_time) {
-	if (ts < _first_time) {
-	    _ff.shift_pos(caplen + skiplen);
-	    return true;
-	} else
+	if (ts < _first_time)
+	    return 0;
+	else
 	    _have_first_time = false;
     }
     if (_have_last_time && ts >= _last_time) {
 	_have_last_time = false;
 	(void) _end_h->call_write(errh);
-	if (!_active) {
-	    _ff.shift_pos(caplen + skiplen);
-	    return false;
-	}
+	if (!_active)
+	    return -1;
 	// retry _last_time in case someone changed it
 	goto check_times;
     }
 
     // checking sampling probability
     if (_sampling_prob < (1 << SAMPLING_SHIFT)
-	&& (click_random() & ((1<<SAMPLING_SHIFT)-1)) >= _sampling_prob) {
-	_ff.shift_pos(caplen + skiplen);
-	return true;
+	&& (click_random() & ((1<<SAMPLING_SHIFT)-1)) >= _sampling_prob)
+	return 0;
+
+    return 1;
+}
+
+/** Read the next packet from the record index; same as read_packet(). */
+bool
+FromDump::read_index_packet(ErrorHandler *errh)
+{
+    if (_index_pos >= _index->size())
+	return false;
+
+    int i = _index_pos++;
+    PcapIndex::Record r;
+    _index->record(i, r);
+    _packet_filepos = _index->offset(i);
+
+    int check = check_record(r.ts, errh);
+    if (check <= 0) {
+	if (Packet *p = _index->take_packet(i))
+	    p->kill();
+	return check == 0;
     }
 
-    // create packet
-    p = _ff.get_packet(caplen, ts.sec(), ts.subsec(), errh);
-    if (!p)
+    // use the preloaded packet, or materialize it now
+    Packet *p = _index->take_packet(i);
+    if (!p && !(p = _index->make_packet(i, r)))
 	return false;
 
+    return finish_packet(p, r.len, r.caplen);
+}
+
+/** Apply FORCE_LEN and set the annotations of a freshly read packet. */
+bool
+FromDump::finish_packet(Packet *p, int len, int caplen)
+{
     // Adjust the packet length as requested by the user
     if (_force_len != DISABLED) {
         WritablePacket *q = 0;
@@ -536,8 +884,6 @@ FromDump::read_packet(ErrorHandler *errh)
         SET_EXTRA_LENGTH_ANNO(p, len - caplen);
     }
 
-    _ff.shift_pos(skiplen);
-
     // Raw IP case; Leave the link layer information out
     if (_linktype == FAKE_DLT_RAW) {
         p->set_network_header(p->data());
@@ -550,6 +896,29 @@ FromDump::read_packet(ErrorHandler *errh)
     return true;
 }
 
+/** Check whether the index finished loading, and start using it if so.
+ *
+ * A pull output waits for the loader, as pulling elements such as the
+ * Replay family take an empty pull for the end of the trace. */
+bool
+FromDump::check_index_loaded()
+{
+    if (!_index->done() && output_is_push(0)) {
+	_timer.schedule_after_msec(LOAD_POLL_MSEC);
+	return false;
+    }
+    _index->wait();
+    _index_loading = false;
+    if (_packet_filepos != 0) {
+	_index_pos = _index->find(_packet_filepos);
+	_packet_filepos = 0;
+    }
+    click_chatter("%s : Indexed %d packets (%d preloaded) with %d threads in %s seconds",
+		  name().c_str(), _index->size(), _index->npreloaded(), _index->nthreads(),
+		  (Timestamp::now_steady() - _load_start).unparse().c_str());
+    return true;
+}
+
 bool
 FromDump::check_timing(Packet *p)
 {
@@ -586,6 +955,8 @@ FromDump::run_task(Task *)
 {
     if (!_active)
 	return false;
+    if (unlikely(_index_loading) && !check_index_loaded())
+	return false;
 
     int retry_count = 0;
   again:
@@ -620,6 +991,8 @@ FromDump::pull(int)
 	_notifier.sleep();
 	return 0;
     }
+    if (unlikely(_index_loading))
+	check_index_loaded();
 
     bool more = true;
     if (!_packet)
@@ -647,7 +1020,7 @@ FromDump::pull(int)
 
 enum {
     H_SAMPLING_PROB, H_ACTIVE, H_ENCAP, H_STOP, H_PACKET_FILEPOS,
-    H_EXTEND_INTERVAL, H_COUNT, H_RESET_COUNTS, H_RESET_TIMING
+    H_EXTEND_INTERVAL, H_COUNT, H_RESET_COUNTS, H_RESET_TIMING, H_LOAD_PROGRESS
 };
 
 String
@@ -659,6 +1032,8 @@ FromDump::read_handler(Element *e, void *thunk)
 	return cp_unparse_real2(fd->_sampling_prob, SAMPLING_SHIFT);
     case H_ENCAP:
 	return String(fake_pcap_unparse_dlt(fd->_linktype));
+    case H_LOAD_PROGRESS:
+	return String(fd->_index ? fd->_index->progress() * 100 : 100.);
     default:
 	return "<error>";
     }
@@ -717,6 +1092,7 @@ FromDump::add_handlers()
     add_data_handlers("packet_filepos", Handler::OP_READ, &_packet_filepos);
     add_write_handler("extend_interval", write_handler, H_EXTEND_INTERVAL);
     add_data_handlers("count", Handler::OP_READ, &_count);
+    add_read_handler("load_progress", read_handler, H_LOAD_PROGRESS);
     add_write_handler("reset_counts", write_handler, H_RESET_COUNTS, Handler::BUTTON);
     add_write_handler("reset_timing", write_handler, H_RESET_TIMING, Handler::BUTTON);
     if (output_is_push(0))
@@ -724,5 +1100,5 @@ FromDump::add_handlers()
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(userlevel|ns FakePcap)
+ELEMENT_REQUIRES(userlevel|ns FakePcap PcapIndex)
 EXPORT_ELEMENT(FromDump)
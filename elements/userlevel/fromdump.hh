@@ -8,11 +8,13 @@
 #include <click/fromfile.hh>
 CLICK_DECLS
 class HandlerCall;
+class PcapIndex;
+struct fake_pcapng_shb;
 
 /*
 =c
 
-FromDump(FILENAME [, I<keywords> STOP, TIMING, SAMPLE, FORCE_IP, START, START_AFTER, END, END_AFTER, INTERVAL, END_CALL, FILEPOS, MMAP])
+FromDump(FILENAME [, I<keywords> STOP, TIMING, SAMPLE, FORCE_IP, START, START_AFTER, END, END_AFTER, INTERVAL, END_CALL, FILEPOS, MMAP, PRELOAD, INDEX, LOAD_THREADS, ZERO_COPY, PAINT_INTERFACE])
 
 =s traces
 
@@ -27,6 +29,13 @@ more packets.
 FromDump also transparently reads gzip- and bzip2-compressed tcpdump files, if
 you have zcat(1) and bzcat(1) installed.
 
+FromDump reads both classic tcpdump files, with microsecond or nanosecond
+timestamps, and pcapng files. In pcapng files, each interface may have its
+own link type and timestamp resolution, and the direction and reception type
+flags of enhanced packet blocks set the packet type annotation. Other
+options, including packet comments, are skipped: a packet has no annotation
+that could hold them.
+
 Keyword arguments are:
 
 =over 8
@@ -117,6 +126,40 @@ This can result in slightly better performance on some machines. FromDump's
 regular file discipline is pretty optimized, so the difference is often small
 in practice. Default is true on most operating systems, but false on Linux.
 
+=item PRELOAD
+
+Integer. If nonzero, FromDump reads that many bytes of packets in memory
+at initialization time, or the whole file if negative. Default is 0.
+
+=item INDEX
+
+Boolean. If true, FromDump maps the whole file in memory and builds an index
+of its records, using LOAD_THREADS threads that each scan a part of the file.
+Packets are then only created when they are emitted, which saves the memory
+and the startup time of PRELOAD for large traces. With PRELOAD, the preloaded
+packets are also created in parallel, from the index. Loading happens in the
+background: a push FromDump starts emitting once it is done, while a pull
+FromDump waits for it on the first pull. The file must be an uncompressed
+regular file in the classic tcpdump format; pcapng files are not supported.
+Default is false.
+
+=item LOAD_THREADS
+
+Integer. Number of threads used to load the index. Default is the number of
+Click threads.
+
+=item ZERO_COPY
+
+Boolean. If true, packets point directly into the mapped file instead of
+being copied out of it. Their buffers are read-only and shared, so elements
+that modify packets copy them first, and encapsulating them always requires a
+copy as they have no headroom. ZERO_COPY implies INDEX. Default is false.
+
+=item PAINT_INTERFACE
+
+Boolean. If true, FromDump sets the paint annotation of packets read from a
+pcapng file to the ID of their interface. Default is false.
+
 =back
 
 You can supply at most one of START and START_AFTER, and at most one of END,
@@ -143,6 +186,11 @@ segmentation violation.
 
 Returns the number of packets output so far.
 
+=h load_progress read-only
+
+Returns the percentage of the INDEX loading work done so far, 100 when
+INDEX is false.
+
 =h reset_counts write-only
 
 Resets "count" to 0.
@@ -171,6 +219,7 @@ cannot be determined (because the file was compressed, for example).
 =h filepos read/write
 
 Returns or sets FromDump's position in the (uncompressed) file, in bytes.
+Not meaningful when INDEX is true.
 
 =h packet_filepos read-only
 
@@ -225,6 +274,8 @@ class FromDump : public Element { public:
 
     enum { DISABLED = -1, REAL_LEN = 0};
 
+    enum { LOAD_POLL_MSEC = 10 };
+
     FromFile _ff;
 
     Packet *_packet;
@@ -263,10 +314,45 @@ class FromDump : public Element { public:
     ActiveNotifier _notifier;
     Packet* _preload_head;
 
+    PcapIndex *_index;
+    int _index_pos;
+    bool _use_index;
+    bool _zero_copy;
+    bool _index_loading;
+    int _load_threads;
+    Timestamp _load_start;
+
+    struct Interface {
+	int linktype;
+	uint32_t snaplen;
+	uint64_t ts_units;
+	int64_t ts_offset;
+    };
+    struct PcapngRecord {
+	Timestamp ts;
+	uint32_t interface;
+	uint32_t caplen;
+	uint32_t len;
+	uint32_t pad;
+	uint32_t optlen;
+    };
+    bool _pcapng;
+    bool _paint_interface;
+    Vector<Interface> _interfaces;
+
     Timestamp _timing_offset;
     off_t _packet_filepos;
 
     bool read_packet(ErrorHandler *);
+    bool read_index_packet(ErrorHandler *);
+    bool read_pcapng_packet(ErrorHandler *);
+    int read_pcapng_block(PcapngRecord &, ErrorHandler *);
+    int read_pcapng_section(const fake_pcapng_shb *, ErrorHandler *);
+    int initialize_pcapng(const fake_pcapng_shb *, ErrorHandler *);
+    static Timestamp pcapng_timestamp(const Interface &, uint64_t);
+    int check_record(const Timestamp &, ErrorHandler *);
+    bool finish_packet(Packet *p, int len, int caplen);
+    bool check_index_loaded();
 
     void prepare_times(const Timestamp &);
     bool check_timing(Packet *p);
@@ -0,0 +1,206 @@
+// -*- c-basic-offset: 4; related-file-name: "fromxdpdevice.hh" -*-
+/*
+ * fromxdpdevice.{cc,hh} -- element reads packets from a network device
+ * through AF_XDP sockets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fromxdpdevice.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/master.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+FromXDPDevice::FromXDPDevice()
+    : _device(0)
+{
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
+    _burst = 32;
+}
+
+int
+FromXDPDevice::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String ifname, mode_str = "auto";
+    unsigned desc = 0;
+    if (Args(this, errh).bind(conf)
+	.read_mp("DEVNAME", ifname)
+	.read("NDESC", desc)
+	.read("MODE", WordArg(), mode_str)
+	.consume() < 0)
+	return -1;
+    if (parse(conf, errh) != 0)
+	return -1;
+    if (Args(conf, this, errh).complete() < 0)
+	return -1;
+
+    XDPDevice::Mode mode;
+    if (!XDPDevice::parse_mode(mode_str, mode))
+	return errh->error("bad MODE %<%s%>", mode_str.c_str());
+    if (!(_device = XDPDevice::open(ifname, errh)))
+	return -1;
+    if (_device->set_parameters(desc ? desc : 1024, mode, errh) < 0)
+	return -1;
+
+    if (firstqueue == -1) {
+	firstqueue = 0;
+	// Like with Netmap, use all queues by default, as RSS spreads
+	// packets among them
+	if (n_queues == -1)
+	    return configure_rx(0, _device->n_queues, _device->n_queues, errh);
+    } else if (n_queues == -1)
+	return configure_rx(0, 1, 1, errh);
+    if (firstqueue + n_queues > _device->n_queues)
+	return errh->error("You asked for %d queues after queue %d but device only have %d.", n_queues, firstqueue, _device->n_queues);
+    return configure_rx(0, n_queues, n_queues, errh);
+}
+
+int
+FromXDPDevice::initialize(ErrorHandler *errh)
+{
+    int ret = initialize_rx(errh);
+    if (ret != 0)
+	return ret;
+    ret = initialize_tasks(false, errh);
+    if (ret != 0)
+	return ret;
+
+    _queues.resize(lastqueue + 1, 0);
+    for (int i = firstqueue; i <= lastqueue; i++) {
+	if (_device->enable_rx(i, errh) < 0)
+	    return -1;
+	_queues[i] = _device->queue(i, errh);
+	if (_queues[i]->fd >= _queue_for_fd.size())
+	    _queue_for_fd.resize(_queues[i]->fd + 1, -1);
+	_queue_for_fd[_queues[i]->fd] = i;
+    }
+    if (_promisc && _device->set_promiscuous(errh) < 0)
+	return -1;
+    if (_verbose > 1)
+	click_chatter("%s: %s, queues %d to %d, %s mode", name().c_str(),
+		      _device->ifname.c_str(), firstqueue, lastqueue,
+		      _queues[firstqueue]->zerocopy ? "zero-copy" : "copy");
+
+    for (int i = 0; i < usable_threads.size(); i++) {
+	if (!usable_threads[i])
+	    continue;
+	for (int j = queue_for_thread_begin(i); j <= queue_for_thread_end(i); j++)
+	    master()->thread(i)->select_set().add_select(_queues[j]->fd, this, SELECT_READ);
+    }
+    return 0;
+}
+
+inline bool
+FromXDPDevice::receive_packets(Task *task, int begin, int end, bool fromtask)
+{
+    unsigned sent = 0;
+    bool pending = false;
+#if HAVE_BATCH
+    PacketArray batch;
+#endif
+
+    for (int i = begin; i <= end; i++) {
+	XDPDevice::Queue *q = _queues[i];
+	lock();
+#if HAVE_BATCH
+	uint32_t n = q->rx.available(_burst < PacketArray::capacity ? _burst : PacketArray::capacity);
+#else
+	uint32_t n = q->rx.available(_burst);
+#endif
+	if (n == 0) {
+	    q->kick_rx();
+	    unlock();
+	    continue;
+	}
+	for (uint32_t j = 0; j < n; j++) {
+	    WritablePacket *p = q->make_packet(q->rx.desc(q->rx.cached + j));
+	    p->set_packet_type_anno(Packet::HOST);
+	    p->set_mac_header(p->data());
+	    if (_set_paint_anno)
+		SET_PAINT_ANNO(p, i);
+#if HAVE_BATCH
+	    batch.push_back(p);
+#else
+	    output(0).push(p);
+#endif
+	}
+	q->rx.release(n);
+	// Give the frames of packets killed since the last call back to
+	// the kernel
+	q->refill();
+	q->kick_rx();
+	if (q->rx.available(1))
+	    pending = true;
+	unlock();
+#if HAVE_BATCH
+	output_push_array(0, batch);
+#endif
+	sent += n;
+    }
+
+    if (pending) {
+	if (fromtask)
+	    task->fast_reschedule();
+	else
+	    task->reschedule();
+    }
+    add_count(sent);
+    return sent;
+}
+
+void
+FromXDPDevice::selected(int fd, int)
+{
+    int q = _queue_for_fd[fd];
+    receive_packets(task_for_thread(), q, q, false);
+}
+
+bool
+FromXDPDevice::run_task(Task *t)
+{
+    return receive_packets(t, queue_for_thisthread_begin(), queue_for_thisthread_end(), true);
+}
+
+void
+FromXDPDevice::cleanup(CleanupStage)
+{
+    cleanup_tasks();
+    if (_device)
+	_device->close();
+}
+
+String
+FromXDPDevice::read_handler(Element *e, void *)
+{
+    FromXDPDevice *fd = static_cast<FromXDPDevice *>(e);
+    if (!fd->_queues.size())
+	return String(false);
+    return String(fd->_queues[fd->firstqueue]->zerocopy);
+}
+
+void
+FromXDPDevice::add_handlers()
+{
+    add_read_handler("count", count_handler, 0);
+    add_read_handler("dropped", dropped_handler, 0);
+    add_read_handler("zerocopy", read_handler, 0);
+    add_write_handler("reset_counts", reset_count_handler, 0, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel xdp QueueDevice XDPDevice)
+EXPORT_ELEMENT(FromXDPDevice)
+ELEMENT_MT_SAFE(FromXDPDevice)
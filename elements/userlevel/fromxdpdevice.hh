@@ -0,0 +1,142 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FROMXDPDEVICE_HH
+#define CLICK_FROMXDPDEVICE_HH
+#include <click/config.h>
+#include <click/task.hh>
+#include "queuedevice.hh"
+#include "xdpdevice.hh"
+CLICK_DECLS
+
+/*
+=c
+
+FromXDPDevice(DEVNAME [, QUEUE, I<keywords> N_QUEUES, PROMISC, BURST, NDESC, MODE, ...])
+
+=s netdevices
+
+reads packets from a network device using AF_XDP sockets
+
+=d
+
+Receives packets from the network interface DEVNAME through AF_XDP sockets,
+bypassing the kernel network stack without dedicating the interface to a
+user-space driver. Packets are received in batches, directly in the memory
+shared with the kernel (the UMEM): no copy is made when the driver supports
+zero-copy AF_XDP, and a single copy, by the kernel, otherwise, as on veth
+interfaces.
+
+FromXDPDevice loads and attaches an XDP program redirecting the packets of
+the queues it uses to its sockets; packets of other queues go to the kernel
+stack. The program is detached when Click exits. This needs the
+CAP_NET_ADMIN and CAP_BPF capabilities (or root), and Linux 5.9 or later.
+
+Like FromDPDKDevice, FromXDPDevice can use several hardware queues and
+threads, spread by the same logic (see QUEUE, N_QUEUES, MAXTHREADS and
+THREADOFFSET). Each queue gets its own socket, shared with ToXDPDevice
+elements using the same interface and queue: a packet received on a queue
+and sent back on it by ToXDPDevice is transmitted without copy.
+
+Arguments:
+
+=over 8
+
+=item DEVNAME
+
+String. Name of the network interface.
+
+=item QUEUE
+
+Integer. First hardware queue to use. Default is 0.
+
+=item N_QUEUES
+
+Integer. Number of hardware queues to use. Default is all queues if QUEUE
+is not set, 1 otherwise.
+
+=item PROMISC
+
+Boolean. Put the interface in promiscuous mode. Default is true.
+
+=item BURST
+
+Integer. Maximum number of packets received at once from a queue. Default
+is 32.
+
+=item NDESC
+
+Integer. Size of the rings of each socket, a power of 2. Each queue uses a
+UMEM of 4 * NDESC frames of 2048 bytes, so packets must fit in 1792 bytes.
+Default is 1024.
+
+=item MODE
+
+Either "auto", "zerocopy", "copy" or "generic". "zerocopy" and "copy" force
+the AF_XDP mode with a native XDP program; "generic" uses a generic XDP
+program, which works on any interface, and copies. "auto" tries zero-copy,
+then copy, and native XDP, then generic. Default is "auto". Elements using
+the same interface must use the same MODE and NDESC.
+
+=item PAINT_QUEUE
+
+Boolean. Set the paint annotation of packets to their queue number. Default
+is false.
+
+=item MAXTHREADS, THREADOFFSET, NUMA, VERBOSE
+
+See FromDPDKDevice.
+
+=back
+
+=h count read-only
+
+Returns the number of packets received.
+
+=h zerocopy read-only
+
+Returns true if the queues receive in zero-copy mode.
+
+=h reset_counts write-only
+
+Resets the count to zero.
+
+=e
+
+  FromXDPDevice(veth0) -> Strip(14) -> CheckIPHeader -> ... -> ToXDPDevice(veth1);
+
+=a ToXDPDevice, FromDevice, FromDPDKDevice, FromNetmapDevice
+*/
+
+class FromXDPDevice : public RXQueueDevice {
+
+public:
+
+    FromXDPDevice() CLICK_COLD;
+
+    const char *class_name() const		{ return "FromXDPDevice"; }
+    const char *port_count() const		{ return PORTS_0_1; }
+    const char *processing() const		{ return PUSH; }
+
+    int configure_phase() const			{ return CONFIGURE_PHASE_PRIVILEGED - 5; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void selected(int fd, int mask);
+    bool run_task(Task *);
+
+  private:
+
+    XDPDevice *_device;
+    Vector<XDPDevice::Queue *> _queues;
+    Vector<int> _queue_for_fd;
+
+    inline bool receive_packets(Task *task, int begin, int end, bool fromtask);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,491 @@
+// -*- related-file-name: "pcapindex.hh"; c-basic-offset: 4 -*-
+/*
+ * pcapindex.{cc,hh} -- parallel record index over a mmap'ed tcpdump file
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "pcapindex.hh"
+#include <click/error.hh>
+#include <click/packet.hh>
+#include <click/machine.hh>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+CLICK_DECLS
+
+#define	SWAPLONG(y) \
+	((((y)&0xff)<<24) | (((y)&0xff00)<<8) | (((y)&0xff0000)>>8) | (((y)>>24)&0xff))
+
+PcapIndex::PcapIndex()
+    : _map(0), _size(0), _mapping(0), _zero_copy(false), _preload(0), _to_make(0), _done(false)
+#if HAVE_MULTITHREAD
+    , _have_thread(false)
+#endif
+{
+}
+
+int
+PcapIndex::open(const String &filename, bool swapped, int minor_version,
+		unsigned extra_pkthdr_crap, bool nano, ErrorHandler *errh)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+	return errh->error("%s: %s", filename.c_str(), strerror(errno));
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+	close(fd);
+	return errh->error("%s: INDEX requires a regular file", filename.c_str());
+    }
+    _size = statbuf.st_size;
+    if (_size < FILE_HEADER_SIZE) {
+	close(fd);
+	return errh->error("%s: not a tcpdump file (too short)", filename.c_str());
+    }
+
+    void *map = mmap(0, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return errh->error("%s: mmap: %s", filename.c_str(), strerror(errno));
+    _map = reinterpret_cast<const uint8_t *>(map);
+    _mapping = new Mapping;
+    _mapping->data = _map;
+    _mapping->size = _size;
+    _mapping->refcount = 1;
+#ifdef HAVE_MADVISE
+    (void) madvise((caddr_t)map, _size, MADV_SEQUENTIAL);
+#endif
+
+    // the header was already parsed from the (possibly uncompressed) stream,
+    // make sure the file itself is that stream
+    uint32_t magic;
+    memcpy(&magic, _map, sizeof(magic));
+    if (swapped)
+	magic = SWAPLONG(magic);
+    if (magic != FAKE_PCAP_MAGIC && magic != FAKE_PCAP_MAGIC_NANO
+	&& magic != FAKE_MODIFIED_PCAP_MAGIC)
+	return errh->error("%s: INDEX requires an uncompressed tcpdump file", filename.c_str());
+
+    _swapped = swapped;
+    _minor_version = minor_version;
+    _nano = nano;
+    _hdrlen = sizeof(fake_pcap_pkthdr) + extra_pkthdr_crap;
+    return 0;
+}
+
+void
+PcapIndex::read_header(off_t off, fake_pcap_pkthdr *ph) const
+{
+    memcpy(ph, _map + off, sizeof(*ph));
+    if (_swapped) {
+	ph->ts.tv.tv_sec = SWAPLONG(ph->ts.tv.tv_sec);
+	ph->ts.tv.tv_usec = SWAPLONG(ph->ts.tv.tv_usec);
+	ph->caplen = SWAPLONG(ph->caplen);
+	ph->len = SWAPLONG(ph->len);
+    }
+}
+
+/** @brief Fill @a r with the description of record @a i.
+ *
+ * Applies the same corrections as FromDump: lengths swapped by old pcap
+ * versions, and capture lengths larger than the wire length. */
+void
+PcapIndex::record(int i, Record &r) const
+{
+    fake_pcap_pkthdr ph;
+    off_t off = _records[i];
+    read_header(off, &ph);
+    if (_minor_version > 3 || (_minor_version == 3 && ph.caplen <= ph.len)) {
+	r.len = ph.len;
+	r.caplen = ph.caplen;
+    } else {
+	r.len = ph.caplen;
+	r.caplen = ph.len;
+    }
+    if (r.caplen > r.len)
+	r.caplen = r.len;
+    r.ts = fake_bpf_timeval_union::make_timestamp(&ph.ts, _nano);
+    r.data = _map + off + _hdrlen;
+}
+
+/** @brief Create the packet of record @a i, described by @a r. */
+Packet *
+PcapIndex::make_packet(int i, const Record &r) const
+{
+    Packet *p;
+    if (_zero_copy) {
+	if ((p = _windows[i / WINDOW_RECORDS]->clone()))
+	    p->shrink_data(r.data, r.caplen);
+    } else
+	p = Packet::make(r.data, r.caplen);
+    if (p)
+	p->timestamp_anno() = r.ts;
+    return p;
+}
+
+void
+PcapIndex::release_mapping(Mapping *m)
+{
+    if (m->refcount.dec_and_test()) {
+	munmap((caddr_t)m->data, m->size);
+	delete m;
+    }
+}
+
+void
+PcapIndex::window_destructor(unsigned char *, size_t, void *arg)
+{
+    release_mapping(static_cast<Mapping *>(arg));
+}
+
+/** @brief Create the read-only packets spanning each window of
+ * WINDOW_RECORDS records, of which zero-copy packets are clones. */
+void
+PcapIndex::make_windows()
+{
+    for (int w = 0; w * WINDOW_RECORDS < _records.size(); w++) {
+	int last = w * WINDOW_RECORDS + WINDOW_RECORDS - 1;
+	if (last >= _records.size())
+	    last = _records.size() - 1;
+	Record r;
+	record(last, r);
+	const uint8_t *begin = _map + _records[w * WINDOW_RECORDS];
+	const uint8_t *end = r.data + r.caplen;
+	_mapping->refcount++;
+	Packet *p = Packet::make(const_cast<unsigned char *>(begin), end - begin,
+				 window_destructor, _mapping);
+	if (!p) {
+	    release_mapping(_mapping);
+	    _records.resize(w * WINDOW_RECORDS);
+	    break;
+	}
+	_windows.push_back(p);
+    }
+}
+
+/** @brief Check whether a record header may start at @a off.
+ *
+ * On success, set *@a next to the offset following the record. */
+bool
+PcapIndex::plausible(off_t off, off_t *next) const
+{
+    if (off + (off_t)_hdrlen > (off_t)_size)
+	return false;
+    fake_pcap_pkthdr ph;
+    read_header(off, &ph);
+    if ((uint32_t) ph.ts.tv.tv_usec >= (_nano ? 1000000000U : 1000000U))
+	return false;
+    uint32_t caplen = stored_caplen(ph);
+    uint32_t len = (caplen == ph.caplen ? ph.len : ph.caplen);
+    if (caplen > MAX_CAPLEN || len > MAX_LEN)
+	return false;
+    *next = off + _hdrlen + caplen;
+    return *next <= (off_t)_size;
+}
+
+/** @brief Find the first record boundary in [@a begin, @a end).
+ *
+ * A boundary is an offset followed by SYNC_RECORDS plausible records, or by
+ * plausible records up to the exact end of the file. Returns -1 if none. */
+off_t
+PcapIndex::find_sync(off_t begin, off_t end) const
+{
+    for (off_t off = begin; off < end; off++) {
+	off_t o = off, next;
+	int k;
+	for (k = 0; k < SYNC_RECORDS && o != (off_t)_size; k++) {
+	    if (!plausible(o, &next))
+		break;
+	    o = next;
+	}
+	if (k == SYNC_RECORDS || (k > 0 && o == (off_t)_size))
+	    return off;
+    }
+    return -1;
+}
+
+/** @brief Index the records of chunk @a c starting at @a from.
+ *
+ * Records whose header starts before the end of the chunk belong to it, so
+ * the last one may extend into the next chunk. Indexing stops at the first
+ * bad or truncated record. */
+void
+PcapIndex::index_chunk(Chunk &c, off_t from)
+{
+    c.records.clear();
+    c.next = from;
+    if (from < 0)
+	return;
+    off_t off = from, next, step = from + PROGRESS_STEP;
+    fake_pcap_pkthdr ph;
+    while (off < c.end && off + (off_t)_hdrlen <= (off_t)_size) {
+	read_header(off, &ph);
+	uint32_t caplen = stored_caplen(ph);
+	if (caplen > MAX_CAPLEN)
+	    break;
+	next = off + _hdrlen + caplen;
+	if (next > (off_t)_size)
+	    break;
+	c.records.push_back(off);
+	off = next;
+	if (off >= step) {
+	    c.scanned = off - c.begin;
+	    step = off + PROGRESS_STEP;
+	}
+    }
+    c.next = off;
+    c.scanned = c.end - c.begin;
+}
+
+void
+PcapIndex::make_chunk(Chunk &c)
+{
+    Record r;
+    for (int i = c.make_begin; i < c.make_end; i++) {
+	record(i, r);
+	_packets[i] = make_packet(i, r);
+	if (!_packets[i])
+	    break;
+	c.made = i + 1 - c.make_begin;
+    }
+}
+
+#if HAVE_MULTITHREAD
+void *
+PcapIndex::index_thread(void *arg)
+{
+    Chunk *c = static_cast<Chunk *>(arg);
+    PcapIndex *idx = c->index;
+    idx->index_chunk(*c, idx->find_sync(c->begin, c->end));
+    return 0;
+}
+
+void *
+PcapIndex::make_thread(void *arg)
+{
+    Chunk *c = static_cast<Chunk *>(arg);
+    c->index->make_chunk(*c);
+    return 0;
+}
+
+void *
+PcapIndex::loader_thread(void *arg)
+{
+    static_cast<PcapIndex *>(arg)->load();
+    return 0;
+}
+#endif
+
+void
+PcapIndex::load()
+{
+    int n = _chunks.size();
+
+    // index all chunks in parallel
+#if HAVE_MULTITHREAD
+    Vector<pthread_t> threads(n, pthread_t());
+    Vector<bool> started(n, false);
+    for (int i = 1; i < n; i++)
+	started[i] = pthread_create(&threads[i], 0, index_thread, &_chunks[i]) == 0;
+    index_chunk(_chunks[0], _chunks[0].begin);
+    for (int i = 1; i < n; i++)
+	if (started[i])
+	    pthread_join(threads[i], 0);
+	else
+	    index_chunk(_chunks[i], find_sync(_chunks[i].begin, _chunks[i].end));
+#else
+    for (int i = 0; i < n; i++)
+	index_chunk(_chunks[i], i == 0 ? _chunks[i].begin : find_sync(_chunks[i].begin, _chunks[i].end));
+#endif
+
+    // stitch the chunks, reindexing those that guessed wrong
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+	Chunk &c = _chunks[i];
+	off_t expected = (i == 0 ? c.begin : _chunks[i - 1].next);
+	bool empty_ok = c.records.size() == 0 && expected >= c.end;
+	if (!empty_ok && (c.records.size() == 0 || c.records[0] != expected))
+	    index_chunk(c, expected);
+	if (c.records.size() == 0 && c.next < expected)
+	    c.next = expected;
+	total += c.records.size();
+	// a bad or truncated record ends the trace
+	if (c.next < c.end) {
+	    for (int j = i + 1; j < n; j++)
+		_chunks[j].records.clear();
+	    break;
+	}
+    }
+    _records.reserve(total);
+    for (int i = 0; i < n; i++) {
+	Vector<off_t> &r = _chunks[i].records;
+	for (int j = 0; j < r.size(); j++)
+	    _records.push_back(r[j]);
+	r.clear();
+    }
+    if (_zero_copy)
+	make_windows();
+
+    // materialize the packets to preload in parallel
+    if (_preload) {
+	int k = 0;
+	long budget = _preload;
+	Record r;
+	while (k < _records.size() && budget > 0) {
+	    record(k, r);
+	    budget -= r.caplen;
+	    k++;
+	}
+	_packets.resize(k, 0);
+	for (int i = 0; i < n; i++) {
+	    Chunk &c = _chunks[i];
+	    c.make_begin = (int)((int64_t)k * i / n);
+	    c.make_end = (int)((int64_t)k * (i + 1) / n);
+	    c.made = 0;
+	}
+	_to_make = k;
+#if HAVE_MULTITHREAD
+	for (int i = 1; i < n; i++)
+	    started[i] = pthread_create(&threads[i], 0, make_thread, &_chunks[i]) == 0;
+	make_chunk(_chunks[0]);
+	for (int i = 1; i < n; i++)
+	    if (started[i])
+		pthread_join(threads[i], 0);
+	    else
+		make_chunk(_chunks[i]);
+#else
+	for (int i = 0; i < n; i++)
+	    make_chunk(_chunks[i]);
+#endif
+    }
+
+    click_write_fence();
+    _done = true;
+}
+
+/** @brief Start loading the index with @a nthreads threads.
+ *
+ * If @a preload is nonzero, the first packets of the file are also
+ * materialized, up to @a preload bytes of packet data (or the whole file if
+ * @a preload is negative). If @a zero_copy is true, packets point into the
+ * mapped file. When Click is multithreaded, loading happens in the
+ * background. */
+int
+PcapIndex::start(int nthreads, long preload, bool zero_copy, ErrorHandler *errh)
+{
+    if (nthreads < 1)
+	nthreads = 1;
+    off_t data = _size - FILE_HEADER_SIZE;
+    if (data < (off_t)nthreads * PROGRESS_STEP)
+	nthreads = data / PROGRESS_STEP + 1;
+    _chunks.resize(nthreads);
+    for (int i = 0; i < nthreads; i++) {
+	Chunk &c = _chunks[i];
+	c.index = this;
+	c.id = i;
+	c.begin = FILE_HEADER_SIZE + data * i / nthreads;
+	c.end = FILE_HEADER_SIZE + data * (i + 1) / nthreads;
+	c.next = c.begin;
+	c.scanned = 0;
+	c.made = 0;
+	c.make_begin = c.make_end = 0;
+    }
+    _preload = (preload < 0 ? LONG_MAX : preload);
+    _zero_copy = zero_copy;
+    _done = false;
+
+#if HAVE_MULTITHREAD
+    if (pthread_create(&_thread, 0, loader_thread, this) == 0) {
+	_have_thread = true;
+	return 0;
+    }
+    errh->warning("could not start loader thread, loading synchronously");
+#else
+    (void) errh;
+#endif
+    load();
+    return 0;
+}
+
+void
+PcapIndex::wait()
+{
+#if HAVE_MULTITHREAD
+    if (_have_thread) {
+	pthread_join(_thread, 0);
+	_have_thread = false;
+    }
+#endif
+}
+
+/** @brief Return the fraction of the loading work done, between 0 and 1.
+ *
+ * Indexing and preloading each count for half of the work when preloading
+ * was requested. */
+double
+PcapIndex::progress() const
+{
+    if (_done)
+	return 1;
+    off_t data = _size - FILE_HEADER_SIZE, scanned = 0;
+    int made = 0;
+    for (int i = 0; i < _chunks.size(); i++) {
+	scanned += _chunks[i].scanned;
+	made += _chunks[i].made;
+    }
+    double indexed = data > 0 ? (double) scanned / data : 1;
+    if (!_preload)
+	return indexed;
+    return indexed / 2 + (_to_make > 0 ? (double) made / _to_make / 2 : 0);
+}
+
+/** @brief Return the index of the first record at or after file offset
+ * @a offset. */
+int
+PcapIndex::find(off_t offset) const
+{
+    int l = 0, r = _records.size();
+    while (l < r) {
+	int m = l + (r - l) / 2;
+	if (_records[m] < offset)
+	    l = m + 1;
+	else
+	    r = m;
+    }
+    return l;
+}
+
+void
+PcapIndex::cleanup()
+{
+    wait();
+    for (int i = 0; i < _packets.size(); i++)
+	if (_packets[i])
+	    _packets[i]->kill();
+    _packets.clear();
+    _records.clear();
+    _chunks.clear();
+    for (int i = 0; i < _windows.size(); i++)
+	_windows[i]->kill();
+    _windows.clear();
+    if (_mapping)
+	release_mapping(_mapping);
+    _mapping = 0;
+    _map = 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel|ns FakePcap)
+ELEMENT_PROVIDES(PcapIndex)
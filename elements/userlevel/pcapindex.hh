@@ -0,0 +1,159 @@
+// -*- related-file-name: "pcapindex.cc"; c-basic-offset: 4 -*-
+#ifndef CLICK_PCAPINDEX_HH
+#define CLICK_PCAPINDEX_HH
+#include <click/string.hh>
+#include <click/vector.hh>
+#include <click/timestamp.hh>
+#include <click/atomic.hh>
+#include "fakepcap.hh"
+#if HAVE_MULTITHREAD
+# include <pthread.h>
+#endif
+CLICK_DECLS
+class ErrorHandler;
+class Packet;
+
+/** @brief Record index over a memory-mapped tcpdump file.
+ *
+ * PcapIndex maps a whole tcpdump file read-only and records the offset of
+ * each packet record, which costs 8 bytes per packet instead of a full
+ * Packet. Packets are then materialized on demand by make_packet().
+ *
+ * The file is split in one chunk per loader thread and the chunks are
+ * indexed in parallel. A thread other than the first one does not know where
+ * the first record of its chunk starts, so it resynchronizes on the first
+ * offset followed by a chain of plausible record headers. Chunks are then
+ * stitched in order: a chunk whose first record does not start exactly where
+ * the previous chunk ended is indexed again sequentially, so a wrong guess
+ * costs time but never correctness.
+ *
+ * Once indexed, the first packets of the file can be materialized in
+ * parallel too (see start()). Loading happens in a background thread when
+ * Click is multithreaded; done() tells when it finished and wait() joins it.
+ *
+ * In zero-copy mode, packets are clones of read-only packets spanning
+ * windows of the mapped file instead of copies of their record. As clones
+ * are always shared, writers uniqueify them first. The file stays mapped
+ * until the last of these packets is freed, even after cleanup().
+ */
+class PcapIndex { public:
+
+    struct Record {
+	const uint8_t *data;
+	Timestamp ts;
+	uint32_t len;
+	uint32_t caplen;
+    };
+
+    PcapIndex();
+    ~PcapIndex()			{ cleanup(); }
+
+    int open(const String &filename, bool swapped, int minor_version,
+	     unsigned extra_pkthdr_crap, bool nano, ErrorHandler *errh);
+    int start(int nthreads, long preload, bool zero_copy, ErrorHandler *errh);
+    bool done() const			{ return _done; }
+    void wait();
+    void cleanup();
+
+    int size() const			{ return _records.size(); }
+    int npreloaded() const		{ return _packets.size(); }
+    int nthreads() const		{ return _chunks.size(); }
+    off_t offset(int i) const		{ return _records[i]; }
+    int find(off_t offset) const;
+    double progress() const;
+
+    void record(int i, Record &r) const;
+    Packet *make_packet(int i, const Record &r) const;
+    inline Packet *take_packet(int i);
+
+  private:
+
+    enum { FILE_HEADER_SIZE = 24, SYNC_RECORDS = 8, MAX_CAPLEN = 65535,
+	   MAX_LEN = 262144, PROGRESS_STEP = 1048576, WINDOW_RECORDS = 16384 };
+
+    struct Mapping {
+	const uint8_t *data;
+	size_t size;
+	atomic_uint32_t refcount;
+    };
+
+    struct Chunk {
+	PcapIndex *index;
+	int id;
+	off_t begin;
+	off_t end;
+	off_t next;
+	volatile off_t scanned;
+	volatile int made;
+	int make_begin;
+	int make_end;
+	Vector<off_t> records;
+    };
+
+    const uint8_t *_map;
+    size_t _size;
+    Mapping *_mapping;
+    bool _zero_copy;
+    Vector<Packet *> _windows;
+    bool _swapped;
+    bool _nano;
+    int _minor_version;
+    unsigned _hdrlen;
+
+    Vector<off_t> _records;
+    Vector<Packet *> _packets;
+    Vector<Chunk> _chunks;
+    long _preload;
+    int _to_make;
+    volatile bool _done;
+#if HAVE_MULTITHREAD
+    pthread_t _thread;
+    bool _have_thread;
+
+    static void *loader_thread(void *);
+    static void *index_thread(void *);
+    static void *make_thread(void *);
+#endif
+
+    void read_header(off_t off, fake_pcap_pkthdr *ph) const;
+    inline uint32_t stored_caplen(const fake_pcap_pkthdr &ph) const;
+    bool plausible(off_t off, off_t *next) const;
+    off_t find_sync(off_t begin, off_t end) const;
+    void index_chunk(Chunk &c, off_t from);
+    void make_chunk(Chunk &c);
+    void make_windows();
+    void load();
+
+    static void release_mapping(Mapping *m);
+    static void window_destructor(unsigned char *, size_t, void *);
+
+};
+
+/** @brief Return the number of packet bytes following header @a ph.
+ *
+ * Versions up to 2.3 of the format may have swapped the length fields. */
+inline uint32_t
+PcapIndex::stored_caplen(const fake_pcap_pkthdr &ph) const
+{
+    if (_minor_version > 3 || (_minor_version == 3 && ph.caplen <= ph.len))
+	return ph.caplen;
+    else
+	return ph.len;
+}
+
+/** @brief Return the preloaded packet for record @a i, if any.
+ *
+ * The caller owns the returned packet. Returns null if record @a i was not
+ * preloaded or was already taken. */
+inline Packet *
+PcapIndex::take_packet(int i)
+{
+    if (i >= _packets.size())
+	return 0;
+    Packet *p = _packets[i];
+    _packets[i] = 0;
+    return p;
+}
+
+CLICK_ENDDECLS
+#endif
@@ -32,6 +32,9 @@
 #include <netinet/tcp.h>
 #include <fcntl.h>
 #include "socket.hh"
+#if SOCKET_ALLOW_MMSG
+# include <netinet/udp.h>
+#endif
 
 #ifdef HAVE_PROPER
 #include <proper/prop.h>
@@ -45,8 +48,16 @@ Socket::Socket()
     _local_port(0), _local_pathname(""),
     _timestamp(true), _sndbuf(-1), _rcvbuf(-1),
     _snaplen(2048), _headroom(Packet::default_headroom), _nodelay(1),
-    _verbose(false), _client(false), _proper(false), _allow(0), _deny(0)
+    _verbose(false), _client(false), _proper(false), _allow(0), _deny(0),
+    _burst(32), _gso(false), _gro(false)
 {
+#if SOCKET_ALLOW_MMSG
+  memset(_rqs, 0, sizeof(_rqs));
+  _gro_buf = 0;
+#endif
+#if HAVE_BATCH
+  in_batch_mode = BATCH_MODE_YES;
+#endif
 }
 
 Socket::~Socket()
@@ -76,6 +87,9 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("PROPER", _proper)
       .read("ALLOW", allow)
       .read("DENY", deny)
+      .read("BURST", _burst)
+      .read("GSO", _gso)
+      .read("GRO", _gro)
       .consume() < 0)
     return -1;
 
@@ -119,6 +133,16 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   else
     return errh->error("unknown socket type `%s'", socktype.c_str());
 
+#if SOCKET_ALLOW_MMSG
+  if (_burst < 1 || _burst > max_burst)
+    return errh->error("BURST must be between 1 and %d", (int) max_burst);
+  if ((_gso || _gro) && _protocol != IPPROTO_UDP)
+    return errh->error("GSO and GRO require a UDP socket");
+#else
+  if (_gso || _gro)
+    return errh->error("GSO and GRO are not supported on this platform");
+#endif
+
   return 0;
 }
 
@@ -189,6 +213,17 @@ Socket::initialize(ErrorHandler *errh)
     if (setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &_rcvbuf, sizeof(_rcvbuf)) < 0)
       return initialize_socket_error(errh, "setsockopt(SO_RCVBUF)");
 
+#if SOCKET_ALLOW_MMSG
+  // let the kernel coalesce received datagrams
+  if (_gro && noutputs()) {
+    int one = 1;
+    if (setsockopt(_fd, IPPROTO_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+      return initialize_socket_error(errh, "setsockopt(UDP_GRO)");
+    if (!(_gro_buf = new unsigned char[_burst * gro_size]))
+      return errh->error("out of memory");
+  }
+#endif
+
   // if a server, then the first arguments should be interpreted as
   // the address/port/file to bind() to, not to connect() to
   if (!_client) {
@@ -262,8 +297,20 @@ Socket::cleanup(CleanupStage)
   }
   if (_rq)
     _rq->kill();
-  if (_wq)
+  while (_wq) {
+    Packet *next = _wq->next();
     _wq->kill();
+    _wq = next;
+  }
+#if SOCKET_ALLOW_MMSG
+  for (int i = 0; i < max_burst; i++)
+    if (_rqs[i]) {
+      _rqs[i]->kill();
+      _rqs[i] = 0;
+    }
+  delete[] _gro_buf;
+  _gro_buf = 0;
+#endif
   if (_fd >= 0) {
     // shut down the listening socket in case we forked
 #ifdef SHUT_RDWR
@@ -303,6 +350,116 @@ Socket::close_active(void)
   }
 }
 
+#if SOCKET_ALLOW_MMSG
+int
+Socket::read_datagrams()
+{
+  struct mmsghdr msgs[max_burst];
+  struct iovec iovs[max_burst];
+  union { struct sockaddr_in in; struct sockaddr_un un; } from[max_burst];
+  char control[max_burst][CMSG_SPACE(sizeof(int))];
+  unsigned nmsgs = 0;
+
+  // receive directly in packets, or in large buffers if the kernel may
+  // coalesce datagrams
+  for (; nmsgs < _burst; nmsgs++) {
+    if (_gro) {
+      iovs[nmsgs].iov_base = _gro_buf + nmsgs * gro_size;
+      iovs[nmsgs].iov_len = gro_size;
+    } else {
+      if (!_rqs[nmsgs] && !(_rqs[nmsgs] = Packet::make(_headroom, 0, _snaplen, 0)))
+	break;
+      iovs[nmsgs].iov_base = _rqs[nmsgs]->data();
+      iovs[nmsgs].iov_len = _snaplen;
+    }
+    struct msghdr &m = msgs[nmsgs].msg_hdr;
+    m.msg_name = &from[nmsgs];
+    m.msg_namelen = sizeof(from[nmsgs]);
+    m.msg_iov = &iovs[nmsgs];
+    m.msg_iovlen = 1;
+    m.msg_control = _gro ? control[nmsgs] : 0;
+    m.msg_controllen = _gro ? sizeof(control[nmsgs]) : 0;
+    m.msg_flags = 0;
+  }
+  if (!nmsgs) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  int n = recvmmsg(_active, msgs, nmsgs, MSG_TRUNC, 0);
+  if (n <= 0)
+    return n;
+
+  Timestamp now;
+  if (_timestamp)
+    now.assign_now();
+#if HAVE_BATCH
+  BATCH_CREATE_INIT(batch);
+#endif
+  for (int i = 0; i < n; i++) {
+    int len = msgs[i].msg_len;
+
+    if (!_client) {
+      // datagram server, find out who we are talking to
+      if (_family == AF_INET && !allowed(IPAddress(from[i].in.sin_addr))) {
+	if (_verbose)
+	  click_chatter("%s: dropped datagram from %s:%d", declaration().c_str(),
+			IPAddress(from[i].in.sin_addr).unparse().c_str(), ntohs(from[i].in.sin_port));
+	continue;
+      }
+      memcpy(&_remote, &from[i], msgs[i].msg_hdr.msg_namelen);
+      _remote_len = msgs[i].msg_hdr.msg_namelen;
+    }
+
+    // split coalesced datagrams
+    int seg = len;
+    if (_gro) {
+      struct msghdr &m = msgs[i].msg_hdr;
+      for (struct cmsghdr *c = CMSG_FIRSTHDR(&m); c; c = CMSG_NXTHDR(&m, c))
+	if (c->cmsg_level == IPPROTO_UDP && c->cmsg_type == UDP_GRO)
+	  memcpy(&seg, CMSG_DATA(c), sizeof(seg));
+      if (len > gro_size)
+	len = gro_size;
+    }
+
+    for (int off = 0; off < len || off == 0; off += seg) {
+      int plen = len - off < seg ? len - off : seg;
+      WritablePacket *p;
+      if (_gro) {
+	p = Packet::make(_headroom, _gro_buf + i * gro_size + off,
+			 plen > _snaplen ? _snaplen : plen, 0);
+	if (!p)
+	  break;
+      } else {
+	p = _rqs[i];
+	_rqs[i] = 0;
+	if (plen <= _snaplen)
+	  p->take(_snaplen - plen);
+      }
+      // truncate packet to max length
+      if (plen > _snaplen)
+	SET_EXTRA_LENGTH_ANNO(p, plen - _snaplen);
+      if (_timestamp)
+	p->set_timestamp_anno(now);
+#if HAVE_BATCH
+      BATCH_CREATE_APPEND(batch, p);
+#else
+      output(0).push(p);
+#endif
+      if (seg <= 0)
+	break;
+    }
+  }
+
+#if HAVE_BATCH
+  BATCH_CREATE_FINISH(batch);
+  if (batch)
+    output_push_batch(0, batch);
+#endif
+  return n;
+}
+#endif
+
 void
 Socket::selected(int fd, int)
 {
@@ -346,6 +503,17 @@ Socket::selected(int fd, int)
       add_select(_active, SELECT_READ);
     }
 
+#if SOCKET_ALLOW_MMSG
+    // read a burst of datagrams
+    if (_socktype == SOCK_DGRAM) {
+      if (read_datagrams() < 0 && errno != EAGAIN && errno != EINTR) {
+	if (_verbose)
+	  click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+	close_active();
+	return;
+      }
+    } else
+#endif
     // read data from socket
     if (!_rq)
       _rq = Packet::make(_headroom, 0, _snaplen, 0);
@@ -386,7 +554,7 @@ Socket::selected(int fd, int)
 	  _rq->timestamp_anno().assign_now();
 
 	// push packet
-	output(0).push(_rq);
+	output_push(0, _rq);
 	_rq = 0;
       }
 
@@ -451,6 +619,102 @@ Socket::write_packet(Packet *p)
   return 0;
 }
 
+#if SOCKET_ALLOW_MMSG
+/* Send as many packets of the list starting at head as one sendmmsg() call
+ * allows, killing the packets sent. On return, head points to the packets
+ * left. */
+int
+Socket::write_datagrams(Packet *&head)
+{
+  enum { max_iov = 256, max_segs = 64, max_gso_size = 65507 };
+  struct mmsghdr msgs[max_burst];
+  struct iovec iovs[max_iov];
+  struct sockaddr_in dst[max_burst];
+  char control[max_burst][CMSG_SPACE(sizeof(uint16_t))];
+  // if the IP address specified when the element was created is 0.0.0.0,
+  // send each packet to its IP destination annotation address
+  bool dst_anno = !IPAddress(_remote_ip) && _client && _family == AF_INET;
+  unsigned nmsgs = 0, niov = 0;
+
+  assert(_active >= 0);
+
+  for (Packet *p = head; p && nmsgs < _burst && niov < max_iov; nmsgs++) {
+    struct msghdr &m = msgs[nmsgs].msg_hdr;
+    memset(&m, 0, sizeof(m));
+    if (dst_anno) {
+      dst[nmsgs] = _remote.in;
+      dst[nmsgs].sin_addr = p->dst_ip_anno();
+      m.msg_name = &dst[nmsgs];
+      m.msg_namelen = sizeof(dst[nmsgs]);
+    } else {
+      m.msg_name = &_remote;
+      m.msg_namelen = _remote_len;
+    }
+    m.msg_iov = &iovs[niov];
+
+    // with GSO, give same-size datagrams to the same destination at once;
+    // only the last one may be shorter
+    uint32_t seg = p->length(), total = 0, last;
+    do {
+      iovs[niov].iov_base = const_cast<unsigned char *>(p->data());
+      iovs[niov].iov_len = last = p->length();
+      total += last;
+      niov++;
+      m.msg_iovlen++;
+      p = p->next();
+    } while (_gso && p && last == seg && p->length() <= seg
+	     && p->length() > 0 && niov < max_iov && m.msg_iovlen < max_segs
+	     && total + p->length() <= max_gso_size
+	     && (!dst_anno || p->dst_ip_anno() == dst[nmsgs].sin_addr));
+
+    if (m.msg_iovlen > 1) {
+      m.msg_control = control[nmsgs];
+      m.msg_controllen = sizeof(control[nmsgs]);
+      struct cmsghdr *c = CMSG_FIRSTHDR(&m);
+      c->cmsg_level = IPPROTO_UDP;
+      c->cmsg_type = UDP_SEGMENT;
+      c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t gso_size = seg;
+      memcpy(CMSG_DATA(c), &gso_size, sizeof(gso_size));
+    }
+  }
+
+  int n;
+  do {
+    n = sendmmsg(_active, msgs, nmsgs, 0);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0) {
+    // out of memory or would block
+    if (errno == ENOBUFS || errno == EAGAIN)
+      return -1;
+    // connection probably terminated or other fatal error
+    if (_verbose)
+      click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+    close_active();
+    while (head) {
+      Packet *next = head->next();
+      head->kill();
+      head = next;
+    }
+    return 0;
+  }
+
+  // kill the packets sent
+  for (int i = 0; i < n; i++)
+    for (size_t j = 0; j < msgs[i].msg_hdr.msg_iovlen; j++) {
+      Packet *next = head->next();
+      head->kill();
+      head = next;
+    }
+  if ((unsigned) n < nmsgs) {
+    errno = EAGAIN;
+    return -1;
+  }
+  return 0;
+}
+#endif
+
 void
 Socket::push(int, Packet *p)
 {
@@ -481,6 +745,68 @@ Socket::push(int, Packet *p)
     p->kill();
 }
 
+#if HAVE_BATCH
+void
+Socket::push_batch(int port, PacketBatch *batch)
+{
+#if SOCKET_ALLOW_MMSG
+  if (_socktype == SOCK_DGRAM) {
+    fd_set fds;
+    int err;
+    batch->tail()->set_next(0);
+    Packet *head = batch;
+
+    // block, then write a burst at a time
+    while (head && _active >= 0) {
+      FD_ZERO(&fds);
+      FD_SET(_active, &fds);
+      err = select(_active + 1, NULL, &fds, NULL, NULL);
+      if (err < 0 && errno != EINTR)
+	break;
+      if (err >= 0)
+	write_datagrams(head);
+    }
+
+    if (head && _verbose)
+      click_chatter("%s: dropping packets", declaration().c_str());
+    while (head) {
+      Packet *next = head->next();
+      head->kill();
+      head = next;
+    }
+    return;
+  }
+#endif
+  FOR_EACH_PACKET_SAFE(batch, p)
+    push(port, p);
+}
+#endif
+
+#if SOCKET_ALLOW_MMSG
+inline Packet *
+Socket::pull_datagrams()
+{
+#if HAVE_BATCH
+  PacketBatch *batch = input(0).pull_batch(_burst);
+  if (!batch)
+    return 0;
+  batch->tail()->set_next(0);
+  return batch;
+#else
+  Packet *head = 0, **tail = &head;
+  for (unsigned n = 0; n < _burst; n++) {
+    Packet *p = input(0).pull();
+    if (!p)
+      break;
+    *tail = p;
+    tail = &p->next();
+  }
+  *tail = 0;
+  return head;
+#endif
+}
+#endif
+
 bool
 Socket::run_task(Task *)
 {
@@ -491,6 +817,16 @@ Socket::run_task(Task *)
     Packet *p = 0;
     int err = 0;
 
+#if SOCKET_ALLOW_MMSG
+    // write as much as we can, a burst of datagrams at a time
+    if (_socktype == SOCK_DGRAM)
+      while (_active >= 0 && (_wq || (_wq = pull_datagrams()))) {
+	any = true;
+	if ((err = write_datagrams(_wq)) < 0)
+	  break;
+      }
+    else
+#endif
     // write as much as we can
     do {
       p = _wq ? _wq : input(0).pull();
@@ -502,9 +838,9 @@ Socket::run_task(Task *)
     } while (p && err >= 0);
 
     if (err < 0) {
-      // queue packet for writing when socket becomes available
-      _wq = p;
-      p = 0;
+      // queue packets for writing when socket becomes available
+      if (p)
+	_wq = p;
       add_select(_active, SELECT_WRITE);
     } else if (_signal)
       // more pending
@@ -1,12 +1,15 @@
 // -*- mode: c++; c-basic-offset: 2 -*-
 #ifndef CLICK_SOCKET_HH
 #define CLICK_SOCKET_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/string.hh>
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include "../ip/iproutetable.hh"
 #include <sys/un.h>
+#ifdef __linux__
+# define SOCKET_ALLOW_MMSG 1
+#endif
 CLICK_DECLS
 
 /*
@@ -59,6 +62,10 @@ otherwise, the socket will pull packets as it can accept them. For
 best performance, place a Notifier element (such as NotifierQueue)
 upstream of a "pull" Socket.
 
+On Linux, datagram sockets receive and send up to BURST datagrams per
+system call, using recvmmsg() and sendmmsg(). Received datagrams are
+emitted as batches.
+
 Keyword arguments are:
 
 =over 8
@@ -141,6 +148,27 @@ Boolean. PlanetLab specific. If true and Click has been configured
 
 Integer. Per-packet headroom. Defaults to 28.
 
+=item BURST
+
+Unsigned integer. Applies to datagram sockets on Linux only. Maximum
+number of datagrams received or sent per system call, at most 64.
+Default is 32.
+
+=item GSO
+
+Boolean. Applies to UDP sockets on Linux only. If set, consecutive
+input packets of the same length and destination are handed to the
+kernel as a single buffer of up to 64 datagrams, which is segmented
+back into datagrams as late as possible (UDP_SEGMENT). The last packet
+of such a group may be shorter. Default is false.
+
+=item GRO
+
+Boolean. Applies to UDP sockets on Linux only. If set, the kernel may
+coalesce received datagrams of a flow into buffers of up to 64KB
+(UDP_GRO), which Socket splits back into packets. Each of the BURST
+receive buffers then takes 64KB. Default is false.
+
 =back
 
 =e
@@ -168,7 +196,7 @@ Integer. Per-packet headroom. Defaults to 28.
 
 =a RawSocket */
 
-class Socket : public Element { public:
+class Socket : public BatchElement { public:
 
   Socket() CLICK_COLD;
   ~Socket() CLICK_COLD;
@@ -188,10 +216,18 @@ class Socket : public Element { public:
   bool run_task(Task *);
   void selected(int fd, int mask);
   void push(int port, Packet*);
+#if HAVE_BATCH
+  void push_batch(int port, PacketBatch*);
+#endif
 
   bool allowed(IPAddress);
   void close_active(void);
   int write_packet(Packet*);
+#if SOCKET_ALLOW_MMSG
+  int read_datagrams();
+  int write_datagrams(Packet *&head);
+  inline Packet *pull_datagrams();
+#endif
 
 protected:
   Task _task;
@@ -211,7 +247,7 @@ private:
 
   NotifierSignal _signal;	// packet is available to pull()
   WritablePacket *_rq;		// queue to receive pulled packets
-  Packet *_wq;			// queue to store pulled packet for when sendto() blocks
+  Packet *_wq;			// queue to store pulled packets for when sendto() blocks
 
   int _family;			// AF_INET or AF_UNIX
   int _socktype;		// SOCK_STREAM or SOCK_DGRAM
@@ -234,6 +270,15 @@ private:
   bool _proper;			// (PlanetLab only) use Proper to bind port
   IPRouteTable *_allow;		// lookup table of good hosts
   IPRouteTable *_deny;		// lookup table of bad hosts
+  unsigned _burst;		// datagrams per recvmmsg()/sendmmsg()
+  bool _gso;			// send same-size datagrams as one buffer
+  bool _gro;			// receive coalesced datagrams
+
+#if SOCKET_ALLOW_MMSG
+  enum { max_burst = 64, gro_size = 65536 };
+  WritablePacket *_rqs[max_burst]; // packets to receive datagrams into
+  unsigned char *_gro_buf;	// receive buffers when GRO is set
+#endif
 
   int initialize_socket_error(ErrorHandler *, const char *);
 
@@ -45,14 +45,12 @@
 #if TODEVICE_ALLOW_LINUX
 # include <sys/socket.h>
 # include <sys/ioctl.h>
+# include <sys/mman.h>
 # include <net/if.h>
-# include <net/if_packet.h>
 # include <features.h>
-# if __GLIBC__ >= 2 && __GLIBC_MINOR__ >= 1
-#  include <netpacket/packet.h>
-# else
-#  include <linux/if_packet.h>
-# endif
+// the ring structures are only in the kernel header
+# include <linux/if_packet.h>
+# include <linux/filter.h>
 #endif
 
 CLICK_DECLS
@@ -68,6 +66,9 @@ ToDevice::ToDevice()
     _fd = -1;
     _my_fd = false;
 #endif
+#if TODEVICE_ALLOW_LINUX
+    _ring = 0;
+#endif
 }
 
 ToDevice::~ToDevice()
@@ -78,12 +79,21 @@ int
 ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String method;
+    bool has_burst;
     _burst = 1;
+#if TODEVICE_ALLOW_LINUX
+    _frame_size = 2048;
+    _nframes = 1024;
+#endif
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _ifname)
 	.read("DEBUG", _debug)
 	.read("METHOD", WordArg(), method)
-	.read("BURST", _burst)
+	.read("BURST", _burst).read_status(has_burst)
+#if TODEVICE_ALLOW_LINUX
+	.read("FRAME_SIZE", _frame_size)
+	.read("FRAMES", _nframes)
+#endif
 	.complete() < 0)
 	return -1;
     if (!_ifname)
@@ -105,6 +115,8 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 #if TODEVICE_ALLOW_LINUX
     else if (method == "LINUX")
 	_method = method_linux;
+    else if (method == "MMAP")
+	_method = method_mmap;
 #endif
 #if TODEVICE_ALLOW_DEVBPF
     else if (method == "DEVBPF")
@@ -117,6 +129,14 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     else
 	return errh->error("bad METHOD");
 
+#if TODEVICE_ALLOW_LINUX
+    if (_frame_size < 128 || (_frame_size & (_frame_size - 1)))
+	return errh->error("FRAME_SIZE must be a power of 2, at least 128");
+    if (_nframes == 0)
+	return errh->error("bad FRAMES");
+    if (_method == method_mmap && !has_burst)
+	_burst = 32;
+#endif
     return 0;
 }
 
@@ -146,6 +166,8 @@ ToDevice::initialize(ErrorHandler *errh)
 #if FROMDEVICE_ALLOW_LINUX && TODEVICE_ALLOW_LINUX
 	if (fd->linux_fd() >= 0)
 	    _method = method_linux;
+	else if (fd->linux_mmap())
+	    _method = method_mmap;
 #endif
     }
 
@@ -201,6 +223,14 @@ ToDevice::initialize(ErrorHandler *errh)
 	    _my_fd = true;
 	}
 	_method = method_linux;
+    } else if (_method == method_mmap) {
+	// A socket has a single TPACKET version, so never share FromDevice's
+	_fd = FromDevice::open_packet_socket(_ifname, errh);
+	if (_fd < 0)
+	    return -1;
+	_my_fd = true;
+	if (open_ring(errh) < 0)
+	    return -1;
     }
 #endif
 
@@ -226,6 +256,77 @@ ToDevice::initialize(ErrorHandler *errh)
     return 0;
 }
 
+#if TODEVICE_ALLOW_LINUX
+int
+ToDevice::open_ring(ErrorHandler *errh)
+{
+    const char *ifname = _ifname.c_str();
+    int version = TPACKET_V2, yes = 1;
+    if (setsockopt(_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+	return errh->error("%s: TPACKET_V2: %s", ifname, strerror(errno));
+    // Skip malformed frames instead of stopping transmission
+    (void) setsockopt(_fd, SOL_PACKET, PACKET_LOSS, &yes, sizeof(yes));
+
+    // Blocks must hold whole frames and be a multiple of the page size
+    struct tpacket_req req;
+    memset(&req, 0, sizeof(req));
+    req.tp_frame_size = _frame_size;
+    req.tp_block_size = _frame_size > (unsigned) getpagesize() ? _frame_size : getpagesize();
+    unsigned per_block = req.tp_block_size / _frame_size;
+    req.tp_block_nr = (_nframes + per_block - 1) / per_block;
+    req.tp_frame_nr = req.tp_block_nr * per_block;
+    if (setsockopt(_fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+	return errh->error("%s: PACKET_TX_RING: %s", ifname, strerror(errno));
+    _nframes = req.tp_frame_nr;
+    _ring_size = (size_t) req.tp_block_size * req.tp_block_nr;
+    void *ring = mmap(0, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (ring == MAP_FAILED)
+	return errh->error("%s: mmap: %s", ifname, strerror(errno));
+    _ring = static_cast<unsigned char *>(ring);
+    _frame = 0;
+    _ring_queued = 0;
+
+    // The socket only sends: do not let the kernel queue received packets
+    // to it
+    struct sock_filter drop = BPF_STMT(BPF_RET | BPF_K, 0);
+    struct sock_fprog prog;
+    prog.len = 1;
+    prog.filter = &drop;
+    (void) setsockopt(_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+    return 0;
+}
+
+int
+ToDevice::ring_send(Packet *p)
+{
+    unsigned char *frame = _ring + (size_t) _frame * _frame_size;
+    struct tpacket2_hdr *h = reinterpret_cast<struct tpacket2_hdr *>(frame);
+    if (__atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE)
+	return -EAGAIN;
+    unsigned offset = TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+    if (p->length() > _frame_size - offset)
+	return -EMSGSIZE;
+    memcpy(frame + offset, p->data(), p->length());
+    h->tp_len = p->length();
+    __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    if (++_frame == _nframes)
+	_frame = 0;
+    ++_ring_queued;
+    return 0;
+}
+
+/* Have the kernel send the frames queued in the ring. Frames it cannot send
+ * yet stay queued and go with the next call. */
+void
+ToDevice::ring_kick()
+{
+    _ring_queued = 0;
+    if (sendto(_fd, 0, 0, MSG_DONTWAIT, 0, 0) < 0
+	&& errno != EAGAIN && errno != ENOBUFS && _debug)
+	click_chatter("ToDevice(%s): %s", _ifname.c_str(), strerror(errno));
+}
+#endif
+
 void
 ToDevice::cleanup(CleanupStage)
 {
@@ -234,6 +335,11 @@ ToDevice::cleanup(CleanupStage)
 	pcap_close(_pcap);
     _pcap = 0;
 #endif
+#if TODEVICE_ALLOW_LINUX
+    if (_ring)
+	munmap(_ring, _ring_size);
+    _ring = 0;
+#endif
 #if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
     if (_fd >= 0 && _my_fd)
 	close(_fd);
@@ -271,6 +377,8 @@ ToDevice::send_packet(Packet *p)
 #if TODEVICE_ALLOW_LINUX
     if (_method == method_linux)
 	r = send(_fd, p->data(), p->length(), 0);
+    else if (_method == method_mmap)
+	return ring_send(p);
 #endif
 
 #if TODEVICE_ALLOW_DEVBPF
@@ -313,6 +421,12 @@ ToDevice::run_task(Task *)
 	    break;
     } while (count < _burst);
 
+#if TODEVICE_ALLOW_LINUX
+    // A full ring may hold frames a previous kick could not send
+    if (_method == method_mmap && (_ring_queued || r == -EAGAIN))
+	ring_kick();
+#endif
+
     if (r == -ENOBUFS || r == -EAGAIN) {
 	assert(!_q);
 	_q = p;
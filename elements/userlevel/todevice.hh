@@ -28,7 +28,8 @@ CLICK_DECLS
  *
  * =item BURST
  *
- * Integer. Maximum number of packets to pull per scheduling. Defaults to 1.
+ * Integer. Maximum number of packets to pull per scheduling. Defaults to 1, or
+ * 32 with METHOD MMAP.
  *
  * =item METHOD
  *
@@ -38,6 +39,20 @@ CLICK_DECLS
  * specified for a matching L<FromDevice(n)>, or the first supported
  * method among PCAP, DEVBPF, LINUX and PCAPFD otherwise.
  *
+ * Linux targets also support MMAP, which copies packets to a TPACKET_V2
+ * transmit ring shared with the kernel, and asks the kernel to send them
+ * with a single system call per burst.
+ *
+ * =item FRAME_SIZE
+ *
+ * Unsigned. Only affects METHOD MMAP. Size in bytes of a transmit ring frame,
+ * a power of 2. Longer packets cannot be sent. Default is 2048.
+ *
+ * =item FRAMES
+ *
+ * Unsigned. Only affects METHOD MMAP. Number of frames of the transmit ring.
+ * Default is 1024.
+ *
  * =item DEBUG
  *
  * Boolean.  If true, print out debug messages.
@@ -114,8 +129,16 @@ class ToDevice : public Element { public:
 #if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
     int _fd;
 #endif
-    enum { method_default, method_linux, method_pcap, method_devbpf, method_pcapfd };
+    enum { method_default, method_linux, method_pcap, method_devbpf, method_pcapfd, method_mmap };
     int _method;
+#if TODEVICE_ALLOW_LINUX
+    unsigned char *_ring;
+    unsigned _frame_size;
+    unsigned _nframes;
+    size_t _ring_size;
+    unsigned _frame;
+    unsigned _ring_queued;
+#endif
     NotifierSignal _signal;
 
     Packet *_q;
@@ -134,6 +157,11 @@ class ToDevice : public Element { public:
     enum { h_debug, h_signal, h_pulls, h_q };
     FromDevice *find_fromdevice() const;
     int send_packet(Packet *p);
+#if TODEVICE_ALLOW_LINUX
+    int open_ring(ErrorHandler *errh);
+    int ring_send(Packet *p);
+    void ring_kick();
+#endif
     static int write_param(const String &in_s, Element *e, void *vparam, ErrorHandler *errh) CLICK_COLD;
     static String read_param(Element *e, void *thunk) CLICK_COLD;
 
@@ -41,6 +41,7 @@ ToDPDKDevice::~ToDPDKDevice()
 int ToDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     int maxqueues = 128;
+    bool segments = false;
     String dev;
     if (Args(this, errh).bind(conf)
             .read_mp("PORT", dev)
@@ -55,6 +56,7 @@ int ToDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("TIMEOUT", _timeout)
         .read("NDESC",ndesc)
         .read("MAXQUEUES", maxqueues)
+        .read("SEGMENTS", segments)
         .complete() < 0)
             return -1;
     if (!DPDKDeviceArg::parse(dev, _dev)) {
@@ -64,6 +66,9 @@ int ToDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
             return errh->error("%s : Unknown or invalid PORT", dev.c_str());
     }
 
+    if (segments)
+        _dev->set_multi_segment();
+
     //TODO : If user put multiple ToDPDKDevice with the same port and without the QUEUE parameter, try to share the available queues among them
     if (firstqueue == -1)
        firstqueue = 0;
@@ -86,6 +86,13 @@ packets will never wait in the internal queue.
 
 Integer.  Number of descriptors per ring. The default is 1024.
 
+=item SEGMENTS
+
+Boolean.  If true, packets made of several segments (see
+Packet::next_segment) are sent as chains of DPDK buffers, without copy. The
+device must support multi-segment transmission. Defaults to false, unless
+set by a FromDPDKDevice on the same port.
+
 =item ALLOW_NONEXISTENT
 
 Boolean.  Do not fail if the PORT do not existent. If it's the case the task
@@ -32,6 +32,9 @@
 #include <click/packet_anno.hh>
 #include "fakepcap.hh"
 #include <click/userutils.hh>
+#include <click/straccum.hh>
+#include <fcntl.h>
+#include <unistd.h>
 #if HAVE_PCAP
 extern "C" {
 # include <pcap.h>
@@ -40,8 +43,18 @@ extern "C" {
 CLICK_DECLS
 
 ToDump::ToDump()
-    : _fp(0), _count(0), _task(this), _use_encap_from(0)
+    : _fp(0), _count(0), _task(this), _use_encap_from(0), _async(false)
+#if HAVE_MULTITHREAD
+    , _block_size(1024 * 1024), _nblocks(16), _rotate_size(0),
+      _io_stop(false), _io_started(false), _fd(-1), _file_bytes(0), _nfiles(0),
+      _flush_timer(this)
+#endif
 {
+    _active = false;
+    _comment_pending = false;
+#if HAVE_MULTITHREAD
+    _async_count = 0;
+#endif
 }
 
 ToDump::~ToDump()
@@ -56,6 +69,7 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _snaplen = 2000;
     _extra_length = true;
     _unbuffered = false;
+    _pcapng = false;
     _nano = Timestamp::subsec_per_sec == Timestamp::nsec_per_sec;
 #if HAVE_PCAP && !defined(PCAP_TSTAMP_PRECISION_NANO)
     _nano = false;
@@ -72,6 +86,13 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("EXTRA_LENGTH", _extra_length)
 	.read("UNBUFFERED", _unbuffered)
         .read("NANO", _nano)
+	.read("PCAPNG", _pcapng)
+	.read("ASYNC", _async)
+#if HAVE_MULTITHREAD
+	.read("BLOCK_SIZE", _block_size)
+	.read("BLOCKS", _nblocks)
+	.read("ROTATE_SIZE", _rotate_size)
+#endif
 #if CLICK_NS
 	.read("PER_NODE", per_node)
 #endif
@@ -81,6 +102,19 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
     if (_snaplen == 0)
 	_snaplen = 0xFFFFFFFFU;
 
+    if (_async) {
+#if HAVE_MULTITHREAD
+	if (_nblocks < 2 || _nblocks >= max_blocks)
+	    return errh->error("BLOCKS must be between 2 and %d", max_blocks - 1);
+	if (_block_size < MAX_RECORD_HEADER + MAX_RECORD_TRAILER + 64)
+	    return errh->error("BLOCK_SIZE is too small");
+	if (_rotate_size && (_filename == "-" || compressed_filename(_filename) > 0))
+	    return errh->error("ROTATE_SIZE requires an uncompressed regular file");
+#else
+	return errh->error("ASYNC requires multithreading support");
+#endif
+    }
+
     if (use_encap_from && encap_type)
 	return errh->error("specify at most one of 'ENCAP' and 'USE_ENCAP_FROM'");
     else if (use_encap_from) {
@@ -113,6 +147,8 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 ToDump *
 ToDump::hotswap_element() const
 {
+    if (_async)
+	return 0;
     if (Element *e = Element::hotswap_element())
 	if (ToDump *td = (ToDump *)e->cast("ToDump"))
 	    if (td->_filename == _filename
@@ -170,22 +206,17 @@ ToDump::initialize(ErrorHandler *errh)
 	if (_unbuffered)
 	    setvbuf(_fp, (char *) 0, _IONBF, 0);
 
-	struct fake_pcap_file_header h;
-
-	h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
-	h.version_major = FAKE_PCAP_VERSION_MAJOR;
-	h.version_minor = FAKE_PCAP_VERSION_MINOR;
-
-	h.thiszone = 0;		// timestamps are in GMT
-	h.sigfigs = 0;		// XXX accuracy of timestamps?
-	h.snaplen = _snaplen;
-	h.linktype = _linktype;
-
-	size_t wrote_header = fwrite(&h, sizeof(h), 1, _fp);
+	String h = file_header();
+	size_t wrote_header = fwrite(h.data(), h.length(), 1, _fp);
 	if (wrote_header != 1)
 	    return errh->error("%s: unable to write file header", _filename.c_str());
     }
 
+#if HAVE_MULTITHREAD
+    if (_async && initialize_async(errh) < 0)
+	return -1;
+#endif
+
     if (input_is_pull(0) && noutputs() == 0) {
 	ScheduleInfo::join_scheduler(this, &_task, errh);
 	_signal = Notifier::upstream_empty_signal(this, 0, &_task);
@@ -207,33 +238,404 @@ ToDump::take_state(Element *e, ErrorHandler *)
 void
 ToDump::cleanup(CleanupStage)
 {
+#if HAVE_MULTITHREAD
+    if (_async)
+	cleanup_async();
+#endif
     if (_fp && _fp != stdout)
 	fclose(_fp);
     _fp = 0;
 }
 
-void
-ToDump::write_packet(Packet *p)
+String
+ToDump::file_header() const
 {
-    struct fake_pcap_pkthdr ph;
+    if (_pcapng) {
+	// section header block, then a single interface description block
+	// with a timestamp resolution option
+	struct {
+	    struct fake_pcapng_shb shb;
+	    uint32_t shb_length;
+	    struct fake_pcapng_block_header idb_h;
+	    struct fake_pcapng_idb idb;
+	    uint16_t tsresol_code;
+	    uint16_t tsresol_length;
+	    uint8_t tsresol[4];
+	    uint32_t endofopt;
+	    uint32_t idb_length;
+	} h;
+	memset(&h, 0, sizeof(h));
+	h.shb.h.type = FAKE_PCAPNG_SHB;
+	h.shb.h.total_length = h.shb_length = sizeof(h.shb) + 4;
+	h.shb.byte_order_magic = FAKE_PCAPNG_BYTE_ORDER_MAGIC;
+	h.shb.version_major = FAKE_PCAPNG_VERSION_MAJOR;
+	h.shb.version_minor = FAKE_PCAPNG_VERSION_MINOR;
+	h.shb.section_length[0] = h.shb.section_length[1] = 0xFFFFFFFFU;
+	h.idb_h.type = FAKE_PCAPNG_IDB;
+	h.idb_h.total_length = h.idb_length = sizeof(h) - sizeof(h.shb) - 4;
+	h.idb.linktype = _linktype;
+	h.idb.snaplen = (_snaplen == 0xFFFFFFFFU ? 0 : _snaplen);
+	h.tsresol_code = FAKE_PCAPNG_OPT_IF_TSRESOL;
+	h.tsresol_length = 1;
+	h.tsresol[0] = _nano ? 9 : 6;
+	h.endofopt = FAKE_PCAPNG_OPT_ENDOFOPT;
+	return String((const char *) &h, sizeof(h));
+    }
+
+    struct fake_pcap_file_header h;
+
+    h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
+    h.version_major = FAKE_PCAP_VERSION_MAJOR;
+    h.version_minor = FAKE_PCAP_VERSION_MINOR;
 
+    h.thiszone = 0;		// timestamps are in GMT
+    h.sigfigs = 0;		// XXX accuracy of timestamps?
+    h.snaplen = _snaplen;
+    h.linktype = _linktype;
+
+    return String((const char *) &h, sizeof(h));
+}
+
+/** Build the record header and trailer of packet @a p, of which @a caplen
+ * bytes are written, with the pcapng @a comment if not empty. Returns the
+ * header length and sets *@a trailer_len to the trailer length, the data
+ * being written in between. */
+unsigned
+ToDump::record_header(Packet *p, unsigned caplen, const String &comment,
+		      unsigned char *header, unsigned char *trailer,
+		      unsigned *trailer_len) const
+{
     Timestamp ts = p->timestamp_anno();
     if (!ts)
         ts = Timestamp::now();
-    ph.ts.tv.tv_sec = ts.sec();
-    ph.ts.tv.tv_usec = _nano ? ts.nsec() : ts.usec();
+    uint32_t len = p->total_length() + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+
+    if (!_pcapng) {
+	struct fake_pcap_pkthdr *ph = reinterpret_cast<struct fake_pcap_pkthdr *>(header);
+	ph->ts.tv.tv_sec = ts.sec();
+	ph->ts.tv.tv_usec = _nano ? ts.nsec() : ts.usec();
+	ph->caplen = caplen;
+	ph->len = len;
+	*trailer_len = 0;
+	return sizeof(*ph);
+    }
+
+    // enhanced packet block: data is padded to 32 bits, then come the
+    // options and the repeated block length
+    unsigned pad = (4 - (caplen & 3)) & 3;
+    unsigned t = 0;
+    memset(trailer, 0, pad);
+    t += pad;
+    uint32_t flags = 0;
+    switch (p->packet_type_anno()) {
+    case Packet::OUTGOING:
+	flags = 2;
+	break;
+    case Packet::MULTICAST:
+	flags = 1 | (2 << 2);
+	break;
+    case Packet::BROADCAST:
+	flags = 1 | (3 << 2);
+	break;
+    case Packet::OTHERHOST:
+	flags = 1 | (4 << 2);
+	break;
+    default:
+	break;
+    }
+    if (flags) {
+	uint16_t opt[2] = { FAKE_PCAPNG_OPT_EPB_FLAGS, 4 };
+	memcpy(trailer + t, opt, 4);
+	memcpy(trailer + t + 4, &flags, 4);
+	t += 8;
+    }
+    if (comment) {
+	uint16_t opt[2] = { FAKE_PCAPNG_OPT_COMMENT, (uint16_t) comment.length() };
+	unsigned clen = (comment.length() + 3) & ~3U;
+	memcpy(trailer + t, opt, 4);
+	memset(trailer + t + 4, 0, clen);
+	memcpy(trailer + t + 4, comment.data(), comment.length());
+	t += 4 + clen;
+    }
+    if (flags || comment) {
+	memset(trailer + t, 0, 4);
+	t += 4;
+    }
+    uint32_t total = MAX_RECORD_HEADER + caplen + t + 4;
+    memcpy(trailer + t, &total, 4);
+    *trailer_len = t + 4;
+
+    uint64_t ticks = (uint64_t) ts.sec() * (_nano ? 1000000000 : 1000000)
+	+ (_nano ? ts.nsec() : ts.usec());
+    uint32_t *h = reinterpret_cast<uint32_t *>(header);
+    h[0] = FAKE_PCAPNG_EPB;
+    h[1] = total;
+    struct fake_pcapng_epb *eb = reinterpret_cast<struct fake_pcapng_epb *>(&h[2]);
+    eb->interface_id = 0;
+    eb->ts_high = ticks >> 32;
+    eb->ts_low = ticks;
+    eb->caplen = caplen;
+    eb->len = len;
+    return MAX_RECORD_HEADER;
+}
+
+#if HAVE_MULTITHREAD
+int
+ToDump::initialize_async(ErrorHandler *errh)
+{
+    fflush(_fp);
+    _fd = fileno(_fp);
+    _file_bytes = file_header().length();
+    _nfiles = 1;
+
+    _blocks.resize(_nblocks);
+    for (unsigned i = 0; i < _nblocks; i++) {
+	Block &b = _blocks[i];
+	// aligned blocks let the kernel copy full pages
+	if (posix_memalign((void **) &b.data, 4096, _block_size) != 0) {
+	    b.data = 0;
+	    return errh->error("could not allocate ASYNC blocks");
+	}
+	b.used = 0;
+	b.count = 0;
+	_free_blocks.insert(&b);
+    }
+
+    _io_stop = false;
+    _io_pending = false;
+    pthread_mutex_init(&_io_mutex, 0);
+    pthread_cond_init(&_io_cond, 0);
+    if (pthread_create(&_io_thread, 0, io_thread, this) != 0)
+	return errh->error("could not start I/O thread: %s", strerror(errno));
+    _io_started = true;
+    _flush_timer.initialize(this);
+    _flush_timer.schedule_after_msec(500);
+    return 0;
+}
+
+void
+ToDump::cleanup_async()
+{
+    // the router is stopped, so no thread fills its block anymore
+    _flush_timer.clear();
+    for (unsigned i = 0; i < _async_state.weight(); i++) {
+	AsyncState &s = _async_state.get_value(i);
+	if (s.block) {
+	    if (s.block->used)
+		submit_block(s.block);
+	    else
+		_free_blocks.insert(s.block);
+	    s.block = 0;
+	}
+    }
+    if (_io_started) {
+	pthread_mutex_lock(&_io_mutex);
+	_io_stop = true;
+	pthread_cond_signal(&_io_cond);
+	pthread_mutex_unlock(&_io_mutex);
+	pthread_join(_io_thread, 0);
+	_io_started = false;
+	pthread_cond_destroy(&_io_cond);
+	pthread_mutex_destroy(&_io_mutex);
+    }
+    for (int i = 0; i < _blocks.size(); i++)
+	free(_blocks[i].data);
+    _blocks.clear();
+    if (!_fp && _fd >= 0)
+	close(_fd);
+    _fd = -1;
+}
+
+void
+ToDump::run_timer(Timer *)
+{
+    // submit the partial blocks of threads that stopped receiving packets;
+    // a thread holding its lock is busy and submits its block itself
+    click_jiffies_t now = click_jiffies();
+    for (unsigned i = 0; i < _async_state.weight(); i++) {
+	AsyncState &s = _async_state.get_value(i);
+	if (!s.lock.attempt())
+	    continue;
+	if (s.block && s.block->used
+	    && now - s.block->start > (click_jiffies_t) CLICK_HZ) {
+	    submit_block(s.block);
+	    s.block = 0;
+	}
+	s.lock.release();
+    }
+    _flush_timer.reschedule_after_msec(500);
+}
+
+void
+ToDump::submit_block(Block *b)
+{
+    // blocks are large, so waking the I/O thread for each one is cheap
+    _full_blocks.insert(b);
+    pthread_mutex_lock(&_io_mutex);
+    _io_pending = true;
+    pthread_cond_signal(&_io_cond);
+    pthread_mutex_unlock(&_io_mutex);
+}
+
+void *
+ToDump::io_thread(void *arg)
+{
+    ToDump *td = static_cast<ToDump *>(arg);
+    while (1) {
+	pthread_mutex_lock(&td->_io_mutex);
+	while (!td->_io_pending && !td->_io_stop)
+	    pthread_cond_wait(&td->_io_cond, &td->_io_mutex);
+	td->_io_pending = false;
+	bool stop = td->_io_stop;
+	pthread_mutex_unlock(&td->_io_mutex);
+
+	// a block queued after this loop sets _io_pending again
+	while (Block *b = td->_full_blocks.extract()) {
+	    td->io_write_block(b);
+	    b->used = 0;
+	    b->count = 0;
+	    td->_free_blocks.insert(b);
+	}
+	if (stop)
+	    break;
+    }
+    return 0;
+}
+
+bool
+ToDump::io_rotate()
+{
+    if (_fp) {
+	fclose(_fp);
+	_fp = 0;
+    } else
+	close(_fd);
+
+    String filename = _filename + "." + String(_nfiles);
+    _fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) {
+	click_chatter("%p{element}: %s: %s", this, filename.c_str(), strerror(errno));
+	return false;
+    }
+    _nfiles++;
+    String h = file_header();
+    if (write(_fd, h.data(), h.length()) != h.length()) {
+	close(_fd);
+	_fd = -1;
+	return false;
+    }
+    _file_bytes = h.length();
+    return true;
+}
 
-    unsigned to_write = p->length();
-    ph.len = to_write + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+void
+ToDump::io_write_block(Block *b)
+{
+    if (!_active)
+	return;
+    if (_rotate_size && _file_bytes + b->used > _rotate_size
+	&& _file_bytes > (uint64_t) file_header().length()
+	&& !io_rotate()) {
+	_active = false;
+	return;
+    }
+
+    const unsigned char *data = b->data;
+    uint32_t len = b->used;
+    while (len > 0) {
+	ssize_t w = write(_fd, data, len);
+	if (w < 0) {
+	    if (errno == EINTR || errno == EAGAIN)
+		continue;
+	    _active = false;
+	    click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(errno));
+	    return;
+	}
+	data += w;
+	len -= w;
+    }
+    _file_bytes += b->used;
+    _async_count += b->count;
+}
+
+void
+ToDump::async_write_packet(Packet *p)
+{
+    AsyncState &s = *_async_state;
+
+    unsigned to_write = p->total_length();
     if (_snaplen && to_write > _snaplen)
 	to_write = _snaplen;
-    ph.caplen = to_write;
+    if (MAX_RECORD_HEADER + to_write + MAX_RECORD_TRAILER > _block_size)
+	to_write = _block_size - MAX_RECORD_HEADER - MAX_RECORD_TRAILER;
+    unsigned char header[MAX_RECORD_HEADER], trailer[MAX_RECORD_TRAILER];
+    unsigned trailer_len;
+    unsigned header_len = record_header(p, to_write, take_comment(), header, trailer, &trailer_len);
+    uint32_t rec_len = header_len + to_write + trailer_len;
+
+    // submit the current block when full or when it waited for more than a
+    // second, so records of slow threads still reach the file; blocks of
+    // idle threads are submitted by run_timer()
+    s.lock.acquire();
+    if (s.block && (s.block->used + rec_len > _block_size
+		    || click_jiffies() - s.block->start > (click_jiffies_t) CLICK_HZ)) {
+	submit_block(s.block);
+	s.block = 0;
+    }
+    if (!s.block) {
+	if (!(s.block = _free_blocks.extract())) {
+	    s.drops++;
+	    s.lock.release();
+	    return;
+	}
+	s.block->start = click_jiffies();
+    }
+
+    unsigned char *rec = s.block->data + s.block->used;
+    memcpy(rec, header, header_len);
+    unsigned char *d = rec + header_len;
+    for (Packet *seg = p; d < rec + header_len + to_write; seg = seg->next_segment()) {
+	unsigned n = rec + header_len + to_write - d;
+	if (n > seg->length())
+	    n = seg->length();
+	memcpy(d, seg->data(), n);
+	d += n;
+    }
+    memcpy(rec + header_len + to_write, trailer, trailer_len);
+    s.block->used += rec_len;
+    s.block->count++;
+    s.lock.release();
+}
+#endif
+
+void
+ToDump::write_packet(Packet *p)
+{
+#if HAVE_MULTITHREAD
+    if (_async) {
+	async_write_packet(p);
+	return;
+    }
+#endif
+    unsigned to_write = p->total_length();
+    if (_snaplen && to_write > _snaplen)
+	to_write = _snaplen;
+    unsigned char header[MAX_RECORD_HEADER], trailer[MAX_RECORD_TRAILER];
+    unsigned trailer_len;
+    unsigned header_len = record_header(p, to_write, take_comment(), header, trailer, &trailer_len);
 
     if (_mt)
         _lock.acquire();
     // XXX writing to pipe?
-    if (fwrite(&ph, sizeof(ph), 1, _fp) == 0
-	|| (to_write > 0 && fwrite(p->data(), 1, to_write, _fp) == 0)) {
+    bool ok = fwrite(header, header_len, 1, _fp) != 0;
+    // segments are written in turn, without linearizing the packet
+    for (Packet *seg = p; ok && to_write > 0; seg = seg->next_segment()) {
+	unsigned n = to_write < seg->length() ? to_write : seg->length();
+	ok = n == 0 || fwrite(seg->data(), 1, n, _fp) != 0;
+	to_write -= n;
+    }
+    if (!ok
+	|| (trailer_len > 0 && fwrite(trailer, trailer_len, 1, _fp) == 0)) {
 	if (errno != EAGAIN) {
 	    _active = false;
 	    click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(errno));
@@ -255,6 +657,18 @@ ToDump::push_batch(int, PacketBatch *b)
         checked_output_push_batch(0, b);
     }
 }
+
+PacketBatch *
+ToDump::pull_batch(int, unsigned max)
+{
+    PacketBatch *b = input_pull_batch(0, max);
+    if (_active && b) {
+        FOR_EACH_PACKET(b,p) {
+            write_packet(p);
+        }
+    }
+    return b;
+}
 #endif
 void
 ToDump::push(int, Packet *p)
@@ -288,7 +702,8 @@ ToDump::run_task(Task *)
     return p != 0;
 }
 
-enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2 };
+enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2, H_DROPS = 3, H_FILES = 4,
+       H_COMMENT = 5 };
 
 String
 ToDump::read_handler(Element *e, void *thunk)
@@ -298,17 +713,43 @@ ToDump::read_handler(Element *e, void *thunk)
     case H_FILENAME:
 	return td->_filename;
     case H_COUNT:
+#if HAVE_MULTITHREAD
+	if (td->_async)
+	    return String(td->_async_count.value());
+#endif
 	return String(td->_count);
+#if HAVE_MULTITHREAD
+    case H_DROPS: {
+	counter_t drops = 0;
+	for (unsigned i = 0; i < td->_async_state.weight(); i++)
+	    drops += td->_async_state.get_value(i).drops;
+	return String(drops);
+    }
+    case H_FILES:
+	return String(td->_nfiles);
+#endif
     default:
 	return "<error>";
     }
 }
 
 int
-ToDump::write_handler(const String &, Element *e, void *, ErrorHandler *)
+ToDump::write_handler(const String &s, Element *e, void *thunk, ErrorHandler *errh)
 {
     ToDump *td = static_cast<ToDump *>(e);
+    if ((uintptr_t) thunk == H_COMMENT) {
+	if (s.length() > MAX_COMMENT)
+	    return errh->error("comment longer than %d bytes", (int) MAX_COMMENT);
+	td->_lock.acquire();
+	td->_comment = s;
+	td->_comment_pending = s.length() > 0;
+	td->_lock.release();
+	return 0;
+    }
     td->_count = 0;
+#if HAVE_MULTITHREAD
+    td->_async_count = 0;
+#endif
     return 0;
 }
 
@@ -317,7 +758,15 @@ ToDump::add_handlers()
 {
     add_read_handler("filename", read_handler, H_FILENAME);
     add_read_handler("count", read_handler, H_COUNT);
+#if HAVE_MULTITHREAD
+    if (_async) {
+	add_read_handler("drops", read_handler, H_DROPS);
+	add_read_handler("files", read_handler, H_FILES);
+    }
+#endif
     add_write_handler("reset_counts", write_handler, H_RESET_COUNTS, Handler::BUTTON);
+    if (_pcapng)
+	add_write_handler("comment", write_handler, H_COMMENT, Handler::RAW);
     if (input_is_pull(0) && noutputs() == 0)
 	add_task_handlers(&_task);
 }
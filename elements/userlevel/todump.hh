@@ -6,13 +6,17 @@
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include <click/sync.hh>
+#include <click/ring.hh>
 #include <stdio.h>
+#if HAVE_MULTITHREAD
+# include <pthread.h>
+#endif
 CLICK_DECLS
 
 /*
 =c
 
-ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO])
+ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO, PCAPNG, ASYNC])
 
 =s traces
 
@@ -32,6 +36,10 @@ read the file correctly. It can be C<ETHER> (Ethernet encapsulation),
 C<IP> (raw IP packets), C<FDDI>, C<ATM>, C<802_11>, C<SLL>, C<AIRONET>, C<HDLC>,
 C<PPP_HDLC>, C<PPP>, C<SUNATM>, C<PRISM>, or C<NULL>; the default is C<ETHER>.
 
+Packets made of several segments, such as jumbo frames received by
+FromDPDKDevice, are written whole, segment by segment, without being copied
+into a single buffer first.
+
 ToDump may have zero or one output. If it has an output, then it emits all
 received packets on that output. ToDump will schedule itself on the task list
 if it is used as a pull element with no outputs.
@@ -72,6 +80,39 @@ false.
 Boolean. Set to true to write nanosecond-precision timestamps. Default depends
 on the version of tcpdump/pcap on the machine.
 
+=item PCAPNG
+
+Boolean. Set to true to write a pcapng file instead of a classic tcpdump
+file. The file has a single interface, and packets whose packet type
+annotation is not HOST are written with the matching direction and
+reception type flags. Comments can be attached to packets with the "comment"
+handler. Default is false.
+
+=item ASYNC
+
+Boolean. If true, the threads passing packets only copy the records into
+per-thread blocks of memory, which are written to the file by a dedicated I/O
+thread. When no free block is available because the I/O thread cannot keep
+up, packets are not recorded and counted in the "drops" handler instead of
+stalling the data path. Records from different threads are not ordered by
+time in the file. A block that is only partially filled is submitted once it
+is one second old, even if its thread receives no more packets. Only
+available with multithreading support. Default is false.
+
+=item BLOCK_SIZE
+
+Integer. Size in bytes of the blocks used in ASYNC mode. Default is 1MB.
+
+=item BLOCKS
+
+Integer. Number of blocks used in ASYNC mode. Default is 16.
+
+=item ROTATE_SIZE
+
+Integer. In ASYNC mode, if non-zero, a new file named FILENAME.I<n> is started
+when the current file would exceed ROTATE_SIZE bytes. Default is 0, no
+rotation.
+
 =back
 
 This element is only available at user level.
@@ -84,10 +125,24 @@ ToDump stores packets' true length annotations when available.
 
 Returns the number of packets emitted so far.
 
+=h drops read-only
+
+Returns the number of packets not recorded in ASYNC mode because of a lack
+of free blocks.
+
+=h files read-only
+
+Returns the number of files written in ASYNC mode with ROTATE_SIZE.
+
 =h reset_counts write-only
 
 Resets "count" to 0.
 
+=h comment write-only
+
+Only with PCAPNG. The string written, of at most 256 bytes, is recorded as
+the comment of the next packet written to the file.
+
 =h filename read-only
 
 Returns the filename.
@@ -115,6 +170,7 @@ class ToDump : public BatchElement { public:
     void take_state(Element *, ErrorHandler *);
 #if HAVE_BATCH
     void push_batch(int, PacketBatch *);
+    PacketBatch *pull_batch(int, unsigned);
 #endif
     void push(int, Packet *);
     Packet *pull(int);
@@ -128,10 +184,11 @@ class ToDump : public BatchElement { public:
     FILE *_fp;
     unsigned _snaplen;
     int _linktype;
-    bool _active;
+    atomic_uint32_t _active;	// cleared by the I/O thread in ASYNC mode
     bool _extra_length;
     bool _unbuffered;
     bool _nano;
+    bool _pcapng;
 
 #if HAVE_INT64_TYPES
     typedef uint64_t counter_t;
@@ -146,9 +203,84 @@ class ToDump : public BatchElement { public:
 
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+    enum { MAX_COMMENT = 256, MAX_RECORD_HEADER = 28,
+	   MAX_RECORD_TRAILER = 24 + MAX_COMMENT };
+
+    String _comment;
+    volatile bool _comment_pending;
+
+    inline String take_comment();
+
+    String file_header() const;
+    unsigned record_header(Packet *, unsigned caplen, const String &comment,
+			   unsigned char *header, unsigned char *trailer,
+			   unsigned *trailer_len) const;
     void write_packet(Packet *);
 
+    bool _async;
+#if HAVE_MULTITHREAD
+    struct Block {
+        unsigned char *data;
+        uint32_t used;
+        uint32_t count;
+        click_jiffies_t start;
+    };
+    struct AsyncState {
+        AsyncState() : block(0), drops(0) {
+        }
+        // taken by the owning thread while it fills the block, and by the
+        // flush timer to submit the block of an idle thread
+        SimpleSpinlock lock;
+        Block *block;
+        counter_t drops;
+    };
+    enum { max_blocks = 256 };
+
+    uint32_t _block_size;
+    unsigned _nblocks;
+    uint64_t _rotate_size;
+    Vector<Block> _blocks;
+    MPMCRing<Block*, max_blocks> _free_blocks;
+    MPMCRing<Block*, max_blocks> _full_blocks;
+    per_thread<AsyncState> _async_state;
+    pthread_t _io_thread;
+    pthread_mutex_t _io_mutex;
+    pthread_cond_t _io_cond;
+    atomic_uint64_t _async_count;
+    bool _io_pending;
+    volatile bool _io_stop;
+    bool _io_started;
+    int _fd;
+    uint64_t _file_bytes;
+    unsigned _nfiles;
+    Timer _flush_timer;
+
+    void async_write_packet(Packet *);
+    void submit_block(Block *);
+    void run_timer(Timer *);
+    static void *io_thread(void *);
+    void io_write_block(Block *);
+    bool io_rotate();
+    int initialize_async(ErrorHandler *);
+    void cleanup_async();
+#endif
+
 };
 
+/** Return the comment set by the "comment" handler, once, or an empty
+ * string. */
+inline String
+ToDump::take_comment()
+{
+    if (likely(!_comment_pending))
+	return String();
+    _lock.acquire();
+    String comment = _comment;
+    _comment = String();
+    _comment_pending = false;
+    _lock.release();
+    return comment;
+}
+
 CLICK_ENDDECLS
 #endif
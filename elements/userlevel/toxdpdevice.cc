@@ -0,0 +1,240 @@
+// -*- c-basic-offset: 4; related-file-name: "toxdpdevice.hh" -*-
+/*
+ * toxdpdevice.{cc,hh} -- element sends packets to a network device through
+ * AF_XDP sockets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "toxdpdevice.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+ToXDPDevice::ToXDPDevice()
+    : _device(0)
+{
+    _burst = 32;
+    _blocking = true;
+    _internal_tx_queue_size = 512;
+}
+
+int
+ToXDPDevice::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String ifname, mode_str = "auto";
+    unsigned desc = 0;
+    if (Args(this, errh).bind(conf)
+	.read_mp("DEVNAME", ifname)
+	.read("NDESC", desc)
+	.read("MODE", WordArg(), mode_str)
+	.consume() < 0)
+	return -1;
+    if (parse(conf, errh) != 0)
+	return -1;
+    if (Args(conf, this, errh).complete() < 0)
+	return -1;
+
+    XDPDevice::Mode mode;
+    if (!XDPDevice::parse_mode(mode_str, mode))
+	return errh->error("bad MODE %<%s%>", mode_str.c_str());
+    if (!(_device = XDPDevice::open(ifname, errh)))
+	return -1;
+    if (_device->set_parameters(desc ? desc : 1024, mode, errh) < 0)
+	return -1;
+
+    if (firstqueue == -1)
+	firstqueue = 0;
+    if (firstqueue >= _device->n_queues)
+	return errh->error("You asked for queue %d but device only have %d queues.", firstqueue, _device->n_queues);
+    if (n_queues == -1)
+	return configure_tx(1, _device->n_queues - firstqueue, errh);
+    if (firstqueue + n_queues > _device->n_queues)
+	return errh->error("You asked for %d queues after queue %d but device only have %d.", n_queues, firstqueue, _device->n_queues);
+    return configure_tx(n_queues, n_queues, errh);
+}
+
+int
+ToXDPDevice::initialize(ErrorHandler *errh)
+{
+    int ret = initialize_tx(errh);
+    if (ret != 0)
+	return ret;
+    ret = initialize_tasks(input_is_pull(0), errh);
+    if (ret != 0)
+	return ret;
+
+    _queues.resize(firstqueue + n_queues, 0);
+    for (int i = firstqueue; i < firstqueue + n_queues; i++)
+	if (!(_queues[i] = _device->queue(i, errh)))
+	    return -1;
+    if (input_is_pull(0))
+	_signal = Notifier::upstream_empty_signal(this, 0, _tasks[0]);
+    return 0;
+}
+
+/* Put as many packets of the list starting at head as possible in the TX
+ * ring of q. On return, head points to the packets left. */
+unsigned
+ToXDPDevice::send_packets(XDPDevice::Queue *q, Packet *&head, bool blocking)
+{
+    unsigned sent = 0, dropped = 0;
+    Packet *done = 0, **done_tail = &done;
+
+    lock();
+    while (head) {
+	q->reclaim();
+	uint32_t space = q->tx.free(q->tx.size);
+	if (!space) {
+	    if (!blocking)
+		break;
+	    q->kick_tx();
+	    click_relax_fence();
+	    continue;
+	}
+	uint32_t n = 0;
+	q->lock.acquire();
+	while (head && n < space) {
+	    Packet *p = head;
+	    uint64_t addr = 0;
+	    bool reserved = true;
+	    if (q->steal_frame(p, addr))
+		/* sent in place */;
+	    else if (p->length() > XDPDevice::FRAME_SIZE)
+		reserved = false;
+	    else if (q->frames.size()) {
+		addr = q->frames.back();
+		q->frames.pop_back();
+		memcpy(q->umem + addr, p->data(), p->length());
+	    } else
+		break;
+	    head = p->next();
+	    *done_tail = p;
+	    done_tail = &p->next();
+	    // Too large for a UMEM frame: no descriptor to fill
+	    if (!reserved) {
+		dropped++;
+		continue;
+	    }
+	    q->tx.desc(q->tx.cached + n).addr = addr;
+	    q->tx.desc(q->tx.cached + n).len = p->length();
+	    q->tx.desc(q->tx.cached + n).options = 0;
+	    n++;
+	}
+	q->lock.release();
+	if (n) {
+	    q->tx.submit(n);
+	    q->kick_tx();
+	    sent += n;
+	} else if (!blocking)
+	    break;
+	else
+	    // No free frame: wait for the kernel to complete transmissions
+	    q->kick_tx();
+    }
+    unlock();
+
+    // Killing packets may give frames back to a queue: do it unlocked
+    *done_tail = 0;
+    while (done) {
+	Packet *next = done->next();
+	done->kill();
+	done = next;
+    }
+    add_count(sent);
+    add_dropped(dropped);
+    return sent;
+}
+
+void
+ToXDPDevice::push(int, Packet *p)
+{
+    p->set_next(0);
+    send_packets(queue_for_thisthread(), p, _blocking);
+    if (p) {
+	add_dropped(1);
+	p->kill();
+    }
+}
+
+#if HAVE_BATCH
+void
+ToXDPDevice::push_batch(int, PacketBatch *batch)
+{
+    batch->tail()->set_next(0);
+    Packet *head = batch;
+    send_packets(queue_for_thisthread(), head, _blocking);
+    while (head) {
+	Packet *next = head->next();
+	add_dropped(1);
+	head->kill();
+	head = next;
+    }
+}
+#endif
+
+bool
+ToXDPDevice::run_task(Task *t)
+{
+    XDPDevice::Queue *q = queue_for_thisthread();
+    q->reclaim();
+    unsigned space = q->tx.free(_burst);
+    Packet *head = 0;
+    unsigned n = 0;
+#if HAVE_BATCH
+    if (space) {
+	if (PacketBatch *batch = input(0).pull_batch(space)) {
+	    n = batch->count();
+	    batch->tail()->set_next(0);
+	    head = batch;
+	}
+    }
+#else
+    Packet **tail = &head;
+    while (n < space) {
+	Packet *p = input(0).pull();
+	if (!p)
+	    break;
+	*tail = p;
+	tail = &p->next();
+	n++;
+    }
+    if (n)
+	*tail = 0;
+#endif
+    if (head)
+	send_packets(q, head, true);
+    if (n || _signal)
+	t->fast_reschedule();
+    return n;
+}
+
+void
+ToXDPDevice::cleanup(CleanupStage)
+{
+    cleanup_tasks();
+    if (_device)
+	_device->close();
+}
+
+void
+ToXDPDevice::add_handlers()
+{
+    add_read_handler("count", count_handler, 0);
+    add_read_handler("dropped", dropped_handler, 0);
+    add_write_handler("reset_counts", reset_count_handler, 0, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel xdp QueueDevice XDPDevice)
+EXPORT_ELEMENT(ToXDPDevice)
+ELEMENT_MT_SAFE(ToXDPDevice)
@@ -0,0 +1,126 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_TOXDPDEVICE_HH
+#define CLICK_TOXDPDEVICE_HH
+#include <click/config.h>
+#include <click/task.hh>
+#include <click/notifier.hh>
+#include "queuedevice.hh"
+#include "xdpdevice.hh"
+CLICK_DECLS
+
+/*
+=c
+
+ToXDPDevice(DEVNAME [, QUEUE, I<keywords> N_QUEUES, BLOCKING, BURST, NDESC, MODE, ...])
+
+=s netdevices
+
+sends packets to a network device using AF_XDP sockets
+
+=d
+
+Sends packets to the network interface DEVNAME through AF_XDP sockets. Packets
+are written in the memory shared with the kernel (the UMEM) of the socket of
+the hardware queue used by the current thread. Packets received by a
+FromXDPDevice on that same queue are sent without copy; others are copied
+into a free frame of the UMEM. Packets longer than 2048 bytes minus their
+headroom cannot be sent and are dropped.
+
+This element can be push or pull. In push mode, packets are sent as soon as
+they arrive, in batches if batching is enabled. In pull mode, each thread
+pulls up to BURST packets at a time when the transmit ring has room.
+
+Only one ToXDPDevice should use a given interface and queue.
+
+Arguments:
+
+=over 8
+
+=item DEVNAME
+
+String. Name of the network interface.
+
+=item QUEUE
+
+Integer. First hardware queue to use. Default is 0.
+
+=item N_QUEUES
+
+Integer. Number of hardware queues to use. Default is as many as needed so
+that each thread has its own queue, at most the number of queues of the
+device.
+
+=item BLOCKING
+
+Boolean. In push mode, if the transmit ring is full, wait until the kernel
+sends some packets; otherwise, drop the packets that do not fit. Default is
+true.
+
+=item BURST
+
+Integer. Number of packets pulled at once in pull mode. Default is 32.
+
+=item NDESC, MODE
+
+See FromXDPDevice. Elements using the same interface must use the same
+values.
+
+=item MAXTHREADS, VERBOSE
+
+See ToDPDKDevice.
+
+=back
+
+=h count read-only
+
+Returns the number of packets sent.
+
+=h dropped read-only
+
+Returns the number of packets dropped.
+
+=h reset_counts write-only
+
+Resets the counts to zero.
+
+=a FromXDPDevice, ToDevice, ToDPDKDevice, ToNetmapDevice
+*/
+
+class ToXDPDevice : public TXQueueDevice {
+
+public:
+
+    ToXDPDevice() CLICK_COLD;
+
+    const char *class_name() const		{ return "ToXDPDevice"; }
+    const char *port_count() const		{ return PORTS_1_0; }
+    const char *processing() const		{ return AGNOSTIC; }
+
+    int configure_phase() const			{ return CONFIGURE_PHASE_PRIVILEGED; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *);
+#endif
+    bool run_task(Task *);
+
+  private:
+
+    XDPDevice *_device;
+    Vector<XDPDevice::Queue *> _queues;
+    NotifierSignal _signal;
+
+    inline XDPDevice::Queue *queue_for_thisthread() {
+	return _queues[queue_for_thisthread_begin()];
+    }
+    unsigned send_packets(XDPDevice::Queue *q, Packet *&head, bool blocking);
+
+};
+
+CLICK_ENDDECLS
+#endif
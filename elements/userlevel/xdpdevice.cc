@@ -0,0 +1,412 @@
+// -*- c-basic-offset: 4; related-file-name: "xdpdevice.hh" -*-
+/*
+ * xdpdevice.{cc,hh} -- AF_XDP sockets of a network interface
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "xdpdevice.hh"
+#include <click/args.hh>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef SOL_XDP
+# define SOL_XDP 283
+#endif
+#ifndef AF_XDP
+# define AF_XDP 44
+#endif
+
+CLICK_DECLS
+
+Vector<XDPDevice *> XDPDevice::devices;
+
+static int
+sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+XDPDevice::XDPDevice(const String &name, int index, int nqueues)
+    : ifname(name), ifindex(index), n_queues(nqueues), _refcount(0),
+      _ndesc(0), _mode(MODE_AUTO), _configured(false),
+      _queues(nqueues, 0), _map_fd(-1), _prog_fd(-1), _link_fd(-1)
+{
+}
+
+XDPDevice::~XDPDevice()
+{
+    if (_link_fd >= 0)
+	::close(_link_fd);
+    if (_prog_fd >= 0)
+	::close(_prog_fd);
+    if (_map_fd >= 0)
+	::close(_map_fd);
+    for (int i = 0; i < _queues.size(); i++)
+	if (_queues[i])
+	    destroy_queue(_queues[i], true);
+}
+
+XDPDevice *
+XDPDevice::open(const String &ifname, ErrorHandler *errh)
+{
+    for (int i = 0; i < devices.size(); i++)
+	if (devices[i]->ifname == ifname) {
+	    devices[i]->_refcount++;
+	    return devices[i];
+	}
+
+    int ifindex = if_nametoindex(ifname.c_str());
+    if (!ifindex) {
+	errh->error("%s: unknown interface", ifname.c_str());
+	return 0;
+    }
+    // AF_XDP binds to RX queues: count them
+    int n_queues = 0;
+    String path = "/sys/class/net/" + ifname + "/queues";
+    if (DIR *dir = opendir(path.c_str())) {
+	while (struct dirent *ent = readdir(dir))
+	    if (strncmp(ent->d_name, "rx-", 3) == 0)
+		n_queues++;
+	closedir(dir);
+    }
+    if (n_queues == 0)
+	n_queues = 1;
+
+    XDPDevice *dev = new XDPDevice(ifname, ifindex, n_queues);
+    dev->_refcount = 1;
+    devices.push_back(dev);
+    return dev;
+}
+
+void
+XDPDevice::close()
+{
+    if (--_refcount > 0)
+	return;
+    for (int i = 0; i < devices.size(); i++)
+	if (devices[i] == this) {
+	    devices[i] = devices.back();
+	    devices.pop_back();
+	    break;
+	}
+    delete this;
+}
+
+bool
+XDPDevice::parse_mode(const String &str, Mode &mode)
+{
+    String s = str.lower();
+    if (s == "auto")
+	mode = MODE_AUTO;
+    else if (s == "zerocopy")
+	mode = MODE_ZEROCOPY;
+    else if (s == "copy")
+	mode = MODE_COPY;
+    else if (s == "generic")
+	mode = MODE_GENERIC;
+    else
+	return false;
+    return true;
+}
+
+int
+XDPDevice::set_parameters(unsigned ndesc, Mode mode, ErrorHandler *errh)
+{
+    if (ndesc < 64 || (ndesc & (ndesc - 1)))
+	return errh->error("NDESC must be a power of 2, at least 64");
+    if (_configured && (ndesc != _ndesc || mode != _mode))
+	return errh->error("%s: all elements of the device must use the same NDESC and MODE", ifname.c_str());
+    _ndesc = ndesc;
+    _mode = mode;
+    _configured = true;
+    return 0;
+}
+
+int
+XDPDevice::map_ring(Queue *q, Ring &r, int fd, const struct xdp_ring_offset &off,
+		    uint64_t pgoff, size_t entry_size, ErrorHandler *errh)
+{
+    r.map_size = off.desc + _ndesc * entry_size;
+    r.map = mmap(0, r.map_size, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (r.map == MAP_FAILED) {
+	r.map = 0;
+	return errh->error("%s: queue %d: cannot map ring: %s", ifname.c_str(), q->index, strerror(errno));
+    }
+    char *base = static_cast<char *>(r.map);
+    r.producer = reinterpret_cast<uint32_t *>(base + off.producer);
+    r.consumer = reinterpret_cast<uint32_t *>(base + off.consumer);
+    r.flags = reinterpret_cast<uint32_t *>(base + off.flags);
+    r.ring = base + off.desc;
+    r.size = _ndesc;
+    r.mask = _ndesc - 1;
+    return 0;
+}
+
+int
+XDPDevice::bind_socket(Queue *q, uint16_t flags)
+{
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = q->index;
+    sxdp.sxdp_flags = flags | XDP_USE_NEED_WAKEUP;
+    if (bind(q->fd, (struct sockaddr *) &sxdp, sizeof(sxdp)) == 0) {
+	q->need_wakeup = true;
+	return 0;
+    }
+    // Kernels before 5.4 do not know XDP_USE_NEED_WAKEUP
+    sxdp.sxdp_flags = flags;
+    return bind(q->fd, (struct sockaddr *) &sxdp, sizeof(sxdp));
+}
+
+int
+XDPDevice::create_socket(Queue *q, ErrorHandler *errh)
+{
+    const char *dev = ifname.c_str();
+    q->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (q->fd < 0)
+	return errh->error("%s: cannot create AF_XDP socket: %s", dev, strerror(errno));
+
+    // Frames for the fill ring, the RX ring, packets held by Click, and the
+    // TX and completion rings
+    uint32_t nframes = _ndesc * 4;
+    q->umem_size = (size_t) nframes * FRAME_SIZE;
+    void *umem = mmap(0, q->umem_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (umem == MAP_FAILED)
+	return errh->error("%s: cannot allocate UMEM: %s", dev, strerror(errno));
+    q->umem = static_cast<unsigned char *>(umem);
+
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (uintptr_t) q->umem;
+    reg.len = q->umem_size;
+    reg.chunk_size = FRAME_SIZE;
+    reg.headroom = 0;
+    int ndesc = _ndesc;
+    if (setsockopt(q->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0
+	|| setsockopt(q->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ndesc, sizeof(ndesc)) < 0
+	|| setsockopt(q->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ndesc, sizeof(ndesc)) < 0
+	|| setsockopt(q->fd, SOL_XDP, XDP_RX_RING, &ndesc, sizeof(ndesc)) < 0
+	|| setsockopt(q->fd, SOL_XDP, XDP_TX_RING, &ndesc, sizeof(ndesc)) < 0)
+	return errh->error("%s: cannot set up AF_XDP socket: %s", dev, strerror(errno));
+
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(q->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+	return errh->error("%s: cannot get ring offsets: %s", dev, strerror(errno));
+    if (map_ring(q, q->fill, q->fd, off.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64_t), errh) < 0
+	|| map_ring(q, q->comp, q->fd, off.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64_t), errh) < 0
+	|| map_ring(q, q->rx, q->fd, off.rx, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc), errh) < 0
+	|| map_ring(q, q->tx, q->fd, off.tx, XDP_PGOFF_TX_RING, sizeof(struct xdp_desc), errh) < 0)
+	return -1;
+    q->fill.cached = *q->fill.producer;
+    q->tx.cached = *q->tx.producer;
+    q->rx.cached = *q->rx.consumer;
+    q->comp.cached = *q->comp.consumer;
+
+    int r;
+    if (_mode == MODE_ZEROCOPY)
+	r = bind_socket(q, XDP_ZEROCOPY);
+    else if (_mode == MODE_AUTO) {
+	// Zero-copy needs driver support; veth and most virtual devices do
+	// not have it
+	r = bind_socket(q, XDP_ZEROCOPY);
+	if (r < 0)
+	    r = bind_socket(q, XDP_COPY);
+    } else
+	r = bind_socket(q, XDP_COPY);
+    if (r < 0)
+	return errh->error("%s: cannot bind AF_XDP socket to queue %d: %s", dev, q->index, strerror(errno));
+
+    struct xdp_options opts;
+    optlen = sizeof(opts);
+    if (getsockopt(q->fd, SOL_XDP, XDP_OPTIONS, &opts, &optlen) == 0)
+	q->zerocopy = opts.flags & XDP_OPTIONS_ZEROCOPY;
+
+    q->frames.reserve(nframes);
+    for (uint32_t i = nframes; i > 0; i--)
+	q->frames.push_back((uint64_t) (i - 1) * FRAME_SIZE);
+    return 0;
+}
+
+void
+XDPDevice::destroy_queue(Queue *q, bool in_use)
+{
+    Ring *rings[4] = { &q->fill, &q->comp, &q->rx, &q->tx };
+    for (int i = 0; i < 4; i++)
+	if (rings[i]->map)
+	    munmap(rings[i]->map, rings[i]->map_size);
+    if (q->fd >= 0)
+	::close(q->fd);
+    // Packets killed later still return their frame to the queue, so a
+    // queue that was used keeps its UMEM
+    if (in_use)
+	return;
+    if (q->umem)
+	munmap(q->umem, q->umem_size);
+    delete q;
+}
+
+XDPDevice::Queue *
+XDPDevice::queue(int i, ErrorHandler *errh)
+{
+    if (i < 0 || i >= n_queues) {
+	errh->error("%s: no queue %d, the device has %d", ifname.c_str(), i, n_queues);
+	return 0;
+    }
+    if (!_queues[i]) {
+	Queue *q = new Queue;
+	q->device = this;
+	q->index = i;
+	if (create_socket(q, errh) < 0) {
+	    destroy_queue(q, false);
+	    return 0;
+	}
+	_queues[i] = q;
+    }
+    return _queues[i];
+}
+
+/* XDP program: return bpf_redirect_map(&xsks_map, ctx->rx_queue_index,
+ * XDP_PASS), so that queues without socket keep going to the kernel. */
+int
+XDPDevice::attach_program(ErrorHandler *errh)
+{
+    const char *dev = ifname.c_str();
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(int);
+    attr.value_size = sizeof(int);
+    attr.max_entries = n_queues;
+    _map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (_map_fd < 0)
+	return errh->error("%s: cannot create XSKMAP: %s", dev, strerror(errno));
+
+    struct bpf_insn insns[6];
+    memset(insns, 0, sizeof(insns));
+    // r2 = ctx->rx_queue_index
+    insns[0].code = BPF_LDX | BPF_MEM | BPF_W;
+    insns[0].dst_reg = BPF_REG_2;
+    insns[0].src_reg = BPF_REG_1;
+    insns[0].off = offsetof(struct xdp_md, rx_queue_index);
+    // r1 = map
+    insns[1].code = BPF_LD | BPF_DW | BPF_IMM;
+    insns[1].dst_reg = BPF_REG_1;
+    insns[1].src_reg = BPF_PSEUDO_MAP_FD;
+    insns[1].imm = _map_fd;
+    // r3 = XDP_PASS
+    insns[3].code = BPF_ALU64 | BPF_MOV | BPF_K;
+    insns[3].dst_reg = BPF_REG_3;
+    insns[3].imm = XDP_PASS;
+    insns[4].code = BPF_JMP | BPF_CALL;
+    insns[4].imm = BPF_FUNC_redirect_map;
+    insns[5].code = BPF_JMP | BPF_EXIT;
+
+    static const char license[] = "GPL";
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uintptr_t) insns;
+    attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+    attr.license = (uintptr_t) license;
+    _prog_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+    if (_prog_fd < 0)
+	return errh->error("%s: cannot load XDP program: %s", dev, strerror(errno));
+
+    // Native mode first, unless asked for generic mode
+    uint32_t modes[2] = { XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE };
+    int first = _mode == MODE_GENERIC ? 1 : 0;
+    int last = _mode == MODE_ZEROCOPY ? 0 : 1;
+    for (int m = first; m <= last && _link_fd < 0; m++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = _prog_fd;
+	attr.link_create.target_ifindex = ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	attr.link_create.flags = modes[m];
+	_link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+    }
+    if (_link_fd < 0)
+	return errh->error("%s: cannot attach XDP program: %s", dev, strerror(errno));
+    return 0;
+}
+
+int
+XDPDevice::enable_rx(int i, ErrorHandler *errh)
+{
+    Queue *q = queue(i, errh);
+    if (!q)
+	return -1;
+    if (q->rx_enabled)
+	return 0;
+    if (_prog_fd < 0 && attach_program(errh) < 0)
+	return -1;
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = _map_fd;
+    attr.key = (uintptr_t) &q->index;
+    attr.value = (uintptr_t) &q->fd;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+	return errh->error("%s: cannot register queue %d: %s", ifname.c_str(), i, strerror(errno));
+    // Leave the other half of the frames for transmission
+    uint32_t n = q->fill.size;
+    if (n > (uint32_t) q->frames.size() / 2)
+	n = q->frames.size() / 2;
+    for (uint32_t j = 0; j < n; j++) {
+	q->fill.addr(q->fill.cached + j) = q->frames.back();
+	q->frames.pop_back();
+    }
+    q->fill.submit(n);
+    q->rx_enabled = true;
+    return 0;
+}
+
+int
+XDPDevice::set_promiscuous(ErrorHandler *errh)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname.c_str(), sizeof(ifr.ifr_name) - 1);
+    int r = ioctl(fd, SIOCGIFFLAGS, &ifr);
+    if (r == 0 && !(ifr.ifr_flags & IFF_PROMISC)) {
+	ifr.ifr_flags |= IFF_PROMISC;
+	r = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    ::close(fd);
+    if (r < 0)
+	return errh->error("%s: cannot set promiscuous mode: %s", ifname.c_str(), strerror(errno));
+    return 0;
+}
+
+void
+XDPDevice::frame_destructor(unsigned char *buf, size_t, void *arg)
+{
+    Queue *q = static_cast<Queue *>(arg);
+    q->free_frame((buf - q->umem) & ~(uint64_t) (FRAME_SIZE - 1));
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel xdp)
+ELEMENT_PROVIDES(XDPDevice)
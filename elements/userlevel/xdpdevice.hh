@@ -0,0 +1,237 @@
+// -*- c-basic-offset: 4; related-file-name: "xdpdevice.cc" -*-
+#ifndef CLICK_XDPDEVICE_HH
+#define CLICK_XDPDEVICE_HH
+#include <click/error.hh>
+#include <click/string.hh>
+#include <click/vector.hh>
+#include <click/sync.hh>
+#include <click/packet.hh>
+#include <linux/if_xdp.h>
+#include <sys/socket.h>
+CLICK_DECLS
+
+/*
+ * XDPDevice
+ *
+ * AF_XDP sockets of a network interface, shared by the FromXDPDevice and
+ * ToXDPDevice elements using it. Each hardware queue used gets one socket
+ * with its own UMEM, the memory area holding packet buffers, shared between
+ * reception and transmission. Received packets are Click packets pointing
+ * into the UMEM; their frame goes back to the queue when they are killed.
+ * Packets sent through ToXDPDevice are copied into a free frame, unless they
+ * were received on the same queue, in which case their frame is sent as is.
+ *
+ * Reception needs an XDP program redirecting packets to the sockets. The
+ * device loads a minimal one, using an XSKMAP indexed by queue number, and
+ * attaches it with a BPF link, which the kernel detaches when Click exits.
+ * Packets of queues without socket go to the kernel stack as usual.
+ */
+
+class XDPDevice { public:
+
+    enum Mode { MODE_AUTO, MODE_ZEROCOPY, MODE_COPY, MODE_GENERIC };
+    enum { FRAME_SIZE = 2048 };
+
+    /* A ring shared with the kernel. "cached" is our own index, the
+     * producer index of fill and TX rings, the consumer index of RX and
+     * completion rings. */
+    struct Ring {
+	uint32_t *producer;
+	uint32_t *consumer;
+	uint32_t *flags;
+	void *ring;
+	uint32_t mask;
+	uint32_t size;
+	uint32_t cached;
+	void *map;
+	size_t map_size;
+
+	Ring() : map(0), map_size(0) {
+	}
+
+	uint64_t &addr(uint32_t i) const {
+	    return static_cast<uint64_t *>(ring)[i & mask];
+	}
+	struct xdp_desc &desc(uint32_t i) const {
+	    return static_cast<struct xdp_desc *>(ring)[i & mask];
+	}
+
+	// Consumer side: RX and completion rings
+	uint32_t available(uint32_t max) const {
+	    uint32_t n = __atomic_load_n(producer, __ATOMIC_ACQUIRE) - cached;
+	    return n < max ? n : max;
+	}
+	void release(uint32_t n) {
+	    cached += n;
+	    __atomic_store_n(consumer, cached, __ATOMIC_RELEASE);
+	}
+
+	// Producer side: fill and TX rings
+	uint32_t free(uint32_t max) const {
+	    uint32_t n = size - (cached - __atomic_load_n(consumer, __ATOMIC_ACQUIRE));
+	    return n < max ? n : max;
+	}
+	void submit(uint32_t n) {
+	    cached += n;
+	    __atomic_store_n(producer, cached, __ATOMIC_RELEASE);
+	}
+
+	bool need_wakeup() const {
+	    return *flags & XDP_RING_NEED_WAKEUP;
+	}
+    };
+
+    struct Queue {
+	XDPDevice *device;
+	int index;
+	int fd;
+	unsigned char *umem;
+	size_t umem_size;
+	Ring fill;
+	Ring comp;
+	Ring rx;
+	Ring tx;
+	bool zerocopy;
+	bool need_wakeup;
+	bool rx_enabled;
+	// Free frames. Packets are killed by any thread, so it is locked.
+	SimpleSpinlock lock;
+	Vector<uint64_t> frames;
+
+	Queue() : fd(-1), umem(0), umem_size(0), zerocopy(false),
+		  need_wakeup(false), rx_enabled(false) {
+	}
+
+	inline WritablePacket *make_packet(const struct xdp_desc &desc);
+	inline void refill();
+	inline void reclaim();
+	inline void kick_rx();
+	inline void kick_tx();
+
+	void free_frame(uint64_t addr) {
+	    lock.acquire();
+	    frames.push_back(addr);
+	    lock.release();
+	}
+	// Steal the frame of packet p, received on this queue, if nothing
+	// else references it, and return its address in the UMEM
+	inline bool steal_frame(Packet *p, uint64_t &addr);
+    };
+
+    /** @brief Return the device of interface @a ifname, opening it if
+     * needed. Every open() must be matched by a close(). */
+    static XDPDevice *open(const String &ifname, ErrorHandler *errh);
+    void close();
+
+    /** @brief Set the ring size and mode used to create sockets. Elements
+     * must agree on them. */
+    int set_parameters(unsigned ndesc, Mode mode, ErrorHandler *errh);
+    static bool parse_mode(const String &str, Mode &mode);
+
+    /** @brief Return queue @a i, creating its socket if needed. */
+    Queue *queue(int i, ErrorHandler *errh);
+
+    /** @brief Start receiving on queue @a i. */
+    int enable_rx(int i, ErrorHandler *errh);
+
+    /** @brief Put the interface in promiscuous mode. */
+    int set_promiscuous(ErrorHandler *errh);
+
+    static void frame_destructor(unsigned char *buf, size_t, void *arg);
+
+    String ifname;
+    int ifindex;
+    int n_queues;
+
+  private:
+
+    int _refcount;
+    unsigned _ndesc;
+    Mode _mode;
+    bool _configured;
+    Vector<Queue *> _queues;
+    int _map_fd;
+    int _prog_fd;
+    int _link_fd;
+
+    static Vector<XDPDevice *> devices;
+
+    XDPDevice(const String &ifname, int ifindex, int n_queues);
+    ~XDPDevice();
+
+    int create_socket(Queue *q, ErrorHandler *errh);
+    int map_ring(Queue *q, Ring &r, int fd, const struct xdp_ring_offset &off,
+		 uint64_t pgoff, size_t entry_size, ErrorHandler *errh);
+    int bind_socket(Queue *q, uint16_t flags);
+    int attach_program(ErrorHandler *errh);
+    void destroy_queue(Queue *q, bool in_use);
+
+};
+
+inline WritablePacket *
+XDPDevice::Queue::make_packet(const struct xdp_desc &desc)
+{
+    unsigned char *data = umem + desc.addr;
+    unsigned headroom = desc.addr & (FRAME_SIZE - 1);
+    WritablePacket *p = Packet::make(data, desc.len, frame_destructor, this,
+				     headroom, FRAME_SIZE - headroom - desc.len);
+    return p;
+}
+
+inline void
+XDPDevice::Queue::refill()
+{
+    uint32_t n = fill.free(fill.size);
+    if (!n)
+	return;
+    lock.acquire();
+    if (n > (uint32_t) frames.size())
+	n = frames.size();
+    for (uint32_t i = 0; i < n; i++) {
+	fill.addr(fill.cached + i) = frames.back();
+	frames.pop_back();
+    }
+    lock.release();
+    fill.submit(n);
+}
+
+inline void
+XDPDevice::Queue::reclaim()
+{
+    uint32_t n = comp.available(comp.size);
+    if (!n)
+	return;
+    lock.acquire();
+    for (uint32_t i = 0; i < n; i++)
+	frames.push_back(comp.addr(comp.cached + i) & ~(uint64_t) (FRAME_SIZE - 1));
+    lock.release();
+    comp.release(n);
+}
+
+inline void
+XDPDevice::Queue::kick_rx()
+{
+    if (need_wakeup && fill.need_wakeup())
+	recvfrom(fd, 0, 0, MSG_DONTWAIT, 0, 0);
+}
+
+inline void
+XDPDevice::Queue::kick_tx()
+{
+    if (!need_wakeup || tx.need_wakeup())
+	sendto(fd, 0, 0, MSG_DONTWAIT, 0, 0);
+}
+
+inline bool
+XDPDevice::Queue::steal_frame(Packet *p, uint64_t &addr)
+{
+    if (p->buffer_destructor() != frame_destructor
+	|| p->destructor_argument() != this || p->shared())
+	return false;
+    addr = p->data() - umem;
+    p->set_buffer_destructor(Packet::empty_destructor);
+    return true;
+}
+
+CLICK_ENDDECLS
+#endif
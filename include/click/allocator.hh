@@ -151,7 +151,11 @@ class pool_allocator_mt : pool_allocator_mt_base { public:
 #if CLICK_DEBUG_ALLOCATOR
                     click_chatter("Global pool is full, freeing item");
 #endif
-                    click_chatter("Extremly inefficient pool_allocator_mt for %s ! Change parameters !",typeid(T).name());
+                    static bool warned = false;
+                    if (!warned) {
+                        warned = true;
+                        click_chatter("Extremly inefficient pool_allocator_mt for %s ! Change parameters !",typeid(T).name());
+                    }
                 }
                 p.count --;
             } else {
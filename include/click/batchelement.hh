@@ -79,6 +79,35 @@ class BatchElement : public Element { public:
         output(port).push_batch(batch);
     }
 
+    /**
+     * Push an array of packets. The default implementation converts it to a
+     *  PacketBatch and calls push_batch(). Elements handling arrays natively
+     *  override it and set receives_array in their constructor. The array
+     *  must be empty on return.
+     */
+    virtual void push_array(int port, PacketArray& array) {
+        PacketBatch* batch = array.to_batch();
+        if (batch)
+            push_batch(port, batch);
+    }
+
+    /**
+     * Push an array of packets to an output : as is if the element
+     *  downstream handles arrays, as a PacketBatch otherwise. The array is
+     *  empty on return.
+     */
+    inline void
+    output_push_array(int port, PacketArray& array) {
+        const Port& o = output(port);
+        if (o.element()->receives_array) {
+            static_cast<BatchElement*>(o.element())->push_array(o.port(), array);
+        } else {
+            PacketBatch* batch = array.to_batch();
+            if (batch)
+                o.push_batch(batch);
+        }
+    }
+
     inline void
     output_push(int port, Packet* p) {
         if (in_batch_mode == BATCH_MODE_YES) {
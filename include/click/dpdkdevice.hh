@@ -73,7 +73,8 @@ public:
             vendor_id(PCI_ANY_ID), vendor_name(), device_id(PCI_ANY_ID), driver(0),
             rx_queues(0,false), tx_queues(0,false), promisc(false), n_rx_descs(0),
             n_tx_descs(0),
-            init_mac(), init_mtu(0), init_fc_mode(FC_UNSET) {
+            init_mac(), init_mtu(0), init_fc_mode(FC_UNSET),
+            multi_segment(false) {
             rx_queues.reserve(128);
             tx_queues.reserve(128);
         }
@@ -103,6 +104,7 @@ public:
         EtherAddress init_mac;
         uint16_t init_mtu;
         FlowControlMode init_fc_mode;
+        bool multi_segment;
     };
 
     int add_rx_queue(
@@ -119,6 +121,7 @@ public:
     void set_init_mac(EtherAddress mac);
     void set_init_mtu(uint16_t mtu);
     void set_init_fc_mode(FlowControlMode fc);
+    void set_multi_segment();
 
     unsigned int get_nb_txdesc();
 
@@ -165,6 +168,7 @@ public:
 
     inline static rte_mbuf* get_pkt(unsigned numa_node);
     inline static rte_mbuf* get_pkt();
+    inline static int get_pkts(unsigned numa_node, struct rte_mbuf **mbufs, unsigned n);
     inline static struct rte_mbuf* get_mbuf(Packet* p, bool create, int node);
 
     static void free_pkt(unsigned char *, size_t, void *pktmbuf);
@@ -322,6 +326,7 @@ template<> struct DefaultArg<FlowControlMode> : public FlowControlModeArg {};
  *     and copy its content.
  *     If compiled with CLICK_PACKET_USE_DPDK, it will simply return the packet
  *     casted as it's already a DPDK buffer.
+ *     The segments of a segmented packet are turned into a chain of mbufs.
  */
 inline struct rte_mbuf* DPDKDevice::get_mbuf(Packet* p, bool create, int node) {
     struct rte_mbuf* mbuf;
@@ -357,6 +362,29 @@ inline struct rte_mbuf* DPDKDevice::get_mbuf(Packet* p, bool create, int node) {
         } else
             return NULL;
     }
+    if (unlikely(p->next_segment())) {
+        // The following segments are chained after this mbuf. If clones
+        // still hold it, chain them after a private indirect mbuf instead,
+        // so that the clones' mbuf keeps its own length and chain.
+        if (rte_mbuf_refcnt_read(mbuf) > 1) {
+            struct rte_mbuf *mi = DPDKDevice::get_pkt(node);
+            if (!mi) {
+                rte_pktmbuf_free(mbuf);
+                return NULL;
+            }
+            rte_pktmbuf_attach(mi, mbuf);
+            rte_pktmbuf_free(mbuf); // mi holds the reference now
+            mbuf = mi;
+        }
+        struct rte_mbuf *rest = get_mbuf(p->next_segment(), create, node);
+        if (!rest) {
+            rte_pktmbuf_free(mbuf);
+            return NULL;
+        }
+        mbuf->next = rest;
+        mbuf->nb_segs = rest->nb_segs + 1;
+        rte_pktmbuf_pkt_len(mbuf) += rte_pktmbuf_pkt_len(rest);
+    }
     #endif
     return mbuf;
 }
@@ -377,6 +405,29 @@ inline rte_mbuf* DPDKDevice::get_pkt() {
     return get_pkt(rte_socket_id());
 }
 
+/**
+ * Allocate @a n mbufs at once from the pool of @a numa_node. Either all of
+ *     them are allocated, and 0 is returned, or none is and a negative value
+ *     is returned.
+ */
+inline int DPDKDevice::get_pkts(unsigned numa_node, struct rte_mbuf **mbufs, unsigned n) {
+    struct rte_mempool *mp = get_mpool(numa_node);
+    if (unlikely(!mp))
+        return -1;
+#if RTE_VERSION >= RTE_VERSION_NUM(16,04,0,0)
+    return rte_pktmbuf_alloc_bulk(mp, mbufs, n);
+#else
+    for (unsigned i = 0; i < n; i++) {
+        if (unlikely(!(mbufs[i] = rte_pktmbuf_alloc(mp)))) {
+            while (i > 0)
+                rte_pktmbuf_free(mbufs[--i]);
+            return -1;
+        }
+    }
+    return 0;
+#endif
+}
+
 int DPDKDevice::nbRXQueues() {
     return info.rx_queues.size();
 };
@@ -307,6 +307,7 @@ class Element { public:
   protected:
     enum batch_mode in_batch_mode;
     bool receives_batch;
+    bool receives_array;	// push_array() is implemented natively
 
   private:
 
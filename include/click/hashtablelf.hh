@@ -0,0 +1,565 @@
+#ifndef CLICK_HASHTABLELF_HH
+#define CLICK_HASHTABLELF_HH
+#include <click/glue.hh>
+#include <click/hashcode.hh>
+#include <click/machine.hh>
+#include <click/sync.hh>
+#include <click/integers.hh>
+#if CLICK_USERLEVEL && defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+CLICK_DECLS
+
+/** @class HashTableLF
+  @brief Concurrent hash table with lock-free readers.
+
+  K is the type of the key and V the type of the value. Both must be plain
+  data that can be copied byte by byte and compared while being overwritten,
+  like integers, pointers, IPFlowID or small structures of those: readers
+  copy them optimistically and discard what they read if it changed.
+
+  Entries are stored in place in an open-addressing table of buckets of 8
+  slots, probed linearly bucket by bucket. A bucket holds a 16-byte header
+  then 8 keys and 8 values; it is aligned on and padded to whole cache lines,
+  so its version, counters and tags always share its first line, the one
+  find_bulk() prefetches. Each slot has a one-byte tag taken from the hash,
+  and the 8 tags of a bucket are matched at once (with SSE2 when available),
+  so a lookup usually touches a single key and value besides the tags. Each
+  bucket also counts the entries that overflowed past it, so a lookup for a
+  missing key stops at the first bucket that never overflowed.
+
+  Readers never write shared memory: every bucket is protected by a sequence
+  counter, that writers make odd while they modify the bucket. A reader
+  retries a bucket if its counter was odd or changed during the read.
+  Writers are serialized by a spinlock; the table targets lookup-heavy
+  workloads like per-packet flow lookups.
+
+  The table doubles when it is 7/8 full. The new table is filled by the
+  writer then published, readers still working on the old table finish
+  their lookup there. As readers do not announce themselves, old tables
+  are only freed when the HashTableLF is destroyed, which costs at most
+  the size of the current table.
+
+  find_bulk() looks up a batch of keys, computing all hashes and
+  prefetching all buckets before the lookups.
+*/
+template <typename K, typename V>
+class HashTableLF { public:
+
+    typedef size_t size_type;
+
+    enum { slots_per_bucket = 8, initial_capacity = 64 };
+
+    /** @brief Construct an empty HashTableLF. */
+    HashTableLF();
+
+    /** @brief Construct an empty HashTableLF holding at least @a n
+     * elements before its first resize. */
+    explicit HashTableLF(size_type n);
+
+    /** @brief Destroy the HashTableLF. */
+    ~HashTableLF();
+
+    /** @brief Return the number of elements stored. */
+    size_type size() const {
+        return _size;
+    }
+
+    /** @brief Return true iff size() == 0. */
+    bool empty() const {
+        return _size == 0;
+    }
+
+    /** @brief Return the number of elements the table can hold before it
+     * is resized. */
+    size_type capacity() const {
+        Table *t = _table;
+        return t->limit;
+    }
+
+    /** @brief Test if an element with key @a key exists in the table. */
+    inline bool contains(const K &key) const {
+        V v;
+        return find(key, v);
+    }
+
+    /** @brief Copy the value for @a key in @a value if found.
+     * @return true iff @a key was found.
+     *
+     * Lock-free, never writes shared memory. */
+    inline bool find(const K &key, V &value) const;
+
+    /** @brief Look up @a n keys at once.
+     * @param keys keys to look up
+     * @param n number of keys
+     * @param values values of the keys found
+     * @param found found[i] is set to whether keys[i] was found
+     * @return the number of keys found */
+    int find_bulk(const K *keys, int n, V *values, bool *found) const;
+
+    /** @brief Insert @a key with @a value if @a key is not present.
+     * @return true iff the element was inserted. */
+    bool insert(const K &key, const V &value);
+
+    /** @brief Return the value for @a key, inserting @a value first if
+     * @a key is not present. */
+    V find_insert(const K &key, const V &value);
+
+    /** @brief Set the value for @a key to @a value, inserting it if
+     * needed. */
+    void set(const K &key, const V &value);
+
+    /** @brief Remove @a key from the table.
+     * @return true iff @a key was present. */
+    bool erase(const K &key) {
+        V v;
+        return find_remove(key, v);
+    }
+
+    /** @brief Copy the value for @a key in @a value and remove it.
+     * @return true iff @a key was present. */
+    bool find_remove(const K &key, V &value);
+
+    /** @brief Call @a f(key, value) for every element, under the writer
+     * lock. @a f may modify the value, and returns false to remove the
+     * element. */
+    template <typename F> void for_each(F f);
+
+    /** @brief Remove all elements. */
+    void clear();
+
+    /** @brief Resize the table to hold at least @a n elements. Never
+     * shrinks. */
+    void rehash(size_type n);
+
+  private:
+
+    struct Bucket {
+        volatile uint32_t version CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+        uint16_t overflow;
+        uint16_t count;
+        union {
+            uint8_t tags[slots_per_bucket];
+            uint64_t tagword;
+        };
+        K keys[slots_per_bucket];
+        V values[slots_per_bucket];
+    };
+
+    struct Table {
+        Bucket *buckets;
+        size_type nbuckets;
+        size_type mask;
+        size_type limit;
+        int shift;
+        void *alloc;
+        size_t alloc_size;
+        Table *retired;
+    };
+
+    Table * volatile _table;
+    size_type _size;
+    SimpleSpinlock _lock;
+
+    HashTableLF(const HashTableLF<K, V> &);
+    HashTableLF<K, V> &operator=(const HashTableLF<K, V> &);
+
+    static inline uint64_t hash(const K &key) {
+        return (uint64_t) hashcode(key) * 0x9E3779B97F4A7C15ULL;
+    }
+    static inline size_type home(const Table *t, uint64_t h) {
+        return (size_type) (h >> t->shift) & t->mask;
+    }
+    static inline uint8_t tag(uint64_t h) {
+        return (uint8_t) (h >> 32) | 0x80;
+    }
+    static inline unsigned match(const Bucket &b, uint8_t tag);
+
+    static inline void write_begin(Bucket &b) {
+        b.version = b.version + 1;
+        click_write_fence();
+    }
+    static inline void write_end(Bucket &b) {
+        click_write_fence();
+        b.version = b.version + 1;
+    }
+
+    static Table *allocate(size_type n);
+    static void deallocate(Table *t);
+    inline bool find(const Table *t, const K &key, uint64_t h, V &value) const;
+    int locate(const Table *t, const K &key, uint64_t h) const;
+    void insert_new(Table *t, const K &key, const V &value, uint64_t h, bool publish);
+    void remove_slot(Table *t, int slot, uint64_t h);
+    void grow(size_type n);
+
+};
+
+template <typename K, typename V>
+HashTableLF<K, V>::HashTableLF()
+    : _table(allocate(initial_capacity)), _size(0)
+{
+}
+
+template <typename K, typename V>
+HashTableLF<K, V>::HashTableLF(size_type n)
+    : _table(allocate(n < initial_capacity ? initial_capacity : n)), _size(0)
+{
+}
+
+template <typename K, typename V>
+HashTableLF<K, V>::~HashTableLF()
+{
+    Table *t = _table;
+    while (t) {
+        Table *next = t->retired;
+        deallocate(t);
+        t = next;
+    }
+}
+
+/** @brief Allocate a table with room for @a n elements under the maximal
+ * load factor. The number of buckets is a power of two. */
+template <typename K, typename V>
+typename HashTableLF<K, V>::Table *
+HashTableLF<K, V>::allocate(size_type n)
+{
+    size_type nbuckets = 1;
+    int shift = 64;
+    while (nbuckets * slots_per_bucket * 7 / 8 < n) {
+        nbuckets <<= 1;
+        shift--;
+    }
+    Table *t = new Table;
+    t->nbuckets = nbuckets;
+    t->mask = nbuckets - 1;
+    t->limit = nbuckets * slots_per_bucket * 7 / 8;
+    t->shift = shift == 64 ? 63 : shift;
+    t->alloc_size = sizeof(Bucket) * nbuckets + CLICK_CACHE_LINE_SIZE;
+    t->alloc = CLICK_LALLOC(t->alloc_size);
+    t->buckets = (Bucket *) (((uintptr_t) t->alloc + CLICK_CACHE_LINE_SIZE - 1)
+                             & ~(uintptr_t) (CLICK_CACHE_LINE_SIZE - 1));
+    memset((void *) t->buckets, 0, sizeof(Bucket) * nbuckets);
+    t->retired = 0;
+    return t;
+}
+
+template <typename K, typename V>
+void
+HashTableLF<K, V>::deallocate(Table *t)
+{
+    CLICK_LFREE(t->alloc, t->alloc_size);
+    delete t;
+}
+
+/** @brief Return a bitmask of the slots of @a b whose tag is @a tag. */
+template <typename K, typename V>
+inline unsigned
+HashTableLF<K, V>::match(const Bucket &b, uint8_t tag)
+{
+#if CLICK_USERLEVEL && defined(__SSE2__)
+    __m128i tags = _mm_loadl_epi64((const __m128i *) b.tags);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag))) & 0xFF;
+#else
+    const uint64_t ones = 0x0101010101010101ULL;
+    uint64_t x = b.tagword ^ (ones * tag);
+    // High bit of each zero byte of x, a few false positives are fine
+    uint64_t z = (x - ones) & ~x & (ones << 7);
+    unsigned m = 0;
+    for (int i = 0; z; i++, z >>= 8)
+        if (z & 0x80)
+            m |= 1 << i;
+    return m;
+#endif
+}
+
+template <typename K, typename V>
+inline bool
+HashTableLF<K, V>::find(const Table *t, const K &key, uint64_t h, V &value) const
+{
+    uint8_t tg = tag(h);
+    size_type b = home(t, h);
+    for (size_type probe = 0; probe <= t->mask; probe++, b = (b + 1) & t->mask) {
+        const Bucket &bk = t->buckets[b];
+        uint32_t v;
+        bool found;
+        uint16_t overflow;
+        do {
+            while ((v = bk.version) & 1)
+                click_relax_fence();
+            click_read_fence();
+            found = false;
+            for (unsigned m = match(bk, tg); m; m &= m - 1) {
+                int i = ffs_lsb(m) - 1;
+                if (bk.keys[i] == key) {
+                    value = bk.values[i];
+                    found = true;
+                    break;
+                }
+            }
+            overflow = bk.overflow;
+            click_read_fence();
+        } while (unlikely(bk.version != v));
+        if (found)
+            return true;
+        if (overflow == 0)
+            return false;
+    }
+    return false;
+}
+
+template <typename K, typename V>
+inline bool
+HashTableLF<K, V>::find(const K &key, V &value) const
+{
+    return find(_table, key, hash(key), value);
+}
+
+template <typename K, typename V>
+int
+HashTableLF<K, V>::find_bulk(const K *keys, int n, V *values, bool *found) const
+{
+    enum { bulk = 32 };
+    uint64_t h[bulk];
+    int nfound = 0;
+    const Table *t = _table;
+    for (int base = 0; base < n; base += bulk) {
+        int m = n - base < bulk ? n - base : bulk;
+        for (int i = 0; i < m; i++) {
+            h[i] = hash(keys[base + i]);
+            click_prefetch0(&t->buckets[home(t, h[i])]);
+        }
+        for (int i = 0; i < m; i++) {
+            found[base + i] = find(t, keys[base + i], h[i], values[base + i]);
+            nfound += found[base + i];
+        }
+    }
+    return nfound;
+}
+
+/** @brief Return the slot of @a key as bucket * slots_per_bucket + index,
+ * or -1. The writer lock must be held. */
+template <typename K, typename V>
+int
+HashTableLF<K, V>::locate(const Table *t, const K &key, uint64_t h) const
+{
+    uint8_t tg = tag(h);
+    size_type b = home(t, h);
+    for (size_type probe = 0; probe <= t->mask; probe++, b = (b + 1) & t->mask) {
+        const Bucket &bk = t->buckets[b];
+        for (unsigned m = match(bk, tg); m; m &= m - 1) {
+            int i = ffs_lsb(m) - 1;
+            if (bk.keys[i] == key)
+                return b * slots_per_bucket + i;
+        }
+        if (bk.overflow == 0)
+            break;
+    }
+    return -1;
+}
+
+/** @brief Insert @a key, known to be absent, in @a t. The writer lock must
+ * be held and @a t must have room. If @a publish is false, @a t is not
+ * visible to readers yet and versions are left alone. */
+template <typename K, typename V>
+void
+HashTableLF<K, V>::insert_new(Table *t, const K &key, const V &value, uint64_t h, bool publish)
+{
+    size_type b = home(t, h);
+    size_type first = b;
+    while (t->buckets[b].count == slots_per_bucket)
+        b = (b + 1) & t->mask;
+    Bucket &bk = t->buckets[b];
+    int i = 0;
+    while (bk.tags[i])
+        i++;
+    if (publish)
+        write_begin(bk);
+    bk.keys[i] = key;
+    bk.values[i] = value;
+    bk.tags[i] = tag(h);
+    bk.count++;
+    if (publish)
+        write_end(bk);
+    for (size_type p = first; p != b; p = (p + 1) & t->mask) {
+        if (publish)
+            write_begin(t->buckets[p]);
+        t->buckets[p].overflow++;
+        if (publish)
+            write_end(t->buckets[p]);
+    }
+}
+
+/** @brief Remove the element in @a slot of @a t, whose hash is @a h. The
+ * writer lock must be held. */
+template <typename K, typename V>
+void
+HashTableLF<K, V>::remove_slot(Table *t, int slot, uint64_t h)
+{
+    size_type b = slot / slots_per_bucket;
+    Bucket &bk = t->buckets[b];
+    write_begin(bk);
+    bk.tags[slot % slots_per_bucket] = 0;
+    bk.count--;
+    write_end(bk);
+    for (size_type p = home(t, h); p != b; p = (p + 1) & t->mask) {
+        write_begin(t->buckets[p]);
+        t->buckets[p].overflow--;
+        write_end(t->buckets[p]);
+    }
+    _size--;
+}
+
+/** @brief Replace the table by a table holding at least @a n elements.
+ * The writer lock must be held. */
+template <typename K, typename V>
+void
+HashTableLF<K, V>::grow(size_type n)
+{
+    Table *old = _table;
+    Table *t = allocate(n);
+    for (size_type b = 0; b < old->nbuckets; b++) {
+        Bucket &bk = old->buckets[b];
+        for (int i = 0; i < slots_per_bucket; i++)
+            if (bk.tags[i])
+                insert_new(t, bk.keys[i], bk.values[i], hash(bk.keys[i]), false);
+    }
+    t->retired = old;
+    click_write_fence();
+    _table = t;
+}
+
+template <typename K, typename V>
+bool
+HashTableLF<K, V>::insert(const K &key, const V &value)
+{
+    uint64_t h = hash(key);
+    _lock.acquire();
+    bool inserted = locate(_table, key, h) < 0;
+    if (inserted) {
+        if (_size >= _table->limit)
+            grow(_table->limit * 2);
+        insert_new(_table, key, value, h, true);
+        _size++;
+    }
+    _lock.release();
+    return inserted;
+}
+
+template <typename K, typename V>
+V
+HashTableLF<K, V>::find_insert(const K &key, const V &value)
+{
+    uint64_t h = hash(key);
+    V v;
+    if (find(_table, key, h, v))
+        return v;
+    _lock.acquire();
+    int slot = locate(_table, key, h);
+    if (slot >= 0)
+        v = _table->buckets[slot / slots_per_bucket].values[slot % slots_per_bucket];
+    else {
+        if (_size >= _table->limit)
+            grow(_table->limit * 2);
+        insert_new(_table, key, value, h, true);
+        _size++;
+        v = value;
+    }
+    _lock.release();
+    return v;
+}
+
+template <typename K, typename V>
+void
+HashTableLF<K, V>::set(const K &key, const V &value)
+{
+    uint64_t h = hash(key);
+    _lock.acquire();
+    Table *t = _table;
+    int slot = locate(t, key, h);
+    if (slot >= 0) {
+        Bucket &bk = t->buckets[slot / slots_per_bucket];
+        write_begin(bk);
+        bk.values[slot % slots_per_bucket] = value;
+        write_end(bk);
+    } else {
+        if (_size >= t->limit)
+            grow(t->limit * 2);
+        insert_new(_table, key, value, h, true);
+        _size++;
+    }
+    _lock.release();
+}
+
+template <typename K, typename V>
+bool
+HashTableLF<K, V>::find_remove(const K &key, V &value)
+{
+    uint64_t h = hash(key);
+    _lock.acquire();
+    Table *t = _table;
+    int slot = locate(t, key, h);
+    if (slot >= 0) {
+        value = t->buckets[slot / slots_per_bucket].values[slot % slots_per_bucket];
+        remove_slot(t, slot, h);
+    }
+    _lock.release();
+    return slot >= 0;
+}
+
+template <typename K, typename V> template <typename F>
+void
+HashTableLF<K, V>::for_each(F f)
+{
+    _lock.acquire();
+    Table *t = _table;
+    for (size_type b = 0; b < t->nbuckets; b++) {
+        Bucket &bk = t->buckets[b];
+        for (int i = 0; i < slots_per_bucket; i++) {
+            if (!bk.tags[i])
+                continue;
+            K key = bk.keys[i];
+            V value = bk.values[i];
+            if (!f(key, value))
+                remove_slot(t, b * slots_per_bucket + i, hash(key));
+            else {
+                write_begin(bk);
+                bk.values[i] = value;
+                write_end(bk);
+            }
+        }
+    }
+    _lock.release();
+}
+
+template <typename K, typename V>
+void
+HashTableLF<K, V>::clear()
+{
+    _lock.acquire();
+    Table *t = _table;
+    for (size_type b = 0; b < t->nbuckets; b++) {
+        Bucket &bk = t->buckets[b];
+        if (!bk.count && !bk.overflow)
+            continue;
+        write_begin(bk);
+        bk.tagword = 0;
+        bk.count = 0;
+        bk.overflow = 0;
+        write_end(bk);
+    }
+    _size = 0;
+    _lock.release();
+}
+
+template <typename K, typename V>
+void
+HashTableLF<K, V>::rehash(size_type n)
+{
+    _lock.acquire();
+    if (n > _table->limit)
+        grow(n);
+    _lock.release();
+}
+
+CLICK_ENDDECLS
+#endif
@@ -658,6 +658,38 @@ inline void HashContainerMP<K,V,Item>::clear()
 }
 
 
+template <typename K, typename V, typename Item>
+void HashContainerMP<K,V,Item>::rehash(size_type n)
+{
+    size_type new_nbuckets = 1;
+    while (new_nbuckets < n && new_nbuckets < max_bucket_count)
+        new_nbuckets = ((new_nbuckets + 1) << 1) - 1;
+    if (likely(_mt))
+        _table.write_begin();
+    if (new_nbuckets != _table->_nbuckets) {
+        size_type old_nbuckets = _table->_nbuckets;
+        Bucket *old_buckets = _table->buckets;
+        _table->_nbuckets = new_nbuckets;
+        _table->buckets = (Bucket *) CLICK_LALLOC(sizeof(Bucket) * new_nbuckets);
+        for (size_type b = 0; b < new_nbuckets; ++b)
+            new(&_table->buckets[b]) Bucket();
+        for (size_type b = 0; b < old_nbuckets; ++b) {
+            ListItem *item = old_buckets[b].list->head;
+            while (item) {
+                ListItem *next = item->_hashnext;
+                ListItemPtr &list = *_table->buckets[bucket(item->key)].list;
+                item->_hashnext = list.head;
+                list.head = item;
+                item = next;
+            }
+            old_buckets[b].~Bucket();
+        }
+        CLICK_LFREE(old_buckets, sizeof(Bucket) * old_nbuckets);
+    }
+    if (likely(_mt))
+        _table.write_end();
+}
+
 template <typename K, typename V, typename Item>
 inline bool HashContainerMP<K,V,Item>::contains(const K& key)
 {
@@ -780,13 +812,19 @@ void HashContainerMP<K,V,Item>::rehash(size_type n)
 
 template <typename K, typename V>
 class HashTableMP : public HashContainerMP<K,V,shared<V> > { public:
+    HashTableMP() {
+    }
+    explicit HashTableMP(size_t n) : HashContainerMP<K,V,shared<V> >(n) {
+    }
 };
 
 
 template <typename K, typename V>
-class RWHashTableMP : public HashContainerMP<K,V,rwlock<V> > {
-
-
+class RWHashTableMP : public HashContainerMP<K,V,rwlock<V> > { public:
+    RWHashTableMP() {
+    }
+    explicit RWHashTableMP(size_t n) : HashContainerMP<K,V,rwlock<V> >(n) {
+    }
 };
 
 CLICK_ENDDECLS
@@ -37,6 +37,20 @@ click_relax_fence()
 #endif
 }
 
+/** @brief Prefetch the cache line containing @a p for reading.
+
+    Prefetching is only a hint: it never faults, so @a p does not need to
+    point to valid memory. */
+inline void
+click_prefetch0(const void *p)
+{
+#if CLICK_LINUXMODULE
+    prefetch(p);
+#else
+    __builtin_prefetch(p, 0, 3);
+#endif
+}
+
 /** @brief Full memory fence. */
 inline void
 click_fence()
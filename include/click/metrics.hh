@@ -0,0 +1,224 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_METRICS_HH
+#define CLICK_METRICS_HH
+#include <click/string.hh>
+#include <click/vector.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+class Element;
+class MetricRegistry;
+
+/** @file <click/metrics.hh>
+ * @brief Numeric metrics published by elements.
+ *
+ * Elements publish their counters, gauges and histograms by registering
+ * pointers to them in a MetricRegistry. Reading a metric loads the
+ * registered values, summing per-thread copies, without calling handlers or
+ * taking the locks of the data path. The values of a snapshot are read one
+ * by one while packets flow, so related metrics, like the packet and byte
+ * counts of a Counter, may be off by a few packets from each other.
+ */
+
+/** @class MetricSource
+ * @brief Interface of elements that publish metrics.
+ *
+ * An element publishes metrics by deriving from MetricSource and returning
+ * itself from cast("MetricSource"). MetricsExporter calls add_metrics() once
+ * the router is initialized. The registered values must stay valid as long
+ * as the router runs. */
+class MetricSource { public:
+    virtual ~MetricSource() {
+    }
+    virtual void add_metrics(MetricRegistry &registry) = 0;
+};
+
+/** @class MetricHistogram
+ * @brief Per-thread histogram of unsigned values in power-of-two buckets.
+ *
+ * Bucket 0 counts values up to 1, bucket i values in (2^(i-1), 2^i], and
+ * the last bucket larger values. Adding a value only touches the data of
+ * the current thread. */
+class MetricHistogram { public:
+    enum { NBUCKETS = 24 };
+
+    struct Buckets {
+	uint64_t count[NBUCKETS];
+	uint64_t sum;
+	Buckets() {
+	    memset(this, 0, sizeof(*this));
+	}
+    };
+
+    static int bucket(uint64_t v) {
+	if (v <= 1)
+	    return 0;
+	int b = 64 - __builtin_clzll(v - 1);
+	return b < NBUCKETS - 1 ? b : NBUCKETS - 1;
+    }
+
+    void add(uint64_t v) {
+	Buckets &b = *_buckets;
+	b.count[bucket(v)]++;
+	b.sum += v;
+    }
+
+    void clear() {
+	for (unsigned i = 0; i < _buckets.weight(); i++)
+	    _buckets.get_value(i) = Buckets();
+    }
+
+    const per_thread<Buckets> &buckets() const {
+	return _buckets;
+    }
+
+  private:
+    per_thread<Buckets> _buckets;
+};
+
+/** @class MetricRegistry
+ * @brief Set of metrics, read at once by snapshot(). */
+class MetricRegistry { public:
+
+    enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+    MetricRegistry()
+	: _nvalues(0) {
+    }
+
+    /** @brief Function returning the value of a metric that has no stable
+     * storage. It must not take locks of the data path. */
+    typedef uint64_t (*read_function)(Element *e, intptr_t thunk);
+
+    struct Metric {
+	Element *element;
+	String name;
+	String help;
+	Type type;
+	// one value per thread, or an array of NBUCKETS counts and the sum
+	// for histograms
+	Vector<const void *> values;
+	int width;
+	read_function read;
+	intptr_t thunk;
+
+	/** @brief Number of values of the metric in a snapshot. */
+	int nvalues() const {
+	    return type == HISTOGRAM ? MetricHistogram::NBUCKETS + 1 : 1;
+	}
+    };
+
+    /** @brief Register the counter at @a value. */
+    void add_counter(Element *e, const String &name, const volatile uint64_t &value,
+		     const String &help = String()) {
+	add(e, name, help, COUNTER, (const void *) &value, sizeof(value));
+    }
+    void add_counter(Element *e, const String &name, const volatile uint32_t &value,
+		     const String &help = String()) {
+	add(e, name, help, COUNTER, (const void *) &value, sizeof(value));
+    }
+    /** @brief Register the gauge at @a value. */
+    void add_gauge(Element *e, const String &name, const volatile uint64_t &value,
+		   const String &help = String()) {
+	add(e, name, help, GAUGE, (const void *) &value, sizeof(value));
+    }
+    void add_gauge(Element *e, const String &name, const volatile uint32_t &value,
+		   const String &help = String()) {
+	add(e, name, help, GAUGE, (const void *) &value, sizeof(value));
+    }
+
+    /** @brief Register a metric, of type COUNTER or GAUGE, summing
+     * @a member of each per-thread copy of @a pt. */
+    template <typename T, typename V>
+    void add_per_thread(Element *e, const String &name, Type type,
+			const per_thread<T> &pt, V T::*member,
+			const String &help = String()) {
+	Metric &m = add(e, name, help, type, 0, sizeof(V));
+	for (unsigned i = 0; i < pt.weight(); i++)
+	    m.values.push_back(&(pt.get_value(i).*member));
+    }
+
+    /** @brief Register a metric read by calling @a f(@a e, @a thunk). */
+    void add_function(Element *e, const String &name, Type type,
+		      read_function f, intptr_t thunk,
+		      const String &help = String()) {
+	Metric &m = add(e, name, help, type, 0, 0);
+	m.read = f;
+	m.thunk = thunk;
+    }
+
+    /** @brief Register histogram @a h. */
+    void add_histogram(Element *e, const String &name, const MetricHistogram &h,
+		       const String &help = String()) {
+	Metric &m = add(e, name, help, HISTOGRAM, 0, sizeof(uint64_t));
+	for (unsigned i = 0; i < h.buckets().weight(); i++)
+	    m.values.push_back(&h.buckets().get_value(i));
+    }
+
+    const Vector<Metric> &metrics() const {
+	return _metrics;
+    }
+    /** @brief Total number of values of the metrics in a snapshot. */
+    int nvalues() const {
+	return _nvalues;
+    }
+
+    /** @brief Store the current values of all metrics in @a out, which
+     * must have room for nvalues() values.
+     *
+     * Counters and gauges have one value. Histograms have NBUCKETS bucket
+     * counts, not cumulative, followed by the sum of the values. */
+    void snapshot(uint64_t *out) const {
+	for (const Metric *m = _metrics.begin(); m != _metrics.end(); ++m) {
+	    if (m->read)
+		*out++ = m->read(m->element, m->thunk);
+	    else if (m->type == HISTOGRAM) {
+		for (int b = 0; b <= MetricHistogram::NBUCKETS; b++)
+		    out[b] = 0;
+		for (int i = 0; i < m->values.size(); i++) {
+		    const volatile uint64_t *v = static_cast<const volatile uint64_t *>(m->values[i]);
+		    for (int b = 0; b <= MetricHistogram::NBUCKETS; b++)
+			out[b] += v[b];
+		}
+		out += MetricHistogram::NBUCKETS + 1;
+	    } else {
+		uint64_t sum = 0;
+		for (int i = 0; i < m->values.size(); i++)
+		    sum += load(m->values[i], m->width);
+		*out++ = sum;
+	    }
+	}
+    }
+
+  private:
+
+    Vector<Metric> _metrics;
+    int _nvalues;
+
+    Metric &add(Element *e, const String &name, const String &help, Type type,
+		const void *value, int width) {
+	_metrics.push_back(Metric());
+	Metric &m = _metrics.back();
+	m.element = e;
+	m.name = name;
+	m.help = help;
+	m.type = type;
+	if (value)
+	    m.values.push_back(value);
+	m.width = width;
+	m.read = 0;
+	m.thunk = 0;
+	_nvalues += m.nvalues();
+	return m;
+    }
+
+    static uint64_t load(const void *p, int width) {
+	if (width == 8)
+	    return *static_cast<const volatile uint64_t *>(p);
+	else
+	    return *static_cast<const volatile uint32_t *>(p);
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
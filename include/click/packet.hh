@@ -89,6 +89,11 @@ class Packet { public:
 				buffer_destructor_type buffer_destructor,
                                 void* argument = (void*) 0, int headroom = 0, int tailroom = 0) CLICK_WARN_UNUSED_RESULT;
 #endif //CLICK_USERLEVEL || CLICK_MINIOS
+#if HAVE_DPDK
+    static WritablePacket *make_dpdk(int numa_node, uint32_t headroom, const void *data,
+				     uint32_t length, uint32_t tailroom) CLICK_WARN_UNUSED_RESULT;
+    static inline WritablePacket *make_dpdk(const void *data, uint32_t length) CLICK_WARN_UNUSED_RESULT;
+#endif
 
     static void static_cleanup();
 
@@ -327,6 +332,54 @@ class Packet { public:
     bool copy(Packet* p, int headroom=0);
     //@}
 
+    /** @name Segments */
+    //@{
+    inline Packet *next_segment() const;
+#if !CLICK_LINUXMODULE
+    void append_segment(Packet *p);
+#endif
+    inline uint32_t total_length() const;
+
+    /** @brief Make the first bytes of a segmented packet contiguous.
+     * @param len number of bytes that must be contiguous
+     * @return packet whose first @a len bytes are in its first segment, or
+     * null on failure
+     *
+     * Elements that read headers beyond the first segment call pullup() with
+     * the length of the headers they need. Returns this packet if its first
+     * segment already holds @a len bytes, which is the common case. Otherwise,
+     * bytes are moved from the following segments to the end of the first
+     * one, which is uniqueified if needed.
+     *
+     * If total_length() is less than @a len, if memory is lacking, or if
+     * @a len bytes do not fit in the first segment's buffer (with DPDK
+     * packets, where the first mbuf cannot grow), the packet is freed and
+     * null is returned.
+     *
+     * @sa next_segment, linearize */
+    Packet *pullup(uint32_t len) CLICK_WARN_UNUSED_RESULT;
+
+    /** @brief Merge the segments of a packet.
+     * @return single-segment packet, or null on failure
+     *
+     * Copies the data of all following segments at the end of the first one,
+     * and frees them. Returns this packet if it has a single segment. On
+     * failure, the packet is freed and null is returned.
+     *
+     * @sa next_segment, pullup */
+    Packet *linearize() CLICK_WARN_UNUSED_RESULT;
+
+    /** @brief Shorten a packet across its segments.
+     * @param len new total length
+     *
+     * Keeps the first @a len bytes of packet data and frees the segments
+     * that follow them. Does nothing if total_length() is at most @a len.
+     * Unlike take(), trim() works on segmented packets.
+     *
+     * @post new total_length() == min(old total_length(), @a len) */
+    void trim(uint32_t len);
+    //@}
+
     /** @name Header Pointers */
     //@{
     inline bool has_mac_header() const;
@@ -798,16 +851,18 @@ class Packet { public:
 
 #if !CLICK_LINUXMODULE
     // All packet annotations are stored in AllAnno so that
-    // clear_annotations(true) can memset() the structure to zero.
+    // clear_annotations(true) can memset() the structure to zero. The
+    // annotation area must come first; the fields most elements use on every
+    // packet follow.
     struct AllAnno {
 	Anno cb;
+	Packet *next;
+	Packet *prev;
+	Timestamp timestamp;
 	unsigned char *mac;
 	unsigned char *nh;
 	unsigned char *h;
 	Packet::PacketType pkt_type;
-	Timestamp timestamp;
-	Packet *next;
-	Packet *prev;
 	AllAnno()
 	    : timestamp(Timestamp::uninitialized_t()) {
 	}
@@ -827,19 +882,28 @@ class Packet { public:
 
 #if !(CLICK_LINUXMODULE || CLICK_PACKET_USE_DPDK)
     // User-space and BSD kernel module implementations.
-protected:
-    atomic_uint32_t _use_count;
-    Packet *_data_packet;
+    //
+    // Fields are ordered by how often elements use them. On 64-bit
+    // platforms, the first cache line holds the data pointers and the
+    // annotation area, and the second one the list pointers, the timestamp,
+    // the header pointers and the head of the buffer. The rest is only used
+    // when the packet is made, uniqueified, cloned or killed. User-level
+    // packets are allocated aligned on a cache line (see operator new()).
 private:
     /* mimic Linux sk_buff */
-    unsigned char *_head; /* start of allocated buffer */
     unsigned char *_data; /* where the packet starts */
     unsigned char *_tail; /* one beyond end of packet */
+    AllAnno _aa;
+    unsigned char *_head; /* start of allocated buffer */
     unsigned char *_end;  /* one beyond end of allocated buffer */
+protected:
+    atomic_uint32_t _use_count;
+    Packet *_data_packet;
+    Packet *_segment;	/* next segment, see next_segment() */
+private:
 # if CLICK_BSDMODULE
     struct mbuf *_m;
 # endif
-    AllAnno _aa;
 # if CLICK_NS
     SimPacketinfoWrapper _sim_packetinfo;
 # endif
@@ -860,6 +924,30 @@ private:
     ~Packet();
     Packet &operator=(const Packet &x);
 
+#if (CLICK_USERLEVEL || CLICK_MINIOS) && !CLICK_PACKET_USE_DPDK
+  public:
+    // Packets start on a cache line, so that their most used fields take
+    // as few cache lines as possible. Packet pools free with operator delete.
+    static void *operator new(size_t size) throw () {
+# if CLICK_USERLEVEL
+	void *p;
+	if (posix_memalign(&p, CLICK_CACHE_LINE_SIZE, size) != 0)
+	    return 0;
+	return p;
+# else
+	return ::operator new(size, std::nothrow);
+# endif
+    }
+    static void operator delete(void *p) {
+# if CLICK_USERLEVEL
+	free(p);
+# else
+	::operator delete(p);
+# endif
+    }
+  private:
+#endif
+
 #if !(CLICK_LINUXMODULE || CLICK_PACKET_USE_DPDK)
     bool alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom);
 #endif
@@ -1043,6 +1131,7 @@ WritablePacket::initialize()
 #else
     _use_count = 1;
     _data_packet = 0;
+    _segment = 0;
 # if CLICK_USERLEVEL || CLICK_MINIOS
     _destructor = 0;
 # elif CLICK_BSDMODULE
@@ -1061,6 +1150,7 @@ WritablePacket::initialize_data()
 #else
     _use_count = 1;
     _data_packet = 0;
+    _segment = 0;
 #endif
     clear_annotations(false);
 }
@@ -1189,6 +1279,54 @@ Packet::buffer_length() const
     return end_buffer() - buffer();
 }
 
+/** @brief Return the packet's next segment, or null.
+ *
+ * Most packets are a single contiguous segment. Large packets, such as jumbo
+ * frames or LRO aggregates received from a device, may instead be a chain
+ * of segments. The packet is the first segment: data(), length(), the
+ * header pointers and the annotations refer to it, and the following
+ * segments hold the rest of the data, in order. Elements that only look at
+ * headers in the first segment work unchanged; pullup() brings more bytes
+ * into it when needed.
+ *
+ * A packet owns its following segments. kill() frees them and clone()
+ * clones them. uniqueify() only copies the first segment, the following
+ * ones staying shared: to change data beyond the first segment, linearize()
+ * the packet first. Packets are never segmented in the Linux kernel module.
+ *
+ * @sa append_segment, total_length, pullup, linearize, trim */
+inline Packet *
+Packet::next_segment() const
+{
+#if CLICK_LINUXMODULE
+    return 0;
+#elif CLICK_PACKET_USE_DPDK
+    return reinterpret_cast<Packet *>(mb()->next);
+#else
+    return _segment;
+#endif
+}
+
+/** @brief Return the length of the packet's data in all its segments.
+ *
+ * Equals length() for single-segment packets.
+ *
+ * @sa next_segment */
+inline uint32_t
+Packet::total_length() const
+{
+#if CLICK_LINUXMODULE
+    return length();
+#elif CLICK_PACKET_USE_DPDK
+    return rte_pktmbuf_pkt_len(mb());
+#else
+    uint32_t len = length();
+    for (const Packet *s = _segment; s; s = s->_segment)
+	len += s->length();
+    return len;
+#endif
+}
+
 inline Packet *
 Packet::next() const
 {
@@ -1596,6 +1734,22 @@ Packet::make(uint32_t length)
     return make(default_headroom, (const unsigned char *) 0, length, 0);
 }
 
+#if HAVE_DPDK
+/** @brief Create and return a new packet in a DPDK buffer of this core's
+ * NUMA node.
+ * @param data data to be copied into the new packet
+ * @param length length of packet
+ * @return new packet, or null if no packet could be created
+ *
+ * Equivalent to make_dpdk(-1, default_headroom, @a data, @a length, 0).
+ * @sa make_dpdk(int, uint32_t, const void *, uint32_t, uint32_t) */
+inline WritablePacket *
+Packet::make_dpdk(const void *data, uint32_t length)
+{
+    return make_dpdk(-1, default_headroom, data, length, 0);
+}
+#endif
+
 #if CLICK_LINUXMODULE
 /** @brief Change an sk_buff into a Packet (linuxmodule).
  * @param skb input sk_buff
@@ -3,6 +3,7 @@
 #define CLICK_PACKETBATCH_HH
 
 #include <click/packet.hh>
+#include <click/machine.hh>
 CLICK_DECLS
 
 /**
@@ -270,6 +271,119 @@ CLICK_DECLS
     }
 
 
+#ifndef CLICK_BATCH_PREFETCH_DISTANCE
+# define CLICK_BATCH_PREFETCH_DISTANCE 4
+#endif
+
+/**
+ * Prefetch the packets of a batch ahead of an iteration.
+ *
+ * Packets coming from a device are usually not in the cache, so each element
+ *  of a chain would wait for the metadata and then the data of each packet.
+ *  A PacketPrefetcher walks the batch a given distance ahead of the packet
+ *  being processed, prefetching the metadata of the next packet and the data
+ *  of the current one. A PacketBatch being a linked list, the metadata must
+ *  be read to find the next packet, so it is prefetched one step before the
+ *  data.
+ *
+ * Call advance() once per packet, before processing it. The packets ahead
+ *  must not be modified during the iteration, the current one may be
+ *  replaced or dropped.
+ *
+ * A distance of 0 disables prefetching. Elements use default_distance, which
+ *  is CLICK_BATCH_PREFETCH_DISTANCE unless changed at run time through the
+ *  global batch_prefetch_distance handler.
+ */
+class PacketPrefetcher { public:
+
+    static unsigned default_distance;
+
+    inline PacketPrefetcher(Packet *head, unsigned distance = default_distance)
+        : _p(distance ? head : 0), _looped(false) {
+        for (unsigned i = 0; i < distance && _p; i++)
+            advance();
+    }
+
+    inline void advance() {
+        if (_p) {
+            Packet *next = _p->next();
+            if (next)
+                prefetch_metadata(next);
+            click_prefetch0(_p->data());
+            _p = next;
+        }
+    }
+
+    /** @brief Prefetch the cache lines of @a p holding the fields most
+     *  elements use: data pointers, annotations and list pointers. */
+    static inline void prefetch_metadata(Packet *p) {
+        click_prefetch0(p);
+#if CLICK_PACKET_USE_DPDK
+        p->prefetch_anno();
+#elif !CLICK_LINUXMODULE
+        click_prefetch0(reinterpret_cast<unsigned char *>(p) + CLICK_CACHE_LINE_SIZE);
+#endif
+    }
+
+    /** @brief Return true on the first call only, so that a for statement
+     *  declaring the prefetcher runs its body once. */
+    inline bool loop_once() {
+        return !_looped && (_looped = true);
+    }
+
+  private:
+
+    Packet *_p;
+    bool _looped;
+
+};
+
+/**
+ * Same as FOR_EACH_PACKET, prefetching packets distance packets ahead.
+ */
+#define FOR_EACH_PACKET_PREFETCH(batch,p,distance) \
+                for(PacketPrefetcher fepp_prefetcher((batch),(distance));fepp_prefetcher.loop_once();)\
+                for(Packet* p = batch;p != 0 && (fepp_prefetcher.advance(), true);p=p->next())
+
+/**
+ * Same as EXECUTE_FOR_EACH_PACKET, prefetching packets distance packets
+ *  ahead.
+ */
+#define EXECUTE_FOR_EACH_PACKET_PREFETCH(fnt,batch,distance) {\
+            PacketPrefetcher efepp_prefetcher((batch),(distance));\
+            auto efepp_fnt = [&](Packet* p) {\
+                efepp_prefetcher.advance();\
+                return (fnt(p));\
+            };\
+            EXECUTE_FOR_EACH_PACKET(efepp_fnt,batch);\
+        }
+
+/**
+ * Same as EXECUTE_FOR_EACH_PACKET_DROPPABLE, prefetching packets distance
+ *  packets ahead.
+ */
+#define EXECUTE_FOR_EACH_PACKET_DROPPABLE_PREFETCH(fnt,batch,on_drop,distance) {\
+            PacketPrefetcher efepdp_prefetcher((batch),(distance));\
+            auto efepdp_fnt = [&](Packet* p) {\
+                efepdp_prefetcher.advance();\
+                return (fnt(p));\
+            };\
+            EXECUTE_FOR_EACH_PACKET_DROPPABLE(efepdp_fnt,batch,on_drop);\
+        }
+
+/**
+ * Same as CLASSIFY_EACH_PACKET, prefetching packets distance packets ahead.
+ */
+#define CLASSIFY_EACH_PACKET_PREFETCH(nbatches,fnt,cep_batch,on_finish,distance) {\
+            PacketPrefetcher cepp_prefetcher((cep_batch),(distance));\
+            auto cepp_fnt = [&](Packet* p) {\
+                cepp_prefetcher.advance();\
+                return (fnt(p));\
+            };\
+            CLASSIFY_EACH_PACKET(nbatches,cepp_fnt,cep_batch,on_finish);\
+        }
+
+
 /**
  * Create a batch by calling multiple times (up to max) a given function and
  *   linking them together in respect to the PacketBatch semantic.
@@ -471,6 +585,10 @@ public :
                     buffer_destructor_type destructor,
                                     void* argument = (void*) 0) CLICK_WARN_UNUSED_RESULT;
 #endif
+#if HAVE_DPDK
+    static PacketBatch *make_dpdk_batch(int numa_node, unsigned count,
+                                        uint32_t headroom, uint32_t length) CLICK_WARN_UNUSED_RESULT;
+#endif
 
     /**
      * Return the first packet of this batch
@@ -538,6 +656,193 @@ inline void PacketBatch::kill() {
     }
 }
 
+/**
+ * Iterate over all packets of a PacketArray. The array cannot be modified
+ *  during iteration.
+ */
+#define FOR_EACH_PACKET_ARRAY(array,p) \
+                for (Packet **fepa_it = (array).begin(), *p; \
+                     fepa_it != (array).end() && ((p = *fepa_it), true); \
+                     ++fepa_it)
+
+/**
+ * Execute a function on each packet of a PacketArray. The function may
+ * return another packet to replace the current one. This version cannot
+ * drop ! Use _DROPPABLE version if the function could return null.
+ */
+#define EXECUTE_FOR_EACH_PACKET_ARRAY(fnt,array) \
+                for (unsigned efepa_i = 0; efepa_i < (array).count(); efepa_i++)\
+                    (array)[efepa_i] = fnt((array)[efepa_i]);
+
+/**
+ * Execute a function on each packet of a PacketArray. The function may
+ * return another packet to replace the current one, or null if the packet is
+ * to be dropped, in which case on_drop is called on it and it is removed
+ * from the array. The order of the remaining packets is kept.
+ */
+#define EXECUTE_FOR_EACH_PACKET_ARRAY_DROPPABLE(fnt,array,on_drop) {\
+                unsigned efepad_n = 0;\
+                for (unsigned efepad_i = 0; efepad_i < (array).count(); efepad_i++) {\
+                    Packet* p = (array)[efepad_i];\
+                    Packet* q = fnt(p);\
+                    if (q == 0)\
+                        on_drop(p);\
+                    else\
+                        (array)[efepad_n++] = q;\
+                }\
+                (array).set_count(efepad_n);\
+            }
+
+/**
+ * Batch of Packet stored in an array.
+ *
+ * A PacketBatch is a linked list, so an element must read a packet to find
+ *  the next one. A PacketArray holds pointers to up to capacity packets in a
+ *  plain array instead : any packet can be reached directly, the next ones
+ *  can be prefetched while handling the current one, and loops over the
+ *  packets' fields can be vectorized. I/O elements can fill it directly from
+ *  the arrays given by their driver.
+ *
+ * Use to_batch() and append_batch() to convert from and to a PacketBatch at
+ *  the boundary with elements handling only PacketBatch, which
+ *  BatchElement::output_push_array() does automatically.
+ *
+ * The next and prev annotations of the packets are not used.
+ */
+class PacketArray { public:
+
+    enum { capacity = 256 };
+
+    PacketArray() : _count(0) {
+    }
+
+    /**
+     * Return the number of packets in this array
+     */
+    inline unsigned count() const {
+        return _count;
+    }
+
+    inline bool empty() const {
+        return _count == 0;
+    }
+
+    inline bool full() const {
+        return _count == capacity;
+    }
+
+    inline Packet*& operator[](unsigned i) {
+        assert(i < _count);
+        return _p[i];
+    }
+
+    inline Packet* operator[](unsigned i) const {
+        assert(i < _count);
+        return _p[i];
+    }
+
+    inline Packet** begin() {
+        return _p;
+    }
+
+    inline Packet** end() {
+        return _p + _count;
+    }
+
+    /**
+     * Return the underlying array, for a driver to fill up to capacity
+     *  packets directly. Call set_count() afterwards.
+     */
+    inline Packet** data() {
+        return _p;
+    }
+
+    inline void set_count(unsigned c) {
+        assert(c <= capacity);
+        _count = c;
+    }
+
+    /**
+     * Forget all packets, without killing them
+     */
+    inline void clear() {
+        _count = 0;
+    }
+
+    inline void push_back(Packet* p) {
+        assert(_count < capacity);
+        _p[_count++] = p;
+    }
+
+    /**
+     * Append the packets of a batch, up to capacity
+     *
+     * @return The packets that did not fit, as a batch, or null
+     */
+    inline PacketBatch* append_batch(PacketBatch* batch);
+
+    /**
+     * Link the packets as a PacketBatch. The array is empty afterwards.
+     *
+     * @return The batch, or null if the array was empty
+     */
+    inline PacketBatch* to_batch();
+
+    /**
+     * Kill all packets in the array. The array is empty afterwards.
+     */
+    inline void kill();
+
+#if HAVE_BATCH && HAVE_CLICK_PACKET_POOL
+    void fast_kill();
+#else
+    inline void fast_kill() {
+        kill();
+    }
+#endif
+
+  private:
+
+    Packet* _p[capacity];
+    unsigned _count;
+
+};
+
+inline PacketBatch* PacketArray::append_batch(PacketBatch* batch) {
+    if (!batch)
+        return 0;
+    unsigned n = batch->count();
+    Packet* tail = batch->tail();
+    Packet* p = batch;
+    while (p && _count < capacity) {
+        _p[_count++] = p;
+        p = p->next();
+        n--;
+    }
+    if (!p)
+        return 0;
+    PacketBatch* rest = PacketBatch::start_head(p);
+    rest->set_tail(tail);
+    rest->set_count(n);
+    return rest;
+}
+
+inline PacketBatch* PacketArray::to_batch() {
+    if (!_count)
+        return 0;
+    for (unsigned i = 1; i < _count; i++)
+        _p[i - 1]->set_next(_p[i]);
+    PacketBatch* head = PacketBatch::start_head(_p[0])->make_tail(_p[_count - 1], _count);
+    _count = 0;
+    return head;
+}
+
+inline void PacketArray::kill() {
+    for (unsigned i = 0; i < _count; i++)
+        _p[i]->kill();
+    _count = 0;
+}
+
 #if HAVE_BATCH_RECYCLE
 #define BATCH_RECYCLE_START() \
 	WritablePacket* head_packet = 0;\
@@ -585,13 +890,13 @@ inline void PacketBatch::kill() {
 
 #if HAVE_DPDK_PACKET_POOL
 #define BATCH_RECYCLE_UNKNOWN_PACKET(p) {\
-	if (p->data_packet() == 0 && p->buffer_destructor() == DPDKDevice::free_pkt && p->buffer() != 0) {\
+	if (p->data_packet() == 0 && !p->next_segment() && p->buffer_destructor() == DPDKDevice::free_pkt && p->buffer() != 0) {\
 		BATCH_RECYCLE_ADD_DATA_PACKET(p);\
 	} else {\
 		BATCH_RECYCLE_ADD_PACKET(p);}}
 #else
 #define BATCH_RECYCLE_UNKNOWN_PACKET(p) {\
-	if (p->data_packet() == 0 && p->buffer_destructor() == 0 && p->buffer() != 0) {\
+	if (p->data_packet() == 0 && !p->next_segment() && p->buffer_destructor() == 0 && p->buffer() != 0) {\
 		BATCH_RECYCLE_ADD_DATA_PACKET(p);\
 	} else {\
 	    BATCH_RECYCLE_ADD_PACKET(p);}}
@@ -3,6 +3,7 @@
 #define CLICK_TOKENBUCKET_HH
 #include <click/timestamp.hh>
 #include <click/bigint.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 /** @file <click/tokenbucket.hh>
@@ -993,6 +994,197 @@ inline typename TokenBucketX<P>::ticks_type TokenBucketX<P>::epochs_until_contai
 /** @endcond never */
 
 
+/** @class SharedTokenBucketX include/click/tokenbucket.hh <click/tokenbucket.hh>
+ @brief  Token bucket rate limiter shared by several threads.
+
+ The SharedTokenBucketX class implements a token bucket rate limiter whose
+ tokens are consumed by several threads without taking a lock for every
+ packet. Each thread owns a cache_type holding tokens taken from the shared
+ bucket in bulk: cache_type::remove_if() only touches the shared bucket,
+ under a spinlock, when the cache runs dry, and then takes the missing
+ tokens plus bulk() more.
+
+ Tokens sitting in caches are not available to other threads, so the
+ effective burst of the shared bucket is up to bulk() tokens per thread
+ larger than its capacity. A cache whose thread stops consuming can return
+ its tokens with cache_type::flush().
+
+ All parameters are read and written under the spinlock, so assign() can
+ change the rate while threads consume tokens; tokens already in caches are
+ still spent.
+
+ Most users will be satisfied with the SharedTokenBucket type, which is equal
+ to SharedTokenBucketX<TokenBucketJiffyParameters<unsigned> >.
+
+ @sa TokenBucketX */
+
+template <typename P>
+class SharedTokenBucketX { public:
+
+    /** @brief The underlying token bucket type. */
+    typedef TokenBucketX<P> bucket_type;
+
+    /** @brief Unsigned type of token counts. */
+    typedef typename bucket_type::token_type token_type;
+
+    /** @brief Construct an idle shared token bucket. */
+    SharedTokenBucketX()
+	: _bulk(0) {
+    }
+
+    /** @brief Set the rate, capacity and bulk size, and fill the bucket.
+     * @param rate refill rate in tokens per period
+     * @param capacity maximum token accumulation
+     * @param bulk number of tokens taken in advance by caches */
+    void assign(token_type rate, token_type capacity, token_type bulk) {
+	_lock.acquire();
+	_bucket.assign(rate, capacity);
+	_bucket.set_full();
+	_bulk = bulk;
+	_lock.release();
+    }
+
+    /** @brief Return true iff the rate is unlimited. */
+    bool unlimited() const {
+	_lock.acquire();
+	bool u = _bucket.unlimited();
+	_lock.release();
+	return u;
+    }
+
+    /** @brief Return the rate in tokens per period. */
+    token_type rate() const {
+	_lock.acquire();
+	token_type r = _bucket.rate();
+	_lock.release();
+	return r;
+    }
+
+    /** @brief Return the capacity in tokens. */
+    token_type capacity() const {
+	_lock.acquire();
+	token_type c = _bucket.capacity();
+	_lock.release();
+	return c;
+    }
+
+    /** @brief Return the number of tokens caches take in advance. */
+    token_type bulk() const {
+	_lock.acquire();
+	token_type b = _bulk;
+	_lock.release();
+	return b;
+    }
+
+    /** @brief Return the number of tokens in the shared bucket, not
+     * counting the tokens held by caches. */
+    token_type size() {
+	_lock.acquire();
+	_bucket.refill();
+	token_type s = _bucket.size();
+	_lock.release();
+	return s;
+    }
+
+    /** @brief Take between @a min and @a want tokens from the shared bucket.
+     * @return the number of tokens taken, 0 if it contains less than @a min */
+    token_type grant(token_type min, token_type want) {
+	token_type n = 0;
+	_lock.acquire();
+	_bucket.refill();
+	token_type avail = _bucket.size();
+	if (avail >= min) {
+	    n = avail < want ? avail : want;
+	    _bucket.remove(n);
+	}
+	_lock.release();
+	return n;
+    }
+
+    /** @brief Take at least @a min tokens from the shared bucket, plus up
+     * to bulk() more.
+     * @return the number of tokens taken, 0 if it contains less than @a min
+     *
+     * Unlike grant(min, min + bulk()), the bulk size is read under the
+     * lock, so assign() may change it concurrently. */
+    token_type grant_bulk(token_type min) {
+	token_type n = 0;
+	_lock.acquire();
+	_bucket.refill();
+	token_type avail = _bucket.size(), want = min + _bulk;
+	if (avail >= min) {
+	    n = avail < want ? avail : want;
+	    _bucket.remove(n);
+	}
+	_lock.release();
+	return n;
+    }
+
+    /** @brief Return @a t tokens to the shared bucket. */
+    void give_back(token_type t) {
+	_lock.acquire();
+	_bucket.refill();
+	token_type s = _bucket.size() + t, cap = _bucket.capacity();
+	_bucket.set(s < t || s > cap ? cap : s);
+	_lock.release();
+    }
+
+    /** @brief Per-thread cache of tokens of a SharedTokenBucketX. */
+    class cache_type { public:
+
+	cache_type()
+	    : _tokens(0) {
+	}
+
+	/** @brief Return the number of tokens in the cache. */
+	token_type size() const {
+	    return _tokens;
+	}
+
+	/** @brief Remove @a t tokens if the cache, refilled from @a shared
+	 * if needed, contains @a t tokens.
+	 * @return true if @a t tokens were removed */
+	bool remove_if(SharedTokenBucketX<P> &shared, token_type t) {
+	    if (likely(t <= _tokens)) {
+		_tokens -= t;
+		return true;
+	    }
+	    token_type missing = t - _tokens;
+	    token_type got = shared.grant_bulk(missing);
+	    if (!got)
+		return false;
+	    _tokens += got - t;
+	    return true;
+	}
+
+	/** @brief Put back @a t tokens removed by remove_if(). */
+	void refund(token_type t) {
+	    _tokens += t;
+	}
+
+	/** @brief Return all the tokens of the cache to @a shared. */
+	void flush(SharedTokenBucketX<P> &shared) {
+	    if (_tokens) {
+		shared.give_back(_tokens);
+		_tokens = 0;
+	    }
+	}
+
+      private:
+
+	token_type _tokens;
+
+    };
+
+  private:
+
+    bucket_type _bucket;
+    token_type _bulk;
+    mutable SimpleSpinlock _lock;
+
+};
+
+
 /** @class TokenRate include/click/tokenbucket.hh <click/tokenbucket.hh>
  * @brief Jiffy-based token bucket rate
  *
@@ -1017,5 +1209,13 @@ typedef TokenCounterX<TokenRate> TokenCounter;
  * @sa TokenBucketX, TokenBucketJiffyParameters */
 typedef TokenBucketX<TokenBucketJiffyParameters<unsigned> > TokenBucket;
 
+/** @class SharedTokenBucket include/click/tokenbucket.hh <click/tokenbucket.hh>
+ * @brief Jiffy-based token bucket rate limiter shared by several threads
+ *
+ * Equivalent to
+ * @link SharedTokenBucketX SharedTokenBucketX<TokenBucketJiffyParameters<unsigned> >@endlink.
+ * @sa SharedTokenBucketX, TokenBucket */
+typedef SharedTokenBucketX<TokenBucketJiffyParameters<unsigned> > SharedTokenBucket;
+
 CLICK_ENDDECLS
 #endif
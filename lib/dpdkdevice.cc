@@ -178,6 +178,8 @@ int DPDKDevice::alloc_pktmbufs(ErrorHandler* errh)
 }
 
 struct rte_mempool *DPDKDevice::get_mpool(unsigned int socket_id) {
+    if (unlikely(socket_id >= _nr_pktmbuf_pools))
+        return 0;
     return _pktmbuf_pools[socket_id];
 }
 
@@ -246,6 +248,29 @@ int DPDKDevice::initialize_device(ErrorHandler *errh)
 #if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0) && RTE_VERSION < RTE_VERSION_NUM(18,11,0,0)
     dev_conf.rxmode.offloads = DEV_RX_OFFLOAD_CRC_STRIP;
 #endif
+    // Frames that do not fit in an mbuf are received as mbuf chains
+    if (info.init_mtu && info.init_mtu + ETHER_HDR_LEN + ETHER_CRC_LEN
+        > (unsigned) (MBUF_DATA_SIZE - RTE_PKTMBUF_HEADROOM))
+        info.multi_segment = true;
+    if (info.multi_segment) {
+#if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0)
+        if (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_SCATTER)
+            dev_conf.rxmode.offloads |= DEV_RX_OFFLOAD_SCATTER;
+        if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_MULTI_SEGS)
+            dev_conf.txmode.offloads |= DEV_TX_OFFLOAD_MULTI_SEGS;
+#else
+        dev_conf.rxmode.enable_scatter = 1;
+#endif
+        if (info.init_mtu > ETHER_MTU) {
+#if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0)
+            dev_conf.rxmode.offloads |= DEV_RX_OFFLOAD_JUMBO_FRAME;
+#else
+            dev_conf.rxmode.jumbo_frame = 1;
+#endif
+            dev_conf.rxmode.max_rx_pkt_len = info.init_mtu + ETHER_HDR_LEN + ETHER_CRC_LEN;
+        }
+    }
+
     dev_conf.rxmode.mq_mode = ETH_MQ_RX_RSS;
     dev_conf.rx_adv_conf.rss_conf.rss_key = NULL;
     dev_conf.rx_adv_conf.rss_conf.rss_hf = ETH_RSS_IP | ETH_RSS_UDP | ETH_RSS_TCP;
@@ -382,7 +407,9 @@ int DPDKDevice::initialize_device(ErrorHandler *errh)
     tx_conf.offloads = dev_conf.txmode.offloads;
 #endif
 #if RTE_VERSION <= RTE_VERSION_NUM(18,05,0,0)
-    tx_conf.txq_flags |= ETH_TXQ_FLAGS_NOMULTSEGS | ETH_TXQ_FLAGS_NOOFFLOADS;
+    tx_conf.txq_flags |= ETH_TXQ_FLAGS_NOOFFLOADS;
+    if (!info.multi_segment)
+        tx_conf.txq_flags |= ETH_TXQ_FLAGS_NOMULTSEGS;
 #endif
 
     int numa_node = DPDKDevice::get_port_numa_node(port_id);
@@ -459,6 +486,13 @@ void DPDKDevice::set_init_mtu(uint16_t mtu) {
     info.init_mtu = mtu;
 }
 
+/* Receive packets larger than an mbuf as segmented packets, and send
+ * segmented packets as mbuf chains. */
+void DPDKDevice::set_multi_segment() {
+    assert(!_is_initialized);
+    info.multi_segment = true;
+}
+
 void DPDKDevice::set_init_fc_mode(FlowControlMode fc) {
     assert(!_is_initialized);
     info.init_fc_mode = fc;
@@ -426,7 +426,7 @@ Element::Element()
 #else
     in_batch_mode(BATCH_MODE_NO),
 #endif
-    receives_batch(false),
+    receives_batch(false), receives_array(false),
     _router(0), _eindex(-1)
 #if HAVE_FULLPUSH_NONATOMIC
     ,_is_fullpush(false)
@@ -221,6 +221,8 @@ Packet::~Packet()
 #elif CLICK_PACKET_USE_DPDK
     rte_panic("Packet destructor");
 #else
+    if (_segment)
+	_segment->kill();
     if (_data_packet)
 	_data_packet->kill();
 # if CLICK_USERLEVEL || CLICK_MINIOS
@@ -444,7 +446,7 @@ WritablePacket::check_packet_pool_size(PacketPool &packet_pool) {
         if (!global_packet_pool.pbatch.insert(packet_pool.p)) { //Si le nombre de batch est au max -> delete
             while (WritablePacket *p = packet_pool.p) { //On supprime le batch
                 packet_pool.p = static_cast<WritablePacket *>(p->next());
-                ::operator delete((void *) p);
+                Packet::operator delete((void *) p);
             }
         }
         packet_pool.p = 0;
@@ -453,7 +455,7 @@ WritablePacket::check_packet_pool_size(PacketPool &packet_pool) {
 #  else /* !HAVE_MULTITHREAD */
     if (packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
         WritablePacket* tmp = (WritablePacket*)packet_pool.p->next();
-        ::operator delete((void *) packet_pool.p);
+        Packet::operator delete((void *) packet_pool.p);
         packet_pool.p = tmp;
         packet_pool.pcount--;
     }
@@ -480,7 +482,7 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool) {
                     ::operator delete[]((unsigned char *) pd->buffer());
                 }
 #endif
-                ::operator delete((void *) pd);
+                Packet::operator delete((void *) pd);
             }
         }
         packet_pool.pd = 0;
@@ -490,7 +492,7 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool) {
 #  else /* !HAVE_MULTITHREAD */
     if (packet_pool.pdcount == CLICK_PACKET_POOL_SIZE) {
         WritablePacket* tmp = (WritablePacket*)packet_pool.pd->next();
-        ::operator delete((void *) packet_pool.pd);
+        Packet::operator delete((void *) packet_pool.pd);
         packet_pool.pd = tmp;
         packet_pool.pdcount--;
     }
@@ -499,10 +501,10 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool) {
 
 inline bool WritablePacket::is_from_data_pool(WritablePacket *p) {
 #if HAVE_DPDK_PACKET_POOL
-	return likely(!p->_data_packet && p->_head
+	return likely(!p->_data_packet && !p->_segment && p->_head
 			&& (p->_destructor == DPDKDevice::free_pkt));
 #else
-    if (likely(!p->_data_packet && p->_head && !p->_destructor)) {
+    if (likely(!p->_data_packet && !p->_segment && p->_head && !p->_destructor)) {
 # if HAVE_NETMAP_PACKET_POOL
         return NetmapBufQ::is_valid_netmap_packet(p);
 # else
@@ -592,8 +594,8 @@ Packet::alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom)
     }
 # if CLICK_USERLEVEL || CLICK_MINIOS
     unsigned char *d = 0;
-    if (n <= CLICK_PACKET_POOL_SIZE) {
 #  if HAVE_DPDK_PACKET_POOL
+    if (n <= (uint32_t) DPDKDevice::MBUF_DATA_SIZE) {
         struct rte_mbuf *mb = DPDKDevice::get_pkt();
         if (likely(mb)) {
           d = (unsigned char*)mb->buf_addr;
@@ -602,14 +604,13 @@ Packet::alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom)
         } else {
             return 0;
         }
-#  elif HAVE_NETMAP_PACKET_POOL
-    d = NetmapBufQ::local_pool()->extract_p();
-#  endif
     } else {
-# if HAVE_DPDK_PACKET_POOL
         click_chatter("Warning : buffer of size %d bigger than DPDK buffer size", n);
-# endif
     }
+#  elif HAVE_NETMAP_PACKET_POOL
+    if (n <= CLICK_PACKET_POOL_SIZE)
+        d = NetmapBufQ::local_pool()->extract_p();
+#  endif
     if (!d) {
 # if HAVE_DPDK
       if (dpdk_enabled)
@@ -820,6 +821,59 @@ Packet::copy(Packet* p, int headroom)
 
 #endif
 
+#if HAVE_DPDK
+/** @brief Create and return a new packet in a DPDK buffer (userlevel).
+ * @param numa_node NUMA node whose DPDK pool provides the buffer, or -1 for
+ *   the node of the calling core
+ * @param headroom headroom in new packet
+ * @param data data to be copied into the new packet
+ * @param length length of packet
+ * @param tailroom minimum tailroom in new packet
+ * @return new packet, or null if no packet could be created
+ *
+ * Like make(uint32_t, const void *, uint32_t, uint32_t), but the buffer is
+ * an mbuf taken directly from the DPDK pool of @a numa_node, and the packet
+ * gets all the tailroom left in that mbuf. ToDPDKDevice sends such packets
+ * without copying them, so elements generating traffic for a DPDK device
+ * should use this function, and PacketBatch::make_dpdk_batch() for whole
+ * batches.
+ *
+ * Returns null if the DPDK pools are not allocated, if the pool is empty,
+ * or if the packet does not fit in a DPDK buffer. */
+WritablePacket *
+Packet::make_dpdk(int numa_node, uint32_t headroom, const void *data,
+		  uint32_t length, uint32_t tailroom)
+{
+    if (numa_node < 0 && (numa_node = (int) rte_socket_id()) < 0)
+	numa_node = 0;
+    struct rte_mempool *mp = DPDKDevice::get_mpool(numa_node);
+    struct rte_mbuf *mb;
+    if (unlikely(!mp || !(mb = rte_pktmbuf_alloc(mp))))
+	return 0;
+    if (unlikely(headroom + length + tailroom > mb->buf_len)) {
+	rte_pktmbuf_free(mb);
+	return 0;
+    }
+# if CLICK_PACKET_USE_DPDK
+    mb->data_off = headroom;
+    rte_pktmbuf_data_len(mb) = length;
+    rte_pktmbuf_pkt_len(mb) = length;
+    WritablePacket *p = reinterpret_cast<WritablePacket *>(mb);
+# else
+    WritablePacket *p = make((unsigned char *) mb->buf_addr + headroom, length,
+			     DPDKDevice::free_pkt, mb,
+			     headroom, mb->buf_len - headroom - length);
+    if (unlikely(!p)) {
+	rte_pktmbuf_free(mb);
+	return 0;
+    }
+# endif
+    if (data)
+	memcpy(p->data(), data, length);
+    return p;
+}
+#endif
+
 //
 // UNIQUEIFICATION
 //
@@ -849,13 +903,10 @@ Packet::clone(bool fast)
 #elif CLICK_PACKET_USE_DPDK
     Packet* p = reinterpret_cast<Packet *>(
         rte_pktmbuf_clone(mb(), DPDKDevice::get_mpool(rte_socket_id())));
+    if (!p)
+        return 0;
     p->copy_annotations(this,true);
     p->shift_header_annotations(buffer(), 0);
-    click_chatter("Clone %p %p",this->mb(),p->mb());
-    click_chatter("Headroom %d %d",headroom(),p->headroom());
-    click_chatter("Tailroom %d %d",tailroom(),p->tailroom());
-    click_chatter("Length %d %d",length(),p->length());
-    click_chatter("Shared %d %d",shared(),p->shared());
     return p;
 #elif CLICK_USERLEVEL || CLICK_BSDMODULE || CLICK_MINIOS
 # if CLICK_BSDMODULE
@@ -904,6 +955,11 @@ Packet::clone(bool fast)
         p->_destructor = empty_destructor;
         }
         p->_data_packet = 0;
+        p->_segment = 0;
+        if (unlikely(_segment) && !(p->_segment = _segment->clone(true))) {
+            p->kill();
+            return 0;
+        }
     } else {
         Packet* origin = this;
         if (origin->_data_packet)
@@ -918,6 +974,12 @@ Packet::clone(bool fast)
 	# endif
 		// increment our reference count because of _data_packet reference
 		origin->_use_count++;
+        // each clone owns a clone of the following segments
+        p->_segment = 0;
+        if (unlikely(_segment) && !(p->_segment = _segment->clone())) {
+            p->kill();
+            return 0;
+        }
     }
     return p;
 
@@ -957,7 +1019,6 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
 #elif CLICK_PACKET_USE_DPDK /* !CLICK_LINUXMODULE */
     struct rte_mbuf *mb = this->mb();
     struct rte_mbuf *nmb = DPDKDevice::get_pkt();
-    click_chatter("Expensive uniqueify %p %p, exh = %d, ext = %d",mb,nmb,extra_headroom,extra_tailroom);
     if (!nmb) {
         click_chatter("cannot allocate new pktmbuf");
         if (free_on_failure)
@@ -969,16 +1030,34 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
     rte_pktmbuf_data_len(nmb) = length();
     rte_pktmbuf_pkt_len(nmb) = length();
 
+    // Copy the headroom and the data, but not the tailroom: it holds no
+    // packet data, and is most of the mbuf for small packets.
     WritablePacket *npkt = reinterpret_cast<WritablePacket *>(nmb);
-    memcpy(npkt->buffer(), buffer(), length() + headroom() + tailroom());
+    uint32_t skip = extra_headroom >= 0 ? 0 : -extra_headroom;
+    memcpy(npkt->buffer() + skip + extra_headroom, buffer() + skip,
+           headroom() - skip + length());
     memcpy(npkt->all_anno(), all_anno(), sizeof (AllAnno));
 
+    if (unlikely(mb->next)) {
+        // The following segments go with the new head: steal them if no
+        // one else holds this chain, clone them otherwise
+        if (rte_mbuf_refcnt_read(mb) == 1) {
+            nmb->next = mb->next;
+            mb->next = 0;
+        } else if (!(nmb->next = rte_pktmbuf_clone(mb->next, DPDKDevice::get_mpool(rte_socket_id())))) {
+            rte_pktmbuf_free(nmb);
+            if (free_on_failure)
+                kill();
+            return 0;
+        }
+        nmb->nb_segs = mb->nb_segs;
+        rte_pktmbuf_pkt_len(nmb) += rte_pktmbuf_pkt_len(mb) - rte_pktmbuf_data_len(mb);
+        if (!mb->next)
+            mb->nb_segs = 1;
+    }
+
     npkt->shift_header_annotations(buffer(), extra_headroom);
 
-    click_chatter("Headroom %d %d",headroom(),npkt->headroom());
-    click_chatter("Tailroom %d %d",tailroom(),npkt->tailroom());
-    click_chatter("Length %d %d",length(),npkt->length());
-    click_chatter("Shared %d %d",shared(),npkt->shared());
     kill(); // Release old mbuf
     return npkt;
 #else /* !CLICK_LINUXMODULE */
@@ -1002,6 +1081,7 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
 #endif
     if (_use_count > 1) {
         memcpy(p, this, sizeof(Packet));
+        _segment = 0; // the following segments now belong to p
 
         # if CLICK_USERLEVEL || CLICK_MINIOS
             p->_destructor = 0;
@@ -1024,8 +1104,11 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
 		struct mbuf *old_m = _m;
 	# endif
 
+    // Like Linux's pskb_expand_head(), copy the headroom and the data, but
+    // not the tailroom. It holds no packet data, and is most of the buffer
+    // when small packets are received into large buffers.
     unsigned char *start_copy = old_head + (extra_headroom >= 0 ? 0 : -extra_headroom);
-    unsigned char *end_copy = old_end + (extra_tailroom >= 0 ? 0 : extra_tailroom);
+    unsigned char *end_copy = old_head + headroom + length;
     memcpy(p->_head + (extra_headroom >= 0 ? extra_headroom : 0), start_copy, end_copy - start_copy);
 
     // free old data
@@ -1245,6 +1328,164 @@ Packet::shift_data(int offset, bool free_on_failure)
     }
 }
 
+//
+// SEGMENTS
+//
+
+#if !CLICK_LINUXMODULE
+/** @brief Append a segment to the packet.
+ * @param p segment to append, which may itself have following segments
+ *
+ * @a p and its segments are added after the last segment of this packet,
+ * which takes ownership of them. Only the data of @a p is used, its
+ * annotations are ignored.
+ *
+ * @sa next_segment */
+void
+Packet::append_segment(Packet *p)
+{
+# if CLICK_PACKET_USE_DPDK
+    struct rte_mbuf *head = mb();
+    if (head->nb_segs + p->mb()->nb_segs > 0xFFFF) {
+	click_chatter("Packet::append_segment: too many segments");
+	p->kill();
+	return;
+    }
+    rte_pktmbuf_lastseg(head)->next = p->mb();
+    head->nb_segs += p->mb()->nb_segs;
+    rte_pktmbuf_pkt_len(head) += rte_pktmbuf_pkt_len(p->mb());
+# else
+    Packet *s = this;
+    while (s->_segment)
+	s = s->_segment;
+    s->_segment = p;
+# endif
+}
+#endif
+
+Packet *
+Packet::pullup(uint32_t len)
+{
+    if (likely(len <= length()))
+	return this;
+#if CLICK_LINUXMODULE
+    if (pskb_may_pull(skb(), len))
+	return this;
+#elif CLICK_PACKET_USE_DPDK
+    if (len <= total_length()) {
+	WritablePacket *q = uniqueify();
+	if (!q)
+	    return 0;
+	struct rte_mbuf *head = q->mb();
+	uint32_t need = len - rte_pktmbuf_data_len(head);
+	if (need > rte_pktmbuf_tailroom(head)) {
+	    q->kill();
+	    return 0;
+	}
+	unsigned char *d = rte_pktmbuf_mtod_offset(head, unsigned char *,
+						   rte_pktmbuf_data_len(head));
+	rte_pktmbuf_data_len(head) += need;
+	while (need) {
+	    struct rte_mbuf *s = head->next;
+	    uint32_t n = rte_pktmbuf_data_len(s) < need ? rte_pktmbuf_data_len(s) : need;
+	    memcpy(d, rte_pktmbuf_mtod(s, unsigned char *), n);
+	    d += n;
+	    need -= n;
+	    // the segment's buffer may be shared, but its mbuf is ours
+	    s->data_off += n;
+	    rte_pktmbuf_data_len(s) -= n;
+	    if (!rte_pktmbuf_data_len(s)) {
+		head->next = s->next;
+		head->nb_segs--;
+		s->next = 0;
+		s->nb_segs = 1;
+		rte_pktmbuf_free_seg(s);
+	    }
+	}
+	return q;
+    }
+#else
+    if (len <= total_length()) {
+	uint32_t need = len - length();
+	WritablePacket *q = put(need);
+	if (!q)
+	    return 0;
+	unsigned char *d = q->end_data() - need;
+	while (need) {
+	    Packet *s = q->_segment;
+	    uint32_t n = s->length() < need ? s->length() : need;
+	    memcpy(d, s->data(), n);
+	    d += n;
+	    need -= n;
+	    // the segment may be shared: only its own header changes
+	    s->pull(n);
+	    if (!s->length()) {
+		q->_segment = s->_segment;
+		s->_segment = 0;
+		s->kill();
+	    }
+	}
+	return q;
+    }
+#endif
+    kill();
+    return 0;
+}
+
+Packet *
+Packet::linearize()
+{
+    if (!next_segment())
+	return this;
+    Packet *p = pullup(total_length());
+#if !(CLICK_LINUXMODULE || CLICK_PACKET_USE_DPDK)
+    // only empty segments can remain
+    if (p && p->_segment) {
+	p->_segment->kill();
+	p->_segment = 0;
+    }
+#endif
+    return p;
+}
+
+void
+Packet::trim(uint32_t len)
+{
+#if CLICK_LINUXMODULE
+    if (len < length())
+	take(length() - len);
+#elif CLICK_PACKET_USE_DPDK
+    struct rte_mbuf *head = mb(), *m = head;
+    if (len >= rte_pktmbuf_pkt_len(head))
+	return;
+    rte_pktmbuf_pkt_len(head) = len;
+    head->nb_segs = 1;
+    while (len > rte_pktmbuf_data_len(m)) {
+	len -= rte_pktmbuf_data_len(m);
+	m = m->next;
+	head->nb_segs++;
+    }
+    rte_pktmbuf_data_len(m) = len;
+    if (m->next) {
+	rte_pktmbuf_free(m->next);
+	m->next = 0;
+    }
+#else
+    Packet *s = this;
+    while (s && len > s->length()) {
+	len -= s->length();
+	s = s->_segment;
+    }
+    if (!s)
+	return;
+    s->take(s->length() - len);
+    if (s->_segment) {
+	s->_segment->kill();
+	s->_segment = 0;
+    }
+#endif
+}
+
 #if HAVE_CLICK_PACKET_POOL
 static void
 cleanup_pool(PacketPool *pp, int global)
@@ -1253,7 +1494,7 @@ cleanup_pool(PacketPool *pp, int global)
     while (WritablePacket *p = pp->p) {
 	++pcount;
 	pp->p = static_cast<WritablePacket *>(p->next());
-	::operator delete((void *) p);
+	Packet::operator delete((void *) p);
     }
     while (WritablePacket *pd = pp->pd) {
     ++pdcount;
@@ -1270,7 +1511,7 @@ cleanup_pool(PacketPool *pp, int global)
 # endif
         delete[] reinterpret_cast<unsigned char *>(pd->buffer());
 #endif
-    ::operator delete((void *) pd);
+    Packet::operator delete((void *) pd);
     }
 #if !HAVE_BATCH_RECYCLE
     assert(pcount <= CLICK_PACKET_POOL_SIZE);
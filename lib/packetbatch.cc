@@ -19,7 +19,7 @@
 #include <click/config.h>
 #include <click/packetbatch.hh>
 #include <click/netmapdevice.hh>
-#if HAVE_DPDK_PACKET_POOL
+#if HAVE_DPDK
 # include <click/dpdkdevice.hh>
 #endif
 
@@ -27,6 +27,8 @@ CLICK_DECLS
 
 #if HAVE_BATCH
 
+unsigned PacketPrefetcher::default_distance = CLICK_BATCH_PREFETCH_DISTANCE;
+
 # if HAVE_CLICK_PACKET_POOL
 /**
  * Recycle a whole batch of unshared packets of the same type
@@ -57,6 +59,19 @@ void PacketBatch::fast_kill() {
     BATCH_RECYCLE_END();
 }
 
+/**
+ * Recycle all packets of an array, faster in most cases than kill()
+ */
+void PacketArray::fast_kill() {
+    BATCH_RECYCLE_START();
+    for (unsigned i = 0; i < _count; i++) {
+        WritablePacket* p = static_cast<WritablePacket*>(_p[i]);
+        BATCH_RECYCLE_PACKET(p);
+    }
+    BATCH_RECYCLE_END();
+    _count = 0;
+}
+
 /**
  * Recycle a whole batch, faster in most cases than a loop of kill_nonatomic
  */
@@ -119,6 +134,76 @@ PacketBatch::make_batch(unsigned char *data, uint16_t count, uint16_t *length,
 #endif
 }
 
+#if HAVE_DPDK
+/** @brief Create and return a batch of packets in DPDK buffers
+ * @param numa_node NUMA node whose DPDK pool provides the buffers, or -1 for
+ *   the node of the calling core
+ * @param count number of packets
+ * @param headroom headroom of each packet
+ * @param length length of each packet
+ * @return new packet batch, or null if the packets could not all be created
+ *
+ * The batch version of Packet::make_dpdk(): mbufs are taken from the pool in
+ * bursts with DPDKDevice::get_pkts(), which is much cheaper than one
+ * allocation per packet. The packets' data is left uninitialized.
+ **/
+PacketBatch *
+PacketBatch::make_dpdk_batch(int numa_node, unsigned count,
+                             uint32_t headroom, uint32_t length)
+{
+    if (numa_node < 0 && (numa_node = (int) rte_socket_id()) < 0)
+        numa_node = 0;
+    struct rte_mbuf *mbs[32];
+    Packet *head = 0;
+    Packet *last = 0;
+    unsigned made = 0;
+    while (made < count) {
+        unsigned n = count - made < 32 ? count - made : 32;
+        if (DPDKDevice::get_pkts(numa_node, mbs, n) != 0)
+            goto fail;
+        for (unsigned i = 0; i < n; i++) {
+            struct rte_mbuf *mb = mbs[i];
+            Packet *p = 0;
+            if (likely(headroom + length <= mb->buf_len)) {
+# if CLICK_PACKET_USE_DPDK
+                mb->data_off = headroom;
+                rte_pktmbuf_data_len(mb) = length;
+                rte_pktmbuf_pkt_len(mb) = length;
+                p = reinterpret_cast<Packet *>(mb);
+# else
+                p = Packet::make((unsigned char *) mb->buf_addr + headroom,
+                                 length, DPDKDevice::free_pkt, mb,
+                                 headroom, mb->buf_len - headroom - length);
+# endif
+            }
+            if (unlikely(!p)) {
+                for (; i < n; i++)
+                    rte_pktmbuf_free(mbs[i]);
+                goto fail;
+            }
+            if (last)
+                last->set_next(p);
+            else
+                head = p;
+            last = p;
+        }
+        made += n;
+    }
+    if (!head)
+        return 0;
+    last->set_next(0);
+    return PacketBatch::make_from_simple_list(head, last, made);
+
+  fail:
+    while (head) {
+        Packet *next = (head == last ? 0 : head->next());
+        head->kill();
+        head = next;
+    }
+    return 0;
+}
+#endif
+
 #endif //HAVE_BATCH
 
 CLICK_ENDDECLS
@@ -2263,7 +2263,8 @@ Router::configuration_string() const
 enum { GH_VERSION, GH_CONFIG, GH_FLATCONFIG, GH_LIST, GH_REQUIREMENTS,
        GH_DRIVER, GH_ACTIVE_PORTS, GH_ACTIVE_PORT_STATS, GH_STRING_PROFILE,
        GH_STRING_PROFILE_LONG, GH_SCHEDULING_PROFILE, GH_STOP,
-       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES };
+       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES,
+       GH_BATCH_PREFETCH_DISTANCE };
 
 #if CLICK_STATS >= 2
 struct stats_info {
@@ -2366,6 +2367,12 @@ Router::router_read_handler(Element *e, void *thunk)
         break;
 #endif
 
+#if HAVE_BATCH
+    case GH_BATCH_PREFETCH_DISTANCE:
+        sa << PacketPrefetcher::default_distance;
+        break;
+#endif
+
 #if CLICK_STATS >= 2
     case GH_ELEMENT_CYCLES:
         if (!r)
@@ -2470,6 +2477,15 @@ Router::router_write_handler(const String &s, Element *e, void *thunk, ErrorHand
             errh->message("no router to stop");
         break;
     }
+#if HAVE_BATCH
+    case GH_BATCH_PREFETCH_DISTANCE: {
+        unsigned distance;
+        if (!IntArg().parse(cp_uncomment(s), distance))
+            return errh->error("expected unsigned integer");
+        PacketPrefetcher::default_distance = distance;
+        break;
+    }
+#endif
 #if CLICK_STATS >= 2
     case GH_RESET_CYCLES:
         for (int i = 0; i < (r ? r->nelements() : 0); i++)
@@ -2495,6 +2511,10 @@ Router::static_initialize()
         add_read_handler(0, "handlers", Element::read_handlers_handler, 0);
         add_read_handler(0, "list", router_read_handler, (void *)GH_LIST);
         add_write_handler(0, "stop", router_write_handler, (void *)GH_STOP);
+#if HAVE_BATCH
+        add_read_handler(0, "batch_prefetch_distance", router_read_handler, (void *)GH_BATCH_PREFETCH_DISTANCE);
+        add_write_handler(0, "batch_prefetch_distance", router_write_handler, (void *)GH_BATCH_PREFETCH_DISTANCE);
+#endif
 #if CLICK_STATS >= 1
         add_read_handler(0, "active_ports", router_read_handler, (void *)GH_ACTIVE_PORTS);
         add_read_handler(0, "active_port_stats", router_read_handler, (void *)GH_ACTIVE_PORT_STATS);
@@ -53,6 +53,7 @@
 #define DEVIRTUALIZE_OPT	311
 #define INSTRS_OPT		312
 #define REVERSE_OPT		313
+#define FUSE_OPT		314
 
 static const Clp_Option options[] = {
   { "clickpath", 'C', CLICKPATH_OPT, Clp_ValString, 0 },
@@ -60,6 +61,7 @@ static const Clp_Option options[] = {
   { "devirtualize", 0, DEVIRTUALIZE_OPT, Clp_ValString, Clp_Negate },
   { "expression", 'e', EXPRESSION_OPT, Clp_ValString, 0 },
   { "file", 'f', ROUTER_OPT, Clp_ValString, 0 },
+  { "fuse", 0, FUSE_OPT, 0, Clp_Negate },
   { "help", 0, HELP_OPT, 0, 0 },
   { 0, 'n', NO_DEVIRTUALIZE_OPT, Clp_ValString, 0 },
   { "kernel", 'k', KERNEL_OPT, 0, Clp_Negate }, // DEPRECATED
@@ -212,6 +214,7 @@ Options:\n\
   -r, --reverse                Reverse devirtualization.\n\
   -n, --no-devirtualize CLASS  Don't devirtualize element class CLASS.\n\
   -i, --instructions FILE      Read devirtualization instructions from FILE.\n\
+      --no-fuse                Don't fuse the batch loops of simple elements.\n\
   -C, --clickpath PATH         Use PATH for CLICKPATH.\n\
       --help                   Print this message and exit.\n\
   -v, --version                Print version number and exit.\n\
@@ -241,6 +244,7 @@ main(int argc, char **argv)
   int compile_kernel = 0;
   int compile_user = 0;
   int reverse = 0;
+  bool fuse = true;
   Vector<const char *> instruction_files;
   HashTable<String, int> specializing;
 
@@ -324,6 +328,10 @@ particular purpose.\n");
       reverse = !clp->negated;
       break;
 
+     case FUSE_OPT:
+      fuse = !clp->negated;
+      break;
+
      bad_option:
      case Clp_BadOption:
       short_usage();
@@ -419,6 +427,7 @@ particular purpose.\n");
 
   // initialize specializer
   Specializer specializer(router, full_elementmap);
+  specializer.set_fuse_batches(fuse);
   specializer.specialize(sigs, errh);
 
   // quit early if nothing was done
@@ -31,7 +31,8 @@
 Specializer::Specializer(RouterT *router, const ElementMap &em)
   : _router(router), _nelements(router->nelements()),
     _ninputs(router->nelements(), 0), _noutputs(router->nelements(), 0),
-    _etinfo_map(0), _header_file_map(-1), _parsed_sources(-1)
+    _etinfo_map(0), _header_file_map(-1), _parsed_sources(-1),
+    _fuse_batches(true)
 {
   _etinfo.push_back(ElementTypeInfo());
 
@@ -328,6 +329,52 @@ Specializer::create_class(SpecializedClass &spc)
   return true;
 }
 
+#if HAVE_BATCH
+// Return true if simple_action_batch function f, of class cxx_name, only
+// calls simple_action on each packet, as in
+//   EXECUTE_FOR_EACH_PACKET_DROPPABLE(X::simple_action, batch, [](Packet *){});
+//   return batch;
+// A fused chain calls simple_action directly, so elements whose batch code
+// does anything else must not be fused.
+static bool
+per_packet_batch(const CxxFunction *f, const String &cxx_name)
+{
+  StringAccum sa;
+  for (const char *s = f->clean_body().begin(); s != f->clean_body().end(); ++s)
+    if (!isspace((unsigned char) *s))
+      sa << *s;
+  String body = sa.take_string();
+  if (body.length() >= 2 && body[0] == '{' && body.back() == '}')
+    body = body.substring(1, body.length() - 2);
+
+  bool droppable;
+  if (body.starts_with("EXECUTE_FOR_EACH_PACKET("))
+    droppable = false;
+  else if (body.starts_with("EXECUTE_FOR_EACH_PACKET_DROPPABLE("))
+    droppable = true;
+  else
+    return false;
+  body = body.substring(body.find_left('(') + 1);
+  if (body.starts_with(cxx_name + "::"))
+    body = body.substring(cxx_name.length() + 2);
+  if (!body.starts_with("simple_action,"))
+    return false;
+  body = body.substring(14);
+
+  int end = body.find_left(droppable ? ',' : ')');
+  if (end <= 0)
+    return false;
+  String batch = body.substring(0, end);
+  String tail = ");return" + batch + ";";
+  if (!droppable)
+    return body.substring(end) == tail;
+  body = body.substring(end + 1);
+  if (!body.starts_with("[](Packet*"))
+    return false;
+  return body.substring(body.find_left(')')) == "){}" + tail;
+}
+#endif
+
 void
 Specializer::do_simple_action(SpecializedClass &spc)
 {
@@ -365,6 +412,9 @@ Specializer::do_simple_action(SpecializedClass &spc)
 #endif
   spc.cxxc->find("output_push")->unkill();
   spc.cxxc->find("input_pull")->unkill();
+#if HAVE_BATCH
+  spc.fusable = per_packet_batch(simple_action_batch, etype_info(spc.eindex).cxx_name);
+#endif
 }
 
 inline const String &
@@ -511,6 +561,71 @@ Specializer::create_connector_methods(SpecializedClass &spc)
 #endif
 }
 
+#if HAVE_BATCH
+// Return the element following eindex in a linear chain of simple action
+// elements, or -1 if there is none.
+int
+Specializer::fusable_successor(int eindex) const
+{
+  if (_ninputs[eindex] != 1 || _noutputs[eindex] != 1)
+    return -1;
+  RouterT::conn_iterator it = _router->find_connections_from(_router->element(eindex), 0);
+  if (it == _router->end_connections() || it->to_port() != 0)
+    return -1;
+  int next = it->to_eindex();
+  const SpecializedClass &next_spc = _specials[_specialize[next]];
+  if (!next_spc.special() || !next_spc.fusable
+      || _ninputs[next] != 1 || _noutputs[next] != 1)
+    return -1;
+  return next;
+}
+
+// Replace the push_batch function of a simple action element followed by
+// other simple action elements with a single loop calling all their
+// smaction functions on each packet, then pushing the batch to the output
+// of the last one.
+void
+Specializer::fuse_batch_chain(SpecializedClass &spc)
+{
+  Vector<int> chain;
+  for (int e = fusable_successor(spc.eindex); e >= 0; e = fusable_successor(e)) {
+    int sp = _specialize[e];
+    if (&_specials[sp] == &spc || chain.size() == 16)
+      break;
+    bool loop = false;
+    for (int i = 0; i < chain.size(); i++)
+      loop |= (_specialize[chain[i]] == sp);
+    if (loop)
+      break;
+    chain.push_back(e);
+  }
+  if (!chain.size())
+    return;
+
+  StringAccum sa;
+  sa << "\n";
+  for (int i = 0; i < chain.size(); i++) {
+    const String &cxx = enew_cxx_type(chain[i]);
+    sa << "  " << cxx << " *e" << (i + 1) << " = (" << cxx << " *)";
+    if (i)
+      sa << "e" << i << "->";
+    sa << "output(0).element();\n";
+  }
+  sa << "  auto fused = [&](Packet *p) -> Packet * {\n"
+     << "    if (!(p = smaction(p)))\n      return 0;\n";
+  for (int i = 0; i < chain.size() - 1; i++)
+    sa << "    if (!(p = e" << (i + 1) << "->" << enew_cxx_type(chain[i])
+       << "::smaction(p)))\n      return 0;\n";
+  const String &last = enew_cxx_type(chain.back());
+  sa << "    return e" << chain.size() << "->" << last << "::smaction(p);\n"
+     << "  };\n"
+     << "  EXECUTE_FOR_EACH_PACKET_DROPPABLE_PREFETCH(fused, batch, [](Packet *) {}, PacketPrefetcher::default_distance);\n"
+     << "  if (batch)\n"
+     << "    e" << chain.size() << "->" << last << "::output_push_batch(0, batch);\n";
+  spc.cxxc->find("push_batch")->set_body(sa.take_string());
+}
+#endif
+
 void
 Specializer::specialize(const Signatures &sigs, ErrorHandler *errh)
 {
@@ -532,6 +647,13 @@ Specializer::specialize(const Signatures &sigs, ErrorHandler *errh)
   for (int s = 0; s < _specials.size(); s++)
     if (_specials[s].special())
       create_connector_methods(_specials[s]);
+
+#if HAVE_BATCH
+  if (_fuse_batches)
+    for (int s = 0; s < _specials.size(); s++)
+      if (_specials[s].special() && _specials[s].fusable)
+	fuse_batch_chain(_specials[s]);
+#endif
 }
 
 void
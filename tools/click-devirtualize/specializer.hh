@@ -30,8 +30,9 @@ struct SpecializedClass {
   String cxx_name;
   CxxClass *cxxc;
   int eindex;
+  bool fusable;
 
-  SpecializedClass() : cxxc(0), eindex(-3)	{ }
+  SpecializedClass() : cxxc(0), eindex(-3), fusable(false) { }
   bool special() const				{ return cxxc != 0; }
 };
 
@@ -46,6 +47,7 @@ class Specializer { public:
   void add_type_info(const String &click_name, const String &cxx_name,
 		     const String &header_file, const String &source_dir);
 
+  void set_fuse_batches(bool fuse)		{ _fuse_batches = fuse; }
   void specialize(const Signatures &, ErrorHandler *);
   void fix_elements();
 
@@ -73,6 +75,7 @@ class Specializer { public:
   HashTable<String, int> _parsed_sources;
 
   Vector<SpecializedClass> _specials;
+  bool _fuse_batches;
 
   CxxInfo _cxxinfo;
 
@@ -84,6 +87,10 @@ class Specializer { public:
   bool create_class(SpecializedClass &);
   void do_simple_action(SpecializedClass &);
   void create_connector_methods(SpecializedClass &);
+#if HAVE_BATCH
+  int fusable_successor(int) const;
+  void fuse_batch_chain(SpecializedClass &);
+#endif
 
   void output_includes(ElementTypeInfo &, StringAccum &);
 